@@ -7,6 +7,9 @@
 #include <iostream>
 #include <vector>
 #include <fstream>
+#include <deque>
+#include <chrono>
+#include <thread>
 
 #include <glad/glad.h>
 #define STB_IMAGE_IMPLEMENTATION
@@ -15,60 +18,686 @@
 #include "gl_utils.h"
 #include "TileMap.h"
 #include "DiamondView.h"
+#include "TileTypes.h"
+#include "TileStack.h"
+#include "JobSystem.h"
+#include "TileSets.h"
+#include "TileIdRenderer.h"
+#include "StaticLayerCache.h"
+#include "FrameScheduler.h"
+#include "LatencyProbe.h"
+#include "AutoTiler.h"
+#include "CellularAutomaton.h"
+#include "LineOfSight.h"
+#include "SaveFile.h"
+#include "LevelPool.h"
+#include "Metrics.h"
+#include "FrameGraph.h"
+#include "RenderSettings.h"
+#include "VertexFormat.h"
+#include "ChunkRenderer.h"
+#include "TextureCodec.h"
 
 using namespace std;
 
 int g_gl_width = 800;
 int g_gl_height = 600;
+// A janela fica com uma amostra: o MSAA de --aa msaa e fora da tela, com resolve proprio.
+int g_gl_samples = 0;
 GLFWwindow* g_window = NULL;
 
 TileMap* tmap = NULL;
 TilemapView* tview = new DiamondView();
+TileTypes* ttypes = new TileTypes();
+TileStack* tstack = NULL;
+TileSetManager* tsets = NULL;
+JobSystem* jobs = NULL;
+MainThreadQueue* gl_queue = NULL;
+FrameScheduler* scheduler = NULL;
+const double frame_budget = 1.0 / 60.0;
+
+// Metricas do laco principal (--metrics). So a thread principal escreve nelas.
+MetricsServer* metrics_server = NULL;
+int metric_frames, metric_frame_us, metric_frame_us_total, metric_draws, metric_frame_draws, metric_instances;
+int metric_gl_queue, metric_job_queue, metric_level_bytes, metric_level_switches, metric_chunk_commands;
+int frame_draws = 0;
 
 int player_col = 1;
 int player_row = 1;
 
 int tileSetCols = 7;
-float tileW_tex, tileH_tex;
+// Os ids do .tmap sao locais ao primeiro tileset; somando a base viram gids globais.
+int tile_gid_base = 1;
 
 GLuint player_texture;
-unsigned int player_VAO, player_VBO, player_EBO;
+unsigned int player_VAO, player_VBO;
+
+GLuint shader_programme;
+GLint loc_offsetX, loc_tileW, loc_tx, loc_ty, loc_tz, loc_weight;
+
+#define RENDER_GEOMETRY 0
+#define RENDER_IDMAP 1
+
+// Geometria instanciada (com elevacao) ou textura de ids num passe de tela (so o chao).
+int render_mode = RENDER_GEOMETRY;
+TileIdRenderer* idmap = NULL;
+
+#define TILES_ALL 0
+#define TILES_STATIC 1
+#define TILES_ANIMATED 2
+
+// Classes de terreno por celula; pintar uma classe escolhe os tiles de transicao.
+AutoTiler* autotiler = NULL;
+// So as regras (sem mapa): copiada pelos workers que retilam mapas carregados ao fundo.
+AutoTiler* autotile_rules = NULL;
+
+// Simulacao (fogo, agua, vegetacao) sobre o proprio tmap; P liga e desliga.
+CellularAutomaton* automaton = NULL;
+bool automaton_running = false;
+double automaton_next_tick = 0.0;
+const double automaton_tick = 0.25;
+
+// Visibilidade entre tiles (bitset de opacos mantido junto com as edicoes).
+LineOfSight* los = NULL;
+
+// F5 grava, F9 carrega. O mapa carregado aponta para o arquivo mapeado, que fica aberto
+// enquanto ele estiver em uso.
+const char* save_path = "savegame.sav";
+SaveFile* loaded_save = NULL;
+
+#define ENTITY_PLAYER 0
+
+// Mapas de levels.txt; 1..9 trocam de nivel. Mapa, blocos e textura de ids sao do pool.
+LevelPool* levels = NULL;
+size_t level_budget = 64 * 1024 * 1024;
 
-TileMap* readMap(const char* filename) {
-    ifstream arq(filename);
-    if (!arq.is_open()) {
-        cout << "ERRO: Não foi possível abrir o arquivo de mapa: " << filename << endl;
-        return NULL;
+// No modo de geometria o que nao e animado fica num framebuffer fora da tela.
+StaticLayerCache* static_cache = NULL;
+
+// Passes do frame e seus alvos fora da tela (--bench-graph mostra o plano).
+FrameGraph* frame_graph = NULL;
+
+// Anti-aliasing (--aa none|msaa|fxaa, --samples N): declara o alvo da cena no grafo.
+RenderSettings render_settings;
+AntiAliasing* antialias = NULL;
+
+float tile_render_width, tile_render_height, block_height;
+const float map_offset_y = 0.4f;
+// Camera (setas): deslocamento do mapa em NDC.
+float cam_x = 0.0f, cam_y = 0.0f;
+const float cam_step = 0.05f;
+unsigned int tile_VAO, tile_instance_VBO;
+GLuint tiles_programme;
+
+// Instancia de bloco em 16 bytes (eram 6 floats, 24). Posicao em snorm16 escalada por
+// TILE_OFFSET_RANGE: blocos com centro alem disso estao fora da tela e nem entram.
+#define TILE_OFFSET_RANGE 2.0f
+struct TileInstance {
+    int16_t x, y;
+    float depth;
+    uint16_t u0, v0;
+    uint8_t layer, pad[3];
+};
+vector<TileInstance> tile_instances;
+
+// Vertices do bloco e do player: posicao snorm16, uv unorm16, sombra unorm8 (12 bytes, eram 20).
+VertexFormat quad_format;
+VertexFormat tile_instance_format(1);
+
+// Blocos estaticos em chunks com culling na CPU e uma multi-draw (--no-chunks volta a
+// instanciar tudo a cada frame; --no-mdi forca o caminho do GL 3.3).
+ChunkRenderer* chunks = NULL;
+bool use_chunks = true;
+// Indices (em getBlocks) dos blocos animados, separados junto com os chunks.
+vector<int> animated_blocks;
+
+// Centro do topo do losango de (col, row) no nivel 0, ja com camera.
+void tile_screen_position(int col, int row, float& x, float& y) {
+    tview->computeDrawPosition(col, row, tile_render_width, tile_render_height, x, y);
+    x += cam_x;
+    y += cam_y - map_offset_y;
+}
+
+// Retangulo em NDC coberto pela pilha de blocos de (col, row).
+DirtyRect tile_screen_rect(int col, int row) {
+    float x, y;
+    tile_screen_position(col, row, x, y);
+    DirtyRect r;
+    r.x0 = x - tile_render_width / 2.0f;
+    r.x1 = x + tile_render_width / 2.0f;
+    r.y0 = y - tile_render_height / 2.0f - block_height;
+    r.y1 = y + tile_render_height / 2.0f + tmap->getElevation(col, row) * block_height;
+    return r;
+}
+
+// Refaz os chunks quando a lista de blocos mudou (edicao, simulacao, troca de nivel). So os
+// blocos nao animados entram: o frame deles nunca muda.
+void update_chunks() {
+    if (!chunks->needsBuild(tstack->getVersion())) return;
+    const vector<StackBlock>& blocks = tstack->getBlocks();
+    chunks->beginBuild(tmap->getWidth(), tmap->getHeight());
+    animated_blocks.clear();
+    for (size_t i = 0; i < blocks.size(); i++) {
+        const StackBlock& b = blocks[i];
+        if (ttypes->hasProperty(b.tile, TILEPROP_ANIMATED)) {
+            animated_blocks.push_back((int)i);
+            continue;
+        }
+        int layer, frame;
+        if (!tsets->resolve(b.tile + tile_gid_base, layer, frame)) continue;
+        ChunkBlock cb;
+        tview->computeDrawPosition(b.col, b.row, tile_render_width, tile_render_height, cb.x, cb.y);
+        cb.y += b.level * block_height;
+        cb.depth = b.depth;
+        cb.layer = (float)layer;
+        tsets->frameOrigin(layer, frame, cb.u0, cb.v0);
+        cb.pad0 = cb.pad1 = 0.0f;
+        chunks->add(b.col, b.row, cb, cb.x - tile_render_width / 2.0f, cb.y - tile_render_height / 2.0f - block_height,
+            cb.x + tile_render_width / 2.0f, cb.y + tile_render_height / 2.0f);
+    }
+    chunks->endBuild(tstack->getVersion());
+}
+
+// Todos os blocos, de qualquer tileset, numa unica chamada instanciada. which separa os
+// tiles animados (redesenhados todo frame) dos estaticos (que vao para o cache); com clip
+// so entram os blocos que tocam o retangulo. Com os chunks ligados os estaticos saem deles
+// e so os animados (ja listados) passam pelas instancias.
+void draw_tiles_geometry(double time_ms, int which, const DirtyRect* clip) {
+    if (use_chunks) update_chunks();
+    if (use_chunks && which != TILES_ANIMATED) {
+        if (chunks->isReady()) {
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D_ARRAY, tmap->getTileSet());
+            int commands = clip ? chunks->draw(cam_x, cam_y - map_offset_y, clip->x0, clip->y0, clip->x1, clip->y1)
+                                : chunks->draw(cam_x, cam_y - map_offset_y, -1.0f, -1.0f, 1.0f, 1.0f);
+            Metrics::get().set(metric_chunk_commands, commands);
+            if (commands > 0) frame_draws++;
+            if (which == TILES_STATIC) return;
+            which = TILES_ANIMATED;
+        }
+    }
+    const vector<StackBlock>& blocks = tstack->getBlocks();
+    bool listed = use_chunks && which == TILES_ANIMATED;
+    size_t count = listed ? animated_blocks.size() : blocks.size();
+    tile_instances.clear();
+    for (size_t i = 0; i < count; i++) {
+        const StackBlock& b = blocks[listed ? animated_blocks[i] : i];
+        if (which != TILES_ALL) {
+            bool animated = ttypes->hasProperty(b.tile, TILEPROP_ANIMATED);
+            if (animated != (which == TILES_ANIMATED)) continue;
+        }
+        float screen_x, screen_y, u0, v0;
+        tile_screen_position(b.col, b.row, screen_x, screen_y);
+        screen_y += b.level * block_height;
+        if (clip && (screen_x + tile_render_width / 2.0f < clip->x0 || screen_x - tile_render_width / 2.0f > clip->x1
+            || screen_y + tile_render_height / 2.0f < clip->y0 || screen_y - tile_render_height / 2.0f - block_height > clip->y1)) continue;
+        if (fabsf(screen_x) > TILE_OFFSET_RANGE || fabsf(screen_y) > TILE_OFFSET_RANGE) continue;
+        int tile_id = ttypes->animatedTile(b.tile, time_ms);
+        int layer, frame;
+        if (!tsets->resolve(tile_id + tile_gid_base, layer, frame)) continue;
+        tsets->frameOrigin(layer, frame, u0, v0);
+        TileInstance inst;
+        inst.x = VertexFormat::toSnorm16(screen_x / TILE_OFFSET_RANGE);
+        inst.y = VertexFormat::toSnorm16(screen_y / TILE_OFFSET_RANGE);
+        inst.depth = b.depth;
+        inst.u0 = VertexFormat::toUnorm16(u0);
+        inst.v0 = VertexFormat::toUnorm16(v0);
+        inst.layer = (uint8_t)layer;
+        inst.pad[0] = inst.pad[1] = inst.pad[2] = 0;
+        tile_instances.push_back(inst);
+    }
+    if (tile_instances.empty()) return;
+    glUseProgram(tiles_programme);
+    glBindVertexArray(tile_VAO);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, tmap->getTileSet());
+    glBindBuffer(GL_ARRAY_BUFFER, tile_instance_VBO);
+    glBufferData(GL_ARRAY_BUFFER, tile_instances.size() * sizeof(TileInstance), tile_instances.data(), GL_STREAM_DRAW);
+    glDrawElementsInstanced(GL_TRIANGLES, 18, GL_UNSIGNED_SHORT, 0, (GLsizei)tile_instances.size());
+    Metrics::get().set(metric_instances, (int64_t)tile_instances.size());
+    frame_draws++;
+}
+
+void draw_tiles_idmap(double time_ms) {
+    idmap->updateLut(ttypes, tsets, tile_gid_base, time_ms);
+    idmap->draw(tsets, tstack, tile_render_width, tile_render_height, cam_x, cam_y - map_offset_y);
+    frame_draws++;
+}
+
+// --bench-render [tamanho] [frames]: mapa plano aleatorio de tamanho x tamanho, desenhado
+// por cada modo sem vsync; o glFinish inclui o custo de GPU no tempo de cada frame (CPU e so
+// ate a submissao). A geometria vai toda instanciada e depois em chunks, pelas duas formas
+// de multi-draw.
+void bench_render(int size, int frames) {
+    TileMap* scene = tmap;
+    TileMap* big = new TileMap(size, size, 0);
+    srand(1);
+    for (int r = 0; r < size; r++) {
+        for (int c = 0; c < size; c++) big->setTile(c, r, (unsigned char)(rand() % tileSetCols));
+    }
+    tmap = big;
+    tmap->setTid(tsets->getTexture());
+    tstack->setMap(big);
+    idmap->setMap(big);
+    glfwSwapInterval(0);
+
+    bool saved_chunks = use_chunks, saved_indirect = chunks->isIndirect();
+    double t_build = glfwGetTime();
+    update_chunks();
+    printf("mapa %dx%d, %d frames por modo; chunks montados em %.3f ms (%d comandos, %.2f MB)\n", size, size, frames,
+        (glfwGetTime() - t_build) * 1000.0, chunks->getCommandCapacity(), chunks->getBytes() / (1024.0 * 1024.0));
+    const char* names[] = { "geometria instanciada", "chunks indireto", "chunks multi-draw", "textura de ids" };
+    for (int mode = 0; mode < 4; mode++) {
+        if (mode == 1 && !chunks->hasIndirect()) {
+            printf("%-22s sem GL 4.3 nem ARB_multi_draw_indirect\n", names[mode]);
+            continue;
+        }
+        use_chunks = mode == 1 || mode == 2;
+        chunks->setIndirect(mode == 1);
+        double total = 0.0, cpu = 0.0;
+        for (int f = -5; f < frames; f++) {
+            double t0 = glfwGetTime();
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            if (mode < 3) draw_tiles_geometry(t0 * 1000.0, TILES_ALL, NULL);
+            else draw_tiles_idmap(t0 * 1000.0);
+            double t1 = glfwGetTime();
+            glFinish();
+            if (f >= 0) {
+                total += glfwGetTime() - t0;
+                cpu += t1 - t0;
+            }
+            glfwSwapBuffers(g_window);
+            glfwPollEvents();
+        }
+        long long instances = mode < 3 ? (long long)tile_instances.size() : 0;
+        long long vertices = mode < 3 ? instances * 12 : 3;
+        if (use_chunks) vertices += (long long)chunks->getLastBlocks() * 12;
+        printf("%-22s %8.3f ms/frame (CPU %.3f), %lld vertices, %.2f MB de instancias por frame", names[mode],
+            total / frames * 1000.0, cpu / frames * 1000.0, vertices, instances * sizeof(TileInstance) / (1024.0 * 1024.0));
+        if (use_chunks) printf(", %d de %d comandos", chunks->getLastCommands(), chunks->getCommandCapacity());
+        printf("\n");
     }
+    use_chunks = saved_chunks;
+    chunks->setIndirect(saved_indirect);
+
+    tmap = scene;
+    tstack->setMap(scene);
+    idmap->setMap(scene);
+    delete big;
+    glfwSwapInterval(1);
+}
+
+void draw_scene_pass(double time_ms, bool use_cache);
+void draw_scene(double time_ms);
+
+// --bench-aa [frames]: a cena normal em cada modo de anti-aliasing, sem vsync, com glFinish
+// no tempo de cada frame. O custo de cada modo e a diferenca para o modo sem AA.
+void bench_antialias(int frames) {
+    RenderSettings saved = render_settings;
+    RenderSettings modes[5];
+    modes[0].antialias = AA_NONE;
+    modes[1].antialias = AA_FXAA;
+    for (int i = 2; i < 5; i++) {
+        modes[i].antialias = AA_MSAA;
+        modes[i].samples = 2 << (i - 2);
+    }
+    glfwSwapInterval(0);
+    int fb_width, fb_height;
+    glfwGetFramebufferSize(g_window, &fb_width, &fb_height);
+    printf("anti-aliasing em %dx%d, %d frames por modo\n", fb_width, fb_height, frames);
+    double base = 0.0;
+    for (int m = 0; m < 5; m++) {
+        antialias->apply(modes[m]);
+        double total = 0.0;
+        for (int f = -5; f < frames; f++) {
+            double t0 = glfwGetTime();
+            draw_scene(t0 * 1000.0);
+            glFinish();
+            if (f >= 0) total += glfwGetTime() - t0;
+            glfwSwapBuffers(g_window);
+            glfwPollEvents();
+        }
+        double ms = total / frames * 1000.0;
+        if (m == 0) base = ms;
+        char name[16];
+        snprintf(name, sizeof(name), modes[m].antialias == AA_MSAA ? "%s %dx" : "%s", RenderSettings::modeName(modes[m].antialias), antialias->getSamples());
+        printf("%-8s %8.3f ms/frame (%+.3f ms), alvo %.1f MB\n", name, ms, ms - base, frame_graph->getPhysicalBytes() / (1024.0 * 1024.0));
+    }
+    antialias->apply(saved);
+    glfwSwapInterval(1);
+}
+
+// --bench-graph [frames]: grafo com os passes fora da tela que o jogo deve ganhar (luz,
+// bloom, captura) em volta da cena real, compilado e executado a cada frame. Mostra o
+// plano, o que foi descartado e quanto o aliasing economiza; os passes novos so limpam.
+void bench_frame_graph(int frames) {
     int w, h;
-    arq >> w >> h;
-    TileMap* tmap = new TileMap(w, h, 0);
-    player_col = w / 2;
-    player_row = h / 2;
-    for (int r = 0; r < h; r++) {
-        for (int c = 0; c < w; c++) {
-            int tid;
-            arq >> tid;
-            tmap->setTile(c, (h - 1) - r, tid);
+    glfwGetFramebufferSize(g_window, &w, &h);
+    glfwSwapInterval(0);
+    double compile_total = 0.0, frame_total = 0.0;
+    for (int f = -5; f < frames; f++) {
+        double t0 = glfwGetTime();
+        FrameGraph& g = *frame_graph;
+        g.beginFrame();
+        int screen = g.importFramebuffer("tela", 0, w, h, true);
+        int color = g.createTexture("cena cor", w, h, GL_RGBA8);
+        int depth = g.createTexture("cena prof", w, h, GL_DEPTH_COMPONENT24);
+        int light = g.createTexture("luz", w / 2, h / 2, GL_RGBA16F);
+        int blur_h = g.createTexture("luz blur h", w / 2, h / 2, GL_RGBA16F);
+        int blur_v = g.createTexture("luz blur v", w / 2, h / 2, GL_RGBA16F);
+        int hdr = g.createTexture("hdr", w, h, GL_RGBA16F);
+        int bloom_down = g.createTexture("bloom 1/4", w / 4, h / 4, GL_RGBA16F);
+        int bloom_up = g.createTexture("bloom 1/2", w / 2, h / 2, GL_RGBA16F);
+        int ldr = g.createTexture("ldr", w, h, GL_RGBA8);
+        int debug = g.createTexture("debug luz", w, h, GL_RGBA8);
+        int capture = g.createTexture("captura", w, h, GL_RGBA8);
+        double now = t0 * 1000.0;
+        int p = g.addPass("cena", [now]() { draw_scene_pass(now, false); });
+        g.write(p, color);
+        g.write(p, depth);
+        g.setClear(p, 0.2f, 0.3f, 0.3f, 1.0f);
+        struct { const char* name; int in0, in1, out; } chain[] = {
+            { "luz", depth, -1, light }, { "luz blur h", light, -1, blur_h }, { "luz blur v", blur_h, -1, blur_v },
+            { "composicao", color, blur_v, hdr }, { "bloom down", hdr, -1, bloom_down }, { "bloom up", bloom_down, -1, bloom_up },
+            { "tonemap", hdr, bloom_up, ldr }, { "debug luz", light, -1, debug }, { "captura", ldr, -1, capture },
+        };
+        for (size_t i = 0; i < sizeof(chain) / sizeof(chain[0]); i++) {
+            p = g.addPass(chain[i].name, []() {});
+            g.read(p, chain[i].in0);
+            if (chain[i].in1 >= 0) g.read(p, chain[i].in1);
+            g.write(p, chain[i].out);
+            g.setClear(p, 0.0f, 0.0f, 0.0f, 0.0f);
+        }
+        FrameGraph* gp = &g;
+        p = g.addPass("para a tela", [gp, ldr, w, h]() {
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, gp->getFramebuffer(ldr));
+            glBlitFramebuffer(0, 0, w, h, 0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+            glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+        });
+        g.read(p, ldr);
+        g.write(p, screen);
+        double t1 = glfwGetTime();
+        g.compile();
+        double t2 = glfwGetTime();
+        g.execute();
+        glFinish();
+        if (f >= 0) {
+            compile_total += t2 - t1;
+            frame_total += glfwGetTime() - t0;
+        }
+        glfwSwapBuffers(g_window);
+        glfwPollEvents();
+    }
+    printf("grafo de teste em %dx%d, %d frames:\n", w, h, frames);
+    frame_graph->printPlan();
+    printf("%d passes descartados, transientes %.1f MB pedidos, %.1f MB no pool (%.1f MB economizados)\n",
+        frame_graph->getCulledCount(), frame_graph->getRequestedBytes() / (1024.0 * 1024.0),
+        frame_graph->getPhysicalBytes() / (1024.0 * 1024.0),
+        (frame_graph->getRequestedBytes() - frame_graph->getPhysicalBytes()) / (1024.0 * 1024.0));
+    printf("compilacao %.1f us/frame, frame %.3f ms\n", compile_total / frames * 1e6, frame_total / frames * 1000.0);
+    frame_graph->printStats();
+    glfwSwapInterval(1);
+}
+
+// Toda edicao de tile passa por aqui: mapa, textura de ids, lista de blocos e o retangulo
+// do cache estatico ficam em dia juntos.
+void edit_tile(int col, int row, unsigned char tile) {
+    idmap->setTile(col, row, tile);
+    automaton->touch(col, row);
+    los->setCell(col, row, ttypes->isOpaque(tile));
+    tstack->invalidate();
+    DirtyRect r = tile_screen_rect(col, row);
+    static_cache->invalidateRect(r.x0, r.y0, r.x1, r.y1);
+}
+
+// Um bloco [c0, c1) x [r0, r1) mudou na simulacao: textura de ids, classes do autotiler,
+// lista de blocos e o retangulo do cache que cobre o bloco.
+void automaton_chunk_changed(int c0, int r0, int c1, int r1) {
+    idmap->updateRect(c0, r0, c1 - c0, r1 - r0);
+    autotiler->syncRect(c0, r0, c1, r1);
+    for (int r = r0; r < r1; r++) {
+        for (int c = c0; c < c1; c++) los->setCell(c, r, ttypes->isOpaque(tmap->getTile(c, r)));
+    }
+    tstack->invalidate();
+    DirtyRect a = tile_screen_rect(c0, r1 - 1);
+    DirtyRect b = tile_screen_rect(c1 - 1, r0);
+    DirtyRect c = tile_screen_rect(c0, r0);
+    DirtyRect d = tile_screen_rect(c1 - 1, r1 - 1);
+    float x0 = min(min(a.x0, b.x0), min(c.x0, d.x0)), x1 = max(max(a.x1, b.x1), max(c.x1, d.x1));
+    float y0 = min(min(a.y0, b.y0), min(c.y0, d.y0)), y1 = max(max(a.y1, b.y1), max(c.y1, d.y1));
+    static_cache->invalidateRect(x0, y0, x1, y1 + tstack->getMaxLevel() * block_height);
+}
+
+// V: um lote com um raio do player para cada tile do mapa.
+void report_visibility() {
+    vector<LosQuery> queries;
+    for (int r = 0; r < tmap->getHeight(); r++) {
+        for (int c = 0; c < tmap->getWidth(); c++) {
+            LosQuery q = { player_col, player_row, c, r };
+            queries.push_back(q);
         }
     }
-    arq.close();
-    return tmap;
+    vector<uint64_t> hits;
+    vector<int> blocker;
+    double t0 = glfwGetTime();
+    los->castBatch(queries.data(), (int)queries.size(), hits, blocker, jobs);
+    double t1 = glfwGetTime();
+    int visible = 0;
+    for (size_t i = 0; i < queries.size(); i++) visible += LineOfSight::isHit(hits, (int)i) ? 0 : 1;
+    printf("Visiveis de (%d, %d): %d de %d tiles (%.3f ms)\n", player_col, player_row, visible, (int)queries.size(),
+        (t1 - t0) * 1000.0);
 }
 
+// Entrar num nivel e so apontar para o que o pool ja montou (mapa, blocos, textura de ids).
+// O que acompanha o mapa atual (classes, opacos, automato) e refeito aqui; o player vai
+// para o centro e quem chamou pode mudar isso depois.
+void activate_level(Level* level) {
+    tmap = level->map;
+    tstack = level->stack;
+    idmap = level->ids;
+    tmap->setTid(tsets->getTexture());
+    autotiler->setMap(tmap);
+    los->setMap(tmap, ttypes);
+    delete automaton;
+    automaton = new CellularAutomaton(tmap);
+    automaton->loadRules("terrain.ca");
+    automaton_next_tick = glfwGetTime();
+    static_cache->invalidateAll();
+    player_col = tmap->getWidth() / 2;
+    player_row = tmap->getHeight() / 2;
+}
+
+bool save_game(const char* path) {
+    double t0 = glfwGetTime();
+    SaveWriter w;
+    saveTileMap(w, 0, tmap);
+    SavedEntity player = { ENTITY_PLAYER, player_col, player_row, 0 };
+    w.beginSection(SAVE_SECTION_ENTITIES, 0);
+    w.appendCopy(&player, sizeof(player));
+    SavedCounter counters[] = {
+        makeCounter("render_mode", render_mode),
+        makeCounter("automaton_running", automaton_running ? 1 : 0),
+        makeCounter("cam_x_1e4", (int64_t)(cam_x * 10000.0f)),
+        makeCounter("cam_y_1e4", (int64_t)(cam_y * 10000.0f)),
+    };
+    w.beginSection(SAVE_SECTION_COUNTERS, 0);
+    w.appendCopy(counters, sizeof(counters));
+    if (!w.write(path)) return false;
+    printf("Jogo salvo em %s (%.3f ms)\n", path, (glfwGetTime() - t0) * 1000.0);
+    return true;
+}
+
+// Nao ha passo de leitura: o mapa do save vira o tmap direto. So os dados derivados
+// (textura de ids, blocos, classes, bitset de opacos, automato) sao refeitos.
+bool load_game(const char* path) {
+    double t0 = glfwGetTime();
+    SaveFile* save = new SaveFile();
+    if (!save->open(path)) {
+        delete save;
+        return false;
+    }
+    TileMap* map = loadTileMap(*save, 0);
+    if (map == NULL) {
+        cout << "ERRO: save sem mapa valido: " << path << endl;
+        delete save;
+        return false;
+    }
+    double t1 = glfwGetTime();
+    // O save vira um nivel do pool; um save anterior sai dele antes do arquivo fechar.
+    Level* level = levels->adopt("save", map, "terrain.png");
+    levels->setCurrent(level);
+    activate_level(level);
+    uint64_t size;
+    const SavedEntity* entities = (const SavedEntity*)save->find(SAVE_SECTION_ENTITIES, 0, size);
+    for (uint64_t i = 0; entities && i < size / sizeof(SavedEntity); i++) {
+        if (entities[i].kind != ENTITY_PLAYER) continue;
+        player_col = min(max((int)entities[i].col, 0), map->getWidth() - 1);
+        player_row = min(max((int)entities[i].row, 0), map->getHeight() - 1);
+    }
+    int64_t v;
+    if (loadCounter(*save, 0, "render_mode", v)) render_mode = v == RENDER_IDMAP ? RENDER_IDMAP : RENDER_GEOMETRY;
+    if (loadCounter(*save, 0, "automaton_running", v)) automaton_running = v != 0;
+    if (loadCounter(*save, 0, "cam_x_1e4", v)) cam_x = v / 10000.0f;
+    if (loadCounter(*save, 0, "cam_y_1e4", v)) cam_y = v / 10000.0f;
+    static_cache->invalidateAll();
+    delete loaded_save;
+    loaded_save = save;
+    printf("Jogo carregado de %s: mmap + validacao %.3f ms, total %.3f ms\n", path, (t1 - t0) * 1000.0,
+        (glfwGetTime() - t0) * 1000.0);
+    return true;
+}
+
+// Pinta a classe de terreno e repassa a edit_tile os tiles que o autotiler trocou.
+void paint_terrain(int col, int row, int cls) {
+    autotiler->paint(col, row, cls, [](int c, int r, unsigned char tile) { edit_tile(c, r, tile); });
+}
+
+// --bench-autotile [tamanho]: retiling do mapa inteiro numa thread e nos workers, e o
+// custo de pintar celulas uma a uma (vizinhanca 3x3).
+void bench_autotile(int size) {
+    TileMap* big = new TileMap(size, size, 0);
+    srand(1);
+    int classes = autotiler->getClassCount() > 0 ? autotiler->getClassCount() : 1;
+    for (int r = 0; r < size; r++) {
+        for (int c = 0; c < size; c++) big->setTile(c, r, (unsigned char)autotiler->lookup(rand() % classes, 0));
+    }
+    autotiler->setMap(big);
+    printf("autotile %dx%d, %d classes\n", size, size, classes);
+    for (int pass = 0; pass < 2; pass++) {
+        double t0 = glfwGetTime();
+        for (int i = 0; i < 5; i++) autotiler->applyAll(pass == 0 ? NULL : jobs);
+        printf("mapa inteiro (%s): %8.3f ms\n", pass == 0 ? "1 thread" : "jobs", (glfwGetTime() - t0) / 5 * 1000.0);
+    }
+    int painted = 100000, changed = 0;
+    double t0 = glfwGetTime();
+    for (int i = 0; i < painted; i++) {
+        changed += autotiler->paint(rand() % size, rand() % size, rand() % classes, [](int, int, unsigned char) {});
+    }
+    printf("pintura: %8.3f us por celula, %d tiles trocados\n", (glfwGetTime() - t0) / painted * 1e6, changed);
+    autotiler->setMap(tmap);
+    delete big;
+}
+
+// Passe "cena": mapa (no modo atual) e player no alvo que o grafo ligou.
+void draw_scene_pass(double time_ms, bool use_cache) {
+    if (render_mode == RENDER_IDMAP) {
+        draw_tiles_idmap(time_ms);
+    } else if (!use_cache) {
+        draw_tiles_geometry(time_ms, TILES_ALL, NULL);
+    } else {
+        // Um passe de composicao do cache + o que muda a cada frame.
+        static_cache->composite();
+        frame_draws++;
+        draw_tiles_geometry(time_ms, TILES_ANIMATED, NULL);
+    }
+
+    glUseProgram(shader_programme);
+    glUniform1i(glGetUniformLocation(shader_programme, "ourTexture"), 0);
+    glUniform1f(loc_weight, 0.0f);
+    glBindVertexArray(player_VAO);
+    glBindTexture(GL_TEXTURE_2D, player_texture);
+    float player_x, player_y;
+    tile_screen_position(player_col, player_row, player_x, player_y);
+    int player_level = tmap->getElevation(player_col, player_row);
+    float player_render_y = player_y + (tile_render_height * 0.5f) + player_level * block_height;
+    glUniform1f(loc_offsetX, 0.0f);
+    glUniform1f(loc_tileW, 1.0f);
+    glUniform1f(loc_tx, player_x);
+    glUniform1f(loc_ty, player_render_y);
+    glUniform1f(loc_tz, tstack->depthOf((float)player_col, (float)player_row, (float)(player_level + 1)));
+    glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+    frame_draws++;
+}
+
+// Declara e roda o frame; o chamador faz o swap. O cache estatico so e lido no modo de
+// geometria sem MSAA (ele tem uma amostra por pixel); nos outros modos ninguem le o que o
+// passe dele escreve e o grafo o descarta.
+void draw_scene(double time_ms) {
+    int fb_width, fb_height;
+    glfwGetFramebufferSize(g_window, &fb_width, &fb_height);
+    bool use_cache = render_mode == RENDER_GEOMETRY && antialias->getSettings().antialias != AA_MSAA;
+    if (use_cache) static_cache->resize(fb_width, fb_height);
+
+    frame_graph->beginFrame();
+    int screen = frame_graph->importFramebuffer("tela", 0, fb_width, fb_height, true);
+    int cache = frame_graph->importFramebuffer("cache estatico", static_cache->getFramebuffer(), fb_width, fb_height, false);
+    int repaint = frame_graph->addPass("cache estatico", [time_ms]() {
+        static_cache->repaint([time_ms](const DirtyRect* clip) {
+            draw_tiles_geometry(time_ms, TILES_STATIC, clip);
+        });
+    });
+    frame_graph->write(repaint, cache);
+
+    int depth;
+    int target = antialias->declareTarget(*frame_graph, screen, fb_width, fb_height, depth);
+    int scene = frame_graph->addPass("cena", [time_ms, use_cache]() { draw_scene_pass(time_ms, use_cache); });
+    frame_graph->write(scene, target);
+    if (depth >= 0) frame_graph->write(scene, depth);
+    if (use_cache) frame_graph->read(scene, cache);
+    frame_graph->setClear(scene, 0.2f, 0.3f, 0.3f, 1.0f);
+    antialias->addResolve(*frame_graph, target, screen);
+
+    frame_graph->compile();
+    frame_graph->execute();
+}
+
+// Linhas (x, y, u, v, sombra) em float para o quad_format compacto.
+vector<unsigned char> pack_quad_vertices(const float* vertices, int count) {
+    int stride = quad_format.getStride();
+    vector<unsigned char> packed(count * stride);
+    for (int i = 0; i < count; i++) {
+        const float* v = vertices + i * 5;
+        quad_format.write(&packed[i * stride], 0, v);
+        quad_format.write(&packed[i * stride], 1, v + 2);
+        quad_format.write(&packed[i * stride], 2, v + 4);
+    }
+    return packed;
+}
+
+// Usa o .ctex da imagem se houver um que a GPU amostre (ja com os mips), senao o PNG.
 int loadTexture(unsigned int& texture, const char* filename) {
+    double t0 = TextureLoader::now();
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_2D, texture);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    CompressedImage compressed;
+    if (TextureLoader::find(filename, compressed)) {
+        TextureLoader::upload(compressed);
+        TextureLoader::account(compressed.getBytes(), TextureLoader::rgba8Bytes(compressed), (TextureLoader::now() - t0) * 1000.0);
+        return 1;
+    }
     int width, height, nrChannels;
     unsigned char* data = stbi_load(filename, &width, &height, &nrChannels, 0);
     if (data) {
         if (nrChannels == 4) glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
         else glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
         glGenerateMipmap(GL_TEXTURE_2D);
+        // Cadeia de mips: ~4/3 do nivel 0.
+        size_t bytes = (size_t)width * height * 4 * 4 / 3;
+        TextureLoader::account(bytes, bytes, (TextureLoader::now() - t0) * 1000.0);
     } else {
         std::cout << "Falha ao carregar a textura: " << filename << std::endl;
     }
@@ -76,7 +705,124 @@ int loadTexture(unsigned int& texture, const char* filename) {
     return 1;
 }
 
+// Imagens que passam pelo TextureLoader e se levam a cadeia de mips.
+const char* texture_images[] = { "terrain.png", "player.png" };
+const bool texture_mips[] = { false, true };
+
+// --bake-textures: grava os .ctex de cada imagem em cada formato (BC1 so sem alfa, BC3 so
+// com alfa), na orientacao em que a cena carrega (stbi de baixo para cima). Mostra o tempo
+// de codificacao nos workers, o tamanho e o PSNR do que a GPU decodifica.
+void bake_textures() {
+    for (int i = 0; i < 2; i++) {
+        int w, h, n;
+        unsigned char* data = stbi_load(texture_images[i], &w, &h, &n, 4);
+        if (!data) {
+            std::cout << "Falha ao carregar a textura: " << texture_images[i] << std::endl;
+            continue;
+        }
+        bool alpha = TextureCodec::hasAlpha(data, w, h);
+        for (int f = TEX_BC1; f < TEX_FORMAT_COUNT; f++) {
+            if ((f == TEX_BC1 && alpha) || (f == TEX_BC3 && !alpha)) continue;
+            CompressedImage img;
+            double t0 = glfwGetTime();
+            TextureCodec::compress(data, w, h, f, texture_mips[i], jobs, img);
+            double ms = (glfwGetTime() - t0) * 1000.0;
+            std::string path = TextureCodec::pathFor(texture_images[i], f);
+            if (!TextureCodec::write(path.c_str(), img)) continue;
+            double db = TextureLoader::psnr(img, data);
+            char quality[32] = "- (sem suporte na GPU)";
+            if (db >= 0.0) snprintf(quality, sizeof(quality), "%.1f dB", db);
+            printf("%s: %dx%d, %d nivel(is), %.1f ms, %.1f KB (RGBA8 %.1f KB), PSNR %s\n", path.c_str(), w, h,
+                (int)img.levels.size(), ms, img.getBytes() / 1024.0, TextureLoader::rgba8Bytes(img) / 1024.0, quality);
+        }
+        stbi_image_free(data);
+    }
+}
+
+// --bench-textures [vezes]: carga completa (arquivo -> textura pronta, com glFinish) de cada
+// imagem em cada formato com .ctex e suporte na GPU, contra o PNG em RGBA8.
+void bench_textures(int runs) {
+    for (int i = 0; i < 2; i++) {
+        for (int f = TEX_RGBA8; f < TEX_FORMAT_COUNT; f++) {
+            std::string path = TextureCodec::pathFor(texture_images[i], f);
+            CompressedImage img;
+            if (f != TEX_RGBA8 && (!TextureLoader::isSupported(f) || !TextureCodec::read(path.c_str(), img))) continue;
+            double total = 0.0;
+            size_t bytes = 0;
+            for (int r = 0; r < runs; r++) {
+                double t0 = glfwGetTime();
+                GLuint texture;
+                glGenTextures(1, &texture);
+                glBindTexture(GL_TEXTURE_2D, texture);
+                if (f == TEX_RGBA8) {
+                    int w, h, n;
+                    unsigned char* data = stbi_load(texture_images[i], &w, &h, &n, 4);
+                    if (!data) break;
+                    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+                    if (texture_mips[i]) glGenerateMipmap(GL_TEXTURE_2D);
+                    bytes = (size_t)w * h * 4 * (texture_mips[i] ? 4 : 3) / 3;
+                    stbi_image_free(data);
+                } else {
+                    TextureCodec::read(path.c_str(), img);
+                    TextureLoader::upload(img);
+                    bytes = img.getBytes();
+                }
+                glFinish();
+                total += glfwGetTime() - t0;
+                glDeleteTextures(1, &texture);
+            }
+            printf("%-12s %-5s: %.2f ms por carga, %.1f KB na GPU\n", texture_images[i], TextureCodec::formatName(f),
+                total * 1000.0 / runs, bytes / 1024.0);
+        }
+    }
+}
+
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+    scheduler->invalidate(INVALID_INPUT);
+    if (action == GLFW_PRESS && key == GLFW_KEY_M) {
+        render_mode = render_mode == RENDER_GEOMETRY ? RENDER_IDMAP : RENDER_GEOMETRY;
+        cout << "Modo de desenho: " << (render_mode == RENDER_GEOMETRY ? "geometria" : "textura de ids") << endl;
+    }
+    // T pinta a proxima classe de terreno sob o player; o autotiler ajusta as transicoes.
+    if (action == GLFW_PRESS && key == GLFW_KEY_T && autotiler->getClassCount() > 0) {
+        int cls = autotiler->getTerrain(player_col, player_row);
+        paint_terrain(player_col, player_row, cls == AUTOTILE_NONE ? 0 : (cls + 1) % autotiler->getClassCount());
+    }
+    if (action == GLFW_PRESS && key == GLFW_KEY_P) {
+        automaton_running = !automaton_running;
+        automaton_next_tick = glfwGetTime();
+        cout << "Simulacao: " << (automaton_running ? "ligada" : "desligada") << endl;
+    }
+    if (action == GLFW_PRESS && key == GLFW_KEY_F5) {
+        save_game(save_path);
+    }
+    if (action == GLFW_PRESS && key == GLFW_KEY_F9) {
+        load_game(save_path);
+    }
+    if (action == GLFW_PRESS && key == GLFW_KEY_V) {
+        report_visibility();
+    }
+    // 1..9: nivel da lista. Pre-carregado troca no proximo frame; frio, quando ficar pronto.
+    if (action == GLFW_PRESS && key >= GLFW_KEY_1 && key <= GLFW_KEY_9) {
+        int i = key - GLFW_KEY_1;
+        if (i < levels->getLevelCount() && levels->getLevel(i) != levels->getCurrent()) {
+            Level* l = levels->getLevel(i);
+            if (!levels->requestSwitch(l->name)) cout << "Nivel indisponivel: " << l->name << endl;
+            else if (l->state != LEVEL_READY) cout << "Carregando nivel " << l->name << "..." << endl;
+        }
+    }
+    // F poe fogo sob o player.
+    if (action == GLFW_PRESS && key == GLFW_KEY_F) {
+        edit_tile(player_col, player_row, 3);
+    }
+    if (action == GLFW_PRESS || action == GLFW_REPEAT) {
+        float old_x = cam_x, old_y = cam_y;
+        if (key == GLFW_KEY_LEFT) cam_x += cam_step;
+        if (key == GLFW_KEY_RIGHT) cam_x -= cam_step;
+        if (key == GLFW_KEY_UP) cam_y -= cam_step;
+        if (key == GLFW_KEY_DOWN) cam_y += cam_step;
+        if (cam_x != old_x || cam_y != old_y) static_cache->invalidateAll();
+    }
     if (action == GLFW_PRESS || action == GLFW_REPEAT) {
         int next_col = player_col;
         int next_row = player_row;
@@ -91,7 +837,9 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         if (key == GLFW_KEY_C) direction = DIRECTION_SOUTHEAST;
         if (direction != -1) {
             tview->computeTileWalking(next_col, next_row, direction);
-            if (next_col >= 0 && next_col < tmap->getWidth() && next_row >= 0 && next_row < tmap->getHeight()) {
+            if (next_col >= 0 && next_col < tmap->getWidth() && next_row >= 0 && next_row < tmap->getHeight()
+                && ttypes->isWalkable(tmap->getTile(next_col, next_row))
+                && abs(tmap->getElevation(next_col, next_row) - tmap->getElevation(player_col, player_row)) <= 1) {
                 player_col = next_col;
                 player_row = next_row;
             }
@@ -99,123 +847,421 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
     }
 }
 
-int main() {
+// --latency [amostras]: entradas sinteticas chegam em instantes aleatorios e sao entregues
+// pelo mesmo key_callback do GLFW no proximo poll; o LatencyProbe marca o frame que as
+// mostra. Repete para vsync ligado/desligado, com e sem limite de 30 fps e com 1 a 3
+// frames em voo (limitados por fences).
+void run_latency_harness(int samples) {
+    LatencyProbe probe;
+    GLFWkeyfun callback = key_callback;
+    int vsyncs[] = { 0, 1 };
+    double caps[] = { 0.0, 30.0 };
+    int depths[] = { 1, 2, 3 };
+    srand(7);
+    printf("latencia entrada -> apresentacao, %d amostras por configuracao\n", samples);
+    for (int v = 0; v < 2; v++) {
+        for (int c = 0; c < 2; c++) {
+            for (int d = 0; d < 3; d++) {
+                glfwSwapInterval(vsyncs[v]);
+                probe.reset();
+                deque<GLsync> in_flight;
+                double next_input = probe.getTime() + 0.02 + (rand() % 50) / 1000.0;
+                int toggle = 0;
+                while (probe.getSampleCount() < samples && !glfwWindowShouldClose(g_window)) {
+                    double frame_start = probe.getTime();
+                    // No maximo depths[d] frames enfileirados na GPU.
+                    while ((int)in_flight.size() >= depths[d]) {
+                        glClientWaitSync(in_flight.front(), GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+                        glDeleteSync(in_flight.front());
+                        in_flight.pop_front();
+                    }
+                    glfwPollEvents();
+                    double t = probe.getTime();
+                    while (next_input <= t) {
+                        unsigned int seq = probe.beginInput(next_input);
+                        callback(g_window, toggle ? GLFW_KEY_A : GLFW_KEY_D, 0, GLFW_PRESS, 0);
+                        probe.markApplied(seq);
+                        toggle ^= 1;
+                        next_input += 0.02 + (rand() % 50) / 1000.0;
+                    }
+                    draw_scene(glfwGetTime() * 1000.0);
+                    probe.endFrame();
+                    glfwSwapBuffers(g_window);
+                    probe.afterSwap();
+                    in_flight.push_back(glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0));
+                    if (caps[c] > 0.0) {
+                        double wait = frame_start + 1.0 / caps[c] - probe.getTime();
+                        if (wait > 0.0) this_thread::sleep_for(chrono::duration<double>(wait));
+                    }
+                }
+                probe.flush();
+                while (!in_flight.empty()) {
+                    glDeleteSync(in_flight.front());
+                    in_flight.pop_front();
+                }
+                char label[96];
+                snprintf(label, sizeof(label), "vsync %-3s limite %-6s %d em voo", vsyncs[v] ? "on" : "off",
+                    caps[c] > 0.0 ? "30fps" : "nenhum", depths[d]);
+                probe.printDistribution(label);
+            }
+        }
+    }
+    glfwSwapInterval(1);
+}
+
+int main(int argc, char** argv) {
+    int bench_size = 0, bench_frames = 200, latency_samples = 0, autotile_size = 0;
+    bool always_render = false, no_mdi = false, bake = false;
+    int bench_aa_frames = 0, bench_graph_frames = 0, bench_texture_runs = 0;
+    const char* metrics_address = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--bench-render") == 0) {
+            bench_size = i + 1 < argc ? atoi(argv[++i]) : 512;
+            if (i + 1 < argc) bench_frames = atoi(argv[++i]);
+            if (bench_size <= 0) bench_size = 512;
+        } else if (strcmp(argv[i], "--idmap") == 0) {
+            render_mode = RENDER_IDMAP;
+        } else if (strcmp(argv[i], "--bench-autotile") == 0) {
+            autotile_size = i + 1 < argc ? atoi(argv[++i]) : 2048;
+            if (autotile_size <= 0) autotile_size = 2048;
+        } else if (strcmp(argv[i], "--latency") == 0) {
+            latency_samples = i + 1 < argc ? atoi(argv[++i]) : 100;
+            if (latency_samples <= 0) latency_samples = 100;
+        } else if (strcmp(argv[i], "--no-idle") == 0) {
+            always_render = true;
+        } else if (strcmp(argv[i], "--level-budget") == 0 && i + 1 < argc) {
+            level_budget = (size_t)atoi(argv[++i]) * 1024 * 1024;
+        } else if (strcmp(argv[i], "--aa") == 0 && i + 1 < argc) {
+            render_settings.antialias = RenderSettings::parseMode(argv[++i]);
+        } else if (strcmp(argv[i], "--samples") == 0 && i + 1 < argc) {
+            render_settings.samples = atoi(argv[++i]);
+            if (render_settings.samples < 2) render_settings.samples = 2;
+        } else if (strcmp(argv[i], "--bench-aa") == 0) {
+            bench_aa_frames = i + 1 < argc ? atoi(argv[++i]) : 200;
+            if (bench_aa_frames <= 0) bench_aa_frames = 200;
+        } else if (strcmp(argv[i], "--bench-graph") == 0) {
+            bench_graph_frames = i + 1 < argc ? atoi(argv[++i]) : 200;
+            if (bench_graph_frames <= 0) bench_graph_frames = 200;
+        } else if (strcmp(argv[i], "--metrics") == 0 && i + 1 < argc) {
+            metrics_address = argv[++i];
+        } else if (strcmp(argv[i], "--no-chunks") == 0) {
+            use_chunks = false;
+        } else if (strcmp(argv[i], "--no-mdi") == 0) {
+            no_mdi = true;
+        } else if (strcmp(argv[i], "--tex-format") == 0 && i + 1 < argc) {
+            int format = TextureCodec::parseFormat(argv[++i]);
+            if (format < 0) printf("ERRO: formato de textura desconhecido: %s (rgba8, bc1, bc3, bc7, etc2)\n", argv[i]);
+            else TextureLoader::setForced(format);
+        } else if (strcmp(argv[i], "--bake-textures") == 0) {
+            bake = true;
+        } else if (strcmp(argv[i], "--bench-textures") == 0) {
+            bench_texture_runs = i + 1 < argc ? atoi(argv[++i]) : 20;
+            if (bench_texture_runs <= 0) bench_texture_runs = 20;
+        }
+    }
+
+    Metrics& metrics = Metrics::get();
+    metric_frames = metrics.define("frames_rendered_total", METRIC_COUNTER, "Frames desenhados");
+    metric_frame_us = metrics.define("frame_time_us", METRIC_GAUGE, "Tempo de CPU do ultimo frame (desenho + fila GL)");
+    metric_frame_us_total = metrics.define("frame_time_us_total", METRIC_COUNTER, "Soma dos tempos de frame");
+    metric_draws = metrics.define("draw_calls_total", METRIC_COUNTER, "Chamadas de desenho");
+    metric_frame_draws = metrics.define("draw_calls", METRIC_GAUGE, "Chamadas de desenho no ultimo frame");
+    metric_instances = metrics.define("tile_instances", METRIC_GAUGE, "Blocos na ultima chamada instanciada");
+    metric_gl_queue = metrics.define("gl_queue_depth", METRIC_GAUGE, "Tarefas GL esperando a thread principal");
+    metric_job_queue = metrics.define("job_queue_depth", METRIC_GAUGE, "Jobs na fila, todas as prioridades");
+    metric_level_bytes = metrics.define("level_pool_bytes", METRIC_GAUGE, "Memoria dos niveis carregados");
+    metric_level_switches = metrics.define("level_switches_total", METRIC_COUNTER, "Trocas de nivel entregues");
+    metric_chunk_commands = metrics.define("chunk_commands", METRIC_GAUGE, "Chunks visiveis na ultima multi-draw");
+    if (metrics_address != NULL) {
+        metrics_server = new MetricsServer(&metrics);
+        if (metrics_server->start(metrics_address)) printf("Metricas em %s\n", metrics_address);
+    }
+
     start_gl();
+    jobs = new JobSystem();
+    gl_queue = new MainThreadQueue();
+    scheduler = new FrameScheduler();
+    scheduler->setAlwaysRender(always_render);
+    // Jobs podem postar tarefas GL enquanto a thread principal dorme.
+    gl_queue->setWakeup([]() { scheduler->invalidateFromThread(INVALID_SIMULATION); });
     glfwSetKeyCallback(g_window, key_callback);
+    glfwSetWindowRefreshCallback(g_window, [](GLFWwindow*) { scheduler->invalidate(INVALID_WINDOW); });
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_LEQUAL);
 
     stbi_set_flip_vertically_on_load(true);
 
-    tmap = readMap("terrain1.tmap");
-    if (tmap == NULL) return -1;
-    
-    GLuint tileset_texture;
-    loadTexture(tileset_texture, "terrain.png");
-    tmap->setTid(tileset_texture);
+    if (bake) bake_textures();
+    if (bench_texture_runs > 0) {
+        bench_textures(bench_texture_runs);
+        delete jobs;
+        delete gl_queue;
+        glfwTerminate();
+        return 0;
+    }
+
+    ttypes->loadSidecar("terrain.tiles");
+
+    autotiler = new AutoTiler();
+    if (!autotiler->loadRules("terrain.autotile")) {
+        // Sem regras: cada tile do tileset e uma classe de uma variante so.
+        for (int i = 0; i < tileSetCols; i++) autotiler->setRule(i, AUTOTILE_MODE_4, vector<unsigned char>(1, (unsigned char)i));
+    }
+    autotile_rules = new AutoTiler(*autotiler);
+
+    los = new LineOfSight(tview);
     
     loadTexture(player_texture, "player.png");
 
     float w_world = 2.0f;
-    float tile_render_width = w_world / 10.0f; 
-    float tile_render_height = tile_render_width / 2.0f;
-    tileW_tex = 1.0f / (float)tileSetCols;
-    tileH_tex = 1.0f;
+    tile_render_width = w_world / 10.0f; 
+    tile_render_height = tile_render_width / 2.0f;
+    block_height = tile_render_height;
     
-    unsigned int tile_VAO, tile_VBO, tile_EBO;
+    // Bloco isometrico: losango do topo + faces laterais esquerda e direita,
+    // que reaproveitam a borda do losango da textura escurecida por aShade.
+    quad_format.add("aPos", 0, 2, VF_SNORM16).add("aTexCoord", 1, 2, VF_UNORM16).add("aShade", 2, 1, VF_UNORM8);
+    tile_instance_format.add("aOffset", 3, 2, VF_SNORM16).add("aDepth", 4, 1, VF_FLOAT)
+        .add("aFrameUV", 5, 2, VF_UNORM16).add("aLayer", 6, 1, VF_UINT8);
+    assert(tile_instance_format.getStride() == (int)sizeof(TileInstance));
+    unsigned int tile_VBO;
     float tile_vertices[] = {
-        -tile_render_width / 2.0f, 0.0f,                       0.0f, 0.5f,
-        0.0f,                     -tile_render_height / 2.0f,    0.5f, 0.0f,
-        tile_render_width / 2.0f,  0.0f,                       1.0f, 0.5f,
-        0.0f,                      tile_render_height / 2.0f,    0.5f, 1.0f,
+        -tile_render_width / 2.0f, 0.0f,                                      0.0f,  0.5f,  1.0f,
+        0.0f,                     -tile_render_height / 2.0f,                  0.5f,  0.0f,  1.0f,
+        tile_render_width / 2.0f,  0.0f,                                      1.0f,  0.5f,  1.0f,
+        0.0f,                      tile_render_height / 2.0f,                  0.5f,  1.0f,  1.0f,
+
+        -tile_render_width / 2.0f, 0.0f,                                      0.0f,  0.5f,  0.75f,
+        0.0f,                     -tile_render_height / 2.0f,                  0.5f,  0.0f,  0.75f,
+        0.0f,                     -tile_render_height / 2.0f - block_height,   0.5f,  0.25f, 0.75f,
+        -tile_render_width / 2.0f, -block_height,                             0.25f, 0.5f,  0.75f,
+
+        0.0f,                     -tile_render_height / 2.0f,                  0.5f,  0.0f,  0.55f,
+        tile_render_width / 2.0f,  0.0f,                                      1.0f,  0.5f,  0.55f,
+        tile_render_width / 2.0f,  -block_height,                             0.75f, 0.5f,  0.55f,
+        0.0f,                     -tile_render_height / 2.0f - block_height,   0.5f,  0.25f, 0.55f,
     };
-    unsigned int indices[] = { 0, 1, 2, 0, 2, 3 };
+    vector<unsigned char> packed = pack_quad_vertices(tile_vertices, 12);
     glGenVertexArrays(1, &tile_VAO);
     glGenBuffers(1, &tile_VBO);
-    glGenBuffers(1, &tile_EBO);
     glBindVertexArray(tile_VAO);
     glBindBuffer(GL_ARRAY_BUFFER, tile_VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(tile_vertices), tile_vertices, GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, tile_EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(indices), indices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+    glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
+    QuadIndexBuffer::get().bind(3);
+    quad_format.apply();
+
+    // Dados por instancia: TileInstance.
+    glGenBuffers(1, &tile_instance_VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, tile_instance_VBO);
+    tile_instance_format.apply();
 
     float player_vertices[] = {
-        -tile_render_width / 2.0f, 0.0f,                   0.0f, 0.0f,
-         tile_render_width / 2.0f, 0.0f,                   1.0f, 0.0f,
-         tile_render_width / 2.0f, tile_render_width,      1.0f, 1.0f,
-        -tile_render_width / 2.0f, tile_render_width,      0.0f, 1.0f
+        -tile_render_width / 2.0f, 0.0f,                   0.0f, 0.0f, 1.0f,
+         tile_render_width / 2.0f, 0.0f,                   1.0f, 0.0f, 1.0f,
+         tile_render_width / 2.0f, tile_render_width,      1.0f, 1.0f, 1.0f,
+        -tile_render_width / 2.0f, tile_render_width,      0.0f, 1.0f, 1.0f
     };
-    unsigned int player_indices[] = { 0, 1, 2, 2, 3, 0 };
+    packed = pack_quad_vertices(player_vertices, 4);
     glGenVertexArrays(1, &player_VAO);
     glGenBuffers(1, &player_VBO);
-    glGenBuffers(1, &player_EBO);
     glBindVertexArray(player_VAO);
     glBindBuffer(GL_ARRAY_BUFFER, player_VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(player_vertices), player_vertices, GL_STATIC_DRAW);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, player_EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(player_indices), player_indices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
-    glEnableVertexAttribArray(1);
+    glBufferData(GL_ARRAY_BUFFER, packed.size(), packed.data(), GL_STATIC_DRAW);
+    QuadIndexBuffer::get().bind(1);
+    quad_format.apply();
 
 
-    GLuint shader_programme = create_programme_from_files("_geral_vs.glsl", "_geral_fs.glsl");
+    shader_programme = create_programme_from_files("_geral_vs.glsl", "_geral_fs.glsl");
+    loc_offsetX = glGetUniformLocation(shader_programme, "offsetX");
+    loc_tileW = glGetUniformLocation(shader_programme, "tileW");
+    loc_tx = glGetUniformLocation(shader_programme, "tx");
+    loc_ty = glGetUniformLocation(shader_programme, "ty");
+    loc_tz = glGetUniformLocation(shader_programme, "tz");
+    loc_weight = glGetUniformLocation(shader_programme, "weight");
 
-    while (!glfwWindowShouldClose(g_window)) {
-        glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
-        glClear(GL_COLOR_BUFFER_BIT);
+    GLuint idmap_programme = create_programme_from_files("_screen_vs.glsl", "_idmap_fs.glsl");
+    glUseProgram(idmap_programme);
+    glUniform1f(glGetUniformLocation(idmap_programme, "weight"), 0.0f);
 
-        glUseProgram(shader_programme);
-        glUniform1i(glGetUniformLocation(shader_programme, "ourTexture"), 0);
-        
-        glBindVertexArray(tile_VAO);
-        glBindTexture(GL_TEXTURE_2D, tmap->getTileSet());
-        
-        float map_offset_y = 0.4f;
-
-        for (int r = 0; r < tmap->getHeight(); r++) {
-            for (int c = 0; c < tmap->getWidth(); c++) {
-                int tile_id = (int)tmap->getTile(c, r);
-                int u = tile_id % tileSetCols;
-                float screen_x, screen_y;
-                tview->computeDrawPosition(c, r, tile_render_width, tile_render_height, screen_x, screen_y);
-                glUniform1f(glGetUniformLocation(shader_programme, "offsetX"), u * tileW_tex);
-                glUniform1f(glGetUniformLocation(shader_programme, "tileW"), tileW_tex);
-                glUniform1f(glGetUniformLocation(shader_programme, "tx"), screen_x);
-                glUniform1f(glGetUniformLocation(shader_programme, "ty"), screen_y - map_offset_y);
-                glUniform1f(glGetUniformLocation(shader_programme, "weight"), 0.0f);
-                glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
-            }
+    static_cache = new StaticLayerCache(create_programme_from_files("_screen_vs.glsl", "_composite_fs.glsl"));
+    static_cache->setClearColor(0.2f, 0.3f, 0.3f, 1.0f);
+    frame_graph = new FrameGraph();
+    antialias = new AntiAliasing(create_programme_from_files("_screen_vs.glsl", "_fxaa_fs.glsl"));
+    antialias->apply(render_settings);
+
+    // O tileset e um so para todos os niveis: o pool conta quem usa e o apaga com o ultimo.
+    // O buffer de instancias ja e um so, reescrito a cada frame, e nao entra no pool.
+    levels = new LevelPool(jobs, gl_queue, idmap_programme, level_budget);
+    levels->registerResource("terrain.png", []() -> void* {
+        TileSetManager* t = new TileSetManager();
+        t->addTileSet("terrain.png", tile_gid_base, 114, 57, tileSetCols, tileSetCols);
+        if (!t->build()) {
+            delete t;
+            return NULL;
         }
-        
-        glBindVertexArray(player_VAO);
-        glBindTexture(GL_TEXTURE_2D, player_texture);
-        float player_x, player_y;
-        tview->computeDrawPosition(player_col, player_row, tile_render_width, tile_render_height, player_x, player_y);
-        float player_render_y = player_y - map_offset_y + (tile_render_height * 0.5f);
-        glUniform1f(glGetUniformLocation(shader_programme, "offsetX"), 0.0f);
-        glUniform1f(glGetUniformLocation(shader_programme, "tileW"), 1.0f);
-        glUniform1f(glGetUniformLocation(shader_programme, "tx"), player_x);
-        glUniform1f(glGetUniformLocation(shader_programme, "ty"), player_render_y);
-        glUniform1f(glGetUniformLocation(shader_programme, "weight"), 0.0f);
-        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+        return t;
+    }, [](void* t) { delete (TileSetManager*)t; });
+    levels->setPrepare([](TileMap* map) {
+        AutoTiler tiler(*autotile_rules);
+        tiler.setMap(map);
+        tiler.applyAll(NULL);
+    });
+    tsets = (TileSetManager*)levels->acquire("terrain.png");
+    if (tsets == NULL) return -1;
+    if (!levels->loadList("levels.txt")) levels->addLevel("terrain1", "terrain1.tmap", "terrain.png");
+    Level* first = levels->loadNow(levels->getLevel(0)->name);
+    if (first == NULL) return -1;
+    levels->setCurrent(first);
+    activate_level(first);
 
+    tiles_programme = create_programme_from_files("_tiles_vs.glsl", "_tiles_fs.glsl");
+    VertexFormat::validate(shader_programme, "_geral_vs.glsl", { &quad_format });
+    VertexFormat::validate(tiles_programme, "_tiles_vs.glsl", { &quad_format, &tile_instance_format });
+    glUseProgram(tiles_programme);
+    glUniform1f(glGetUniformLocation(tiles_programme, "offsetRange"), TILE_OFFSET_RANGE);
+    tsets->setUniforms(tiles_programme);
+    glUniform1f(glGetUniformLocation(tiles_programme, "weight"), 0.0f);
 
-        glfwPollEvents();
+    GLuint chunks_programme = create_programme_from_files("_chunks_vs.glsl", "_tiles_fs.glsl");
+    VertexFormat::validate(chunks_programme, "_chunks_vs.glsl", {});
+    glUseProgram(chunks_programme);
+    tsets->setUniforms(chunks_programme);
+    glUniform1f(glGetUniformLocation(chunks_programme, "weight"), 0.0f);
+    chunks = new ChunkRenderer(chunks_programme);
+    chunks->setCorners(tile_vertices);
+    chunks->setIndirect(!no_mdi);
+
+    if (latency_samples > 0) {
+        run_latency_harness(latency_samples);
+        jobs->printStats();
+        delete levels;
+        delete jobs;
+        delete gl_queue;
+        delete static_cache;
+        glfwTerminate();
+        return 0;
+    }
+
+    if (autotile_size > 0) {
+        bench_autotile(autotile_size);
+        delete levels;
+        delete autotiler;
+        delete jobs;
+        glfwTerminate();
+        return 0;
+    }
+
+    if (bench_graph_frames > 0) {
+        bench_frame_graph(bench_graph_frames);
+        delete antialias;
+        delete frame_graph;
+        delete levels;
+        glfwTerminate();
+        return 0;
+    }
+
+    if (bench_aa_frames > 0) {
+        bench_antialias(bench_aa_frames);
+        delete antialias;
+        delete frame_graph;
+        delete levels;
+        glfwTerminate();
+        return 0;
+    }
+
+    if (bench_size > 0) {
+        bench_render(bench_size, bench_frames);
+        delete levels;
+        glfwTerminate();
+        return 0;
+    }
+
+    while (!glfwWindowShouldClose(g_window)) {
+        // Sem nada invalido (entrada, animacao, tarefas GL, janela) o laco dorme aqui.
+        scheduler->waitForWork();
         if (GLFW_PRESS == glfwGetKey(g_window, GLFW_KEY_ESCAPE)) {
             glfwSetWindowShouldClose(g_window, 1);
         }
+        if (!scheduler->beginFrame()) continue;
+
+        // Troca de nivel so aqui, entre dois frames.
+        Level* next_level = levels->pollSwitch();
+        if (next_level != NULL) activate_level(next_level);
+
+        if (automaton_running && glfwGetTime() >= automaton_next_tick) {
+            automaton->tick(jobs, automaton_chunk_changed);
+            automaton_next_tick += automaton_tick;
+            if (automaton_next_tick < glfwGetTime()) automaton_next_tick = glfwGetTime() + automaton_tick;
+        }
+        if (automaton_running) scheduler->wakeAt(automaton_next_tick);
+
+        double frame_start = glfwGetTime();
+        double time_ms = frame_start * 1000.0;
+        draw_scene(time_ms);
+
+        // Tarefas GL postadas pelos jobs rodam so no tempo que sobra do frame.
+        gl_queue->run(frame_budget - (glfwGetTime() - frame_start));
+        int gl_depth = gl_queue->getDepth();
+        if (gl_depth > 0 || levels->isSwitchReady()) scheduler->invalidate(INVALID_SIMULATION);
+
+        int64_t frame_us = (int64_t)((glfwGetTime() - frame_start) * 1e6);
+        JobStats job_stats = jobs->getStats();
+        int job_depth = 0;
+        for (int p = 0; p < JOB_PRIORITY_COUNT; p++) job_depth += job_stats.queued[p];
+        metrics.add(metric_frames, 1);
+        metrics.set(metric_frame_us, frame_us);
+        metrics.add(metric_frame_us_total, frame_us);
+        metrics.add(metric_draws, frame_draws);
+        metrics.set(metric_frame_draws, frame_draws);
+        metrics.set(metric_gl_queue, gl_depth);
+        metrics.set(metric_job_queue, job_depth);
+        metrics.set(metric_level_bytes, (int64_t)levels->getMemory());
+        frame_draws = 0;
+
+        // Proximo frame so quando algum tile animado trocar de quadro.
+        double next_anim_ms = ttypes->msUntilNextFrame(time_ms);
+        if (next_anim_ms >= 0.0) scheduler->wakeAt(time_ms / 1000.0 + next_anim_ms / 1000.0);
         
         glfwSwapBuffers(g_window);
+        // Latencia da troca: do pedido ate o primeiro frame do nivel novo entregue.
+        double switch_latency = levels->presented();
+        if (switch_latency >= 0.0) {
+            metrics.add(metric_level_switches, 1);
+            printf("Nivel %s: troca %s em %.3f ms\n", levels->getCurrent()->name.c_str(),
+                levels->lastSwitchWasWarm() ? "pre-carregada" : "fria", switch_latency * 1000.0);
+        }
     }
 
+    // O servidor para antes de tudo: ele so le os blocos de metricas, que nao sao liberados.
+    delete metrics_server;
+    levels->printStats();
+    jobs->printStats();
+    gl_queue->printStats();
+    static_cache->printStats();
+    chunks->printStats();
+    TextureLoader::printStats();
+    frame_graph->printStats();
+    scheduler->printStats();
+    automaton->printStats();
+    // O automato sai antes dos mapas do pool; o save mapeado, depois.
+    delete automaton;
+    levels->release("terrain.png");
+    delete levels;
+    delete jobs;
+    delete gl_queue;
+    delete static_cache;
+    delete chunks;
+    delete antialias;
+    delete frame_graph;
     glfwTerminate();
-    delete tmap;
     delete tview;
+    delete ttypes;
+    delete scheduler;
+    delete autotiler;
+    delete autotile_rules;
+    delete los;
+    delete loaded_save;
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,253 @@
+#ifndef AutoTiler_h
+#define AutoTiler_h
+
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "JobSystem.h"
+#include "TileMap.h"
+#include "TileTypes.h"
+
+#define AUTOTILE_MAX_CLASSES 32
+#define AUTOTILE_NONE 255
+#define AUTOTILE_MODE_4 4
+#define AUTOTILE_MODE_BLOB 8
+#define AUTOTILE_BLOB_COUNT 47
+
+// Bits da mascara de vizinhos com a mesma classe (linha - 1 e o norte).
+#define AUTOTILE_N 1
+#define AUTOTILE_NE 2
+#define AUTOTILE_E 4
+#define AUTOTILE_SE 8
+#define AUTOTILE_S 16
+#define AUTOTILE_SW 32
+#define AUTOTILE_W 64
+#define AUTOTILE_NW 128
+
+// Escolhe o tile de transicao a partir da classe de terreno de cada celula. Cada classe tem
+// uma regra de 4 bits (16 variantes, so os lados) ou blob de 8 bits (47 variantes; uma
+// diagonal so conta quando os dois lados vizinhos a ela tambem sao iguais). As duas regras
+// sao expandidas para uma tabela de 256 entradas por classe, entao o laco interno calcula a
+// mascara de 8 bits sem desvio e faz uma unica busca. As classes ficam num grid com borda
+// de uma celula que replica a beirada do mapa: fora do mapa conta como mesma classe.
+class AutoTiler {
+    TileMap* map;
+    int width, height, stride;
+    std::vector<unsigned char> classes;
+    int classCount;
+    unsigned char mode[AUTOTILE_MAX_CLASSES];
+    unsigned char lut[AUTOTILE_MAX_CLASSES][256];
+    unsigned char classOf[TILE_MAX_TYPES];
+    unsigned char blobIndex[256];
+    unsigned char blobMask[AUTOTILE_BLOB_COUNT];
+
+    static int reduceBlob(int m) {
+        if ((m & (AUTOTILE_N | AUTOTILE_E)) != (AUTOTILE_N | AUTOTILE_E)) m &= ~AUTOTILE_NE;
+        if ((m & (AUTOTILE_S | AUTOTILE_E)) != (AUTOTILE_S | AUTOTILE_E)) m &= ~AUTOTILE_SE;
+        if ((m & (AUTOTILE_S | AUTOTILE_W)) != (AUTOTILE_S | AUTOTILE_W)) m &= ~AUTOTILE_SW;
+        if ((m & (AUTOTILE_N | AUTOTILE_W)) != (AUTOTILE_N | AUTOTILE_W)) m &= ~AUTOTILE_NW;
+        return m;
+    }
+
+    static int edgeBits(int m) {
+        return ((m & AUTOTILE_N) ? 1 : 0) | ((m & AUTOTILE_E) ? 2 : 0) | ((m & AUTOTILE_S) ? 4 : 0) |
+               ((m & AUTOTILE_W) ? 8 : 0);
+    }
+
+    unsigned char& cell(int col, int row) {
+        return this->classes[(row + 1) * this->stride + col + 1];
+    }
+
+    // Refaz as celulas da borda que copiam (col, row).
+    void updateBorder(int col, int row) {
+        unsigned char k = this->cell(col, row);
+        for (int dr = -1; dr <= 1; dr++) {
+            for (int dc = -1; dc <= 1; dc++) {
+                int pc = col + 1 + dc, pr = row + 1 + dr;
+                bool border = pc == 0 || pc == this->width + 1 || pr == 0 || pr == this->height + 1;
+                if (!border) continue;
+                int cc = pc - 1 < 0 ? 0 : (pc - 1 >= this->width ? this->width - 1 : pc - 1);
+                int cr = pr - 1 < 0 ? 0 : (pr - 1 >= this->height ? this->height - 1 : pr - 1);
+                if (cc == col && cr == row) this->classes[pr * this->stride + pc] = k;
+            }
+        }
+    }
+
+    // Tiles das colunas [c0, c1) da linha row; celulas sem classe (AUTOTILE_NONE) nao mudam.
+    void computeRow(int row, int c0, int c1, unsigned char* out) {
+        const unsigned char* up = &this->classes[row * this->stride + 1];
+        const unsigned char* mid = up + this->stride;
+        const unsigned char* dn = mid + this->stride;
+        for (int c = c0; c < c1; c++) {
+            unsigned char k = mid[c];
+            if (k == AUTOTILE_NONE) continue;
+            int m = (up[c] == k) | ((up[c + 1] == k) << 1) | ((mid[c + 1] == k) << 2) | ((dn[c + 1] == k) << 3) |
+                    ((dn[c] == k) << 4) | ((dn[c - 1] == k) << 5) | ((mid[c - 1] == k) << 6) | ((up[c - 1] == k) << 7);
+            out[c] = this->lut[k][m];
+        }
+    }
+
+public:
+    AutoTiler() {
+        this->map = NULL;
+        this->width = this->height = this->stride = 0;
+        this->classCount = 0;
+        memset(this->mode, AUTOTILE_MODE_4, sizeof(this->mode));
+        memset(this->lut, 0, sizeof(this->lut));
+        memset(this->classOf, AUTOTILE_NONE, sizeof(this->classOf));
+        // As 47 mascaras blob distintas, em ordem crescente: e a ordem das variantes nas regras.
+        int n = 0;
+        for (int m = 0; m < 256; m++) {
+            if (reduceBlob(m) == m) this->blobMask[n++] = (unsigned char)m;
+        }
+        for (int m = 0; m < 256; m++) {
+            int r = reduceBlob(m);
+            for (int i = 0; i < AUTOTILE_BLOB_COUNT; i++) {
+                if (this->blobMask[i] == r) this->blobIndex[m] = (unsigned char)i;
+            }
+        }
+    }
+
+    // tiles: as variantes da classe (16 pela mascara de lados N=1 L=2 S=4 O=8, ou 47 na ordem
+    // de getBlobMask). Variantes que faltarem usam a primeira.
+    void setRule(int cls, int ruleMode, const std::vector<unsigned char>& tiles) {
+        if (cls < 0 || cls >= AUTOTILE_MAX_CLASSES || tiles.empty()) return;
+        this->mode[cls] = (unsigned char)ruleMode;
+        int variants = ruleMode == AUTOTILE_MODE_BLOB ? AUTOTILE_BLOB_COUNT : 16;
+        for (int m = 0; m < 256; m++) {
+            int v = ruleMode == AUTOTILE_MODE_BLOB ? this->blobIndex[m] : edgeBits(m);
+            this->lut[cls][m] = v < (int)tiles.size() ? tiles[v] : tiles[0];
+        }
+        // Qualquer variante identifica a classe ao ler um mapa ja pintado.
+        for (int i = 0; i < variants && i < (int)tiles.size(); i++) {
+            if (this->classOf[tiles[i]] == AUTOTILE_NONE) this->classOf[tiles[i]] = (unsigned char)cls;
+        }
+        if (cls + 1 > this->classCount) this->classCount = cls + 1;
+    }
+
+    // Uma linha por classe:  classe modo(4 ou 8) tile tile ...   ('#' comeca comentario).
+    bool loadRules(const char* filename) {
+        std::ifstream arq(filename);
+        if (!arq.is_open()) {
+            std::cout << "ERRO: Não foi possível abrir as regras de autotile: " << filename << std::endl;
+            return false;
+        }
+        std::string line;
+        while (std::getline(arq, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            std::istringstream ss(line);
+            int cls, ruleMode, t;
+            if (!(ss >> cls >> ruleMode)) continue;
+            if (ruleMode != AUTOTILE_MODE_4 && ruleMode != AUTOTILE_MODE_BLOB) {
+                std::cout << "ERRO: modo de autotile invalido na classe " << cls << std::endl;
+                continue;
+            }
+            std::vector<unsigned char> tiles;
+            while (ss >> t) {
+                if (t >= 0 && t < TILE_MAX_TYPES) tiles.push_back((unsigned char)t);
+            }
+            this->setRule(cls, ruleMode, tiles);
+        }
+        arq.close();
+        return true;
+    }
+
+    // Le as classes a partir dos tiles atuais do mapa (tiles fora das regras ficam sem classe).
+    void setMap(TileMap* map) {
+        this->map = map;
+        this->width = map->getWidth();
+        this->height = map->getHeight();
+        this->stride = this->width + 2;
+        this->classes.assign((size_t)this->stride * (this->height + 2), AUTOTILE_NONE);
+        const unsigned char* tiles = map->getMap();
+        for (int r = -1; r <= this->height; r++) {
+            int cr = r < 0 ? 0 : (r >= this->height ? this->height - 1 : r);
+            for (int c = -1; c <= this->width; c++) {
+                int cc = c < 0 ? 0 : (c >= this->width ? this->width - 1 : c);
+                this->classes[(r + 1) * this->stride + c + 1] = this->classOf[tiles[cr * this->width + cc]];
+            }
+        }
+    }
+
+    // Rele as classes de um retangulo [c0, c1) x [r0, r1) cujos tiles mudaram por fora.
+    void syncRect(int c0, int r0, int c1, int r1) {
+        const unsigned char* tiles = this->map->getMap();
+        for (int r = r0; r < r1; r++) {
+            for (int c = c0; c < c1; c++) {
+                this->cell(c, r) = this->classOf[tiles[r * this->width + c]];
+                if (c == 0 || r == 0 || c == this->width - 1 || r == this->height - 1) this->updateBorder(c, r);
+            }
+        }
+    }
+
+    // Retiling do mapa inteiro. Cada linha so escreve nela mesma, entao faixas de linhas vao
+    // para os workers sem sincronizacao; sem jobs roda na thread atual.
+    void applyAll(JobSystem* jobs) {
+        unsigned char* out = this->map->getMap();
+        int w = this->width;
+        auto rows = [this, out, w](int r0, int r1) {
+            for (int r = r0; r < r1; r++) this->computeRow(r, 0, w, out + (size_t)r * w);
+        };
+        if (jobs == NULL) {
+            rows(0, this->height);
+            return;
+        }
+        int grain = 16384 / (w > 0 ? w : 1);
+        jobs->parallelFor(0, this->height, grain < 1 ? 1 : grain, rows);
+    }
+
+    // Pinta a classe em (col, row) e refaz so a vizinhanca 3x3, a unica que enxerga a celula.
+    // onChange(col, row, tile) e chamado para cada tile que mudou (textura, cache, etc).
+    // Retorna quantos tiles mudaram.
+    template <class ChangeFn>
+    int paint(int col, int row, int cls, ChangeFn onChange) {
+        if (col < 0 || row < 0 || col >= this->width || row >= this->height) return 0;
+        this->cell(col, row) = (unsigned char)cls;
+        this->updateBorder(col, row);
+        unsigned char* tiles = this->map->getMap();
+        int changed = 0;
+        for (int r = row - 1; r <= row + 1; r++) {
+            if (r < 0 || r >= this->height) continue;
+            int c0 = col - 1 < 0 ? 0 : col - 1;
+            int c1 = col + 2 > this->width ? this->width : col + 2;
+            unsigned char before[3];
+            memcpy(before, tiles + (size_t)r * this->width + c0, c1 - c0);
+            this->computeRow(r, c0, c1, tiles + (size_t)r * this->width);
+            for (int c = c0; c < c1; c++) {
+                unsigned char t = tiles[(size_t)r * this->width + c];
+                if (t == before[c - c0]) continue;
+                changed++;
+                onChange(c, r, t);
+            }
+        }
+        return changed;
+    }
+
+    int getTerrain(int col, int row) {
+        return this->cell(col, row);
+    }
+
+    int getClassCount() {
+        return this->classCount;
+    }
+
+    int getMode(int cls) {
+        return this->mode[cls];
+    }
+
+    int getBlobMask(int variant) {
+        return this->blobMask[variant];
+    }
+
+    // Tile que a regra da classe da para uma mascara de 8 bits.
+    int lookup(int cls, int mask) {
+        return this->lut[cls & (AUTOTILE_MAX_CLASSES - 1)][mask & 255];
+    }
+};
+
+#endif
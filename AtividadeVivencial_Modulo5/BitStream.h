@@ -0,0 +1,118 @@
+#ifndef BitStream_h
+#define BitStream_h
+
+#include <stdint.h>
+#include <string.h>
+
+// Escrita/leitura de campos com numero arbitrario de bits sobre um buffer de
+// tamanho fixo. Quando o buffer acaba, a escrita para de avancar e overflow()
+// passa a indicar true; o chamador decide o que fazer (ex.: fechar o pacote).
+class BitWriter {
+    uint8_t* data;
+    int capacityBits;
+    int bitPos;
+    bool overflowed;
+
+public:
+    BitWriter(uint8_t* data, int capacityBytes) {
+        this->data = data;
+        this->capacityBits = capacityBytes * 8;
+        this->bitPos = 0;
+        this->overflowed = false;
+        memset(data, 0, capacityBytes);
+    }
+
+    bool write(uint32_t value, int bits) {
+        if (this->bitPos + bits > this->capacityBits) {
+            this->overflowed = true;
+            return false;
+        }
+        for (int i = 0; i < bits; i++) {
+            if ((value >> i) & 1u) this->data[this->bitPos >> 3] |= (uint8_t)(1u << (this->bitPos & 7));
+            this->bitPos++;
+        }
+        return true;
+    }
+
+    bool writeBool(bool v) {
+        return this->write(v ? 1u : 0u, 1);
+    }
+
+    bool fits(int bits) const {
+        return this->bitPos + bits <= this->capacityBits;
+    }
+
+    int getBitPos() const {
+        return this->bitPos;
+    }
+
+    // Volta para uma posicao ja escrita (descarta o que veio depois).
+    void rewind(int bitPos) {
+        for (int b = bitPos; b < this->bitPos; b++) this->data[b >> 3] &= (uint8_t)~(1u << (b & 7));
+        this->bitPos = bitPos;
+        this->overflowed = false;
+    }
+
+    // Sobrescreve um campo ja escrito (ex.: contador preenchido no fim).
+    void patch(int bitPos, uint32_t value, int bits) {
+        for (int i = 0; i < bits; i++) {
+            int b = bitPos + i;
+            if ((value >> i) & 1u) this->data[b >> 3] |= (uint8_t)(1u << (b & 7));
+            else this->data[b >> 3] &= (uint8_t)~(1u << (b & 7));
+        }
+    }
+
+    int getBytes() const {
+        return (this->bitPos + 7) >> 3;
+    }
+
+    bool overflow() const {
+        return this->overflowed;
+    }
+};
+
+class BitReader {
+    const uint8_t* data;
+    int sizeBits;
+    int bitPos;
+    bool overflowed;
+
+public:
+    BitReader(const uint8_t* data, int sizeBytes) {
+        this->data = data;
+        this->sizeBits = sizeBytes * 8;
+        this->bitPos = 0;
+        this->overflowed = false;
+    }
+
+    uint32_t read(int bits) {
+        if (this->bitPos + bits > this->sizeBits) {
+            this->overflowed = true;
+            this->bitPos = this->sizeBits;
+            return 0;
+        }
+        uint32_t v = 0;
+        for (int i = 0; i < bits; i++) {
+            if ((this->data[this->bitPos >> 3] >> (this->bitPos & 7)) & 1u) v |= 1u << i;
+            this->bitPos++;
+        }
+        return v;
+    }
+
+    bool readBool() {
+        return this->read(1) != 0;
+    }
+
+    bool overflow() const {
+        return this->overflowed;
+    }
+};
+
+// Quantidade de bits para representar valores em [0, n).
+inline int bitsFor(uint32_t n) {
+    int b = 1;
+    while (b < 32 && (1u << b) < n) b++;
+    return b;
+}
+
+#endif
@@ -0,0 +1,320 @@
+#ifndef Broadphase_h
+#define Broadphase_h
+
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "JobSystem.h"
+
+#define BROADPHASE_PARALLEL_MIN 8192
+#define BROADPHASE_CHUNKS 64
+
+struct BroadphasePair {
+    int a, b;
+};
+
+// Caixas alinhadas aos eixos em forma struct-of-arrays, indexadas por id estavel.
+class BroadphaseBoxes {
+public:
+    std::vector<float> minX, minY, maxX, maxY;
+
+    void resize(int n) {
+        this->minX.resize(n);
+        this->minY.resize(n);
+        this->maxX.resize(n);
+        this->maxY.resize(n);
+    }
+
+    int size() const {
+        return (int)this->minX.size();
+    }
+
+    void set(int id, float x0, float y0, float x1, float y1) {
+        this->minX[id] = x0;
+        this->minY[id] = y0;
+        this->maxX[id] = x1;
+        this->maxY[id] = y1;
+    }
+
+    bool overlaps(int a, int b) const {
+        return this->minX[a] <= this->maxX[b] && this->minX[b] <= this->maxX[a]
+            && this->minY[a] <= this->maxY[b] && this->minY[b] <= this->maxY[a];
+    }
+};
+
+// Junta os pares encontrados por cada bloco de trabalho no buffer do chamador. Os buffers
+// por bloco sao reaproveitados entre frames, entao nao ha alocacao depois do aquecimento.
+class PairChunks {
+    std::vector<std::vector<BroadphasePair> > chunks;
+
+public:
+    PairChunks() : chunks(BROADPHASE_CHUNKS) {}
+
+    std::vector<BroadphasePair>& get(int i) {
+        return this->chunks[i];
+    }
+
+    void clear() {
+        for (size_t i = 0; i < this->chunks.size(); i++) this->chunks[i].clear();
+    }
+
+    int gather(BroadphasePair* out, int capacity, int& overflow) {
+        int n = 0;
+        overflow = 0;
+        for (size_t i = 0; i < this->chunks.size(); i++) {
+            const std::vector<BroadphasePair>& c = this->chunks[i];
+            int take = (int)c.size();
+            if (n + take > capacity) {
+                overflow += n + take - capacity;
+                take = capacity - n;
+            }
+            if (take > 0) memcpy(out + n, c.data(), take * sizeof(BroadphasePair));
+            n += take;
+        }
+        return n;
+    }
+};
+
+// Sweep-and-prune no eixo X. A ordem dos ids pelo minX e mantida entre frames e
+// reordenada por insercao: com objetos que se movem pouco a lista ja esta quase
+// ordenada e o custo fica perto de O(n). Os endpoints e as extensoes em Y sao copiados
+// na ordem do sweep para o laco interno ler memoria contigua.
+class SweepAndPrune {
+    JobSystem* jobs;
+    std::vector<int> order;
+    std::vector<float> sMinX, sMaxX, sMinY, sMaxY;
+    PairChunks chunks;
+    long long swaps;
+    int overflow;
+
+    void sortEndpoints(const BroadphaseBoxes& boxes) {
+        int n = boxes.size();
+        bool reset = (int)this->order.size() != n;
+        if (reset) {
+            this->order.resize(n);
+            for (int i = 0; i < n; i++) this->order[i] = i;
+            this->sMinX.resize(n);
+            this->sMaxX.resize(n);
+            this->sMinY.resize(n);
+            this->sMaxY.resize(n);
+        }
+        for (int i = 0; i < n; i++) this->sMinX[i] = boxes.minX[this->order[i]];
+        // Sem coerencia temporal (primeiro frame, teleportes, muitas trocas no frame
+        // anterior) a insercao seria O(n^2): nesse caso ordena do zero.
+        if (reset || this->swaps > (long long)n * 16) {
+            std::vector<std::pair<float, int> > keyed(n);
+            for (int i = 0; i < n; i++) keyed[i] = std::make_pair(this->sMinX[i], this->order[i]);
+            std::sort(keyed.begin(), keyed.end());
+            for (int i = 0; i < n; i++) {
+                this->sMinX[i] = keyed[i].first;
+                this->order[i] = keyed[i].second;
+            }
+        }
+        this->swaps = 0;
+        for (int i = 1; i < n; i++) {
+            float key = this->sMinX[i];
+            int id = this->order[i];
+            int j = i - 1;
+            while (j >= 0 && this->sMinX[j] > key) {
+                this->sMinX[j + 1] = this->sMinX[j];
+                this->order[j + 1] = this->order[j];
+                j--;
+            }
+            this->swaps += i - 1 - j;
+            this->sMinX[j + 1] = key;
+            this->order[j + 1] = id;
+        }
+        for (int i = 0; i < n; i++) {
+            int id = this->order[i];
+            this->sMaxX[i] = boxes.maxX[id];
+            this->sMinY[i] = boxes.minY[id];
+            this->sMaxY[i] = boxes.maxY[id];
+        }
+    }
+
+    void sweep(int begin, int end, std::vector<BroadphasePair>& out) {
+        int n = (int)this->order.size();
+        const float* minX = this->sMinX.data();
+        const float* maxX = this->sMaxX.data();
+        const float* minY = this->sMinY.data();
+        const float* maxY = this->sMaxY.data();
+        for (int i = begin; i < end; i++) {
+            float xi = maxX[i], y0 = minY[i], y1 = maxY[i];
+            for (int j = i + 1; j < n && minX[j] <= xi; j++) {
+                if (minY[j] <= y1 && y0 <= maxY[j]) {
+                    BroadphasePair p;
+                    p.a = this->order[i];
+                    p.b = this->order[j];
+                    out.push_back(p);
+                }
+            }
+        }
+    }
+
+public:
+    SweepAndPrune(JobSystem* jobs = NULL) {
+        this->jobs = jobs;
+        this->swaps = 0;
+        this->overflow = 0;
+    }
+
+    // Escreve ate capacity pares em out e retorna quantos foram escritos; os que nao
+    // couberam ficam em getOverflow().
+    int findPairs(const BroadphaseBoxes& boxes, BroadphasePair* out, int capacity) {
+        this->sortEndpoints(boxes);
+        int n = boxes.size();
+        this->chunks.clear();
+        if (this->jobs == NULL || n < BROADPHASE_PARALLEL_MIN) {
+            this->sweep(0, n, this->chunks.get(0));
+        } else {
+            int per = (n + BROADPHASE_CHUNKS - 1) / BROADPHASE_CHUNKS;
+            this->jobs->parallelFor(0, BROADPHASE_CHUNKS, 1, [this, n, per](int b, int e) {
+                for (int c = b; c < e; c++) {
+                    int begin = c * per, end = begin + per < n ? begin + per : n;
+                    if (begin < end) this->sweep(begin, end, this->chunks.get(c));
+                }
+            });
+        }
+        return this->chunks.gather(out, capacity, this->overflow);
+    }
+
+    long long getSwaps() {
+        return this->swaps;
+    }
+
+    int getOverflow() {
+        return this->overflow;
+    }
+};
+
+// Alternativa com grade uniforme: cada caixa entra em todas as celulas que toca (tabela
+// hash de celulas, ordenada por contagem). Um par so e reportado na celula que contem o
+// canto minimo da intersecao das duas caixas, entao nao ha duplicatas.
+class UniformGrid {
+    JobSystem* jobs;
+    float cellSize;
+    int bucketBits;
+    std::vector<int> bucketStart;
+    std::vector<int> entryBox;
+    std::vector<int> entryCellX, entryCellY;
+    std::vector<int> cursor;
+    PairChunks chunks;
+    int overflow;
+
+    int cellOf(float v) const {
+        return (int)floorf(v / this->cellSize);
+    }
+
+    uint32_t bucketOf(int cx, int cy) const {
+        uint32_t h = (uint32_t)cx * 73856093u ^ (uint32_t)cy * 19349663u;
+        return h & ((1u << this->bucketBits) - 1);
+    }
+
+    void build(const BroadphaseBoxes& boxes) {
+        int n = boxes.size();
+        int buckets = 1 << this->bucketBits;
+        this->bucketStart.assign(buckets + 1, 0);
+        int total = 0;
+        for (int i = 0; i < n; i++) {
+            int x0 = this->cellOf(boxes.minX[i]), x1 = this->cellOf(boxes.maxX[i]);
+            int y0 = this->cellOf(boxes.minY[i]), y1 = this->cellOf(boxes.maxY[i]);
+            for (int cy = y0; cy <= y1; cy++) {
+                for (int cx = x0; cx <= x1; cx++) {
+                    this->bucketStart[this->bucketOf(cx, cy) + 1]++;
+                    total++;
+                }
+            }
+        }
+        for (int b = 0; b < buckets; b++) this->bucketStart[b + 1] += this->bucketStart[b];
+        this->entryBox.resize(total);
+        this->entryCellX.resize(total);
+        this->entryCellY.resize(total);
+        this->cursor.assign(this->bucketStart.begin(), this->bucketStart.end() - 1);
+        for (int i = 0; i < n; i++) {
+            int x0 = this->cellOf(boxes.minX[i]), x1 = this->cellOf(boxes.maxX[i]);
+            int y0 = this->cellOf(boxes.minY[i]), y1 = this->cellOf(boxes.maxY[i]);
+            for (int cy = y0; cy <= y1; cy++) {
+                for (int cx = x0; cx <= x1; cx++) {
+                    int k = this->cursor[this->bucketOf(cx, cy)]++;
+                    this->entryBox[k] = i;
+                    this->entryCellX[k] = cx;
+                    this->entryCellY[k] = cy;
+                }
+            }
+        }
+    }
+
+    void testBuckets(const BroadphaseBoxes& boxes, int begin, int end, std::vector<BroadphasePair>& out) {
+        for (int b = begin; b < end; b++) {
+            int s = this->bucketStart[b], e = this->bucketStart[b + 1];
+            for (int i = s; i < e; i++) {
+                int a = this->entryBox[i];
+                int cx = this->entryCellX[i], cy = this->entryCellY[i];
+                for (int j = i + 1; j < e; j++) {
+                    if (this->entryCellX[j] != cx || this->entryCellY[j] != cy) continue;
+                    int c = this->entryBox[j];
+                    if (!boxes.overlaps(a, c)) continue;
+                    float ix = boxes.minX[a] > boxes.minX[c] ? boxes.minX[a] : boxes.minX[c];
+                    float iy = boxes.minY[a] > boxes.minY[c] ? boxes.minY[a] : boxes.minY[c];
+                    if (this->cellOf(ix) != cx || this->cellOf(iy) != cy) continue;
+                    BroadphasePair p;
+                    p.a = a;
+                    p.b = c;
+                    out.push_back(p);
+                }
+            }
+        }
+    }
+
+public:
+    // cellSize deve ficar perto do tamanho tipico dos objetos.
+    UniformGrid(float cellSize, int bucketBits = 16, JobSystem* jobs = NULL) {
+        this->jobs = jobs;
+        this->cellSize = cellSize;
+        this->bucketBits = bucketBits;
+        this->overflow = 0;
+    }
+
+    int findPairs(const BroadphaseBoxes& boxes, BroadphasePair* out, int capacity) {
+        this->build(boxes);
+        this->chunks.clear();
+        int buckets = 1 << this->bucketBits;
+        if (this->jobs == NULL || boxes.size() < BROADPHASE_PARALLEL_MIN) {
+            this->testBuckets(boxes, 0, buckets, this->chunks.get(0));
+        } else {
+            int per = (buckets + BROADPHASE_CHUNKS - 1) / BROADPHASE_CHUNKS;
+            this->jobs->parallelFor(0, BROADPHASE_CHUNKS, 1, [this, &boxes, buckets, per](int b, int e) {
+                for (int c = b; c < e; c++) {
+                    int begin = c * per, end = begin + per < buckets ? begin + per : buckets;
+                    if (begin < end) this->testBuckets(boxes, begin, end, this->chunks.get(c));
+                }
+            });
+        }
+        return this->chunks.gather(out, capacity, this->overflow);
+    }
+
+    int getOverflow() {
+        return this->overflow;
+    }
+};
+
+// Referencia O(n^2) usada pelo benchmark para validar e comparar.
+inline int bruteForcePairs(const BroadphaseBoxes& boxes, BroadphasePair* out, int capacity) {
+    int n = boxes.size(), count = 0;
+    for (int i = 0; i < n; i++) {
+        for (int j = i + 1; j < n; j++) {
+            if (!boxes.overlaps(i, j)) continue;
+            if (count < capacity) {
+                out[count].a = i;
+                out[count].b = j;
+            }
+            count++;
+        }
+    }
+    return count < capacity ? count : capacity;
+}
+
+#endif
@@ -0,0 +1,130 @@
+// Benchmark da broadphase: objetos se movendo num mundo 2D, comparando sweep-and-prune,
+// grade uniforme (com e sem threads) e forca bruta. Para contagens pequenas os conjuntos
+// de pares dos tres metodos sao conferidos entre si.
+//
+// Uso: BroadphaseBench [frames=30] [maxForcaBruta=20000] [n1 n2 ...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "Broadphase.h"
+#include "JobSystem.h"
+
+using namespace std;
+
+static double now() {
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static float frand() {
+    return (float)rand() / (float)RAND_MAX;
+}
+
+static bool samePairs(BroadphasePair* a, int na, BroadphasePair* b, int nb) {
+    if (na != nb) return false;
+    vector<pair<int, int> > x, y;
+    for (int i = 0; i < na; i++) x.push_back(make_pair(min(a[i].a, a[i].b), max(a[i].a, a[i].b)));
+    for (int i = 0; i < nb; i++) y.push_back(make_pair(min(b[i].a, b[i].b), max(b[i].a, b[i].b)));
+    sort(x.begin(), x.end());
+    sort(y.begin(), y.end());
+    return x == y;
+}
+
+int main(int argc, char** argv) {
+    int frames = argc > 1 ? atoi(argv[1]) : 30;
+    int bruteLimit = argc > 2 ? atoi(argv[2]) : 20000;
+    vector<int> sizes;
+    for (int i = 3; i < argc; i++) sizes.push_back(atoi(argv[i]));
+    if (sizes.empty()) {
+        sizes.push_back(1000);
+        sizes.push_back(10000);
+        sizes.push_back(100000);
+        sizes.push_back(500000);
+    }
+
+    JobSystem jobs;
+    printf("%d threads de trabalho, %d frames por medida (ms por frame)\n", jobs.getThreadCount() + 1, frames);
+    printf("%9s %10s %10s %10s %10s %10s %10s %s\n", "objetos", "pares", "SAP", "SAP mt", "grade", "grade mt", "bruta", "trocas/frame");
+
+    for (size_t s = 0; s < sizes.size(); s++) {
+        int n = sizes[s];
+        srand(42);
+        // Densidade constante: cerca de 2 vizinhos por objeto.
+        float world = sqrtf((float)n) * 4.0f;
+        vector<float> px(n), py(n), vx(n), vy(n), half(n);
+        BroadphaseBoxes boxes;
+        boxes.resize(n);
+        for (int i = 0; i < n; i++) {
+            px[i] = frand() * world;
+            py[i] = frand() * world;
+            vx[i] = (frand() - 0.5f) * 0.2f;
+            vy[i] = (frand() - 0.5f) * 0.2f;
+            half[i] = 0.5f + frand() * 0.5f;
+        }
+
+        int capacity = n * 16;
+        vector<BroadphasePair> out(capacity), ref(capacity);
+        SweepAndPrune sap(NULL), sapMt(&jobs);
+        int bucketBits = 10;
+        while ((1 << bucketBits) < n * 2 && bucketBits < 22) bucketBits++;
+        UniformGrid grid(2.0f, bucketBits, NULL), gridMt(2.0f, bucketBits, &jobs);
+        double tSap = 0, tSapMt = 0, tGrid = 0, tGridMt = 0, tBrute = 0;
+        long long swaps = 0;
+        int pairs = 0;
+        bool ok = true;
+
+        for (int f = 0; f < frames; f++) {
+            for (int i = 0; i < n; i++) {
+                px[i] += vx[i];
+                py[i] += vy[i];
+                if (px[i] < 0 || px[i] > world) vx[i] = -vx[i];
+                if (py[i] < 0 || py[i] > world) vy[i] = -vy[i];
+                boxes.set(i, px[i] - half[i], py[i] - half[i], px[i] + half[i], py[i] + half[i]);
+            }
+
+            double t0 = now();
+            pairs = sap.findPairs(boxes, out.data(), capacity);
+            double t1 = now();
+            swaps += sap.getSwaps();
+            sapMt.findPairs(boxes, out.data(), capacity);
+            double t2 = now();
+            int g = grid.findPairs(boxes, ref.data(), capacity);
+            double t3 = now();
+            gridMt.findPairs(boxes, ref.data(), capacity);
+            double t4 = now();
+            if (f > 0) {
+                tSap += t1 - t0;
+                tSapMt += t2 - t1;
+                tGrid += t3 - t2;
+                tGridMt += t4 - t3;
+            }
+
+            if (f == frames - 1) {
+                int sp = sapMt.findPairs(boxes, out.data(), capacity);
+                int gp = gridMt.findPairs(boxes, ref.data(), capacity);
+                ok = ok && samePairs(out.data(), sp, ref.data(), gp) && g == gp;
+                if (n <= bruteLimit) {
+                    vector<BroadphasePair> brute(capacity);
+                    double b0 = now();
+                    int bp = bruteForcePairs(boxes, brute.data(), capacity);
+                    tBrute = now() - b0;
+                    ok = ok && samePairs(brute.data(), bp, ref.data(), gp);
+                }
+            }
+        }
+
+        int measured = frames > 1 ? frames - 1 : 1;
+        char brute[32];
+        if (n <= bruteLimit) snprintf(brute, sizeof(brute), "%10.3f", tBrute * 1000.0);
+        else snprintf(brute, sizeof(brute), "%10s", "-");
+        printf("%9d %10d %10.3f %10.3f %10.3f %10.3f %s %lld %s\n", n, pairs,
+            tSap / measured * 1000.0, tSapMt / measured * 1000.0,
+            tGrid / measured * 1000.0, tGridMt / measured * 1000.0,
+            brute, swaps / frames, ok ? "" : "DIVERGENTE");
+    }
+    jobs.printStats();
+    return 0;
+}
@@ -0,0 +1,288 @@
+#ifndef CellularAutomaton_h
+#define CellularAutomaton_h
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "JobSystem.h"
+#include "TileMap.h"
+#include "TileTypes.h"
+
+#define CA_CHUNK 32
+#define CA_MAX_RULES 32
+// Valor das linhas fora do mapa: nao deve ser usado como tile nas regras.
+#define CA_OUTSIDE 255
+
+// Uma regra: uma celula com o tile source, com minCount..maxCount vizinhos (8-vizinhanca)
+// iguais a neighbour, vira result. minCount 0 faz a regra valer sempre.
+struct CellRule {
+    unsigned char source, neighbour, minCount, maxCount, result;
+};
+
+// Automato celular sobre dois TileMaps do mesmo tamanho: cada tick le o mapa da frente,
+// escreve o de tras e troca os dois (TileMap::swapTiles), entao o mapa do jogo e sempre o
+// estado completo do ultimo tick. As regras de um tile valem na ordem em que foram
+// adicionadas (a primeira que casar ganha). O mapa e dividido em blocos de CA_CHUNK
+// celulas; um bloco so e recalculado se ele ou um vizinho mudou no tick anterior, ja que
+// fora disso o resultado e o mesmo e o buffer de tras ja tem esses tiles.
+class CellularAutomaton {
+    TileMap* front;
+    TileMap* back;
+    int width, height;
+    int chunksX, chunksY;
+    std::vector<CellRule> rules;
+    std::vector<unsigned char> ruleFor[TILE_MAX_TYPES];
+    std::vector<unsigned char> changed;
+    std::vector<unsigned char> active;
+    std::vector<unsigned char> outside;
+    bool simd, tracking;
+    long long ticks, chunksRun, chunksSkipped, cellsRun;
+
+    int applyScalar(const unsigned char* up, const unsigned char* mid, const unsigned char* dn, int x) {
+        unsigned char t = mid[x];
+        const std::vector<unsigned char>& list = this->ruleFor[t];
+        for (size_t i = 0; i < list.size(); i++) {
+            const CellRule& r = this->rules[list[i]];
+            int n = 0;
+            for (int dx = -1; dx <= 1; dx++) {
+                int xx = x + dx;
+                if (xx < 0 || xx >= this->width) continue;
+                n += (up[xx] == r.neighbour) + (dn[xx] == r.neighbour) + (dx != 0 && mid[xx] == r.neighbour);
+            }
+            if (n >= r.minCount && n <= r.maxCount) return r.result;
+        }
+        return t;
+    }
+
+#ifdef __SSE2__
+    // 16 celulas por vez; x-1 e x+16 tem que estar dentro da linha.
+    bool apply16(const unsigned char* up, const unsigned char* mid, const unsigned char* dn, unsigned char* out, int x) {
+        __m128i n[8];
+        n[0] = _mm_loadu_si128((const __m128i*)(up + x - 1));
+        n[1] = _mm_loadu_si128((const __m128i*)(up + x));
+        n[2] = _mm_loadu_si128((const __m128i*)(up + x + 1));
+        n[3] = _mm_loadu_si128((const __m128i*)(mid + x - 1));
+        n[4] = _mm_loadu_si128((const __m128i*)(mid + x + 1));
+        n[5] = _mm_loadu_si128((const __m128i*)(dn + x - 1));
+        n[6] = _mm_loadu_si128((const __m128i*)(dn + x));
+        n[7] = _mm_loadu_si128((const __m128i*)(dn + x + 1));
+        __m128i cur = _mm_loadu_si128((const __m128i*)(mid + x));
+        __m128i res = cur;
+        __m128i done = _mm_setzero_si128();
+        for (size_t i = 0; i < this->rules.size(); i++) {
+            const CellRule& r = this->rules[i];
+            __m128i is = _mm_andnot_si128(done, _mm_cmpeq_epi8(cur, _mm_set1_epi8((char)r.source)));
+            if (_mm_movemask_epi8(is) == 0) continue;
+            __m128i t = _mm_set1_epi8((char)r.neighbour);
+            __m128i cnt = _mm_setzero_si128();
+            for (int k = 0; k < 8; k++) cnt = _mm_sub_epi8(cnt, _mm_cmpeq_epi8(n[k], t));
+            __m128i ge = _mm_cmpeq_epi8(_mm_max_epu8(cnt, _mm_set1_epi8((char)r.minCount)), cnt);
+            __m128i le = _mm_cmpeq_epi8(_mm_min_epu8(cnt, _mm_set1_epi8((char)r.maxCount)), cnt);
+            __m128i hit = _mm_and_si128(is, _mm_and_si128(ge, le));
+            res = _mm_or_si128(_mm_andnot_si128(hit, res), _mm_and_si128(hit, _mm_set1_epi8((char)r.result)));
+            done = _mm_or_si128(done, hit);
+        }
+        _mm_storeu_si128((__m128i*)(out + x), res);
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(res, cur)) != 0xFFFF;
+    }
+#endif
+
+    // Colunas [x0, x1) de uma linha; retorna se algum tile mudou.
+    bool runRow(const unsigned char* up, const unsigned char* mid, const unsigned char* dn, unsigned char* out, int x0, int x1) {
+        bool any = false;
+        int x = x0;
+#ifdef __SSE2__
+        if (this->simd) {
+            if (x == 0) {
+                out[0] = (unsigned char)this->applyScalar(up, mid, dn, 0);
+                any |= out[0] != mid[0];
+                x = 1;
+            }
+            int last = x1 < this->width - 1 ? x1 : this->width - 1;
+            for (; x + 16 <= last; x += 16) any |= this->apply16(up, mid, dn, out, x);
+        }
+#endif
+        for (; x < x1; x++) {
+            out[x] = (unsigned char)this->applyScalar(up, mid, dn, x);
+            any |= out[x] != mid[x];
+        }
+        return any;
+    }
+
+    // Uma faixa de blocos (linha de blocos cy): so escreve nas proprias linhas e flags.
+    void runBand(int cy, std::vector<unsigned char>& nextChanged) {
+        const unsigned char* src = this->front->getMap();
+        unsigned char* dst = this->back->getMap();
+        int w = this->width;
+        int y0 = cy * CA_CHUNK;
+        int y1 = y0 + CA_CHUNK < this->height ? y0 + CA_CHUNK : this->height;
+        for (int cx = 0; cx < this->chunksX; cx++) {
+            int idx = cy * this->chunksX + cx;
+            if (this->tracking && !this->active[idx]) {
+                nextChanged[idx] = 0;
+                continue;
+            }
+            int x0 = cx * CA_CHUNK;
+            int x1 = x0 + CA_CHUNK < w ? x0 + CA_CHUNK : w;
+            bool any = false;
+            for (int y = y0; y < y1; y++) {
+                const unsigned char* mid = src + (size_t)y * w;
+                const unsigned char* up = y > 0 ? mid - w : &this->outside[1];
+                const unsigned char* dn = y + 1 < this->height ? mid + w : &this->outside[1];
+                any |= this->runRow(up, mid, dn, dst + (size_t)y * w, x0, x1);
+            }
+            nextChanged[idx] = any ? 1 : 0;
+        }
+    }
+
+public:
+    // O mapa de tras e criado aqui; front e o mapa do jogo.
+    CellularAutomaton(TileMap* front) {
+        this->front = front;
+        this->width = front->getWidth();
+        this->height = front->getHeight();
+        this->back = new TileMap(this->width, this->height, 0);
+        this->chunksX = (this->width + CA_CHUNK - 1) / CA_CHUNK;
+        this->chunksY = (this->height + CA_CHUNK - 1) / CA_CHUNK;
+        this->changed.assign((size_t)this->chunksX * this->chunksY, 1);
+        this->active.assign(this->changed.size(), 1);
+        this->outside.assign(this->width + 2 + 16, CA_OUTSIDE);
+        this->simd = true;
+        this->tracking = true;
+        this->ticks = this->chunksRun = this->chunksSkipped = this->cellsRun = 0;
+    }
+
+    ~CellularAutomaton() {
+        delete this->back;
+    }
+
+    bool addRule(int source, int neighbour, int minCount, int maxCount, int result) {
+        if ((int)this->rules.size() >= CA_MAX_RULES) {
+            std::cout << "ERRO: limite de " << CA_MAX_RULES << " regras do automato" << std::endl;
+            return false;
+        }
+        CellRule r;
+        r.source = (unsigned char)source;
+        r.neighbour = (unsigned char)neighbour;
+        r.minCount = (unsigned char)(minCount < 0 ? 0 : minCount);
+        r.maxCount = (unsigned char)(maxCount > 8 ? 8 : maxCount);
+        r.result = (unsigned char)result;
+        this->ruleFor[r.source].push_back((unsigned char)this->rules.size());
+        this->rules.push_back(r);
+        this->invalidateAll();
+        return true;
+    }
+
+    // Uma regra por linha:  origem vizinho min max resultado   ('#' comeca comentario).
+    bool loadRules(const char* filename) {
+        std::ifstream arq(filename);
+        if (!arq.is_open()) {
+            std::cout << "ERRO: Não foi possível abrir as regras do automato: " << filename << std::endl;
+            return false;
+        }
+        std::string line;
+        while (std::getline(arq, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            std::istringstream ss(line);
+            int s, n, mn, mx, r;
+            if (ss >> s >> n >> mn >> mx >> r) this->addRule(s & 255, n & 255, mn, mx, r & 255);
+        }
+        arq.close();
+        return true;
+    }
+
+    // Para medir: desliga os kernels SSE2 ou o salto dos blocos parados.
+    void setSimd(bool on) {
+        this->simd = on;
+    }
+
+    void setTracking(bool on) {
+        this->tracking = on;
+        this->invalidateAll();
+    }
+
+    // Edicao de fora (editor, autotiler): o bloco da celula e os vizinhos rodam no proximo tick.
+    void touch(int col, int row) {
+        if (col < 0 || row < 0 || col >= this->width || row >= this->height) return;
+        this->changed[(row / CA_CHUNK) * this->chunksX + col / CA_CHUNK] = 1;
+    }
+
+    void invalidateAll() {
+        std::fill(this->changed.begin(), this->changed.end(), 1);
+    }
+
+    // Um passo. Com jobs, cada linha de blocos vira uma tarefa. Depois da troca,
+    // onChunk(col0, row0, col1, row1) e chamado para cada bloco que mudou (intervalo aberto
+    // no fim), para o renderer sujar so essas areas. Retorna quantos blocos mudaram.
+    template <class ChunkFn>
+    int tick(JobSystem* jobs, ChunkFn onChunk) {
+        int cw = this->chunksX, ch = this->chunksY;
+        for (int cy = 0; cy < ch; cy++) {
+            for (int cx = 0; cx < cw; cx++) {
+                unsigned char a = 0;
+                for (int dy = -1; dy <= 1 && !a; dy++) {
+                    int y = cy + dy;
+                    if (y < 0 || y >= ch) continue;
+                    for (int dx = -1; dx <= 1; dx++) {
+                        int x = cx + dx;
+                        if (x >= 0 && x < cw && this->changed[y * cw + x]) a = 1;
+                    }
+                }
+                this->active[cy * cw + cx] = a;
+            }
+        }
+        std::vector<unsigned char> next(this->changed.size(), 0);
+        if (jobs == NULL) {
+            for (int cy = 0; cy < ch; cy++) this->runBand(cy, next);
+        } else {
+            jobs->parallelFor(0, ch, 1, [this, &next](int b, int e) {
+                for (int cy = b; cy < e; cy++) this->runBand(cy, next);
+            });
+        }
+        this->front->swapTiles(this->back);
+        this->changed.swap(next);
+
+        int count = 0;
+        for (int i = 0; i < cw * ch; i++) {
+            if (this->tracking && !this->active[i]) {
+                this->chunksSkipped++;
+                continue;
+            }
+            this->chunksRun++;
+            int x0 = (i % cw) * CA_CHUNK, y0 = (i / cw) * CA_CHUNK;
+            int x1 = x0 + CA_CHUNK < this->width ? x0 + CA_CHUNK : this->width;
+            int y1 = y0 + CA_CHUNK < this->height ? y0 + CA_CHUNK : this->height;
+            this->cellsRun += (long long)(x1 - x0) * (y1 - y0);
+            if (!this->changed[i]) continue;
+            count++;
+            onChunk(x0, y0, x1, y1);
+        }
+        this->ticks++;
+        return count;
+    }
+
+    int tick(JobSystem* jobs) {
+        return this->tick(jobs, [](int, int, int, int) {});
+    }
+
+    long long getCellsRun() {
+        return this->cellsRun;
+    }
+
+    void printStats(FILE* out = stdout) {
+        fprintf(out, "automato: %lld ticks, %lld blocos calculados, %lld pulados (%d regras)\n", this->ticks,
+            this->chunksRun, this->chunksSkipped, (int)this->rules.size());
+    }
+};
+
+#endif
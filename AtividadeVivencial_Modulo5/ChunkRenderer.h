@@ -0,0 +1,304 @@
+#ifndef ChunkRenderer_h
+#define ChunkRenderer_h
+
+#include <stdio.h>
+#include <vector>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+#include "VertexFormat.h"
+
+#define CHUNK_SIZE 16
+// Blocos por comando: 3 quads cada, dentro dos indices de 16 bits do QuadIndexBuffer.
+#define CHUNK_MAX_BLOCKS (QUAD_INDEX_MAX_QUADS / 3)
+
+// O glad do projeto e gerado para o GL 3.3: o alvo e a funcao da 4.3 nao vem nele.
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+typedef void (APIENTRYP MultiDrawElementsIndirectProc)(GLenum mode, GLenum type, const void* indirect, GLsizei drawcount, GLsizei stride);
+
+// Layout fixo de um comando de glMultiDrawElementsIndirect.
+struct DrawElementsIndirectCommand {
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// Um bloco no buffer de textura: dois texels RGBA32F lidos por _chunks_vs.glsl.
+struct ChunkBlock {
+    float x, y, depth, layer;
+    float u0, v0, pad0, pad1;
+};
+
+// Pedaco de um chunk que cabe num comando. A caixa e a do chunk inteiro, sem a camera.
+struct ChunkDraw {
+    float x0, y0, x1, y1;
+    int firstBlock;
+    int blocks;
+};
+
+// Blocos estaticos do mapa em chunks de CHUNK_SIZE x CHUNK_SIZE celulas, num buffer que so
+// muda quando a lista de blocos muda. A cada frame um passe de CPU testa a caixa de cada
+// chunk contra a tela e escreve um comando por chunk visivel direto no GL_DRAW_INDIRECT_BUFFER
+// mapeado; tudo sai numa glMultiDrawElementsIndirect (GL 4.3 ou ARB_multi_draw_indirect).
+// No GL 3.3 pedido por start_gl os mesmos comandos vao para glMultiDrawElementsBaseVertex.
+// Nao ha atributos de vertice: o baseVertex de cada comando aponta o primeiro bloco.
+class ChunkRenderer {
+    GLuint program;
+    GLuint vao;
+    GLuint blockBuffer;
+    GLuint blockTexture;
+    GLuint indirectBuffer;
+    GLint maxTexels;
+    MultiDrawElementsIndirectProc multiDrawIndirect;
+    bool indirectSupported;
+    bool indirect;
+    bool ready;
+    unsigned long long version;
+    int chunksX;
+    std::vector<std::vector<ChunkBlock> > staging;
+    std::vector<float> bounds;
+    std::vector<ChunkDraw> draws;
+    int blockCount;
+    // So para o caminho sem indireto.
+    std::vector<GLsizei> counts;
+    std::vector<const void*> offsets;
+    std::vector<GLint> baseVertices;
+    int lastCommands, lastBlocks;
+    long long builds, frames, commandsTotal;
+
+public:
+    // program e _chunks_vs + _tiles_fs, com os uniforms do tileset ja passados.
+    ChunkRenderer(GLuint program) {
+        this->program = program;
+        this->multiDrawIndirect = NULL;
+        if (versionAtLeast(4, 3) || glfwExtensionSupported("GL_ARB_multi_draw_indirect")) {
+            this->multiDrawIndirect = (MultiDrawElementsIndirectProc)glfwGetProcAddress("glMultiDrawElementsIndirect");
+        }
+        this->indirectSupported = this->multiDrawIndirect != NULL;
+        this->indirect = this->indirectSupported;
+        this->ready = false;
+        this->version = 0;
+        this->chunksX = 0;
+        this->blockCount = 0;
+        this->lastCommands = this->lastBlocks = 0;
+        this->builds = this->frames = this->commandsTotal = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &this->maxTexels);
+        glGenVertexArrays(1, &this->vao);
+        glBindVertexArray(this->vao);
+        QuadIndexBuffer::get().bind(CHUNK_MAX_BLOCKS * 3);
+        glBindVertexArray(0);
+        glGenBuffers(1, &this->blockBuffer);
+        glGenBuffers(1, &this->indirectBuffer);
+        glGenTextures(1, &this->blockTexture);
+        glBindBuffer(GL_TEXTURE_BUFFER, this->blockBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, this->blockTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, this->blockBuffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        glUseProgram(this->program);
+        glUniform1i(glGetUniformLocation(this->program, "blocks"), 1);
+    }
+
+    ~ChunkRenderer() {
+        glDeleteVertexArrays(1, &this->vao);
+        glDeleteBuffers(1, &this->blockBuffer);
+        glDeleteBuffers(1, &this->indirectBuffer);
+        glDeleteTextures(1, &this->blockTexture);
+    }
+
+    // Os 12 cantos do bloco em linhas (x, y, u, v, sombra), os mesmos do caminho instanciado.
+    void setCorners(const float* vertices) {
+        float pos[24], uv[24], shade[12];
+        for (int i = 0; i < 12; i++) {
+            pos[i * 2] = vertices[i * 5];
+            pos[i * 2 + 1] = vertices[i * 5 + 1];
+            uv[i * 2] = vertices[i * 5 + 2];
+            uv[i * 2 + 1] = vertices[i * 5 + 3];
+            shade[i] = vertices[i * 5 + 4];
+        }
+        glUseProgram(this->program);
+        glUniform2fv(glGetUniformLocation(this->program, "cornerPos"), 12, pos);
+        glUniform2fv(glGetUniformLocation(this->program, "cornerUV"), 12, uv);
+        glUniform1fv(glGetUniformLocation(this->program, "cornerShade"), 12, shade);
+    }
+
+    // Versao do contexto atual, que pode ser maior que a pedida por start_gl.
+    static bool versionAtLeast(int major, int minor) {
+        GLint ma = 0, mi = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &ma);
+        glGetIntegerv(GL_MINOR_VERSION, &mi);
+        return ma > major || (ma == major && mi >= minor);
+    }
+
+    bool hasIndirect() {
+        return this->indirectSupported;
+    }
+
+    // Sem suporte o pedido e ignorado e fica o caminho do GL 3.3.
+    void setIndirect(bool on) {
+        this->indirect = on && this->indirectSupported;
+    }
+
+    bool isIndirect() {
+        return this->indirect;
+    }
+
+    // version e a de TileStack::getVersion dos blocos usados no ultimo build.
+    bool needsBuild(unsigned long long version) {
+        return version != this->version;
+    }
+
+    // Falso quando o ultimo build nao coube no buffer de textura: use o caminho instanciado.
+    bool isReady() {
+        return this->ready;
+    }
+
+    void beginBuild(int cols, int rows) {
+        this->chunksX = (cols + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        int chunks = this->chunksX * ((rows + CHUNK_SIZE - 1) / CHUNK_SIZE);
+        this->staging.assign(chunks, std::vector<ChunkBlock>());
+        this->bounds.assign(chunks * 4, 0.0f);
+    }
+
+    // Bloco da celula (col, row); x0..y1 e o retangulo que ele cobre, sem a camera.
+    void add(int col, int row, const ChunkBlock& b, float x0, float y0, float x1, float y1) {
+        int c = (row / CHUNK_SIZE) * this->chunksX + col / CHUNK_SIZE;
+        float* box = &this->bounds[c * 4];
+        if (this->staging[c].empty() || x0 < box[0]) box[0] = x0;
+        if (this->staging[c].empty() || y0 < box[1]) box[1] = y0;
+        if (this->staging[c].empty() || x1 > box[2]) box[2] = x1;
+        if (this->staging[c].empty() || y1 > box[3]) box[3] = y1;
+        this->staging[c].push_back(b);
+    }
+
+    // Junta os chunks num buffer so (cada um contiguo) e sobe para a GPU.
+    bool endBuild(unsigned long long version) {
+        this->version = version;
+        this->draws.clear();
+        std::vector<ChunkBlock> all;
+        for (size_t c = 0; c < this->staging.size(); c++) {
+            const std::vector<ChunkBlock>& blocks = this->staging[c];
+            for (size_t first = 0; first < blocks.size(); first += CHUNK_MAX_BLOCKS) {
+                ChunkDraw d;
+                d.x0 = this->bounds[c * 4];
+                d.y0 = this->bounds[c * 4 + 1];
+                d.x1 = this->bounds[c * 4 + 2];
+                d.y1 = this->bounds[c * 4 + 3];
+                d.firstBlock = (int)(all.size() + first);
+                d.blocks = (int)(blocks.size() - first < CHUNK_MAX_BLOCKS ? blocks.size() - first : CHUNK_MAX_BLOCKS);
+                this->draws.push_back(d);
+            }
+            all.insert(all.end(), blocks.begin(), blocks.end());
+        }
+        this->staging.clear();
+        this->bounds.clear();
+        this->blockCount = (int)all.size();
+        this->builds++;
+        if ((long long)all.size() * 2 > this->maxTexels) {
+            printf("ERRO: %d blocos nao cabem no buffer de textura (%d texels); chunks desligados\n", this->blockCount, this->maxTexels);
+            this->ready = false;
+            return false;
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, this->blockBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, all.size() * sizeof(ChunkBlock), all.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        if (this->indirectSupported) {
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->indirectBuffer);
+            glBufferData(GL_DRAW_INDIRECT_BUFFER, this->draws.size() * sizeof(DrawElementsIndirectCommand), NULL, GL_STREAM_DRAW);
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        }
+        this->counts.assign(this->draws.size(), 0);
+        this->offsets.assign(this->draws.size(), (const void*)0);
+        this->baseVertices.assign(this->draws.size(), 0);
+        this->ready = true;
+        return true;
+    }
+
+    // Desenha os chunks cuja caixa, deslocada pela camera, toca o retangulo x0..y1 (NDC).
+    // O tileset deve estar ligado na unidade 0. Retorna o numero de comandos.
+    int draw(float cameraX, float cameraY, float x0, float y0, float x1, float y1) {
+        if (!this->ready || this->draws.empty()) return 0;
+        DrawElementsIndirectCommand* commands = NULL;
+        if (this->indirect) {
+            // Invalidar o buffer inteiro deixa o driver trocar a memoria em vez de esperar a GPU.
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, this->indirectBuffer);
+            commands = (DrawElementsIndirectCommand*)glMapBufferRange(GL_DRAW_INDIRECT_BUFFER, 0,
+                this->draws.size() * sizeof(DrawElementsIndirectCommand), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+            if (commands == NULL) {
+                printf("ERRO: Não foi possível mapear o buffer de comandos indiretos\n");
+                glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+                return 0;
+            }
+        }
+        int n = 0, blocks = 0;
+        for (size_t i = 0; i < this->draws.size(); i++) {
+            const ChunkDraw& d = this->draws[i];
+            if (d.x1 + cameraX < x0 || d.x0 + cameraX > x1 || d.y1 + cameraY < y0 || d.y0 + cameraY > y1) continue;
+            if (commands) {
+                DrawElementsIndirectCommand& c = commands[n];
+                c.count = (GLuint)d.blocks * 18;
+                c.instanceCount = 1;
+                c.firstIndex = 0;
+                c.baseVertex = d.firstBlock * 12;
+                c.baseInstance = 0;
+            } else {
+                this->counts[n] = d.blocks * 18;
+                this->baseVertices[n] = d.firstBlock * 12;
+            }
+            n++;
+            blocks += d.blocks;
+        }
+        // Conteudo perdido no unmap (raro, troca de modo de video): pula o frame.
+        if (commands && glUnmapBuffer(GL_DRAW_INDIRECT_BUFFER) == GL_FALSE) n = 0;
+        if (n > 0) {
+            glUseProgram(this->program);
+            glUniform2f(glGetUniformLocation(this->program, "camera"), cameraX, cameraY);
+            glActiveTexture(GL_TEXTURE1);
+            glBindTexture(GL_TEXTURE_BUFFER, this->blockTexture);
+            glActiveTexture(GL_TEXTURE0);
+            glBindVertexArray(this->vao);
+            if (this->indirect) {
+                this->multiDrawIndirect(GL_TRIANGLES, GL_UNSIGNED_SHORT, (void*)0, n, 0);
+            } else {
+                glMultiDrawElementsBaseVertex(GL_TRIANGLES, this->counts.data(), GL_UNSIGNED_SHORT, this->offsets.data(), n, this->baseVertices.data());
+            }
+            glBindVertexArray(0);
+        }
+        if (this->indirect) glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+        this->lastCommands = n;
+        this->lastBlocks = blocks;
+        this->frames++;
+        this->commandsTotal += n;
+        return n;
+    }
+
+    int getLastCommands() {
+        return this->lastCommands;
+    }
+
+    int getLastBlocks() {
+        return this->lastBlocks;
+    }
+
+    int getCommandCapacity() {
+        return (int)this->draws.size();
+    }
+
+    size_t getBytes() {
+        return (size_t)this->blockCount * sizeof(ChunkBlock) + this->draws.size() * sizeof(DrawElementsIndirectCommand);
+    }
+
+    void printStats() {
+        printf("chunks: %lld builds, %d blocos em %d comandos (%.2f MB), %.1f comandos por frame, %s\n", this->builds,
+            this->blockCount, (int)this->draws.size(), this->getBytes() / (1024.0 * 1024.0),
+            this->frames ? (double)this->commandsTotal / this->frames : 0.0,
+            this->indirect ? "glMultiDrawElementsIndirect" : "glMultiDrawElementsBaseVertex");
+    }
+};
+
+#endif
@@ -0,0 +1,558 @@
+#ifndef FrameGraph_h
+#define FrameGraph_h
+
+#include <stdio.h>
+#include <functional>
+#include <vector>
+
+#include <glad/glad.h>
+
+#define FG_MAX_COLOR 4
+#define FG_POOL_KEEP_FRAMES 60
+
+struct FgTextureDesc {
+    int width, height;
+    GLenum format;
+    int samples;
+};
+
+struct FgResource {
+    const char* name;
+    FgTextureDesc desc;
+    bool imported;
+    bool output;
+    GLuint importedFbo;
+    int physical;
+    int firstPass, lastPass;
+    int refs;
+    std::vector<int> writers;
+    std::vector<int> readers;
+};
+
+struct FgPass {
+    const char* name;
+    std::function<void()> fn;
+    std::vector<int> reads;
+    std::vector<int> writes;
+    bool keep;
+    bool culled;
+    bool clear;
+    float clearColor[4];
+    int refs;
+};
+
+struct FgPhysicalTexture {
+    FgTextureDesc desc;
+    GLuint texture;
+    bool busy;
+    unsigned long long lastFrame;
+};
+
+struct FgFramebuffer {
+    GLuint attachments[FG_MAX_COLOR + 1];
+    GLuint fbo;
+    unsigned long long lastFrame;
+};
+
+// Grafo do frame: cada passe declara o que le e o que escreve, e o grafo e compilado de
+// novo a cada frame. Passes cujo resultado ninguem le sao descartados (a menos que
+// escrevam numa saida, como a tela, ou estejam marcados com keep); os demais sao
+// ordenados pelas dependencias. Texturas transientes vivem do primeiro ao ultimo passe
+// que as usa; duas com o mesmo formato e vidas disjuntas dividem a mesma textura do pool.
+// O pool e os framebuffers montados sobrevivem entre frames e so saem depois de
+// FG_POOL_KEEP_FRAMES frames sem uso. Um passe recebe ligado o framebuffer do que
+// escreve e deve deixa-lo ligado ao terminar.
+class FrameGraph {
+    std::vector<FgResource> resources;
+    std::vector<FgPass> passes;
+    std::vector<int> order;
+    std::vector<FgPhysicalTexture> pool;
+    std::vector<FgFramebuffer> framebuffers;
+    unsigned long long frame;
+    GLuint bound;
+    bool compiled;
+    // Ultimo frame compilado e acumulados.
+    int lastCulled;
+    size_t lastRequested, lastPhysical;
+    unsigned long long frames, passesDeclared, passesCulled, binds, bindsSkipped, texturesCreated;
+    double savedTotal;
+
+    static bool isDepth(GLenum format) {
+        return format == GL_DEPTH_COMPONENT24 || format == GL_DEPTH_COMPONENT32F || format == GL_DEPTH24_STENCIL8;
+    }
+
+    static int bytesPerPixel(GLenum format) {
+        switch (format) {
+        case GL_R8: return 1;
+        case GL_RG8: return 2;
+        case GL_RGBA16F: return 8;
+        case GL_RGBA32F: return 16;
+        default: return 4;
+        }
+    }
+
+    static bool sameDesc(const FgTextureDesc& a, const FgTextureDesc& b) {
+        return a.width == b.width && a.height == b.height && a.format == b.format && a.samples == b.samples;
+    }
+
+    static size_t bytesOf(const FgTextureDesc& d) {
+        return (size_t)d.width * d.height * d.samples * bytesPerPixel(d.format);
+    }
+
+    GLuint createTexture(const FgTextureDesc& d) {
+        GLuint texture;
+        glGenTextures(1, &texture);
+        if (d.samples > 1) {
+            glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, texture);
+            glTexImage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, d.samples, d.format, d.width, d.height, GL_TRUE);
+            glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+        } else {
+            GLenum external = GL_RGBA, type = GL_UNSIGNED_BYTE;
+            if (isDepth(d.format)) {
+                external = d.format == GL_DEPTH24_STENCIL8 ? GL_DEPTH_STENCIL : GL_DEPTH_COMPONENT;
+                type = d.format == GL_DEPTH24_STENCIL8 ? GL_UNSIGNED_INT_24_8 : (d.format == GL_DEPTH_COMPONENT32F ? GL_FLOAT : GL_UNSIGNED_INT);
+            } else if (d.format == GL_R8) {
+                external = GL_RED;
+            } else if (d.format == GL_RG8) {
+                external = GL_RG;
+            } else if (d.format == GL_RGBA16F || d.format == GL_RGBA32F) {
+                type = GL_FLOAT;
+            }
+            GLint filter = isDepth(d.format) ? GL_NEAREST : GL_LINEAR;
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, d.format, d.width, d.height, 0, external, type, NULL);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        }
+        this->texturesCreated++;
+        return texture;
+    }
+
+    int acquire(const FgTextureDesc& d) {
+        for (size_t i = 0; i < this->pool.size(); i++) {
+            if (!this->pool[i].busy && sameDesc(this->pool[i].desc, d)) {
+                this->pool[i].busy = true;
+                this->pool[i].lastFrame = this->frame;
+                return (int)i;
+            }
+        }
+        FgPhysicalTexture t;
+        t.desc = d;
+        t.texture = this->createTexture(d);
+        t.busy = true;
+        t.lastFrame = this->frame;
+        this->pool.push_back(t);
+        return (int)this->pool.size() - 1;
+    }
+
+    // Framebuffer com essas texturas presas (cores na ordem, profundidade no fim).
+    GLuint framebufferFor(const GLuint* attachments) {
+        for (size_t i = 0; i < this->framebuffers.size(); i++) {
+            FgFramebuffer& f = this->framebuffers[i];
+            bool same = true;
+            for (int a = 0; a <= FG_MAX_COLOR && same; a++) same = f.attachments[a] == attachments[a];
+            if (same) {
+                f.lastFrame = this->frame;
+                return f.fbo;
+            }
+        }
+        FgFramebuffer f;
+        for (int a = 0; a <= FG_MAX_COLOR; a++) f.attachments[a] = attachments[a];
+        f.lastFrame = this->frame;
+        glGenFramebuffers(1, &f.fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, f.fbo);
+        this->bound = f.fbo;
+        GLenum buffers[FG_MAX_COLOR];
+        int colors = 0;
+        for (int a = 0; a <= FG_MAX_COLOR; a++) {
+            if (attachments[a] == 0) continue;
+            const FgPhysicalTexture* t = NULL;
+            for (size_t i = 0; i < this->pool.size(); i++) {
+                if (this->pool[i].texture == attachments[a]) t = &this->pool[i];
+            }
+            GLenum target = t->desc.samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+            if (a == FG_MAX_COLOR) {
+                GLenum point = t->desc.format == GL_DEPTH24_STENCIL8 ? GL_DEPTH_STENCIL_ATTACHMENT : GL_DEPTH_ATTACHMENT;
+                glFramebufferTexture2D(GL_FRAMEBUFFER, point, target, attachments[a], 0);
+            } else {
+                glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + colors, target, attachments[a], 0);
+                buffers[colors] = GL_COLOR_ATTACHMENT0 + colors;
+                colors++;
+            }
+        }
+        if (colors > 0) glDrawBuffers(colors, buffers);
+        else glDrawBuffer(GL_NONE);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            printf("ERRO: framebuffer do grafo incompleto\n");
+        }
+        this->framebuffers.push_back(f);
+        return f.fbo;
+    }
+
+    void bind(GLuint fbo) {
+        if (fbo == this->bound) {
+            this->bindsSkipped++;
+            return;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        this->bound = fbo;
+        this->binds++;
+    }
+
+    // Texturas e framebuffers parados ha FG_POOL_KEEP_FRAMES frames (tamanho ou modo antigo).
+    void trim() {
+        for (size_t i = 0; i < this->pool.size();) {
+            if (this->frame - this->pool[i].lastFrame <= FG_POOL_KEEP_FRAMES) {
+                i++;
+                continue;
+            }
+            GLuint texture = this->pool[i].texture;
+            for (size_t f = 0; f < this->framebuffers.size();) {
+                bool uses = false;
+                for (int a = 0; a <= FG_MAX_COLOR; a++) uses = uses || this->framebuffers[f].attachments[a] == texture;
+                if (!uses) {
+                    f++;
+                    continue;
+                }
+                glDeleteFramebuffers(1, &this->framebuffers[f].fbo);
+                this->framebuffers.erase(this->framebuffers.begin() + f);
+            }
+            glDeleteTextures(1, &texture);
+            this->pool.erase(this->pool.begin() + i);
+        }
+    }
+
+    // Descarte a partir dos recursos que ninguem le: o passe que os escreve perde uma
+    // referencia e, sem nenhuma, deixa de ler o que lia.
+    void cull() {
+        std::vector<int> stack;
+        for (size_t r = 0; r < this->resources.size(); r++) {
+            FgResource& res = this->resources[r];
+            res.refs = (int)res.readers.size() + (res.output ? 1 : 0);
+            if (res.refs == 0) stack.push_back((int)r);
+        }
+        for (size_t p = 0; p < this->passes.size(); p++) {
+            FgPass& pass = this->passes[p];
+            pass.refs = (int)pass.writes.size() + (pass.keep ? 1 : 0);
+            pass.culled = false;
+        }
+        for (size_t p = 0; p < this->passes.size(); p++) {
+            if (this->passes[p].refs == 0) this->release((int)p, stack);
+        }
+        while (!stack.empty()) {
+            int r = stack.back();
+            stack.pop_back();
+            const std::vector<int>& writers = this->resources[r].writers;
+            for (size_t w = 0; w < writers.size(); w++) {
+                FgPass& pass = this->passes[writers[w]];
+                if (pass.culled) continue;
+                if (--pass.refs == 0) this->release(writers[w], stack);
+            }
+        }
+    }
+
+    void release(int p, std::vector<int>& stack) {
+        FgPass& pass = this->passes[p];
+        pass.culled = true;
+        this->lastCulled++;
+        for (size_t i = 0; i < pass.reads.size(); i++) {
+            if (--this->resources[pass.reads[i]].refs == 0) stack.push_back(pass.reads[i]);
+        }
+    }
+
+    // Ordem topologica estavel: quem le depende de todos que escrevem o recurso, e quem
+    // escreve um recurso ja escrito vem depois do escritor anterior.
+    bool sort() {
+        int count = (int)this->passes.size();
+        std::vector<std::vector<int> > next(count);
+        std::vector<int> pending(count, 0);
+        for (size_t r = 0; r < this->resources.size(); r++) {
+            const FgResource& res = this->resources[r];
+            for (size_t w = 0; w < res.writers.size(); w++) {
+                int writer = res.writers[w];
+                if (this->passes[writer].culled) continue;
+                for (size_t k = 0; k < res.readers.size(); k++) {
+                    int reader = res.readers[k];
+                    if (reader == writer || this->passes[reader].culled) continue;
+                    next[writer].push_back(reader);
+                    pending[reader]++;
+                }
+                if (w + 1 < res.writers.size() && !this->passes[res.writers[w + 1]].culled) {
+                    next[writer].push_back(res.writers[w + 1]);
+                    pending[res.writers[w + 1]]++;
+                }
+            }
+        }
+        this->order.clear();
+        std::vector<bool> done(count, false);
+        int alive = 0;
+        for (int p = 0; p < count; p++) alive += this->passes[p].culled ? 0 : 1;
+        while ((int)this->order.size() < alive) {
+            int pick = -1;
+            for (int p = 0; p < count && pick < 0; p++) {
+                if (!done[p] && !this->passes[p].culled && pending[p] == 0) pick = p;
+            }
+            if (pick < 0) break;
+            done[pick] = true;
+            this->order.push_back(pick);
+            for (size_t n = 0; n < next[pick].size(); n++) pending[next[pick][n]]--;
+        }
+        if ((int)this->order.size() == alive) return true;
+        printf("ERRO: ciclo no grafo do frame; usando a ordem de declaracao\n");
+        this->order.clear();
+        for (int p = 0; p < count; p++) {
+            if (!this->passes[p].culled) this->order.push_back(p);
+        }
+        return false;
+    }
+
+    // Vida de cada transiente na ordem final e texturas do pool para cada um.
+    void alias() {
+        for (size_t r = 0; r < this->resources.size(); r++) {
+            this->resources[r].firstPass = -1;
+            this->resources[r].lastPass = -1;
+            this->resources[r].physical = -1;
+        }
+        for (size_t i = 0; i < this->order.size(); i++) {
+            const FgPass& pass = this->passes[this->order[i]];
+            for (int k = 0; k < 2; k++) {
+                const std::vector<int>& list = k == 0 ? pass.reads : pass.writes;
+                for (size_t j = 0; j < list.size(); j++) {
+                    FgResource& res = this->resources[list[j]];
+                    if (res.firstPass < 0) res.firstPass = (int)i;
+                    res.lastPass = (int)i;
+                }
+            }
+        }
+        for (size_t t = 0; t < this->pool.size(); t++) this->pool[t].busy = false;
+        this->lastRequested = this->lastPhysical = 0;
+        for (size_t i = 0; i < this->order.size(); i++) {
+            for (size_t r = 0; r < this->resources.size(); r++) {
+                FgResource& res = this->resources[r];
+                if (res.imported || res.firstPass != (int)i) continue;
+                res.physical = this->acquire(res.desc);
+                this->lastRequested += bytesOf(res.desc);
+            }
+            for (size_t r = 0; r < this->resources.size(); r++) {
+                FgResource& res = this->resources[r];
+                if (!res.imported && res.lastPass == (int)i) this->pool[res.physical].busy = false;
+            }
+        }
+        for (size_t t = 0; t < this->pool.size(); t++) {
+            if (this->pool[t].lastFrame == this->frame) this->lastPhysical += bytesOf(this->pool[t].desc);
+        }
+    }
+
+public:
+    FrameGraph() {
+        this->frame = 0;
+        this->bound = 0;
+        this->compiled = false;
+        this->lastCulled = 0;
+        this->lastRequested = this->lastPhysical = 0;
+        this->frames = this->passesDeclared = this->passesCulled = 0;
+        this->binds = this->bindsSkipped = this->texturesCreated = 0;
+        this->savedTotal = 0.0;
+    }
+
+    ~FrameGraph() {
+        for (size_t f = 0; f < this->framebuffers.size(); f++) glDeleteFramebuffers(1, &this->framebuffers[f].fbo);
+        for (size_t t = 0; t < this->pool.size(); t++) glDeleteTextures(1, &this->pool[t].texture);
+    }
+
+    // Comeca a declaracao de um frame novo; os ids do frame anterior deixam de valer.
+    void beginFrame() {
+        this->resources.clear();
+        this->passes.clear();
+        this->order.clear();
+        this->compiled = false;
+        this->frame++;
+    }
+
+    // Textura que so existe durante o frame; samples > 1 e multisample.
+    int createTexture(const char* name, int width, int height, GLenum format, int samples = 1) {
+        FgResource res;
+        res.name = name;
+        res.desc.width = width;
+        res.desc.height = height;
+        res.desc.format = format;
+        res.desc.samples = samples < 1 ? 1 : samples;
+        res.imported = false;
+        res.output = false;
+        res.importedFbo = 0;
+        res.physical = -1;
+        res.firstPass = res.lastPass = -1;
+        res.refs = 0;
+        this->resources.push_back(res);
+        return (int)this->resources.size() - 1;
+    }
+
+    // Framebuffer de fora do grafo (a tela e 0). output: o resultado e consumido fora do
+    // frame (tela, captura) e quem escreve nele nunca e descartado.
+    int importFramebuffer(const char* name, GLuint fbo, int width, int height, bool output) {
+        int r = this->createTexture(name, width, height, GL_RGBA8);
+        this->resources[r].imported = true;
+        this->resources[r].output = output;
+        this->resources[r].importedFbo = fbo;
+        return r;
+    }
+
+    int addPass(const char* name, std::function<void()> fn) {
+        FgPass pass;
+        pass.name = name;
+        pass.fn = fn;
+        pass.keep = pass.culled = pass.clear = false;
+        pass.refs = 0;
+        this->passes.push_back(pass);
+        return (int)this->passes.size() - 1;
+    }
+
+    void read(int pass, int resource) {
+        this->passes[pass].reads.push_back(resource);
+        this->resources[resource].readers.push_back(pass);
+    }
+
+    void write(int pass, int resource) {
+        this->passes[pass].writes.push_back(resource);
+        this->resources[resource].writers.push_back(pass);
+    }
+
+    // Passe com efeito fora do grafo (leitura para a CPU, contadores): nunca descartado.
+    void keep(int pass) {
+        this->passes[pass].keep = true;
+    }
+
+    // Limpa o que o passe escreve (cor e profundidade) antes de rodar.
+    void setClear(int pass, float r, float g, float b, float a) {
+        FgPass& p = this->passes[pass];
+        p.clear = true;
+        p.clearColor[0] = r;
+        p.clearColor[1] = g;
+        p.clearColor[2] = b;
+        p.clearColor[3] = a;
+    }
+
+    void compile() {
+        this->lastCulled = 0;
+        this->cull();
+        this->sort();
+        // Antes do aliasing: apagar do pool muda os indices que ele distribui.
+        this->trim();
+        this->alias();
+        this->compiled = true;
+        this->frames++;
+        this->passesDeclared += this->passes.size();
+        this->passesCulled += this->lastCulled;
+        this->savedTotal += (double)(this->lastRequested - this->lastPhysical);
+    }
+
+    void execute() {
+        if (!this->compiled) this->compile();
+        // Algum passe de fora do grafo pode ter trocado o framebuffer desde o frame anterior.
+        GLint current;
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &current);
+        this->bound = (GLuint)current;
+        for (size_t i = 0; i < this->order.size(); i++) {
+            FgPass& pass = this->passes[this->order[i]];
+            GLuint attachments[FG_MAX_COLOR + 1] = { 0 };
+            int colors = 0, width = 0, height = 0;
+            bool depth = false, target = false;
+            GLuint fbo = 0;
+            for (size_t w = 0; w < pass.writes.size(); w++) {
+                const FgResource& res = this->resources[pass.writes[w]];
+                if (width == 0) {
+                    width = res.desc.width;
+                    height = res.desc.height;
+                }
+                target = true;
+                if (res.imported) {
+                    fbo = res.importedFbo;
+                    depth = true;
+                } else if (isDepth(res.desc.format)) {
+                    attachments[FG_MAX_COLOR] = this->pool[res.physical].texture;
+                    depth = true;
+                } else if (colors < FG_MAX_COLOR) {
+                    attachments[colors++] = this->pool[res.physical].texture;
+                }
+            }
+            if (target) {
+                bool transient = colors > 0 || attachments[FG_MAX_COLOR] != 0;
+                this->bind(transient ? this->framebufferFor(attachments) : fbo);
+                glViewport(0, 0, width, height);
+            }
+            if (pass.clear) {
+                glClearColor(pass.clearColor[0], pass.clearColor[1], pass.clearColor[2], pass.clearColor[3]);
+                glClear(GL_COLOR_BUFFER_BIT | (depth ? GL_DEPTH_BUFFER_BIT : 0));
+            }
+            pass.fn();
+        }
+    }
+
+    GLuint getTexture(int resource) {
+        const FgResource& res = this->resources[resource];
+        return res.imported || res.physical < 0 ? 0 : this->pool[res.physical].texture;
+    }
+
+    // Framebuffer que contem so o recurso (para glBlitFramebuffer a partir dele).
+    GLuint getFramebuffer(int resource) {
+        const FgResource& res = this->resources[resource];
+        if (res.imported) return res.importedFbo;
+        GLuint attachments[FG_MAX_COLOR + 1] = { 0 };
+        attachments[isDepth(res.desc.format) ? FG_MAX_COLOR : 0] = this->pool[res.physical].texture;
+        GLuint previous = this->bound;
+        GLuint fbo = this->framebufferFor(attachments);
+        this->bind(previous);
+        return fbo;
+    }
+
+    int getCulledCount() {
+        return this->lastCulled;
+    }
+
+    // Bytes que as transientes do ultimo frame ocupariam cada uma na sua textura e o que
+    // de fato ocupam no pool.
+    size_t getRequestedBytes() {
+        return this->lastRequested;
+    }
+
+    size_t getPhysicalBytes() {
+        return this->lastPhysical;
+    }
+
+    size_t getPoolBytes() {
+        size_t total = 0;
+        for (size_t t = 0; t < this->pool.size(); t++) total += bytesOf(this->pool[t].desc);
+        return total;
+    }
+
+    // Ordem, passes descartados e a textura do pool de cada transiente no ultimo frame.
+    void printPlan() {
+        for (size_t p = 0; p < this->passes.size(); p++) {
+            if (this->passes[p].culled) printf("  descartado: %s\n", this->passes[p].name);
+        }
+        for (size_t i = 0; i < this->order.size(); i++) {
+            const FgPass& pass = this->passes[this->order[i]];
+            printf("  %2d %-18s escreve", (int)i, pass.name);
+            for (size_t w = 0; w < pass.writes.size(); w++) {
+                const FgResource& res = this->resources[pass.writes[w]];
+                if (res.imported) printf(" %s", res.name);
+                else printf(" %s[#%d]", res.name, res.physical);
+            }
+            printf("\n");
+        }
+    }
+
+    void printStats() {
+        printf("grafo do frame: %llu frames, %.1f passes por frame, %.1f descartados, %llu binds (%llu evitados), "
+            "%llu texturas criadas, pool %.1f MB, %.1f MB economizados por frame pelo aliasing\n",
+            this->frames, this->frames ? (double)this->passesDeclared / this->frames : 0.0,
+            this->frames ? (double)this->passesCulled / this->frames : 0.0, this->binds, this->bindsSkipped,
+            this->texturesCreated, this->getPoolBytes() / (1024.0 * 1024.0),
+            this->frames ? this->savedTotal / this->frames / (1024.0 * 1024.0) : 0.0);
+    }
+};
+
+#endif
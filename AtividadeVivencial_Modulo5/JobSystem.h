@@ -0,0 +1,383 @@
+#ifndef JobSystem_h
+#define JobSystem_h
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define JOB_PRIORITY_HIGH 0
+#define JOB_PRIORITY_NORMAL 1
+#define JOB_PRIORITY_LOW 2
+#define JOB_PRIORITY_COUNT 3
+
+// Uma tarefa so entra na fila quando todas as dependencias terminaram. "pending" conta
+// as dependencias ainda abertas mais 1, que e liberado por submit().
+struct Job {
+    std::function<void()> fn;
+    int priority;
+    std::atomic<int> pending;
+    std::mutex lock;
+    bool finished;
+    std::vector<std::shared_ptr<Job> > continuations;
+
+    Job() : priority(JOB_PRIORITY_NORMAL), pending(1), finished(false) {}
+};
+
+typedef std::shared_ptr<Job> JobHandle;
+
+struct JobStats {
+    unsigned long long executed;
+    unsigned long long steals;
+    unsigned long long stealAttempts;
+    int queued[JOB_PRIORITY_COUNT];
+    int maxQueued;
+};
+
+// Pool de threads com roubo de trabalho: cada worker tem um deque por prioridade, consome
+// o seu pelo fim (LIFO, melhor para cache) e rouba dos outros pelo inicio. Tarefas
+// criadas fora dos workers vao para uma fila global.
+class JobSystem {
+    struct WorkerQueue {
+        std::mutex lock;
+        std::deque<JobHandle> jobs[JOB_PRIORITY_COUNT];
+    };
+
+    std::vector<std::thread> threads;
+    std::vector<WorkerQueue*> queues;
+    WorkerQueue global;
+    std::mutex sleepLock;
+    std::condition_variable wake;
+    std::atomic<bool> running;
+    std::atomic<int> queued[JOB_PRIORITY_COUNT];
+    std::atomic<int> maxQueued;
+    std::atomic<unsigned long long> executed;
+    std::atomic<unsigned long long> steals;
+    std::atomic<unsigned long long> stealAttempts;
+
+    static int& workerIndex() {
+        static thread_local int index = -1;
+        return index;
+    }
+
+    void enqueue(const JobHandle& job) {
+        int w = workerIndex();
+        WorkerQueue* q = w >= 0 ? this->queues[w] : &this->global;
+        {
+            std::lock_guard<std::mutex> guard(q->lock);
+            q->jobs[job->priority].push_back(job);
+        }
+        int depth = ++this->queued[job->priority];
+        for (int p = 0; p < JOB_PRIORITY_COUNT; p++) {
+            if (p != job->priority) depth += this->queued[p].load();
+        }
+        int prev = this->maxQueued.load();
+        while (depth > prev && !this->maxQueued.compare_exchange_weak(prev, depth)) {}
+        std::lock_guard<std::mutex> guard(this->sleepLock);
+        this->wake.notify_one();
+    }
+
+    bool popFrom(WorkerQueue* q, int priority, bool back, JobHandle& out) {
+        std::lock_guard<std::mutex> guard(q->lock);
+        std::deque<JobHandle>& d = q->jobs[priority];
+        if (d.empty()) return false;
+        if (back) {
+            out = d.back();
+            d.pop_back();
+        } else {
+            out = d.front();
+            d.pop_front();
+        }
+        this->queued[priority]--;
+        return true;
+    }
+
+    bool findJob(JobHandle& out) {
+        int w = workerIndex();
+        int n = (int)this->queues.size();
+        for (int p = 0; p < JOB_PRIORITY_COUNT; p++) {
+            if (this->queued[p].load() == 0) continue;
+            if (w >= 0 && this->popFrom(this->queues[w], p, true, out)) return true;
+            if (this->popFrom(&this->global, p, false, out)) return true;
+            for (int k = 1; k <= n; k++) {
+                int victim = ((w < 0 ? 0 : w) + k) % n;
+                if (victim == w) continue;
+                this->stealAttempts++;
+                if (this->popFrom(this->queues[victim], p, false, out)) {
+                    this->steals++;
+                    return true;
+                }
+            }
+        }
+        return false;
+    }
+
+    void execute(const JobHandle& job) {
+        if (job->fn) job->fn();
+        this->executed++;
+        std::vector<JobHandle> ready;
+        {
+            std::lock_guard<std::mutex> guard(job->lock);
+            job->finished = true;
+            ready.swap(job->continuations);
+        }
+        for (size_t i = 0; i < ready.size(); i++) {
+            if (--ready[i]->pending == 0) this->enqueue(ready[i]);
+        }
+    }
+
+    bool hasWork() {
+        for (int p = 0; p < JOB_PRIORITY_COUNT; p++) {
+            if (this->queued[p].load() > 0) return true;
+        }
+        return false;
+    }
+
+    void workerLoop(int index) {
+        workerIndex() = index;
+        while (this->running.load()) {
+            JobHandle job;
+            if (this->findJob(job)) {
+                this->execute(job);
+                continue;
+            }
+            std::unique_lock<std::mutex> guard(this->sleepLock);
+            this->wake.wait_for(guard, std::chrono::milliseconds(10), [this]() {
+                return !this->running.load() || this->hasWork();
+            });
+        }
+    }
+
+public:
+    // threads <= 0 usa o numero de nucleos menos um (a thread principal tambem ajuda em wait()).
+    JobSystem(int numThreads = 0) : running(true), maxQueued(0), executed(0), steals(0), stealAttempts(0) {
+        if (numThreads <= 0) {
+            numThreads = (int)std::thread::hardware_concurrency() - 1;
+            if (numThreads < 1) numThreads = 1;
+        }
+        for (int p = 0; p < JOB_PRIORITY_COUNT; p++) this->queued[p] = 0;
+        for (int i = 0; i < numThreads; i++) this->queues.push_back(new WorkerQueue());
+        for (int i = 0; i < numThreads; i++) this->threads.push_back(std::thread(&JobSystem::workerLoop, this, i));
+    }
+
+    ~JobSystem() {
+        this->running.store(false);
+        {
+            std::lock_guard<std::mutex> guard(this->sleepLock);
+            this->wake.notify_all();
+        }
+        for (size_t i = 0; i < this->threads.size(); i++) this->threads[i].join();
+        for (size_t i = 0; i < this->queues.size(); i++) delete this->queues[i];
+    }
+
+    int getThreadCount() {
+        return (int)this->threads.size();
+    }
+
+    JobHandle create(std::function<void()> fn, int priority = JOB_PRIORITY_NORMAL) {
+        JobHandle job = std::make_shared<Job>();
+        job->fn = fn;
+        job->priority = priority < 0 ? 0 : (priority >= JOB_PRIORITY_COUNT ? JOB_PRIORITY_COUNT - 1 : priority);
+        return job;
+    }
+
+    // job so roda depois de dep terminar. Deve ser chamado antes de submit(job).
+    void dependsOn(const JobHandle& job, const JobHandle& dep) {
+        std::lock_guard<std::mutex> guard(dep->lock);
+        if (dep->finished) return;
+        job->pending++;
+        dep->continuations.push_back(job);
+    }
+
+    void submit(const JobHandle& job) {
+        if (--job->pending == 0) this->enqueue(job);
+    }
+
+    JobHandle run(std::function<void()> fn, int priority = JOB_PRIORITY_NORMAL) {
+        JobHandle job = this->create(fn, priority);
+        this->submit(job);
+        return job;
+    }
+
+    JobHandle run(std::function<void()> fn, const std::vector<JobHandle>& deps, int priority = JOB_PRIORITY_NORMAL) {
+        JobHandle job = this->create(fn, priority);
+        for (size_t i = 0; i < deps.size(); i++) this->dependsOn(job, deps[i]);
+        this->submit(job);
+        return job;
+    }
+
+    // Continuacao: roda fn assim que parent terminar.
+    JobHandle then(const JobHandle& parent, std::function<void()> fn, int priority = JOB_PRIORITY_NORMAL) {
+        JobHandle job = this->create(fn, priority);
+        this->dependsOn(job, parent);
+        this->submit(job);
+        return job;
+    }
+
+    bool isFinished(const JobHandle& job) {
+        std::lock_guard<std::mutex> guard(job->lock);
+        return job->finished;
+    }
+
+    // Espera ajudando: enquanto job nao termina, a thread chamadora executa outras tarefas.
+    void wait(const JobHandle& job) {
+        while (!this->isFinished(job)) {
+            JobHandle other;
+            if (this->findJob(other)) this->execute(other);
+            else std::this_thread::yield();
+        }
+    }
+
+    // Divide [begin, end) em blocos de ate grain elementos e espera todos terminarem.
+    void parallelFor(int begin, int end, int grain, std::function<void(int, int)> fn, int priority = JOB_PRIORITY_HIGH) {
+        if (end <= begin) return;
+        if (grain < 1) grain = 1;
+        if (end - begin <= grain) {
+            fn(begin, end);
+            return;
+        }
+        JobHandle done = this->create(std::function<void()>(), priority);
+        for (int b = begin; b < end; b += grain) {
+            int e = b + grain < end ? b + grain : end;
+            JobHandle part = this->create([fn, b, e]() { fn(b, e); }, priority);
+            this->dependsOn(done, part);
+            this->submit(part);
+        }
+        this->submit(done);
+        this->wait(done);
+    }
+
+    JobStats getStats() {
+        JobStats s;
+        s.executed = this->executed.load();
+        s.steals = this->steals.load();
+        s.stealAttempts = this->stealAttempts.load();
+        for (int p = 0; p < JOB_PRIORITY_COUNT; p++) s.queued[p] = this->queued[p].load();
+        s.maxQueued = this->maxQueued.load();
+        return s;
+    }
+
+    void printStats(FILE* out = stdout) {
+        JobStats s = this->getStats();
+        fprintf(out, "jobs: %d threads, %llu executadas, %llu roubos (%llu tentativas), fila alta/normal/baixa %d/%d/%d, pico %d\n",
+            this->getThreadCount(), s.executed, s.steals, s.stealAttempts,
+            s.queued[0], s.queued[1], s.queued[2], s.maxQueued);
+    }
+};
+
+struct MainTask {
+    std::function<void()> fn;
+    double estimate;
+};
+
+// Fila de tarefas que precisam do contexto GL (uploads, criacao de buffers). Qualquer
+// thread pode postar; a thread principal roda a cada frame so o que cabe no tempo que
+// sobrou do frame. Uma tarefa que ja comecou vai ate o fim: se passar do orcamento,
+// conta como estouro.
+class MainThreadQueue {
+    std::mutex lock;
+    std::deque<MainTask> tasks[JOB_PRIORITY_COUNT];
+    int starvedFrames;
+    unsigned long long executed;
+    unsigned long long overruns;
+    unsigned long long deferredFrames;
+    double overrunSeconds;
+    int maxDepth;
+    std::function<void()> wakeup;
+
+    static double now() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    bool takeNext(double remaining, bool force, MainTask& out) {
+        std::lock_guard<std::mutex> guard(this->lock);
+        for (int p = 0; p < JOB_PRIORITY_COUNT; p++) {
+            if (this->tasks[p].empty()) continue;
+            if (!force && this->tasks[p].front().estimate > remaining) return false;
+            out = this->tasks[p].front();
+            this->tasks[p].pop_front();
+            return true;
+        }
+        return false;
+    }
+
+public:
+    MainThreadQueue() {
+        this->starvedFrames = 0;
+        this->executed = 0;
+        this->overruns = 0;
+        this->deferredFrames = 0;
+        this->overrunSeconds = 0.0;
+        this->maxDepth = 0;
+    }
+
+    // Chamado (na thread que postou) a cada post, para acordar um laco principal ocioso.
+    void setWakeup(std::function<void()> fn) {
+        this->wakeup = fn;
+    }
+
+    // estimate: custo esperado em segundos, usado para decidir se a tarefa cabe no frame.
+    void post(std::function<void()> fn, double estimate = 0.0, int priority = JOB_PRIORITY_NORMAL) {
+        {
+            std::lock_guard<std::mutex> guard(this->lock);
+            MainTask t;
+            t.fn = fn;
+            t.estimate = estimate;
+            this->tasks[priority < 0 ? 0 : (priority >= JOB_PRIORITY_COUNT ? JOB_PRIORITY_COUNT - 1 : priority)].push_back(t);
+            int depth = 0;
+            for (int p = 0; p < JOB_PRIORITY_COUNT; p++) depth += (int)this->tasks[p].size();
+            if (depth > this->maxDepth) this->maxDepth = depth;
+        }
+        if (this->wakeup) this->wakeup();
+    }
+
+    int getDepth() {
+        std::lock_guard<std::mutex> guard(this->lock);
+        int depth = 0;
+        for (int p = 0; p < JOB_PRIORITY_COUNT; p++) depth += (int)this->tasks[p].size();
+        return depth;
+    }
+
+    // Roda tarefas ate acabar o orcamento (segundos). Para nao deixar uma tarefa grande
+    // esperando para sempre, depois de alguns frames sem progresso ela roda mesmo sem caber.
+    int run(double budget) {
+        double start = now();
+        double end = start + budget;
+        int count = 0;
+        MainTask t;
+        while (true) {
+            double remaining = end - now();
+            bool force = count == 0 && this->starvedFrames >= 4;
+            if (remaining <= 0.0 && !force) break;
+            if (!this->takeNext(remaining, force, t)) break;
+            t.fn();
+            count++;
+            this->executed++;
+            double after = now();
+            if (after > end) {
+                this->overruns++;
+                this->overrunSeconds += after - end;
+            }
+        }
+        if (count == 0 && this->getDepth() > 0) {
+            this->starvedFrames++;
+            this->deferredFrames++;
+        } else {
+            this->starvedFrames = 0;
+        }
+        return count;
+    }
+
+    void printStats(FILE* out = stdout) {
+        fprintf(out, "fila principal: %llu executadas, %d pendentes (pico %d), %llu estouros de orcamento (%.2f ms no total), %llu frames adiados\n",
+            this->executed, this->getDepth(), this->maxDepth, this->overruns, this->overrunSeconds * 1000.0, this->deferredFrames);
+    }
+};
+
+#endif
@@ -0,0 +1,186 @@
+#ifndef LatencyProbe_h
+#define LatencyProbe_h
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <vector>
+
+#include <glad/glad.h>
+
+#define LATENCY_RING 8
+
+struct LatencyInput {
+    unsigned int seq;
+    double arrival;
+};
+
+// Mede o tempo entre uma entrada e o primeiro frame que a mostra. Cada entrada recebe um
+// numero de sequencia; o jogo chama markApplied quando o estado ja inclui a entrada, e o
+// frame grava o ultimo numero aplicado num pixel marcador (canto inferior esquerdo).
+// O marcador e lido de volta por PBO, sem travar o pipeline, junto com um timestamp de GPU
+// do fim do frame. A apresentacao e estimada como o maior entre o fim do frame na GPU e o
+// retorno do glfwSwapBuffers desse frame: antes disso a imagem nao pode estar na tela.
+class LatencyProbe {
+    GLuint pbo[LATENCY_RING];
+    GLuint query[LATENCY_RING];
+    GLsync fence[LATENCY_RING];
+    double swapReturn[LATENCY_RING];
+    bool inFlight[LATENCY_RING];
+    int head;
+    double gpuToCpu;
+
+    unsigned int nextSeq;
+    unsigned int appliedSeq;
+    std::deque<LatencyInput> pending;
+    std::vector<double> samples;
+
+    static double now() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Le um slot ja terminado: decodifica o marcador e fecha as entradas que ele cobre.
+    void resolve(int slot) {
+        unsigned char px[4] = { 0, 0, 0, 0 };
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, this->pbo[slot]);
+        const unsigned char* p = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 4, GL_MAP_READ_BIT);
+        if (p) {
+            px[0] = p[0];
+            px[1] = p[1];
+            px[2] = p[2];
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        GLuint64 gpuDone = 0;
+        glGetQueryObjectui64v(this->query[slot], GL_QUERY_RESULT, &gpuDone);
+        glDeleteSync(this->fence[slot]);
+        this->inFlight[slot] = false;
+
+        unsigned int seq = px[0] | (px[1] << 8) | (px[2] << 16);
+        double present = std::max((double)gpuDone * 1e-9 + this->gpuToCpu, this->swapReturn[slot]);
+        while (!this->pending.empty() && this->pending.front().seq <= seq) {
+            this->samples.push_back(present - this->pending.front().arrival);
+            this->pending.pop_front();
+        }
+    }
+
+public:
+    LatencyProbe() {
+        glGenBuffers(LATENCY_RING, this->pbo);
+        glGenQueries(LATENCY_RING, this->query);
+        for (int i = 0; i < LATENCY_RING; i++) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, this->pbo[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, 4, NULL, GL_STREAM_READ);
+            this->fence[i] = 0;
+            this->inFlight[i] = false;
+            this->swapReturn[i] = 0.0;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        this->nextSeq = 1;
+        this->appliedSeq = 0;
+        this->head = 0;
+        this->reset();
+    }
+
+    ~LatencyProbe() {
+        for (int i = 0; i < LATENCY_RING; i++) {
+            if (this->inFlight[i]) glDeleteSync(this->fence[i]);
+        }
+        glDeleteBuffers(LATENCY_RING, this->pbo);
+        glDeleteQueries(LATENCY_RING, this->query);
+    }
+
+    // Descarta as amostras e recalibra o relogio da GPU contra o da CPU (chamar entre configuracoes).
+    void reset() {
+        this->flush();
+        this->pending.clear();
+        this->samples.clear();
+        GLint64 gpuNow = 0;
+        glGetInteger64v(GL_TIMESTAMP, &gpuNow);
+        this->gpuToCpu = now() - (double)gpuNow * 1e-9;
+    }
+
+    // Uma entrada chegou no instante arrival (relogio de now()); retorna o numero dela.
+    unsigned int beginInput(double arrival) {
+        LatencyInput in;
+        in.seq = this->nextSeq++ & 0xFFFFFF;
+        in.arrival = arrival;
+        this->pending.push_back(in);
+        return in.seq;
+    }
+
+    void markApplied(unsigned int seq) {
+        this->appliedSeq = seq;
+    }
+
+    // Desenha o marcador e agenda a leitura dele; chamar depois da cena e antes do swap.
+    void endFrame() {
+        int slot = this->head;
+        if (this->inFlight[slot]) {
+            glClientWaitSync(this->fence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+            this->resolve(slot);
+        }
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(0, 0, 1, 1);
+        glClearColor((this->appliedSeq & 0xFF) / 255.0f, ((this->appliedSeq >> 8) & 0xFF) / 255.0f,
+                     ((this->appliedSeq >> 16) & 0xFF) / 255.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glDisable(GL_SCISSOR_TEST);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, this->pbo[slot]);
+        glReadPixels(0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glQueryCounter(this->query[slot], GL_TIMESTAMP);
+        this->fence[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        this->inFlight[slot] = true;
+    }
+
+    // Logo apos glfwSwapBuffers; tambem fecha os slots que a GPU ja terminou.
+    void afterSwap() {
+        this->swapReturn[this->head] = now();
+        this->head = (this->head + 1) % LATENCY_RING;
+        for (int i = 0; i < LATENCY_RING; i++) {
+            int slot = (this->head + i) % LATENCY_RING;
+            if (!this->inFlight[slot]) continue;
+            if (glClientWaitSync(this->fence[slot], 0, 0) == GL_TIMEOUT_EXPIRED) break;
+            this->resolve(slot);
+        }
+    }
+
+    // Espera todos os frames em voo.
+    void flush() {
+        for (int i = 0; i < LATENCY_RING; i++) {
+            int slot = (this->head + i) % LATENCY_RING;
+            if (!this->inFlight[slot]) continue;
+            glClientWaitSync(this->fence[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull);
+            this->resolve(slot);
+        }
+    }
+
+    int getSampleCount() {
+        return (int)this->samples.size();
+    }
+
+    double getTime() {
+        return now();
+    }
+
+    // Uma linha com a distribuicao (ms) das amostras coletadas desde o ultimo reset.
+    void printDistribution(const char* label, FILE* out = stdout) {
+        std::vector<double> s = this->samples;
+        if (s.empty()) {
+            fprintf(out, "%-34s sem amostras\n", label);
+            return;
+        }
+        std::sort(s.begin(), s.end());
+        double sum = 0.0;
+        for (size_t i = 0; i < s.size(); i++) sum += s[i];
+        size_t n = s.size();
+        fprintf(out, "%-34s n=%4d  media %6.2f  p50 %6.2f  p90 %6.2f  p99 %6.2f  max %6.2f ms\n", label, (int)n,
+            sum / n * 1000.0, s[n / 2] * 1000.0, s[n * 9 / 10] * 1000.0, s[std::min(n - 1, n * 99 / 100)] * 1000.0,
+            s[n - 1] * 1000.0);
+    }
+};
+
+#endif
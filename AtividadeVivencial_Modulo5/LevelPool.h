@@ -0,0 +1,440 @@
+#ifndef LevelPool_h
+#define LevelPool_h
+
+#include <stdio.h>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+
+#include "JobSystem.h"
+#include "TileIdRenderer.h"
+#include "TileMap.h"
+#include "TileStack.h"
+
+#define LEVEL_UNLOADED 0
+#define LEVEL_LOADING 1
+#define LEVEL_READY 2
+
+// Um mapa e o que deriva dele (lista de blocos, textura de ids). O tileset e compartilhado.
+struct Level {
+    std::string name, path, tileset;
+    std::vector<std::string> next;
+    std::atomic<int> state;
+    TileMap* map;
+    TileStack* stack;
+    TileIdRenderer* ids;
+    size_t bytes;
+    double lastUsed;
+    JobHandle job;
+};
+
+// Recurso de GPU compartilhado entre niveis (p.ex. a textura do tileset), com contagem de
+// referencias: criado no primeiro acquire e destruido no ultimo release, sempre na thread GL.
+struct SharedResource {
+    std::function<void*()> create;
+    std::function<void(void*)> destroy;
+    void* ptr;
+    int refs;
+};
+
+// Mantem mapas prontos para a troca ser so uma troca de ponteiros. Ao entrar num nivel,
+// os vizinhos dele (levels.txt) sao carregados ao fundo: o parse e a lista de blocos num
+// worker, a textura de ids na MainThreadQueue. Quando a memoria estimada passa do
+// orcamento, os niveis usados ha mais tempo saem primeiro (o atual e o pedido nunca).
+// A troca pedida so acontece em pollSwitch, chamado no limite entre frames; se o nivel
+// ainda nao estiver pronto o jogo segue no atual ate ficar.
+class LevelPool {
+    JobSystem* jobs;
+    MainThreadQueue* queue;
+    GLuint idProgram;
+    size_t budget;
+    std::vector<Level*> levels;
+    std::map<std::string, SharedResource> shared;
+    std::shared_ptr<bool> alive;
+    std::function<void(TileMap*)> prepare;
+    Level* current;
+    Level* pending;
+    double requestedAt;
+    bool pendingWasReady;
+    bool awaitingPresent;
+    bool lastWasReady;
+
+    int switches, warmSwitches, preloads, evictions;
+    double warmTotal, warmMax, coldTotal, coldMax;
+
+    static double now() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Chamado ja com map e stack prontos, na thread GL. Cargas sincronas viram o nivel atual
+    // logo depois, entao so as cargas ao fundo aplicam o orcamento aqui.
+    void finishLoad(Level* l, bool evict) {
+        l->ids = new TileIdRenderer(this->idProgram);
+        l->ids->setMap(l->map);
+        this->acquire(l->tileset);
+        size_t cells = (size_t)l->map->getWidth() * l->map->getHeight();
+        // tiles + elevacao + textura de ids + lista de blocos
+        l->bytes = cells * 3 + l->stack->getBlocks().size() * sizeof(StackBlock);
+        l->lastUsed = now();
+        l->state = LEVEL_READY;
+        if (evict) this->enforceBudget();
+    }
+
+    void unload(Level* l) {
+        delete l->ids;
+        delete l->stack;
+        delete l->map;
+        l->ids = NULL;
+        l->stack = NULL;
+        l->map = NULL;
+        l->bytes = 0;
+        this->release(l->tileset);
+        l->state = LEVEL_UNLOADED;
+    }
+
+    // Na thread GL, quando o parse falhou no worker: o nivel volta a descarregado e uma
+    // troca pedida para ele e cancelada, senao pollSwitch esperaria para sempre.
+    void failLoad(Level* l) {
+        std::cout << "ERRO: falha ao carregar o nivel " << l->name << " (" << l->path << ")" << std::endl;
+        l->state = LEVEL_UNLOADED;
+        if (this->pending == l) this->pending = NULL;
+    }
+
+    void startLoad(Level* l, int priority) {
+        if (l->state != LEVEL_UNLOADED) return;
+        l->state = LEVEL_LOADING;
+        this->preloads++;
+        std::shared_ptr<bool> token = this->alive;
+        MainThreadQueue* q = this->queue;
+        l->job = this->jobs->run([this, l, token, q, priority]() {
+            TileMap* map = readMap(l->path.c_str());
+            if (map == NULL) {
+                q->post([this, l, token]() {
+                    if (*token) this->failLoad(l);
+                }, 0.001, priority);
+                return;
+            }
+            if (this->prepare) this->prepare(map);
+            TileStack* stack = new TileStack(map);
+            // A lista de blocos sai pronta do worker; na troca nao ha rebuild.
+            stack->getBlocks();
+            l->map = map;
+            l->stack = stack;
+            q->post([this, l, token]() {
+                if (*token) this->finishLoad(l, true);
+            }, 0.001, priority);
+        }, priority);
+    }
+
+    bool isProtected(Level* l) {
+        if (l == this->current || l == this->pending) return true;
+        return false;
+    }
+
+    bool isNeighbour(Level* l) {
+        if (this->current == NULL) return false;
+        for (size_t i = 0; i < this->current->next.size(); i++) {
+            if (this->current->next[i] == l->name) return true;
+        }
+        return false;
+    }
+
+    // Despeja por LRU ate caber; vizinhos do nivel atual so saem se nao houver outro jeito.
+    void enforceBudget() {
+        while (this->getMemory() > this->budget) {
+            Level* victim = NULL;
+            for (int pass = 0; pass < 2 && victim == NULL; pass++) {
+                for (size_t i = 0; i < this->levels.size(); i++) {
+                    Level* l = this->levels[i];
+                    if (l->state != LEVEL_READY || this->isProtected(l)) continue;
+                    if (pass == 0 && this->isNeighbour(l)) continue;
+                    if (victim == NULL || l->lastUsed < victim->lastUsed) victim = l;
+                }
+            }
+            if (victim == NULL) return;
+            this->unload(victim);
+            this->evictions++;
+        }
+    }
+
+public:
+    LevelPool(JobSystem* jobs, MainThreadQueue* queue, GLuint idProgram, size_t budget) {
+        this->jobs = jobs;
+        this->queue = queue;
+        this->idProgram = idProgram;
+        this->budget = budget;
+        this->alive = std::make_shared<bool>(true);
+        this->current = this->pending = NULL;
+        this->requestedAt = 0.0;
+        this->pendingWasReady = this->awaitingPresent = this->lastWasReady = false;
+        this->switches = this->warmSwitches = this->preloads = this->evictions = 0;
+        this->warmTotal = this->warmMax = this->coldTotal = this->coldMax = 0.0;
+    }
+
+    // Na thread GL. Cargas em andamento terminam no worker, mas nao sobem mais nada.
+    ~LevelPool() {
+        *this->alive = false;
+        for (size_t i = 0; i < this->levels.size(); i++) {
+            Level* l = this->levels[i];
+            if (l->job) this->jobs->wait(l->job);
+            if (l->state == LEVEL_READY) this->unload(l);
+            else {
+                delete l->stack;
+                delete l->map;
+            }
+            delete l;
+        }
+        std::map<std::string, SharedResource>::iterator it;
+        for (it = this->shared.begin(); it != this->shared.end(); ++it) {
+            if (it->second.ptr) it->second.destroy(it->second.ptr);
+        }
+    }
+
+    // Formato .tmap: largura altura, os tiles (linha de cima primeiro) e, opcionalmente,
+    // a grade de elevacao no mesmo formato. Pode rodar em qualquer thread.
+    static TileMap* readMap(const char* filename) {
+        std::ifstream arq(filename);
+        if (!arq.is_open()) {
+            std::cout << "ERRO: Não foi possível abrir o arquivo de mapa: " << filename << std::endl;
+            return NULL;
+        }
+        int w, h;
+        if (!(arq >> w >> h) || w <= 0 || h <= 0) {
+            std::cout << "ERRO: cabecalho de mapa invalido: " << filename << std::endl;
+            return NULL;
+        }
+        TileMap* tmap = new TileMap(w, h, 0);
+        for (int r = 0; r < h; r++) {
+            for (int c = 0; c < w; c++) {
+                int tid = 0;
+                arq >> tid;
+                tmap->setTile(c, (h - 1) - r, tid);
+            }
+        }
+        int elev;
+        for (int r = 0; r < h && arq >> elev; r++) {
+            tmap->setElevation(0, (h - 1) - r, elev);
+            for (int c = 1; c < w && arq >> elev; c++) {
+                tmap->setElevation(c, (h - 1) - r, elev);
+            }
+        }
+        arq.close();
+        return tmap;
+    }
+
+    // Passo extra sobre cada mapa lido (p.ex. retiling), no worker que fez o parse.
+    // Nao pode tocar em estado da thread principal.
+    void setPrepare(std::function<void(TileMap*)> fn) {
+        this->prepare = fn;
+    }
+
+    // Como criar e destruir um recurso compartilhado (so e criado no primeiro acquire).
+    void registerResource(const std::string& key, std::function<void*()> create, std::function<void(void*)> destroy) {
+        SharedResource r;
+        r.create = create;
+        r.destroy = destroy;
+        r.ptr = NULL;
+        r.refs = 0;
+        this->shared[key] = r;
+    }
+
+    void* acquire(const std::string& key) {
+        std::map<std::string, SharedResource>::iterator it = this->shared.find(key);
+        if (it == this->shared.end()) return NULL;
+        if (it->second.refs++ == 0 && it->second.ptr == NULL) it->second.ptr = it->second.create();
+        return it->second.ptr;
+    }
+
+    void release(const std::string& key) {
+        std::map<std::string, SharedResource>::iterator it = this->shared.find(key);
+        if (it == this->shared.end() || it->second.refs == 0) return;
+        if (--it->second.refs == 0 && it->second.ptr) {
+            it->second.destroy(it->second.ptr);
+            it->second.ptr = NULL;
+        }
+    }
+
+    int getRefs(const std::string& key) {
+        std::map<std::string, SharedResource>::iterator it = this->shared.find(key);
+        return it == this->shared.end() ? 0 : it->second.refs;
+    }
+
+    Level* find(const std::string& name) {
+        for (size_t i = 0; i < this->levels.size(); i++) {
+            if (this->levels[i]->name == name) return this->levels[i];
+        }
+        return NULL;
+    }
+
+    Level* addLevel(const std::string& name, const std::string& path, const std::string& tileset) {
+        Level* l = this->find(name);
+        if (l == NULL) {
+            l = new Level();
+            l->state = LEVEL_UNLOADED;
+            l->map = NULL;
+            l->stack = NULL;
+            l->ids = NULL;
+            l->bytes = 0;
+            l->lastUsed = 0.0;
+            this->levels.push_back(l);
+        }
+        l->name = name;
+        l->path = path;
+        l->tileset = tileset;
+        return l;
+    }
+
+    // Uma linha por nivel:  nome arquivo.tmap tileset [vizinho vizinho ...]
+    bool loadList(const char* filename) {
+        std::ifstream arq(filename);
+        if (!arq.is_open()) {
+            std::cout << "ERRO: Não foi possível abrir a lista de niveis: " << filename << std::endl;
+            return false;
+        }
+        std::string line;
+        while (std::getline(arq, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            std::istringstream ss(line);
+            std::string name, path, tileset, n;
+            if (!(ss >> name >> path >> tileset)) continue;
+            Level* l = this->addLevel(name, path, tileset);
+            l->next.clear();
+            while (ss >> n) l->next.push_back(n);
+        }
+        arq.close();
+        return true;
+    }
+
+    // Carga sincrona (inicio do jogo): tudo na thread atual.
+    Level* loadNow(const std::string& name) {
+        Level* l = this->find(name);
+        if (l == NULL) return NULL;
+        if (l->state == LEVEL_READY) return l;
+        if (l->state == LEVEL_LOADING) {
+            this->jobs->wait(l->job);
+            while (l->state == LEVEL_LOADING) this->queue->run(1.0);
+            return l->state == LEVEL_READY ? l : NULL;
+        }
+        l->map = readMap(l->path.c_str());
+        if (l->map == NULL) return NULL;
+        if (this->prepare) this->prepare(l->map);
+        l->stack = new TileStack(l->map);
+        this->finishLoad(l, false);
+        return l;
+    }
+
+    // Nivel feito de um mapa ja em memoria (p.ex. um save); substitui outro de mesmo nome.
+    Level* adopt(const std::string& name, TileMap* map, const std::string& tileset) {
+        Level* l = this->find(name);
+        if (l != NULL && l->state == LEVEL_READY) this->unload(l);
+        l = this->addLevel(name, "", tileset);
+        l->map = map;
+        l->stack = new TileStack(map);
+        this->finishLoad(l, false);
+        return l;
+    }
+
+    void preload(const std::string& name) {
+        Level* l = this->find(name);
+        if (l != NULL) this->startLoad(l, JOB_PRIORITY_LOW);
+    }
+
+    // Pede a troca; o nivel entra no proximo pollSwitch em que estiver pronto.
+    bool requestSwitch(const std::string& name) {
+        Level* l = this->find(name);
+        if (l == NULL || (l->path.empty() && l->state != LEVEL_READY)) return false;
+        this->pending = l;
+        this->requestedAt = now();
+        this->pendingWasReady = l->state == LEVEL_READY;
+        this->startLoad(l, JOB_PRIORITY_HIGH);
+        return true;
+    }
+
+    // Limite de frame: devolve o nivel novo se a troca pedida ja pode acontecer.
+    Level* pollSwitch() {
+        Level* l = this->pending;
+        if (l == NULL || l->state != LEVEL_READY) return NULL;
+        this->pending = NULL;
+        this->current = l;
+        l->lastUsed = now();
+        this->awaitingPresent = true;
+        this->lastWasReady = this->pendingWasReady;
+        for (size_t i = 0; i < l->next.size(); i++) this->preload(l->next[i]);
+        this->enforceBudget();
+        return l;
+    }
+
+    // Nivel inicial ou adotado: vira o atual sem medir latencia.
+    void setCurrent(Level* l) {
+        this->current = l;
+        l->lastUsed = now();
+        for (size_t i = 0; i < l->next.size(); i++) this->preload(l->next[i]);
+        this->enforceBudget();
+    }
+
+    // Ha troca pedida que o proximo pollSwitch ja consegue fazer?
+    bool isSwitchReady() {
+        return this->pending != NULL && this->pending->state == LEVEL_READY;
+    }
+
+    // Depois do swap do primeiro frame desenhado no nivel novo; retorna a latencia (s) ou -1.
+    double presented() {
+        if (!this->awaitingPresent) return -1.0;
+        this->awaitingPresent = false;
+        double latency = now() - this->requestedAt;
+        this->switches++;
+        if (this->lastWasReady) {
+            this->warmSwitches++;
+            this->warmTotal += latency;
+            if (latency > this->warmMax) this->warmMax = latency;
+        } else {
+            this->coldTotal += latency;
+            if (latency > this->coldMax) this->coldMax = latency;
+        }
+        return latency;
+    }
+
+    bool lastSwitchWasWarm() {
+        return this->lastWasReady;
+    }
+
+    Level* getCurrent() {
+        return this->current;
+    }
+
+    int getLevelCount() {
+        return (int)this->levels.size();
+    }
+
+    Level* getLevel(int i) {
+        return this->levels[i];
+    }
+
+    size_t getMemory() {
+        size_t total = 0;
+        for (size_t i = 0; i < this->levels.size(); i++) {
+            if (this->levels[i]->state == LEVEL_READY) total += this->levels[i]->bytes;
+        }
+        return total;
+    }
+
+    void printStats(FILE* out = stdout) {
+        int cold = this->switches - this->warmSwitches;
+        fprintf(out, "niveis: %d trocas, %d pre-carregadas (media %.3f ms, max %.3f ms), %d frias (media %.3f ms, max %.3f ms); "
+            "%d cargas ao fundo, %d despejos, %.1f KB de %.1f KB\n",
+            this->switches, this->warmSwitches, this->warmSwitches ? this->warmTotal / this->warmSwitches * 1000.0 : 0.0,
+            this->warmMax * 1000.0, cold, cold ? this->coldTotal / cold * 1000.0 : 0.0, this->coldMax * 1000.0,
+            this->preloads, this->evictions, this->getMemory() / 1024.0, this->budget / 1024.0);
+    }
+};
+
+#endif
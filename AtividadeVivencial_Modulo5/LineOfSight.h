@@ -0,0 +1,171 @@
+#ifndef LineOfSight_h
+#define LineOfSight_h
+
+#include <stdint.h>
+#include <algorithm>
+#include <vector>
+
+#include "JobSystem.h"
+#include "TileMap.h"
+#include "TileTypes.h"
+#include "TilemapView.h"
+
+#define LOS_CHUNK 16
+
+// "A ve B?": origem e destino em (col, row) do mapa.
+struct LosQuery {
+    int srcCol, srcRow, dstCol, dstRow;
+};
+
+// Linha de visao em lote sobre o bitset de celulas opacas (TileTypes::buildCellMask).
+// Cada raio anda pela reta de Bresenham em passos inteiros e para no primeiro tile opaco.
+// Os passos seguem o TilemapView (computeTileWalking): se a view anda na diagonal, o raio
+// tambem passa entre duas quinas, como o player; se nao, a diagonal precisa de um lado livre.
+// Origem e destino nao contam como obstaculo.
+// O lote e ordenado pelo bloco de LOS_CHUNK celulas da origem: raios vizinhos tocam as
+// mesmas linhas do bitset, e faixas contiguas do lote vao para os workers.
+class LineOfSight {
+    int width, height;
+    bool sortBySource;
+    std::vector<uint64_t> opaque;
+    // Direcao da view para cada passo (dc + 1, dr + 1); 0 se a view nao anda assim.
+    int stepDir[3][3];
+    std::vector<int> order;
+    std::vector<int> buckets;
+    std::vector<LosQuery> sorted;
+    std::vector<int> sortedBlocker;
+
+    bool isOpaque(int col, int row) const {
+        size_t i = (size_t)row * this->width + col;
+        return (this->opaque[i >> 6] >> (i & 63)) & 1;
+    }
+
+    // Anda um raio; retorna o indice (row * largura + col) do tile que bloqueou, ou -1.
+    int cast(const LosQuery& q) const {
+        int c = q.srcCol, r = q.srcRow;
+        int dc = q.dstCol > c ? 1 : (q.dstCol < c ? -1 : 0);
+        int dr = q.dstRow > r ? 1 : (q.dstRow < r ? -1 : 0);
+        int ac = q.dstCol > c ? q.dstCol - c : c - q.dstCol;
+        int ar = q.dstRow > r ? q.dstRow - r : r - q.dstRow;
+        bool diagonal = this->stepDir[dc + 1][dr + 1] != 0;
+        int err = ac - ar;
+        while (c != q.dstCol || r != q.dstRow) {
+            int e2 = 2 * err;
+            bool moveC = e2 > -ar;
+            bool moveR = e2 < ac;
+            if (moveC && moveR && !diagonal) {
+                // A view nao anda na diagonal: o raio passa por um dos lados, se algum estiver livre.
+                bool sideC = this->isOpaque(c + dc, r);
+                bool sideR = this->isOpaque(c, r + dr);
+                if (sideC && sideR) return r * this->width + c + dc;
+            }
+            if (moveC && moveR) {
+                err += -ar + ac;
+                c += dc;
+                r += dr;
+            } else if (moveC) {
+                err -= ar;
+                c += dc;
+            } else {
+                err += ac;
+                r += dr;
+            }
+            if ((c != q.dstCol || r != q.dstRow) && this->isOpaque(c, r)) return r * this->width + c;
+        }
+        return -1;
+    }
+
+    // Fora do mapa devolve -2 (conta como bloqueado, sem tile).
+    void castRange(int begin, int end) {
+        for (int k = begin; k < end; k++) {
+            const LosQuery& q = this->sorted[k];
+            bool inside = q.srcCol >= 0 && q.srcRow >= 0 && q.srcCol < this->width && q.srcRow < this->height &&
+                          q.dstCol >= 0 && q.dstRow >= 0 && q.dstCol < this->width && q.dstRow < this->height;
+            this->sortedBlocker[k] = inside ? this->cast(q) : -2;
+        }
+    }
+
+    int chunkOf(const LosQuery& q, int chunksX) {
+        int cx = std::min(std::max(q.srcCol, 0), this->width - 1) / LOS_CHUNK;
+        int cy = std::min(std::max(q.srcRow, 0), this->height - 1) / LOS_CHUNK;
+        return cy * chunksX + cx;
+    }
+
+public:
+    LineOfSight(TilemapView* view) {
+        this->width = this->height = 0;
+        this->sortBySource = true;
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) this->stepDir[i][j] = 0;
+        }
+        for (int d = DIRECTION_NORTH; d <= DIRECTION_SOUTHWEST; d++) {
+            int c = 0, r = 0;
+            view->computeTileWalking(c, r, d);
+            if (c >= -1 && c <= 1 && r >= -1 && r <= 1) this->stepDir[c + 1][r + 1] = d;
+        }
+    }
+
+    // Para medir: sem ordenar, o lote roda na ordem em que chegou.
+    void setSorting(bool on) {
+        this->sortBySource = on;
+    }
+
+    // Refaz o bitset de opacos; chamar quando o mapa trocar.
+    void setMap(TileMap* map, const TileTypes* types) {
+        this->width = map->getWidth();
+        this->height = map->getHeight();
+        types->buildCellMask(map, TILEPROP_OPAQUE, this->opaque);
+    }
+
+    // Um tile editado, sem refazer o bitset todo.
+    void setCell(int col, int row, bool isOpaque) {
+        size_t i = (size_t)row * this->width + col;
+        if (isOpaque) this->opaque[i >> 6] |= (uint64_t)1 << (i & 63);
+        else this->opaque[i >> 6] &= ~((uint64_t)1 << (i & 63));
+    }
+
+    // hits recebe um bit por consulta (1 = bloqueado, ou fora do mapa) e blocker o indice
+    // row * largura + col do tile que bloqueou (-1 se visivel). Sem jobs roda na thread atual.
+    // Antes de setMap nao ha o que bloquear: todas as consultas saem visiveis.
+    void castBatch(const LosQuery* queries, int count, std::vector<uint64_t>& hits, std::vector<int>& blocker,
+                   JobSystem* jobs) {
+        hits.assign((count + 63) / 64, 0);
+        blocker.assign(count, -1);
+        // Sem mapa os buckets teriam uma entrada so e chunkOf apontaria alem dela.
+        if (count == 0 || this->width == 0 || this->height == 0) return;
+        // Counting sort pelo bloco da origem (estavel) e copia das consultas nessa ordem,
+        // para os workers lerem o lote em sequencia.
+        this->order.resize(count);
+        if (this->sortBySource) {
+            int chunksX = (this->width + LOS_CHUNK - 1) / LOS_CHUNK;
+            int chunksY = (this->height + LOS_CHUNK - 1) / LOS_CHUNK;
+            this->buckets.assign(chunksX * chunksY + 1, 0);
+            for (int i = 0; i < count; i++) this->buckets[this->chunkOf(queries[i], chunksX) + 1]++;
+            for (size_t b = 1; b < this->buckets.size(); b++) this->buckets[b] += this->buckets[b - 1];
+            for (int i = 0; i < count; i++) this->order[this->buckets[this->chunkOf(queries[i], chunksX)]++] = i;
+        } else {
+            for (int i = 0; i < count; i++) this->order[i] = i;
+        }
+        this->sorted.resize(count);
+        for (int k = 0; k < count; k++) this->sorted[k] = queries[this->order[k]];
+        this->sortedBlocker.resize(count);
+        if (jobs == NULL) {
+            this->castRange(0, count);
+        } else {
+            jobs->parallelFor(0, count, 4096, [this](int b, int e) { this->castRange(b, e); });
+        }
+        // Resultados voltam para a ordem original aqui: dois workers nunca escrevem na mesma palavra do bitset.
+        for (int k = 0; k < count; k++) {
+            int i = this->order[k];
+            int b = this->sortedBlocker[k];
+            blocker[i] = b >= 0 ? b : -1;
+            if (b != -1) hits[i >> 6] |= (uint64_t)1 << (i & 63);
+        }
+    }
+
+    static bool isHit(const std::vector<uint64_t>& hits, int i) {
+        return (hits[i >> 6] >> (i & 63)) & 1;
+    }
+};
+
+#endif
@@ -0,0 +1,74 @@
+// Benchmark da linha de visao em lote: agentes espalhados num mapa com paredes, cada um
+// consultando alvos proximos. Compara o lote na ordem de chegada, ordenado pelo bloco da
+// origem e ordenado nos workers; os resultados dos tres sao conferidos entre si.
+//
+// Uso: LosBench [tamanho=8192] [consultas=1000000] [alcance=40] [repeticoes=5]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <vector>
+
+#include "DiamondView.h"
+#include "JobSystem.h"
+#include "LineOfSight.h"
+#include "TileMap.h"
+#include "TileTypes.h"
+
+using namespace std;
+
+static double now() {
+    return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char** argv) {
+    int size = argc > 1 ? atoi(argv[1]) : 8192;
+    int count = argc > 2 ? atoi(argv[2]) : 1000000;
+    int range = argc > 3 ? atoi(argv[3]) : 40;
+    int reps = argc > 4 ? atoi(argv[4]) : 5;
+
+    // Tile 1 livre, tile 2 opaco (como em terrain.tiles): ~8% de paredes.
+    TileTypes types;
+    types.loadSidecar("terrain.tiles");
+    TileMap map(size, size, 1);
+    srand(3);
+    for (int r = 0; r < size; r++) {
+        for (int c = 0; c < size; c++) {
+            if (rand() % 100 < 8) map.setTile(c, r, 2);
+        }
+    }
+    DiamondView view;
+    LineOfSight los(&view);
+    los.setMap(&map, &types);
+
+    // Consultas em ordem aleatoria, como chegam de varios sistemas de IA.
+    vector<LosQuery> queries(count);
+    for (int i = 0; i < count; i++) {
+        LosQuery& q = queries[i];
+        q.srcCol = rand() % size;
+        q.srcRow = rand() % size;
+        q.dstCol = min(max(q.srcCol + rand() % (2 * range + 1) - range, 0), size - 1);
+        q.dstRow = min(max(q.srcRow + rand() % (2 * range + 1) - range, 0), size - 1);
+    }
+
+    JobSystem jobs;
+    printf("mapa %dx%d, %d consultas, alcance %d, %d threads de trabalho\n", size, size, count, range, jobs.getThreadCount() + 1);
+    const char* names[] = { "ordem de chegada", "ordenado por bloco", "ordenado + jobs" };
+    vector<uint64_t> hits[3];
+    vector<int> blockers[3];
+    for (int m = 0; m < 3; m++) {
+        los.setSorting(m > 0);
+        double best = 1e9;
+        for (int k = 0; k < reps; k++) {
+            double t0 = now();
+            los.castBatch(queries.data(), count, hits[m], blockers[m], m == 2 ? &jobs : NULL);
+            best = min(best, now() - t0);
+        }
+        printf("%-20s %9.3f ms %8.1f Mraios/s\n", names[m], best * 1000.0, count / best / 1e6);
+    }
+    int blocked = 0;
+    for (int i = 0; i < count; i++) blocked += LineOfSight::isHit(hits[0], i);
+    bool same = hits[0] == hits[1] && hits[0] == hits[2] && blockers[0] == blockers[1] && blockers[0] == blockers[2];
+    printf("%.1f%% bloqueados, resultados %s\n", 100.0 * blocked / count, same ? "iguais" : "DIFERENTES");
+    return same ? 0 : 1;
+}
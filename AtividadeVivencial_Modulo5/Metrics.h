@@ -0,0 +1,272 @@
+#ifndef Metrics_h
+#define Metrics_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define METRICS_MAX 64
+#define METRIC_COUNTER 0
+#define METRIC_GAUGE 1
+
+// Valores de uma thread. So a dona escreve (load + store relaxed, sem instrucao travada);
+// o servidor le com load relaxed. Cada bloco ocupa as proprias linhas de cache.
+struct alignas(64) MetricsBlock {
+    std::atomic<int64_t> values[METRICS_MAX];
+};
+
+struct MetricInfo {
+    std::string name;
+    std::string help;
+    int type;
+};
+
+// Contadores e gauges por thread, somados so na hora de exportar. Definir uma metrica e
+// a primeira escrita de cada thread pegam um mutex; depois disso add/set sao so acessos
+// ao bloco da propria thread. Um gauge deve ter uma thread dona (os blocos sao somados).
+class Metrics {
+    std::mutex lock;
+    MetricInfo infos[METRICS_MAX];
+    std::atomic<int> count;
+    std::vector<MetricsBlock*> blocks;
+
+    MetricsBlock* local() {
+        static thread_local MetricsBlock* block = NULL;
+        if (block == NULL) {
+            block = new MetricsBlock();
+            for (int i = 0; i < METRICS_MAX; i++) block->values[i].store(0, std::memory_order_relaxed);
+            std::lock_guard<std::mutex> guard(this->lock);
+            this->blocks.push_back(block);
+        }
+        return block;
+    }
+
+public:
+    Metrics() {
+        this->count = 0;
+    }
+
+    // Os blocos ficam vivos ate o fim do processo: threads que terminam continuam somando.
+    static Metrics& get() {
+        static Metrics instance;
+        return instance;
+    }
+
+    // Retorna o id (o mesmo se o nome ja existir) ou -1 se acabou o espaco.
+    int define(const char* name, int type, const char* help) {
+        std::lock_guard<std::mutex> guard(this->lock);
+        int n = this->count.load();
+        for (int i = 0; i < n; i++) {
+            if (this->infos[i].name == name) return i;
+        }
+        if (n >= METRICS_MAX) return -1;
+        this->infos[n].name = name;
+        this->infos[n].help = help;
+        this->infos[n].type = type;
+        this->count.store(n + 1);
+        return n;
+    }
+
+    void add(int id, int64_t v) {
+        if (id < 0) return;
+        std::atomic<int64_t>& slot = this->local()->values[id];
+        slot.store(slot.load(std::memory_order_relaxed) + v, std::memory_order_relaxed);
+    }
+
+    void set(int id, int64_t v) {
+        if (id < 0) return;
+        this->local()->values[id].store(v, std::memory_order_relaxed);
+    }
+
+    int getThreadCount() {
+        std::lock_guard<std::mutex> guard(this->lock);
+        return (int)this->blocks.size();
+    }
+
+    // Soma de todos os blocos, na ordem de definicao.
+    void snapshot(std::vector<MetricInfo>& info, std::vector<int64_t>& values) {
+        std::lock_guard<std::mutex> guard(this->lock);
+        int n = this->count.load();
+        info.assign(this->infos, this->infos + n);
+        values.assign(n, 0);
+        for (size_t b = 0; b < this->blocks.size(); b++) {
+            for (int i = 0; i < n; i++) values[i] += this->blocks[b]->values[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    // Formato de texto do Prometheus ou um objeto JSON {"nome": valor, ...}.
+    std::string format(bool json) {
+        std::vector<MetricInfo> info;
+        std::vector<int64_t> values;
+        this->snapshot(info, values);
+        std::string out = json ? "{" : "";
+        // Montado em std::string: o texto de ajuda nao tem limite de tamanho.
+        for (size_t i = 0; i < info.size(); i++) {
+            const std::string& name = info[i].name;
+            std::string value = std::to_string((long long)values[i]);
+            if (json) {
+                if (i) out += ", ";
+                out += "\"" + name + "\": " + value;
+            } else {
+                out += "# HELP " + name + " " + info[i].help + "\n";
+                out += "# TYPE " + name + (info[i].type == METRIC_COUNTER ? " counter\n" : " gauge\n");
+                out += name + " " + value + "\n";
+            }
+        }
+        if (json) out += "}\n";
+        return out;
+    }
+};
+
+// Serve um retrato das metricas a cada conexao, numa thread propria. Endereco:
+// "tcp:PORTA" (so 127.0.0.1) ou o caminho de um socket Unix. Um GET HTTP (curl) recebe
+// resposta HTTP; qualquer outra coisa (nc -U, socat) recebe o texto direto. Pedidos com
+// "json" recebem JSON, os demais o formato do Prometheus.
+class MetricsServer {
+    Metrics* metrics;
+    int listenFd;
+    std::string unixPath;
+    std::thread thread;
+    std::atomic<bool> running;
+    std::atomic<unsigned long long> served;
+
+    static int64_t residentBytes() {
+        long pages = 0, resident = 0;
+        FILE* f = fopen("/proc/self/statm", "r");
+        if (f == NULL) return 0;
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2) resident = 0;
+        fclose(f);
+        return (int64_t)resident * sysconf(_SC_PAGESIZE);
+    }
+
+    void serve(int fd) {
+        // Cliente que nao manda nada em 50 ms (nc -U) recebe o formato padrao.
+        char request[1024];
+        int got = 0;
+        struct pollfd p = { fd, POLLIN, 0 };
+        if (poll(&p, 1, 50) > 0) {
+            got = (int)read(fd, request, sizeof(request) - 1);
+            if (got < 0) got = 0;
+        }
+        request[got] = 0;
+        bool json = strstr(request, "json") != NULL;
+        bool http = strncmp(request, "GET ", 4) == 0;
+
+        std::string body = this->metrics->format(json);
+        char extra[128];
+        int64_t rss = residentBytes();
+        if (json) {
+            body.erase(body.size() - 2);
+            snprintf(extra, sizeof(extra), "%s\"process_resident_bytes\": %lld}\n", body.size() > 1 ? ", " : "", (long long)rss);
+        } else {
+            snprintf(extra, sizeof(extra), "# TYPE process_resident_bytes gauge\nprocess_resident_bytes %lld\n", (long long)rss);
+        }
+        body += extra;
+        std::string out;
+        if (http) {
+            snprintf(extra, sizeof(extra), "HTTP/1.0 200 OK\r\nContent-Type: %s\r\nContent-Length: %zu\r\n\r\n",
+                json ? "application/json" : "text/plain; version=0.0.4", body.size());
+            out = extra;
+        }
+        out += body;
+        size_t sent = 0;
+        while (sent < out.size()) {
+            ssize_t n = write(fd, out.data() + sent, out.size() - sent);
+            if (n <= 0) break;
+            sent += (size_t)n;
+        }
+        this->served++;
+    }
+
+    void loop() {
+        while (this->running.load()) {
+            struct pollfd p = { this->listenFd, POLLIN, 0 };
+            if (poll(&p, 1, 100) <= 0) continue;
+            int fd = accept(this->listenFd, NULL, NULL);
+            if (fd < 0) continue;
+            this->serve(fd);
+            close(fd);
+        }
+    }
+
+public:
+    MetricsServer(Metrics* metrics) {
+        this->metrics = metrics;
+        this->listenFd = -1;
+        this->running = false;
+        this->served = 0;
+    }
+
+    ~MetricsServer() {
+        this->stop();
+    }
+
+    bool start(const char* address) {
+        if (strncmp(address, "tcp:", 4) == 0) {
+            this->listenFd = socket(AF_INET, SOCK_STREAM, 0);
+            int yes = 1;
+            setsockopt(this->listenFd, SOL_SOCKET, SO_REUSEADDR, &yes, sizeof(yes));
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons((unsigned short)atoi(address + 4));
+            addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+            if (bind(this->listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+                printf("ERRO: Não foi possível abrir a porta de metricas %s: %s\n", address + 4, strerror(errno));
+                close(this->listenFd);
+                this->listenFd = -1;
+                return false;
+            }
+        } else {
+            struct sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            if (strlen(address) >= sizeof(addr.sun_path)) {
+                printf("ERRO: caminho do socket de metricas longo demais: %s\n", address);
+                return false;
+            }
+            strcpy(addr.sun_path, address);
+            unlink(address);
+            this->listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (bind(this->listenFd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+                printf("ERRO: Não foi possível criar o socket de metricas %s: %s\n", address, strerror(errno));
+                close(this->listenFd);
+                this->listenFd = -1;
+                return false;
+            }
+            this->unixPath = address;
+        }
+        listen(this->listenFd, 8);
+        this->running = true;
+        this->thread = std::thread([this]() { this->loop(); });
+        return true;
+    }
+
+    void stop() {
+        if (!this->running.exchange(false)) return;
+        this->thread.join();
+        close(this->listenFd);
+        this->listenFd = -1;
+        if (!this->unixPath.empty()) unlink(this->unixPath.c_str());
+    }
+
+    unsigned long long getServed() {
+        return this->served.load();
+    }
+};
+
+#endif
@@ -0,0 +1,151 @@
+// Harness de rede: roda um NetServer e N clientes headless em loopback, com o servidor
+// editando tiles e movendo entidades a cada tick, e relata banda e latencia por tick.
+// "lat" e a latencia de ida (servidor -> cliente, mesmo relogio); "rtt" inclui a espera
+// ate o proximo tick do servidor, que e quando as confirmacoes sao lidas.
+//
+// Uso: NetHarness [clientes=4] [segundos=5] [tamanhoMapa=256] [edicoesPorTick=32] [tickHz=30]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "TileMap.h"
+#include "NetSync.h"
+
+using namespace std;
+
+static float percentile(vector<float>& v, float p) {
+    if (v.empty()) return 0.0f;
+    size_t i = (size_t)(p * (v.size() - 1));
+    nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+}
+
+int main(int argc, char** argv) {
+    int numClients = argc > 1 ? atoi(argv[1]) : 4;
+    double seconds = argc > 2 ? atof(argv[2]) : 5.0;
+    int mapSize = argc > 3 ? atoi(argv[3]) : 256;
+    int editsPerTick = argc > 4 ? atoi(argv[4]) : 32;
+    int tickHz = argc > 5 ? atoi(argv[5]) : 30;
+    if (numClients > NET_MAX_CLIENTS) numClients = NET_MAX_CLIENTS;
+
+    TileMap* world = new TileMap(mapSize, mapSize, 1);
+    NetServer server(world);
+    if (!server.open(0)) {
+        printf("ERRO: nao foi possivel abrir o socket do servidor\n");
+        return 1;
+    }
+    unsigned short port = server.getPort();
+    printf("servidor em 127.0.0.1:%u, mapa %dx%d, %d clientes, %d edicoes/tick, %d Hz\n",
+        port, mapSize, mapSize, numClients, editsPerTick, tickHz);
+
+    int numEntities = NET_MAX_ENTITIES / 2;
+    srand(1234);
+    for (int e = 0; e < numEntities; e++) server.setEntity(e, rand() % mapSize, rand() % mapSize);
+
+    vector<NetClient*> clients;
+    for (int i = 0; i < numClients; i++) {
+        NetClient* c = new NetClient();
+        if (!c->connect(port)) {
+            printf("ERRO: cliente %d nao conectou\n", i);
+            return 1;
+        }
+        clients.push_back(c);
+    }
+
+    atomic<bool> running(true);
+    vector<thread> threads;
+    for (int i = 0; i < numClients; i++) {
+        NetClient* c = clients[i];
+        threads.push_back(thread([c, &running]() {
+            while (running.load()) {
+                c->update();
+                this_thread::sleep_for(chrono::microseconds(200));
+            }
+            c->update();
+        }));
+    }
+
+    double tickSeconds = 1.0 / tickHz;
+    double start = netSeconds();
+    double next = start;
+    double simEnd = start + seconds;
+    double end = simEnd + 1.0;
+    double tickCostSum = 0.0;
+    int ticks = 0;
+    while (netSeconds() < end) {
+        double now = netSeconds();
+        if (now < next) {
+            this_thread::sleep_for(chrono::microseconds(100));
+            continue;
+        }
+        next += tickSeconds;
+        // Depois de simEnd o mundo fica parado para os clientes convergirem.
+        if (now < simEnd) {
+            for (int k = 0; k < editsPerTick; k++) {
+                int c = rand() % mapSize, r = rand() % mapSize;
+                if (k % 8 == 0) server.setElevation(c, r, rand() % 3);
+                else server.setTile(c, r, rand() % 7);
+            }
+            for (int e = 0; e < numEntities; e++) {
+                const NetEntity& ent = server.getEntity(e);
+                int col = ent.col + rand() % 3 - 1, row = ent.row + rand() % 3 - 1;
+                if (col < 0) col = 0;
+                if (row < 0) row = 0;
+                if (col >= mapSize) col = mapSize - 1;
+                if (row >= mapSize) row = mapSize - 1;
+                server.setEntity(e, col, row);
+            }
+        }
+        double t0 = netSeconds();
+        server.update();
+        tickCostSum += netSeconds() - t0;
+        ticks++;
+    }
+    running.store(false);
+    for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+    double elapsed = netSeconds() - start;
+
+    printf("\n%d ticks em %.2fs, custo medio do tick no servidor %.3f ms, seq final %u, log %zu\n",
+        ticks, elapsed, tickCostSum / ticks * 1000.0, server.getSeq(), server.getLogSize());
+    printf("banda total do servidor: %.1f KB/s, pacotes limitados pelo orcamento: %llu\n",
+        server.getTotalBytes() / 1024.0 / elapsed, (unsigned long long)server.getBudgetLimited());
+    printf("%-8s %10s %10s %10s %8s %8s %8s %8s %8s %s\n",
+        "cliente", "KB/s", "pacotes/s", "B/pacote", "lat med", "p50", "p95", "p99", "rtt", "estado");
+
+    int failures = 0;
+    for (int i = 0; i < numClients; i++) {
+        NetClient* c = clients[i];
+        vector<float>& lat = c->getLatencies();
+        double sum = 0.0;
+        for (size_t k = 0; k < lat.size(); k++) sum += lat[k];
+        double avg = lat.empty() ? 0.0 : sum / lat.size();
+        float p50 = percentile(lat, 0.50f), p95 = percentile(lat, 0.95f), p99 = percentile(lat, 0.99f);
+
+        bool ok = c->isSynced() && c->getMap() != NULL
+            && memcmp(c->getMap()->getMap(), world->getMap(), mapSize * mapSize) == 0
+            && memcmp(c->getMap()->getElevations(), world->getElevations(), mapSize * mapSize) == 0;
+        for (int e = 0; ok && e < numEntities; e++) {
+            ok = c->getEntity(e).col == server.getEntity(e).col && c->getEntity(e).row == server.getEntity(e).row;
+        }
+        if (!ok) failures++;
+
+        double rtt = 0.0;
+        for (int s = 0; s < NET_MAX_CLIENTS; s++) {
+            const NetClientSlot& slot = server.getClient(s);
+            if (slot.used && slot.rttCount > 0 && ntohs(slot.addr.sin_port) == c->getLocalPort()) rtt = slot.rttSumMs / slot.rttCount;
+        }
+        printf("%-8d %10.1f %10.1f %10.1f %8.3f %8.3f %8.3f %8.3f %8.3f %s\n",
+            i, c->getBytesReceived() / 1024.0 / elapsed, c->getPacketsReceived() / elapsed,
+            c->getPacketsReceived() ? (double)c->getBytesReceived() / c->getPacketsReceived() : 0.0,
+            avg, p50, p95, p99, rtt, ok ? "convergiu" : "DIVERGENTE");
+    }
+
+    for (int i = 0; i < numClients; i++) delete clients[i];
+    delete world;
+    return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,669 @@
+#ifndef NetSync_h
+#define NetSync_h
+
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <chrono>
+#include <deque>
+#include <vector>
+
+#include "TileMap.h"
+#include "BitStream.h"
+
+#define NET_MAX_PACKET 1200
+#define NET_MAGIC 0x7E47
+#define NET_MSG_SNAPSHOT 1
+#define NET_MSG_ACK 2
+#define NET_MAX_CLIENTS 16
+#define NET_MAX_ENTITIES 64
+#define NET_HISTORY 64
+#define NET_MAX_LOG (1 << 20)
+#define NET_RESEND_TICKS 8
+#define NET_TIMEOUT_SECONDS 5.0
+
+// Replicacao do estado de um TileMap e das posicoes de entidades entre um servidor
+// autoritativo e varios clientes via UDP (loopback). Cada tick o servidor manda a cada
+// cliente um snapshot de no maximo NET_MAX_PACKET bytes, comprimido contra o ultimo
+// estado que aquele cliente confirmou:
+//  - entidades: delta contra o snapshot do tick confirmado (historico de NET_HISTORY ticks);
+//  - tiles: edicoes do log com seq > ultima seq confirmada; um cliente novo (ou muito
+//    atrasado) recebe antes o mapa inteiro em fatias, retomando do ultimo indice confirmado.
+
+inline uint32_t netTimeUs() {
+    return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline double netSeconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct NetEntity {
+    uint16_t col, row;
+    uint8_t active;
+};
+
+struct NetTileEdit {
+    uint32_t seq;
+    uint32_t index;
+};
+
+class UdpSocket {
+    int fd;
+
+public:
+    UdpSocket() {
+        this->fd = -1;
+    }
+
+    ~UdpSocket() {
+        this->close();
+    }
+
+    // Abre um socket nao bloqueante em 127.0.0.1:port (port 0 = porta livre qualquer).
+    bool open(unsigned short port) {
+        this->fd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (this->fd < 0) return false;
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = htons(port);
+        if (bind(this->fd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+            this->close();
+            return false;
+        }
+        fcntl(this->fd, F_SETFL, fcntl(this->fd, F_GETFL, 0) | O_NONBLOCK);
+        return true;
+    }
+
+    void close() {
+        if (this->fd >= 0) ::close(this->fd);
+        this->fd = -1;
+    }
+
+    unsigned short getPort() const {
+        sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        if (getsockname(this->fd, (sockaddr*)&addr, &len) < 0) return 0;
+        return ntohs(addr.sin_port);
+    }
+
+    int sendTo(const sockaddr_in& to, const uint8_t* buf, int len) {
+        return (int)sendto(this->fd, buf, len, 0, (const sockaddr*)&to, sizeof(to));
+    }
+
+    // Retorna o tamanho do datagrama ou -1 quando nao ha nada para ler.
+    int recvFrom(sockaddr_in& from, uint8_t* buf, int cap) {
+        socklen_t len = sizeof(from);
+        return (int)recvfrom(this->fd, buf, cap, 0, (sockaddr*)&from, &len);
+    }
+};
+
+inline sockaddr_in netLoopback(unsigned short port) {
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    return addr;
+}
+
+struct NetClientSlot {
+    bool used;
+    sockaddr_in addr;
+    uint32_t ackTick;
+    uint32_t ackSeq;
+    bool synced;
+    uint32_t fullSeq;
+    uint32_t fullCursor;
+    uint32_t sentCursor;
+    int stallTicks;
+    double lastHeard;
+    uint64_t bytesSent;
+    uint64_t packetsSent;
+    double rttSumMs;
+    int rttCount;
+};
+
+class NetServer {
+    TileMap* map;
+    UdpSocket sock;
+    uint32_t tick;
+    uint32_t seq;
+    std::vector<uint32_t> lastSeq;
+    std::deque<NetTileEdit> log;
+    NetEntity entities[NET_MAX_ENTITIES];
+    NetEntity history[NET_HISTORY][NET_MAX_ENTITIES];
+    uint32_t historyTick[NET_HISTORY];
+    NetClientSlot clients[NET_MAX_CLIENTS];
+    int idxBits, colBits, rowBits;
+    uint64_t totalBytes;
+    uint64_t budgetLimited;
+
+    int cellCount() {
+        return this->map->getWidth() * this->map->getHeight();
+    }
+
+    void record(int index) {
+        this->seq++;
+        this->lastSeq[index] = this->seq;
+        NetTileEdit e;
+        e.seq = this->seq;
+        e.index = (uint32_t)index;
+        this->log.push_back(e);
+    }
+
+    void beginFullSync(NetClientSlot& c) {
+        c.synced = false;
+        c.fullSeq = this->seq;
+        c.fullCursor = 0;
+        c.sentCursor = 0;
+        c.stallTicks = 0;
+    }
+
+    NetClientSlot* findClient(const sockaddr_in& addr, bool create) {
+        NetClientSlot* freeSlot = NULL;
+        for (int i = 0; i < NET_MAX_CLIENTS; i++) {
+            NetClientSlot& c = this->clients[i];
+            if (c.used && c.addr.sin_port == addr.sin_port && c.addr.sin_addr.s_addr == addr.sin_addr.s_addr) return &c;
+            if (!c.used && freeSlot == NULL) freeSlot = &c;
+        }
+        if (!create || freeSlot == NULL) return NULL;
+        memset(freeSlot, 0, sizeof(NetClientSlot));
+        freeSlot->used = true;
+        freeSlot->addr = addr;
+        this->beginFullSync(*freeSlot);
+        return freeSlot;
+    }
+
+    void receiveAcks() {
+        uint8_t buf[NET_MAX_PACKET];
+        sockaddr_in from;
+        int n;
+        double now = netSeconds();
+        while ((n = this->sock.recvFrom(from, buf, sizeof(buf))) > 0) {
+            BitReader in(buf, n);
+            if (in.read(16) != NET_MAGIC || in.read(2) != NET_MSG_ACK) continue;
+            uint32_t ackTick = in.read(32);
+            uint32_t ackSeq = in.read(32);
+            uint32_t fullSeq = in.read(32);
+            uint32_t fullCursor = in.read(32);
+            bool synced = in.readBool();
+            uint32_t echo = in.read(32);
+            if (in.overflow()) continue;
+            NetClientSlot* c = this->findClient(from, true);
+            if (c == NULL) continue;
+            c->lastHeard = now;
+            if (ackTick > c->ackTick && ackTick <= this->tick) c->ackTick = ackTick;
+            if (echo != 0) {
+                c->rttSumMs += (double)(uint32_t)(netTimeUs() - echo) / 1000.0;
+                c->rttCount++;
+            }
+            if (!c->synced) {
+                if (fullSeq != c->fullSeq) continue;
+                if (fullCursor > c->fullCursor) {
+                    c->fullCursor = fullCursor;
+                    c->stallTicks = 0;
+                }
+                if (synced && c->fullCursor >= (uint32_t)this->cellCount()) {
+                    c->synced = true;
+                    c->ackSeq = c->fullSeq;
+                }
+            } else if (ackSeq > c->ackSeq && ackSeq <= this->seq) {
+                c->ackSeq = ackSeq;
+            }
+        }
+    }
+
+    // Descarta do log as edicoes que todos os clientes ja confirmaram. Se o log passar do
+    // limite, as mais antigas sao descartadas mesmo assim e os clientes atrasados voltam
+    // para a sincronizacao completa.
+    void compactLog() {
+        uint32_t minSeq = this->seq;
+        for (int i = 0; i < NET_MAX_CLIENTS; i++) {
+            NetClientSlot& c = this->clients[i];
+            if (!c.used) continue;
+            uint32_t s = c.synced ? c.ackSeq : c.fullSeq;
+            if (s < minSeq) minSeq = s;
+        }
+        while (!this->log.empty() && (this->log.front().seq <= minSeq || this->log.size() > NET_MAX_LOG)) {
+            this->log.pop_front();
+        }
+        uint32_t oldest = this->log.empty() ? this->seq + 1 : this->log.front().seq;
+        for (int i = 0; i < NET_MAX_CLIENTS; i++) {
+            NetClientSlot& c = this->clients[i];
+            if (!c.used) continue;
+            uint32_t s = c.synced ? c.ackSeq : c.fullSeq;
+            if (s + 1 < oldest) this->beginFullSync(c);
+        }
+    }
+
+    void writeEntities(BitWriter& out, const NetClientSlot& c) {
+        const NetEntity* base = NULL;
+        uint32_t baseTick = 0;
+        if (c.ackTick != 0 && this->tick - c.ackTick < NET_HISTORY && this->historyTick[c.ackTick % NET_HISTORY] == c.ackTick) {
+            base = this->history[c.ackTick % NET_HISTORY];
+            baseTick = c.ackTick;
+        }
+        out.write(baseTick, 32);
+        for (int e = 0; e < NET_MAX_ENTITIES; e++) {
+            const NetEntity& cur = this->entities[e];
+            bool changed = base == NULL || base[e].active != cur.active
+                || (cur.active && (base[e].col != cur.col || base[e].row != cur.row));
+            out.writeBool(changed);
+            if (!changed) continue;
+            out.writeBool(cur.active != 0);
+            if (cur.active) {
+                out.write(cur.col, this->colBits);
+                out.write(cur.row, this->rowBits);
+            }
+        }
+    }
+
+    void writeValue(BitWriter& out, int index) {
+        out.write(this->map->getMap()[index], 8);
+        out.write(this->map->getElevations()[index], 8);
+    }
+
+    void writeFullSlice(BitWriter& out, NetClientSlot& c) {
+        int n = this->cellCount();
+        if (++c.stallTicks > NET_RESEND_TICKS) {
+            c.sentCursor = c.fullCursor;
+            c.stallTicks = 0;
+        }
+        if (c.sentCursor < c.fullCursor || c.sentCursor >= (uint32_t)n) c.sentCursor = c.fullCursor;
+        out.writeBool(false);
+        out.write(c.fullSeq, 32);
+        out.write(c.sentCursor, this->idxBits);
+        int countPos = out.getBitPos();
+        out.write(0, this->idxBits + 1);
+        // RLE: trechos iguais viram [1][tamanho 8 bits][valor], celulas isoladas [0][valor].
+        const unsigned char* tiles = this->map->getMap();
+        const unsigned char* elev = this->map->getElevations();
+        uint32_t i = c.sentCursor;
+        while (i < (uint32_t)n && out.fits(25)) {
+            uint32_t run = 1;
+            while (i + run < (uint32_t)n && run < 255 && tiles[i + run] == tiles[i] && elev[i + run] == elev[i]) run++;
+            out.writeBool(run > 1);
+            if (run > 1) out.write(run, 8);
+            this->writeValue(out, i);
+            i += run;
+        }
+        out.patch(countPos, i - c.sentCursor, this->idxBits + 1);
+        c.sentCursor = i;
+    }
+
+    void writeDelta(BitWriter& out, NetClientSlot& c) {
+        out.writeBool(true);
+        out.write(c.ackSeq, 32);
+        int lastPos = out.getBitPos();
+        out.write(c.ackSeq, 32);
+        int countPos = out.getBitPos();
+        out.write(0, 16);
+        int count = 0;
+        uint32_t last = c.ackSeq;
+        int entryBits = this->idxBits + 16;
+        // As seqs do log sao consecutivas, entao a primeira edicao pendente e acessada direto.
+        size_t first = this->log.empty() || c.ackSeq < this->log.front().seq ? 0 : c.ackSeq + 1 - this->log.front().seq;
+        for (size_t k = first; k < this->log.size(); k++) {
+            const NetTileEdit& e = this->log[k];
+            // Edicao sobrescrita por outra mais nova: basta mandar a mais nova.
+            if (this->lastSeq[e.index] != e.seq) {
+                last = e.seq;
+                continue;
+            }
+            if (!out.fits(entryBits) || count == 0xFFFF) {
+                this->budgetLimited++;
+                break;
+            }
+            out.write(e.index, this->idxBits);
+            this->writeValue(out, e.index);
+            last = e.seq;
+            count++;
+        }
+        out.patch(lastPos, last, 32);
+        out.patch(countPos, count, 16);
+    }
+
+    void sendSnapshot(NetClientSlot& c) {
+        uint8_t buf[NET_MAX_PACKET];
+        BitWriter out(buf, NET_MAX_PACKET);
+        out.write(NET_MAGIC, 16);
+        out.write(NET_MSG_SNAPSHOT, 2);
+        out.write(this->tick, 32);
+        out.write(netTimeUs(), 32);
+        out.write(this->map->getWidth(), 16);
+        out.write(this->map->getHeight(), 16);
+        this->writeEntities(out, c);
+        if (c.synced) this->writeDelta(out, c);
+        else this->writeFullSlice(out, c);
+        int bytes = out.getBytes();
+        if (this->sock.sendTo(c.addr, buf, bytes) == bytes) {
+            c.bytesSent += bytes;
+            c.packetsSent++;
+            this->totalBytes += bytes;
+        }
+    }
+
+public:
+    NetServer(TileMap* map) {
+        this->map = map;
+        this->tick = 0;
+        this->seq = 0;
+        this->lastSeq.assign(this->cellCount(), 0);
+        memset(this->entities, 0, sizeof(this->entities));
+        memset(this->history, 0, sizeof(this->history));
+        memset(this->historyTick, 0, sizeof(this->historyTick));
+        memset(this->clients, 0, sizeof(this->clients));
+        this->idxBits = bitsFor(this->cellCount());
+        this->colBits = bitsFor(map->getWidth());
+        this->rowBits = bitsFor(map->getHeight());
+        this->totalBytes = 0;
+        this->budgetLimited = 0;
+    }
+
+    bool open(unsigned short port) {
+        return this->sock.open(port);
+    }
+
+    unsigned short getPort() {
+        return this->sock.getPort();
+    }
+
+    TileMap* getMap() {
+        return this->map;
+    }
+
+    void setTile(int col, int row, unsigned char tile) {
+        int index = col + row * this->map->getWidth();
+        if (this->map->getMap()[index] == tile) return;
+        this->map->setTile(col, row, tile);
+        this->record(index);
+    }
+
+    void setElevation(int col, int row, unsigned char h) {
+        int index = col + row * this->map->getWidth();
+        if (this->map->getElevations()[index] == h) return;
+        this->map->setElevation(col, row, h);
+        this->record(index);
+    }
+
+    void setEntity(int id, int col, int row) {
+        this->entities[id].active = 1;
+        this->entities[id].col = (uint16_t)col;
+        this->entities[id].row = (uint16_t)row;
+    }
+
+    void removeEntity(int id) {
+        this->entities[id].active = 0;
+    }
+
+    const NetEntity& getEntity(int id) {
+        return this->entities[id];
+    }
+
+    // Um passo da simulacao de rede: le confirmacoes, grava o historico de entidades
+    // e envia um snapshot para cada cliente.
+    void update() {
+        this->receiveAcks();
+        this->tick++;
+        memcpy(this->history[this->tick % NET_HISTORY], this->entities, sizeof(this->entities));
+        this->historyTick[this->tick % NET_HISTORY] = this->tick;
+        double now = netSeconds();
+        for (int i = 0; i < NET_MAX_CLIENTS; i++) {
+            if (this->clients[i].used && now - this->clients[i].lastHeard > NET_TIMEOUT_SECONDS) this->clients[i].used = false;
+        }
+        this->compactLog();
+        for (int i = 0; i < NET_MAX_CLIENTS; i++) {
+            if (this->clients[i].used) this->sendSnapshot(this->clients[i]);
+        }
+    }
+
+    uint32_t getTick() {
+        return this->tick;
+    }
+
+    uint32_t getSeq() {
+        return this->seq;
+    }
+
+    int getClientCount() {
+        int n = 0;
+        for (int i = 0; i < NET_MAX_CLIENTS; i++) {
+            if (this->clients[i].used) n++;
+        }
+        return n;
+    }
+
+    const NetClientSlot& getClient(int i) {
+        return this->clients[i];
+    }
+
+    uint64_t getTotalBytes() {
+        return this->totalBytes;
+    }
+
+    // Pacotes que nao couberam todas as edicoes pendentes (o resto vai nos proximos ticks).
+    uint64_t getBudgetLimited() {
+        return this->budgetLimited;
+    }
+
+    size_t getLogSize() {
+        return this->log.size();
+    }
+};
+
+class NetClient {
+    UdpSocket sock;
+    sockaddr_in server;
+    TileMap* map;
+    uint32_t lastTick;
+    uint32_t seq;
+    bool synced;
+    uint32_t fullSeq;
+    uint32_t fullCursor;
+    uint32_t echo;
+    NetEntity entities[NET_MAX_ENTITIES];
+    NetEntity history[NET_HISTORY][NET_MAX_ENTITIES];
+    uint32_t historyTick[NET_HISTORY];
+    uint64_t bytesReceived;
+    uint64_t packetsReceived;
+    std::vector<float> latencyMs;
+
+    void writeValue(uint32_t index, unsigned char tile, unsigned char h) {
+        if (index >= (uint32_t)(this->map->getWidth() * this->map->getHeight())) return;
+        this->map->getMap()[index] = tile;
+        this->map->getElevations()[index] = h;
+    }
+
+    void handleSnapshot(BitReader& in) {
+        uint32_t tick = in.read(32);
+        uint32_t sentUs = in.read(32);
+        int w = (int)in.read(16);
+        int h = (int)in.read(16);
+        if (in.overflow() || w <= 0 || h <= 0) return;
+        if (this->map == NULL || this->map->getWidth() != w || this->map->getHeight() != h) {
+            delete this->map;
+            this->map = new TileMap(w, h, 0);
+            this->synced = false;
+            this->fullSeq = 0;
+            this->fullCursor = 0;
+        }
+        int colBits = bitsFor(w), rowBits = bitsFor(h), idxBits = bitsFor(w * h);
+
+        // Entidades: so aplica se o snapshot e mais novo e o cliente ainda tem o baseline.
+        uint32_t baseTick = in.read(32);
+        const NetEntity* base = NULL;
+        bool haveBase = baseTick == 0;
+        if (baseTick != 0 && this->historyTick[baseTick % NET_HISTORY] == baseTick) {
+            base = this->history[baseTick % NET_HISTORY];
+            haveBase = true;
+        }
+        bool applyEntities = haveBase && tick > this->lastTick;
+        NetEntity next[NET_MAX_ENTITIES];
+        if (base != NULL) memcpy(next, base, sizeof(next));
+        else memset(next, 0, sizeof(next));
+        for (int e = 0; e < NET_MAX_ENTITIES; e++) {
+            if (!in.readBool()) continue;
+            next[e].active = in.readBool() ? 1 : 0;
+            if (next[e].active) {
+                next[e].col = (uint16_t)in.read(colBits);
+                next[e].row = (uint16_t)in.read(rowBits);
+            }
+        }
+        if (in.overflow()) return;
+
+        bool delta = in.readBool();
+        if (!delta) {
+            uint32_t fullSeq = in.read(32);
+            uint32_t start = in.read(idxBits);
+            uint32_t count = in.read(idxBits + 1);
+            if (this->synced && fullSeq == this->fullSeq) return;
+            if (fullSeq != this->fullSeq) {
+                this->synced = false;
+                this->fullSeq = fullSeq;
+                this->fullCursor = 0;
+            }
+            bool apply = start <= this->fullCursor && start + count > this->fullCursor;
+            for (uint32_t i = 0; i < count && !in.overflow();) {
+                uint32_t run = in.readBool() ? in.read(8) : 1;
+                unsigned char tile = (unsigned char)in.read(8);
+                unsigned char h = (unsigned char)in.read(8);
+                for (uint32_t k = 0; k < run && i < count; k++, i++) {
+                    if (apply) this->writeValue(start + i, tile, h);
+                }
+            }
+            if (in.overflow()) return;
+            if (apply) this->fullCursor = start + count;
+            if (this->fullCursor >= (uint32_t)(w * h)) {
+                this->synced = true;
+                this->seq = fullSeq;
+            }
+        } else {
+            uint32_t baseSeq = in.read(32);
+            uint32_t lastSeq = in.read(32);
+            uint32_t count = in.read(16);
+            bool apply = this->synced && baseSeq <= this->seq && lastSeq > this->seq;
+            for (uint32_t i = 0; i < count; i++) {
+                uint32_t index = in.read(idxBits);
+                unsigned char tile = (unsigned char)in.read(8);
+                unsigned char h = (unsigned char)in.read(8);
+                if (apply) this->writeValue(index, tile, h);
+            }
+            if (in.overflow()) return;
+            if (apply) this->seq = lastSeq;
+        }
+
+        if (applyEntities) {
+            memcpy(this->entities, next, sizeof(next));
+            memcpy(this->history[tick % NET_HISTORY], next, sizeof(next));
+            this->historyTick[tick % NET_HISTORY] = tick;
+            this->lastTick = tick;
+        }
+        this->echo = sentUs;
+        this->latencyMs.push_back((float)(uint32_t)(netTimeUs() - sentUs) / 1000.0f);
+    }
+
+    void sendAck() {
+        uint8_t buf[32];
+        BitWriter out(buf, sizeof(buf));
+        out.write(NET_MAGIC, 16);
+        out.write(NET_MSG_ACK, 2);
+        out.write(this->lastTick, 32);
+        out.write(this->seq, 32);
+        out.write(this->fullSeq, 32);
+        out.write(this->fullCursor, 32);
+        out.writeBool(this->synced);
+        out.write(this->echo, 32);
+        this->sock.sendTo(this->server, buf, out.getBytes());
+        this->echo = 0;
+    }
+
+public:
+    NetClient() {
+        this->map = NULL;
+        this->lastTick = 0;
+        this->seq = 0;
+        this->synced = false;
+        this->fullSeq = 0;
+        this->fullCursor = 0;
+        this->echo = 0;
+        memset(this->entities, 0, sizeof(this->entities));
+        memset(this->history, 0, sizeof(this->history));
+        memset(this->historyTick, 0, sizeof(this->historyTick));
+        this->bytesReceived = 0;
+        this->packetsReceived = 0;
+    }
+
+    ~NetClient() {
+        delete this->map;
+    }
+
+    bool connect(unsigned short serverPort) {
+        if (!this->sock.open(0)) return false;
+        this->server = netLoopback(serverPort);
+        this->sendAck();
+        return true;
+    }
+
+    // Processa todos os pacotes pendentes e confirma o estado mais recente.
+    void update() {
+        uint8_t buf[NET_MAX_PACKET];
+        sockaddr_in from;
+        int n;
+        bool received = false;
+        while ((n = this->sock.recvFrom(from, buf, sizeof(buf))) > 0) {
+            BitReader in(buf, n);
+            if (in.read(16) != NET_MAGIC || in.read(2) != NET_MSG_SNAPSHOT) continue;
+            this->bytesReceived += n;
+            this->packetsReceived++;
+            this->handleSnapshot(in);
+            received = true;
+        }
+        if (received || this->map == NULL) this->sendAck();
+    }
+
+    TileMap* getMap() {
+        return this->map;
+    }
+
+    unsigned short getLocalPort() {
+        return this->sock.getPort();
+    }
+
+    const NetEntity& getEntity(int id) {
+        return this->entities[id];
+    }
+
+    bool isSynced() {
+        return this->synced;
+    }
+
+    uint32_t getSeq() {
+        return this->seq;
+    }
+
+    uint32_t getTick() {
+        return this->lastTick;
+    }
+
+    uint64_t getBytesReceived() {
+        return this->bytesReceived;
+    }
+
+    uint64_t getPacketsReceived() {
+        return this->packetsReceived;
+    }
+
+    std::vector<float>& getLatencies() {
+        return this->latencyMs;
+    }
+};
+
+#endif
@@ -0,0 +1,128 @@
+#ifndef RenderSettings_h
+#define RenderSettings_h
+
+#include <stdio.h>
+#include <string.h>
+
+#include <glad/glad.h>
+
+#include "FrameGraph.h"
+
+#define AA_NONE 0
+#define AA_MSAA 1
+#define AA_FXAA 2
+
+// Qualidade escolhida por instalacao (--aa none|msaa|fxaa, --samples N).
+struct RenderSettings {
+    int antialias;
+    int samples;
+
+    RenderSettings() {
+        this->antialias = AA_NONE;
+        this->samples = 4;
+    }
+
+    static int parseMode(const char* name) {
+        if (strcmp(name, "msaa") == 0) return AA_MSAA;
+        if (strcmp(name, "fxaa") == 0) return AA_FXAA;
+        return AA_NONE;
+    }
+
+    static const char* modeName(int mode) {
+        return mode == AA_MSAA ? "msaa" : (mode == AA_FXAA ? "fxaa" : "none");
+    }
+};
+
+// Alvo onde a cena e desenhada e o passe que leva o resultado para a tela, declarados
+// no grafo do frame (as texturas saem do pool dele).
+// AA_NONE: a cena vai direto para a tela, sem passe extra.
+// AA_MSAA: cor e profundidade multisample; o passe "resolve msaa" faz um blit para a tela.
+//          So alisa bordas de geometria: o passe de ids e o cache estatico sao por pixel.
+// AA_FXAA: cor de uma amostra; o passe "fxaa" roda o filtro (_screen_vs + _fxaa_fs) num
+//          triangulo de tela, o que alisa qualquer borda de contraste, inclusive as de alfa.
+class AntiAliasing {
+    RenderSettings settings;
+    GLuint fxaaProgram;
+    GLuint vao;
+    int samples;
+
+public:
+    AntiAliasing(GLuint fxaaProgram) {
+        this->fxaaProgram = fxaaProgram;
+        this->samples = 1;
+        glGenVertexArrays(1, &this->vao);
+        glUseProgram(this->fxaaProgram);
+        glUniform1i(glGetUniformLocation(this->fxaaProgram, "sceneColor"), 0);
+    }
+
+    ~AntiAliasing() {
+        glDeleteVertexArrays(1, &this->vao);
+    }
+
+    void apply(const RenderSettings& s) {
+        this->settings = s;
+        this->samples = 1;
+        if (s.antialias == AA_MSAA) {
+            GLint maxSamples = 0;
+            glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+            this->samples = s.samples > maxSamples ? maxSamples : s.samples;
+        }
+    }
+
+    const RenderSettings& getSettings() {
+        return this->settings;
+    }
+
+    // Amostras de fato usadas (o pedido e limitado por GL_MAX_SAMPLES).
+    int getSamples() {
+        return this->samples;
+    }
+
+    // Onde o passe da cena escreve: retorna a cor e poe em depth a profundidade (-1 quando
+    // e a propria tela, que ja tem a sua).
+    int declareTarget(FrameGraph& graph, int screen, int width, int height, int& depth) {
+        depth = -1;
+        if (this->settings.antialias == AA_NONE) return screen;
+        depth = graph.createTexture("cena profundidade", width, height, GL_DEPTH_COMPONENT24, this->samples);
+        return graph.createTexture("cena cor", width, height, GL_RGBA8, this->samples);
+    }
+
+    // Passe que leva color (de declareTarget) para a tela.
+    void addResolve(FrameGraph& graph, int color, int screen) {
+        if (this->settings.antialias == AA_NONE) return;
+        FrameGraph* g = &graph;
+        int pass;
+        if (this->settings.antialias == AA_MSAA) {
+            pass = graph.addPass("resolve msaa", [g, color]() {
+                GLint viewport[4];
+                glGetIntegerv(GL_VIEWPORT, viewport);
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, g->getFramebuffer(color));
+                glBlitFramebuffer(0, 0, viewport[2], viewport[3], 0, 0, viewport[2], viewport[3], GL_COLOR_BUFFER_BIT, GL_NEAREST);
+                GLint screen;
+                glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &screen);
+                glBindFramebuffer(GL_READ_FRAMEBUFFER, screen);
+            });
+        } else {
+            GLuint program = this->fxaaProgram, vao = this->vao;
+            pass = graph.addPass("fxaa", [g, color, program, vao]() {
+                GLint viewport[4];
+                glGetIntegerv(GL_VIEWPORT, viewport);
+                glUseProgram(program);
+                glUniform2f(glGetUniformLocation(program, "texelSize"), 1.0f / viewport[2], 1.0f / viewport[3]);
+                glActiveTexture(GL_TEXTURE0);
+                glBindTexture(GL_TEXTURE_2D, g->getTexture(color));
+                glDisable(GL_BLEND);
+                glDisable(GL_DEPTH_TEST);
+                glBindVertexArray(vao);
+                glDrawArrays(GL_TRIANGLES, 0, 3);
+                glBindVertexArray(0);
+                glEnable(GL_DEPTH_TEST);
+                glEnable(GL_BLEND);
+            });
+        }
+        graph.read(pass, color);
+        graph.write(pass, screen);
+    }
+};
+
+#endif
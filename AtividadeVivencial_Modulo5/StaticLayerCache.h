@@ -0,0 +1,202 @@
+#ifndef StaticLayerCache_h
+#define StaticLayerCache_h
+
+#include <iostream>
+#include <vector>
+
+#include <glad/glad.h>
+
+#define STATIC_CACHE_MAX_RECTS 16
+
+// Retangulo sujo em NDC (x0, y0, x1, y1).
+struct DirtyRect {
+    float x0, y0, x1, y1;
+};
+
+// Camadas estaticas do mapa desenhadas uma vez num framebuffer fora da tela (cor +
+// profundidade). Cada frame vira um passe de tela que copia cor e profundidade do cache,
+// e so o que e dinamico (player, tiles animados) e desenhado por cima com depth test.
+// Editar um tile suja um retangulo, que e limpo e redesenhado com scissor; mover a
+// camera ou mudar o tamanho da janela suja tudo.
+class StaticLayerCache {
+    GLuint fbo;
+    GLuint color;
+    GLuint depth;
+    GLuint program;
+    GLuint vao;
+    int width, height;
+    bool full;
+    std::vector<DirtyRect> rects;
+    float clear[4];
+    long long repaints, partialRepaints, pixelsRepainted;
+
+    void toPixels(const DirtyRect& r, int& x, int& y, int& w, int& h) {
+        int x0 = (int)((r.x0 + 1.0f) * 0.5f * this->width) - 1;
+        int y0 = (int)((r.y0 + 1.0f) * 0.5f * this->height) - 1;
+        int x1 = (int)((r.x1 + 1.0f) * 0.5f * this->width) + 2;
+        int y1 = (int)((r.y1 + 1.0f) * 0.5f * this->height) + 2;
+        x = x0 < 0 ? 0 : x0;
+        y = y0 < 0 ? 0 : y0;
+        w = (x1 > this->width ? this->width : x1) - x;
+        h = (y1 > this->height ? this->height : y1) - y;
+    }
+
+    // O retangulo em pixels de volta para NDC, para o clip cobrir tudo que o scissor limpou.
+    DirtyRect toNdc(int x, int y, int w, int h) {
+        DirtyRect r;
+        r.x0 = (float)x / this->width * 2.0f - 1.0f;
+        r.y0 = (float)y / this->height * 2.0f - 1.0f;
+        r.x1 = (float)(x + w) / this->width * 2.0f - 1.0f;
+        r.y1 = (float)(y + h) / this->height * 2.0f - 1.0f;
+        return r;
+    }
+
+public:
+    // program e o passe de composicao (_screen_vs + _composite_fs).
+    StaticLayerCache(GLuint program) {
+        this->program = program;
+        this->fbo = this->color = this->depth = 0;
+        this->width = this->height = 0;
+        this->full = true;
+        this->clear[0] = this->clear[1] = this->clear[2] = 0.0f;
+        this->clear[3] = 1.0f;
+        this->repaints = this->partialRepaints = this->pixelsRepainted = 0;
+        glGenVertexArrays(1, &this->vao);
+    }
+
+    ~StaticLayerCache() {
+        glDeleteVertexArrays(1, &this->vao);
+        if (this->fbo) glDeleteFramebuffers(1, &this->fbo);
+        if (this->color) glDeleteTextures(1, &this->color);
+        if (this->depth) glDeleteTextures(1, &this->depth);
+    }
+
+    // Mesma cor de fundo da tela, para a composicao ficar identica ao desenho direto.
+    void setClearColor(float r, float g, float b, float a) {
+        this->clear[0] = r;
+        this->clear[1] = g;
+        this->clear[2] = b;
+        this->clear[3] = a;
+    }
+
+    // Chamado todo frame com o tamanho do framebuffer; so realoca quando ele muda.
+    void resize(int w, int h) {
+        if (w == this->width && h == this->height && this->fbo) return;
+        this->width = w;
+        this->height = h;
+        if (!this->fbo) {
+            glGenFramebuffers(1, &this->fbo);
+            glGenTextures(1, &this->color);
+            glGenTextures(1, &this->depth);
+        }
+        glBindTexture(GL_TEXTURE_2D, this->color);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, this->depth);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, w, h, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, this->color, 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, this->depth, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            std::cout << "ERRO: framebuffer do cache estatico incompleto" << std::endl;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        this->invalidateAll();
+    }
+
+    GLuint getFramebuffer() {
+        return this->fbo;
+    }
+
+    void invalidateAll() {
+        this->full = true;
+        this->rects.clear();
+    }
+
+    void invalidateRect(float x0, float y0, float x1, float y1) {
+        if (this->full) return;
+        if ((int)this->rects.size() >= STATIC_CACHE_MAX_RECTS) {
+            this->invalidateAll();
+            return;
+        }
+        DirtyRect r;
+        r.x0 = x0;
+        r.y0 = y0;
+        r.x1 = x1;
+        r.y1 = y1;
+        this->rects.push_back(r);
+    }
+
+    bool needsRepaint() {
+        return this->full || !this->rects.empty();
+    }
+
+    // Redesenha o que estiver sujo. drawStatic(clip) desenha as camadas estaticas; clip e
+    // a area limpa pelo scissor, o retangulo sujo com a folga do toPixels (NULL no
+    // redesenho completo), e serve para pular blocos fora dele.
+    template <class DrawFn>
+    void repaint(DrawFn drawStatic) {
+        if (!this->needsRepaint()) return;
+        // Volta para o alvo que estava ligado (a tela ou o alvo de anti-aliasing).
+        GLint viewport[4], target;
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &target);
+        glBindFramebuffer(GL_FRAMEBUFFER, this->fbo);
+        glViewport(0, 0, this->width, this->height);
+        glClearColor(this->clear[0], this->clear[1], this->clear[2], this->clear[3]);
+        if (this->full) {
+            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            drawStatic((const DirtyRect*)NULL);
+            this->repaints++;
+            this->pixelsRepainted += (long long)this->width * this->height;
+        } else {
+            glEnable(GL_SCISSOR_TEST);
+            for (size_t i = 0; i < this->rects.size(); i++) {
+                int x, y, w, h;
+                this->toPixels(this->rects[i], x, y, w, h);
+                if (w <= 0 || h <= 0) continue;
+                glScissor(x, y, w, h);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+                DirtyRect clip = this->toNdc(x, y, w, h);
+                drawStatic(&clip);
+                this->partialRepaints++;
+                this->pixelsRepainted += (long long)w * h;
+            }
+            glDisable(GL_SCISSOR_TEST);
+        }
+        this->full = false;
+        this->rects.clear();
+        glBindFramebuffer(GL_FRAMEBUFFER, target);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    }
+
+    // Copia cor e profundidade do cache para a tela num unico passe.
+    void composite() {
+        glUseProgram(this->program);
+        glUniform1i(glGetUniformLocation(this->program, "cachedColor"), 0);
+        glUniform1i(glGetUniformLocation(this->program, "cachedDepth"), 1);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, this->color);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, this->depth);
+        glDisable(GL_BLEND);
+        glDepthFunc(GL_ALWAYS);
+        glBindVertexArray(this->vao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glDepthFunc(GL_LEQUAL);
+        glEnable(GL_BLEND);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    void printStats() {
+        std::cout << "cache estatico: " << this->repaints << " redesenhos completos, " << this->partialRepaints
+                  << " retangulos, " << this->pixelsRepainted / 1000 << " mil pixels redesenhados" << std::endl;
+    }
+};
+
+#endif
@@ -0,0 +1,132 @@
+#ifndef TileIdRenderer_h
+#define TileIdRenderer_h
+
+#include <glad/glad.h>
+
+#include "TileMap.h"
+#include "TileSets.h"
+#include "TileStack.h"
+#include "TileTypes.h"
+
+// Modo de desenho alternativo: o mapa inteiro vai para a GPU como uma textura inteira
+// (GL_R8UI, um texel por celula) e um unico triangulo que cobre a tela inverte a projecao
+// do DiamondView por pixel, busca o id do tile e amostra o tileset. O custo de vertices
+// fica constante, qualquer que seja o tamanho do mapa, e setTile vira um glTexSubImage2D
+// de um texel. So desenha o plano do chao (nivel 0): mapas com elevacao usam a geometria.
+class TileIdRenderer {
+    TileMap* map;
+    GLuint program;
+    GLuint vao;
+    GLuint mapTex;
+    GLuint lutTex;
+    int width, height;
+    // Por id de tile: camada do tileset, origem u e v do frame (ja com a animacao aplicada).
+    float lut[TILE_MAX_TYPES * 4];
+
+public:
+    TileIdRenderer(GLuint program) {
+        this->map = NULL;
+        this->program = program;
+        this->width = this->height = 0;
+        // O triangulo de tela e gerado a partir de gl_VertexID, sem buffer de vertices.
+        glGenVertexArrays(1, &this->vao);
+        glGenTextures(1, &this->mapTex);
+        glGenTextures(1, &this->lutTex);
+        glBindTexture(GL_TEXTURE_2D, this->lutTex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, TILE_MAX_TYPES, 1, 0, GL_RGBA, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    ~TileIdRenderer() {
+        glDeleteVertexArrays(1, &this->vao);
+        glDeleteTextures(1, &this->mapTex);
+        glDeleteTextures(1, &this->lutTex);
+    }
+
+    void setMap(TileMap* map) {
+        this->map = map;
+        this->width = map->getWidth();
+        this->height = map->getHeight();
+        glBindTexture(GL_TEXTURE_2D, this->mapTex);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, this->width, this->height, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, map->getMap());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Edita o mapa e o texel correspondente.
+    void setTile(int col, int row, unsigned char tile) {
+        this->map->setTile(col, row, tile);
+        glBindTexture(GL_TEXTURE_2D, this->mapTex);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, col, row, 1, 1, GL_RED_INTEGER, GL_UNSIGNED_BYTE, &tile);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Reenvia um retangulo de celulas ja alterado no mapa (p.ex. blocos da simulacao).
+    void updateRect(int col, int row, int w, int h) {
+        glBindTexture(GL_TEXTURE_2D, this->mapTex);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, this->width);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, col, row, w, h, GL_RED_INTEGER, GL_UNSIGNED_BYTE,
+                        this->map->getMap() + (size_t)row * this->width + col);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Refaz a tabela id -> frame do tileset; chamada uma vez por frame por causa das animacoes.
+    void updateLut(TileTypes* types, TileSetManager* sets, int gidBase, double timeMs) {
+        for (int id = 0; id < TILE_MAX_TYPES; id++) {
+            int layer, frame;
+            float* e = &this->lut[id * 4];
+            if (sets->resolve(types->animatedTile(id, timeMs) + gidBase, layer, frame)) {
+                e[0] = (float)layer;
+                sets->frameOrigin(layer, frame, e[1], e[2]);
+                e[3] = 1.0f;
+            } else {
+                e[0] = e[1] = e[2] = e[3] = 0.0f;
+            }
+        }
+        glBindTexture(GL_TEXTURE_2D, this->lutTex);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, TILE_MAX_TYPES, 1, GL_RGBA, GL_FLOAT, this->lut);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // tw, th e o deslocamento (offsetX, offsetY) do mapa na tela sao os mesmos usados pela
+    // geometria, para os dois modos coincidirem. A profundidade segue TileStack::depthOf no nivel 0.
+    void draw(TileSetManager* sets, TileStack* stack, float tw, float th, float offsetX, float offsetY) {
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glUseProgram(this->program);
+        sets->setUniforms(this->program);
+        glUniform4f(glGetUniformLocation(this->program, "viewport"),
+                    (float)viewport[0], (float)viewport[1], (float)viewport[2], (float)viewport[3]);
+        glUniform2f(glGetUniformLocation(this->program, "tileSize"), tw, th);
+        glUniform2f(glGetUniformLocation(this->program, "offset"), offsetX, offsetY);
+        glUniform2i(glGetUniformLocation(this->program, "mapSize"), this->width, this->height);
+        stack->getBlocks();
+        float range = (float)(this->width + this->height + stack->getMaxLevel() + 2);
+        glUniform2f(glGetUniformLocation(this->program, "depthParams"), (float)(stack->getMaxLevel() + 1), range);
+        glUniform1i(glGetUniformLocation(this->program, "tileIds"), 1);
+        glUniform1i(glGetUniformLocation(this->program, "tileLut"), 2);
+
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, sets->getTexture());
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, this->mapTex);
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_2D, this->lutTex);
+        glBindVertexArray(this->vao);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+};
+
+#endif
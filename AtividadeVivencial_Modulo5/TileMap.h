@@ -1,19 +1,51 @@
+#ifndef TileMap_h
+#define TileMap_h
+
+#include <string.h>
+
 class TileMap {
     float z;
     unsigned int tid;
     int width, height;
     unsigned char *map;
+    unsigned char *elevation;
+    // false quando os arrays sao de fora (p.ex. um save mapeado com mmap).
+    bool ownsMap, ownsElevation;
 
     
 public:
     TileMap(int w, int h, unsigned char initWith) {
         this->map = new unsigned char [w*h];
+        this->elevation = new unsigned char [w*h];
+        memset(this->map, initWith, w*h);
+        memset(this->elevation, 0, w*h);
+        this->width = w;
+        this->height = h;
+        this->z = 0.0f;
+        this->tid = 0;
+        this->ownsMap = this->ownsElevation = true;
+    }
+    
+    // Usa memoria de fora sem copiar; ela tem que viver mais que o TileMap.
+    TileMap(int w, int h, unsigned char* tiles, unsigned char* elevation) {
+        this->map = tiles;
+        this->elevation = elevation;
         this->width = w;
         this->height = h;
         this->z = 0.0f;
         this->tid = 0;
+        this->ownsMap = this->ownsElevation = false;
     }
     
+    ~TileMap() {
+        if (this->ownsMap) delete[] this->map;
+        if (this->ownsElevation) delete[] this->elevation;
+    }
+
+    // Os arrays sao de um dono so: copiar liberaria duas vezes.
+    TileMap(const TileMap&) = delete;
+    TileMap& operator=(const TileMap&) = delete;
+    
     unsigned char* getMap() {
         return this->map;
     }
@@ -34,6 +66,29 @@ public:
         this->map[col + row * this->width] = tile;
     }
     
+    // Troca os tiles com outro mapa do mesmo tamanho (buffers duplos da simulacao);
+    // quem guarda o ponteiro do TileMap continua vendo o mapa atual.
+    void swapTiles(TileMap* other) {
+        unsigned char* t = this->map;
+        this->map = other->map;
+        other->map = t;
+        bool o = this->ownsMap;
+        this->ownsMap = other->ownsMap;
+        other->ownsMap = o;
+    }
+    
+    unsigned char* getElevations() {
+        return this->elevation;
+    }
+    
+    int getElevation(int col, int row) {
+        return this->elevation[col + row * this->width];
+    }
+    
+    void setElevation(int col, int row, unsigned char h) {
+        this->elevation[col + row * this->width] = h;
+    }
+    
     int getTileSet() {
         return this->tid;
     }
@@ -52,3 +107,4 @@ public:
     
 };
 
+#endif
@@ -0,0 +1,224 @@
+#ifndef TileSets_h
+#define TileSets_h
+
+#include <stdint.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+#include "TextureCodec.h"
+
+#define TILESET_MAX 16
+#define TILESET_NONE 0xFFFFFFFFu
+// Bits de espelhamento que o Tiled guarda no topo do gid.
+#define TILESET_GID_MASK 0x1FFFFFFFu
+
+struct TileSetInfo {
+    std::string image;
+    int firstgid;
+    int tileW, tileH;
+    int columns, count;
+    int margin, spacing;
+    int imageW, imageH;
+};
+
+// Varios tilesets por mapa, no esquema do Tiled: cada tileset ocupa a faixa de gids
+// [firstgid, firstgid + count). Uma tabela plana indexada pelo gid devolve (camada, frame)
+// sem busca, e cada tileset vira uma camada de uma unica GL_TEXTURE_2D_ARRAY, entao uma
+// camada do mapa que mistura tilesets continua sendo desenhada numa chamada so.
+class TileSetManager {
+    std::vector<TileSetInfo> sets;
+    std::vector<uint32_t> lut;
+    GLuint texture;
+    int layerW, layerH;
+
+    void buildLut() {
+        uint32_t maxGid = 0;
+        for (size_t i = 0; i < this->sets.size(); i++) {
+            uint32_t last = (uint32_t)(this->sets[i].firstgid + this->sets[i].count);
+            if (last > maxGid) maxGid = last;
+        }
+        this->lut.assign(maxGid + 1, TILESET_NONE);
+        // Em caso de faixas sobrepostas vale o tileset de maior firstgid, como no Tiled.
+        for (size_t i = 0; i < this->sets.size(); i++) {
+            const TileSetInfo& t = this->sets[i];
+            for (int f = 0; f < t.count; f++) {
+                uint32_t gid = (uint32_t)(t.firstgid + f);
+                uint32_t cur = this->lut[gid];
+                if (cur != TILESET_NONE && this->sets[cur >> 16].firstgid > t.firstgid) continue;
+                this->lut[gid] = ((uint32_t)i << 16) | (uint32_t)f;
+            }
+        }
+    }
+
+public:
+    TileSetManager() {
+        this->texture = 0;
+        this->layerW = 0;
+        this->layerH = 0;
+    }
+
+    ~TileSetManager() {
+        if (this->texture) glDeleteTextures(1, &this->texture);
+    }
+
+    // columns e count podem ser 0: nesse caso saem do tamanho da imagem em build().
+    int addTileSet(const char* image, int firstgid, int tileW, int tileH, int columns = 0, int count = 0) {
+        if ((int)this->sets.size() >= TILESET_MAX) {
+            std::cout << "ERRO: limite de " << TILESET_MAX << " tilesets atingido" << std::endl;
+            return -1;
+        }
+        TileSetInfo t;
+        t.image = image;
+        t.firstgid = firstgid;
+        t.tileW = tileW;
+        t.tileH = tileH;
+        t.columns = columns;
+        t.count = count;
+        t.margin = t.spacing = 0;
+        t.imageW = t.imageH = 0;
+        this->sets.push_back(t);
+        return (int)this->sets.size() - 1;
+    }
+
+    // Colunas e numero de tiles que addTileSet nao informou, pelo tamanho da imagem.
+    void measure(TileSetInfo& t) {
+        if (t.columns <= 0) t.columns = (t.imageW - 2 * t.margin + t.spacing) / (t.tileW + t.spacing);
+        int rows = (t.imageH - 2 * t.margin + t.spacing) / (t.tileH + t.spacing);
+        if (t.columns < 1) t.columns = 1;
+        if (t.count <= 0) t.count = t.columns * rows;
+        if (t.imageW > this->layerW) this->layerW = t.imageW;
+        if (t.imageH > this->layerH) this->layerH = t.imageH;
+    }
+
+    // Todas as imagens com .ctex no mesmo formato e tamanho: a textura array sobe ja
+    // comprimida (so o nivel 0, o filtro e NEAREST). Senao volta aos PNGs em RGBA8.
+    bool buildCompressed(double t0) {
+        std::vector<CompressedImage> images(this->sets.size());
+        for (size_t i = 0; i < this->sets.size(); i++) {
+            if (!TextureLoader::find(this->sets[i].image.c_str(), images[i])) return false;
+            if (images[i].format != images[0].format || images[i].width != images[0].width
+                || images[i].height != images[0].height) return false;
+        }
+        this->layerW = this->layerH = 0;
+        for (size_t i = 0; i < this->sets.size(); i++) {
+            this->sets[i].imageW = images[i].width;
+            this->sets[i].imageH = images[i].height;
+            this->measure(this->sets[i]);
+        }
+        GLenum internal = TextureCodec::glFormat(images[0].format);
+        GLsizei layerBytes = (GLsizei)images[0].levels[0].data.size();
+        GLsizei layers = (GLsizei)this->sets.size();
+        glBindTexture(GL_TEXTURE_2D_ARRAY, this->texture);
+        glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, 0, internal, this->layerW, this->layerH, layers, 0, layerBytes * layers, NULL);
+        for (size_t i = 0; i < this->sets.size(); i++) {
+            glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, (GLint)i, this->layerW, this->layerH, 1, internal,
+                                      layerBytes, images[i].levels[0].data.data());
+        }
+        TextureLoader::account((size_t)layerBytes * layers, (size_t)this->layerW * this->layerH * 4 * layers,
+                               (TextureLoader::now() - t0) * 1000.0);
+        return true;
+    }
+
+    // Carrega as imagens, monta a textura array (uma camada por tileset, do tamanho da
+    // maior imagem) e a tabela de gids. Espera stbi_set_flip_vertically_on_load(true),
+    // como o resto da cena.
+    bool build() {
+        double t0 = TextureLoader::now();
+        if (this->texture) glDeleteTextures(1, &this->texture);
+        glGenTextures(1, &this->texture);
+        if (!this->buildCompressed(t0)) {
+            std::vector<unsigned char*> pixels(this->sets.size(), (unsigned char*)NULL);
+            this->layerW = this->layerH = 0;
+            for (size_t i = 0; i < this->sets.size(); i++) {
+                TileSetInfo& t = this->sets[i];
+                int n;
+                pixels[i] = stbi_load(t.image.c_str(), &t.imageW, &t.imageH, &n, 4);
+                if (!pixels[i]) {
+                    std::cout << "Falha ao carregar a textura: " << t.image << std::endl;
+                    t.imageW = t.imageH = 0;
+                    t.count = 0;
+                    continue;
+                }
+                this->measure(t);
+            }
+            if (this->layerW == 0) {
+                glDeleteTextures(1, &this->texture);
+                this->texture = 0;
+                return false;
+            }
+
+            glBindTexture(GL_TEXTURE_2D_ARRAY, this->texture);
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA8, this->layerW, this->layerH, (GLsizei)this->sets.size(),
+                         0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+            for (size_t i = 0; i < this->sets.size(); i++) {
+                if (!pixels[i]) continue;
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, (GLint)i, this->sets[i].imageW, this->sets[i].imageH, 1,
+                                GL_RGBA, GL_UNSIGNED_BYTE, pixels[i]);
+                stbi_image_free(pixels[i]);
+            }
+            size_t bytes = (size_t)this->layerW * this->layerH * 4 * this->sets.size();
+            TextureLoader::account(bytes, bytes, (TextureLoader::now() - t0) * 1000.0);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+        this->buildLut();
+        return true;
+    }
+
+    // gid -> (camada da textura array, frame local ao tileset). gid 0 e celula vazia.
+    bool resolve(unsigned int gid, int& layer, int& frame) {
+        gid &= TILESET_GID_MASK;
+        if (gid >= this->lut.size() || this->lut[gid] == TILESET_NONE) return false;
+        layer = (int)(this->lut[gid] >> 16);
+        frame = (int)(this->lut[gid] & 0xFFFF);
+        return true;
+    }
+
+    // Canto inferior esquerdo do frame na camada, em coordenadas de textura (a imagem
+    // foi carregada de baixo para cima, entao a linha 0 de tiles fica no topo).
+    void frameOrigin(int layer, int frame, float& u, float& v) {
+        const TileSetInfo& t = this->sets[layer];
+        int col = frame % t.columns, row = frame / t.columns;
+        int px = t.margin + col * (t.tileW + t.spacing);
+        int py = t.margin + row * (t.tileH + t.spacing);
+        u = (float)px / (float)this->layerW;
+        v = (float)(t.imageH - py - t.tileH) / (float)this->layerH;
+    }
+
+    // Tamanho de um tile de cada camada em coordenadas de textura, para o uniform tileUV[].
+    void setUniforms(GLuint program) {
+        float uv[TILESET_MAX * 2];
+        for (size_t i = 0; i < this->sets.size(); i++) {
+            uv[i * 2] = (float)this->sets[i].tileW / (float)this->layerW;
+            uv[i * 2 + 1] = (float)this->sets[i].tileH / (float)this->layerH;
+        }
+        glUniform2fv(glGetUniformLocation(program, "tileUV"), (GLsizei)this->sets.size(), uv);
+        glUniform1i(glGetUniformLocation(program, "tileSets"), 0);
+    }
+
+    GLuint getTexture() {
+        return this->texture;
+    }
+
+    int getCount() {
+        return (int)this->sets.size();
+    }
+
+    int getFirstGid(int set) {
+        return this->sets[set].firstgid;
+    }
+
+    const TileSetInfo& getInfo(int set) {
+        return this->sets[set];
+    }
+};
+
+#endif
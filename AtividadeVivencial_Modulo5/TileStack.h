@@ -0,0 +1,124 @@
+#ifndef TileStack_h
+#define TileStack_h
+
+#include <atomic>
+#include <vector>
+
+#include "TileMap.h"
+
+struct StackBlock {
+    int col, row, level;
+    unsigned char tile;
+    float depth;
+};
+
+// Lista de blocos visiveis de um mapa com elevacao. Cada celula (col,row) empilha
+// blocos nos niveis 0..getElevation(col,row); o bloco do topo usa o tile da celula.
+// A ordem isometrica e resolvida no depth buffer: cada bloco recebe uma profundidade
+// (col + row - level) normalizada, entao a lista so precisa ser refeita quando o mapa
+// muda, nunca reordenada a cada frame.
+class TileStack {
+    TileMap* map;
+    std::vector<StackBlock> blocks;
+    int maxLevel;
+    int culled;
+    bool dirty;
+    unsigned long long version;
+
+    // Versoes unicas entre todas as pilhas (rebuild tambem roda nos workers do pool).
+    static unsigned long long nextVersion() {
+        static std::atomic<unsigned long long> counter(0);
+        return ++counter;
+    }
+
+    // Sem vizinho (fora do mapa) a face fica exposta.
+    int neighbourElevation(int col, int row) {
+        if (col < 0 || row < 0 || col >= this->map->getWidth() || row >= this->map->getHeight()) return -1;
+        return this->map->getElevation(col, row);
+    }
+
+    // Um bloco esta totalmente escondido quando ha outro bloco em cima dele e as duas
+    // faces frontais (voltadas para col-1 e row-1) encostam em pilhas no mesmo nivel.
+    bool isHidden(int col, int row, int level, int top) {
+        return level < top
+            && this->neighbourElevation(col - 1, row) >= level
+            && this->neighbourElevation(col, row - 1) >= level;
+    }
+
+public:
+    TileStack(TileMap* map) {
+        this->map = map;
+        this->maxLevel = 0;
+        this->culled = 0;
+        this->dirty = true;
+        this->version = 0;
+    }
+
+    void invalidate() {
+        this->dirty = true;
+    }
+
+    void setMap(TileMap* map) {
+        this->map = map;
+        this->dirty = true;
+    }
+
+    // Profundidade em NDC: menor = mais perto da camera.
+    float depthOf(float col, float row, float level) {
+        float range = (float)(this->map->getWidth() + this->map->getHeight() + this->maxLevel + 2);
+        float v = (col + row - level + this->maxLevel + 1) / range;
+        return v * 1.8f - 0.9f;
+    }
+
+    void rebuild() {
+        int w = this->map->getWidth(), h = this->map->getHeight();
+        this->maxLevel = 0;
+        for (int i = 0; i < w * h; i++) {
+            if (this->map->getElevations()[i] > this->maxLevel) this->maxLevel = this->map->getElevations()[i];
+        }
+        this->blocks.clear();
+        this->culled = 0;
+        for (int r = 0; r < h; r++) {
+            for (int c = 0; c < w; c++) {
+                int top = this->map->getElevation(c, r);
+                for (int l = 0; l <= top; l++) {
+                    if (this->isHidden(c, r, l, top)) {
+                        this->culled++;
+                        continue;
+                    }
+                    StackBlock b;
+                    b.col = c;
+                    b.row = r;
+                    b.level = l;
+                    b.tile = (unsigned char)this->map->getTile(c, r);
+                    b.depth = this->depthOf((float)c, (float)r, (float)l);
+                    this->blocks.push_back(b);
+                }
+            }
+        }
+        this->dirty = false;
+        this->version = nextVersion();
+    }
+
+    const std::vector<StackBlock>& getBlocks() {
+        if (this->dirty) this->rebuild();
+        return this->blocks;
+    }
+
+    // Muda a cada rebuild. Quem guarda algo derivado dos blocos (os chunks de desenho)
+    // compara so este numero, inclusive depois de trocar de pilha.
+    unsigned long long getVersion() {
+        if (this->dirty) this->rebuild();
+        return this->version;
+    }
+
+    int getCulled() {
+        return this->culled;
+    }
+
+    int getMaxLevel() {
+        return this->maxLevel;
+    }
+};
+
+#endif
@@ -0,0 +1,285 @@
+#ifndef TileTypes_h
+#define TileTypes_h
+
+#include <stdint.h>
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <iostream>
+
+#include "TileMap.h"
+
+#define TILE_MAX_TYPES 256
+#define TILE_MASK_WORDS (TILE_MAX_TYPES / 64)
+
+#define TILEPROP_WALKABLE 0
+#define TILEPROP_OPAQUE 1
+#define TILEPROP_ANIMATED 2
+#define TILEPROP_COUNT 3
+
+#define TILEFLAG_WALKABLE (1u << TILEPROP_WALKABLE)
+#define TILEFLAG_OPAQUE (1u << TILEPROP_OPAQUE)
+#define TILEFLAG_ANIMATED (1u << TILEPROP_ANIMATED)
+
+// Tabela de propriedades por tipo de tile, em forma struct-of-arrays:
+// cada propriedade e um array denso indexado pelo id do tile.
+class TileTypes {
+    int count;
+    unsigned char walkable[TILE_MAX_TYPES];
+    unsigned char opaque[TILE_MAX_TYPES];
+    unsigned short cost[TILE_MAX_TYPES];
+    unsigned short animStart[TILE_MAX_TYPES];
+    unsigned short animLength[TILE_MAX_TYPES];
+    unsigned int animTotalMs[TILE_MAX_TYPES];
+    std::vector<unsigned char> animFrameTile;
+    std::vector<unsigned int> animFrameMs;
+
+    // flags[id] junta todas as propriedades booleanas em 32 bits (um gather por tile);
+    // masks[prop] e o bitset de ids que possuem a propriedade.
+    uint32_t flags[TILE_MAX_TYPES];
+    uint64_t masks[TILEPROP_COUNT][TILE_MASK_WORDS];
+
+    void reset() {
+        this->count = 0;
+        for (int i = 0; i < TILE_MAX_TYPES; i++) {
+            this->walkable[i] = 1;
+            this->opaque[i] = 0;
+            this->cost[i] = 1;
+            this->animStart[i] = 0;
+            this->animLength[i] = 0;
+            this->animTotalMs[i] = 0;
+        }
+        this->animFrameTile.clear();
+        this->animFrameMs.clear();
+    }
+
+    void setAnimation(int id, const std::vector<unsigned char>& tiles, const std::vector<unsigned int>& ms) {
+        this->animStart[id] = (unsigned short)this->animFrameTile.size();
+        this->animLength[id] = (unsigned short)tiles.size();
+        this->animTotalMs[id] = 0;
+        for (size_t i = 0; i < tiles.size(); i++) {
+            this->animFrameTile.push_back(tiles[i]);
+            this->animFrameMs.push_back(ms[i] > 0 ? ms[i] : 1);
+            this->animTotalMs[id] += ms[i] > 0 ? ms[i] : 1;
+        }
+    }
+
+    void touch(int id) {
+        if (id + 1 > this->count) this->count = id + 1;
+    }
+
+    static bool readAttr(const std::string& line, const char* name, std::string& value) {
+        std::string key = std::string(name) + "=\"";
+        size_t p = line.find(key);
+        if (p == std::string::npos) return false;
+        p += key.size();
+        size_t e = line.find('"', p);
+        if (e == std::string::npos) return false;
+        value = line.substr(p, e - p);
+        return true;
+    }
+
+    static bool parseBool(const std::string& v) {
+        return v == "true" || v == "1";
+    }
+
+public:
+    TileTypes() {
+        this->reset();
+        this->rebuildMasks();
+    }
+
+    // Formato sidecar (.tiles), uma linha por tipo:
+    //   id walkable cost opaque [frameId:ms frameId:ms ...]
+    // Linhas iniciadas por '#' sao comentarios.
+    bool loadSidecar(const char* filename) {
+        std::ifstream arq(filename);
+        if (!arq.is_open()) {
+            std::cout << "ERRO: Não foi possível abrir a tabela de tiles: " << filename << std::endl;
+            return false;
+        }
+        this->reset();
+        std::string line;
+        while (std::getline(arq, line)) {
+            if (line.empty() || line[0] == '#') continue;
+            std::istringstream ss(line);
+            int id, walk, c, opq;
+            if (!(ss >> id >> walk >> c >> opq)) continue;
+            if (id < 0 || id >= TILE_MAX_TYPES) continue;
+            this->touch(id);
+            this->walkable[id] = walk ? 1 : 0;
+            this->cost[id] = (unsigned short)(c > 0 ? c : 1);
+            this->opaque[id] = opq ? 1 : 0;
+            std::vector<unsigned char> tiles;
+            std::vector<unsigned int> ms;
+            std::string frame;
+            while (ss >> frame) {
+                int ft = 0, fms = 0;
+                if (sscanf(frame.c_str(), "%d:%d", &ft, &fms) == 2 && ft >= 0 && ft < TILE_MAX_TYPES) {
+                    tiles.push_back((unsigned char)ft);
+                    ms.push_back((unsigned int)fms);
+                    this->touch(ft);
+                }
+            }
+            if (tiles.size() > 1) this->setAnimation(id, tiles, ms);
+        }
+        arq.close();
+        this->rebuildMasks();
+        return true;
+    }
+
+    // Le as propriedades customizadas (walkable, cost, opaque) e as <animation>
+    // de um tileset do Tiled (.tsx).
+    bool loadTsx(const char* filename) {
+        std::ifstream arq(filename);
+        if (!arq.is_open()) {
+            std::cout << "ERRO: Não foi possível abrir o tileset: " << filename << std::endl;
+            return false;
+        }
+        this->reset();
+        std::string line, v;
+        int current = -1;
+        std::vector<unsigned char> tiles;
+        std::vector<unsigned int> ms;
+        while (std::getline(arq, line)) {
+            if (line.find("<tileset") != std::string::npos && readAttr(line, "tilecount", v)) {
+                int n = atoi(v.c_str());
+                if (n > this->count) this->count = n < TILE_MAX_TYPES ? n : TILE_MAX_TYPES;
+            }
+            if (line.find("<tile ") != std::string::npos && readAttr(line, "id", v)) {
+                current = atoi(v.c_str());
+                if (current < 0 || current >= TILE_MAX_TYPES) current = -1;
+                else this->touch(current);
+                tiles.clear();
+                ms.clear();
+            }
+            if (current < 0) continue;
+            if (line.find("<property") != std::string::npos) {
+                std::string name, value;
+                if (readAttr(line, "name", name) && readAttr(line, "value", value)) {
+                    if (name == "walkable") this->walkable[current] = parseBool(value) ? 1 : 0;
+                    else if (name == "opaque") this->opaque[current] = parseBool(value) ? 1 : 0;
+                    else if (name == "cost") {
+                        int c = atoi(value.c_str());
+                        this->cost[current] = (unsigned short)(c > 0 ? c : 1);
+                    }
+                }
+            }
+            if (line.find("<frame") != std::string::npos) {
+                std::string t, d;
+                if (readAttr(line, "tileid", t) && readAttr(line, "duration", d)) {
+                    int ft = atoi(t.c_str());
+                    if (ft >= 0 && ft < TILE_MAX_TYPES) {
+                        tiles.push_back((unsigned char)ft);
+                        ms.push_back((unsigned int)atoi(d.c_str()));
+                        this->touch(ft);
+                    }
+                }
+            }
+            if (line.find("</tile>") != std::string::npos) {
+                if (tiles.size() > 1) this->setAnimation(current, tiles, ms);
+                current = -1;
+            }
+        }
+        arq.close();
+        this->rebuildMasks();
+        return true;
+    }
+
+    void rebuildMasks() {
+        memset(this->masks, 0, sizeof(this->masks));
+        for (int i = 0; i < TILE_MAX_TYPES; i++) {
+            uint32_t f = 0;
+            if (this->walkable[i]) f |= TILEFLAG_WALKABLE;
+            if (this->opaque[i]) f |= TILEFLAG_OPAQUE;
+            if (this->animLength[i] > 1) f |= TILEFLAG_ANIMATED;
+            this->flags[i] = f;
+            for (int p = 0; p < TILEPROP_COUNT; p++) {
+                if (f & (1u << p)) this->masks[p][i >> 6] |= (uint64_t)1 << (i & 63);
+            }
+        }
+    }
+
+    int getCount() {
+        return this->count;
+    }
+
+    bool hasProperty(int id, int prop) const {
+        return (this->masks[prop][(id >> 6) & (TILE_MASK_WORDS - 1)] >> (id & 63)) & 1;
+    }
+
+    bool isWalkable(int id) const {
+        return this->hasProperty(id, TILEPROP_WALKABLE);
+    }
+
+    bool isOpaque(int id) const {
+        return this->hasProperty(id, TILEPROP_OPAQUE);
+    }
+
+    int getCost(int id) const {
+        return this->cost[id & (TILE_MAX_TYPES - 1)];
+    }
+
+    const uint32_t* getFlags() const {
+        return this->flags;
+    }
+
+    const uint64_t* getMask(int prop) const {
+        return this->masks[prop];
+    }
+
+    const unsigned short* getCosts() const {
+        return this->cost;
+    }
+
+    // Frame da animacao do tile no instante timeMs; tiles sem animacao retornam o proprio id.
+    int animatedTile(int id, double timeMs) const {
+        id &= TILE_MAX_TYPES - 1;
+        if (this->animLength[id] < 2) return id;
+        unsigned int t = (unsigned int)fmod(timeMs, (double)this->animTotalMs[id]);
+        int start = this->animStart[id];
+        for (int i = 0; i < this->animLength[id]; i++) {
+            if (t < this->animFrameMs[start + i]) return this->animFrameTile[start + i];
+            t -= this->animFrameMs[start + i];
+        }
+        return this->animFrameTile[start + this->animLength[id] - 1];
+    }
+
+    // Milissegundos ate algum tile animado trocar de frame; -1 se nenhum tile e animado.
+    double msUntilNextFrame(double timeMs) const {
+        double best = -1.0;
+        for (int id = 0; id < this->count; id++) {
+            if (this->animLength[id] < 2) continue;
+            double t = fmod(timeMs, (double)this->animTotalMs[id]);
+            int start = this->animStart[id];
+            for (int i = 0; i < this->animLength[id]; i++) {
+                if (t < this->animFrameMs[start + i]) {
+                    if (best < 0.0 || this->animFrameMs[start + i] - t < best) best = this->animFrameMs[start + i] - t;
+                    break;
+                }
+                t -= this->animFrameMs[start + i];
+            }
+        }
+        return best;
+    }
+
+    // Bitset por celula do mapa (linha a linha, um bit por tile) para a propriedade prop.
+    // Usado por kernels como pathfinding e visibilidade, que testam a celula com um unico acesso.
+    void buildCellMask(TileMap* map, int prop, std::vector<uint64_t>& bits) const {
+        int w = map->getWidth(), h = map->getHeight();
+        size_t n = (size_t)w * h;
+        bits.assign((n + 63) / 64, 0);
+        const unsigned char* cells = map->getMap();
+        const uint32_t bit = 1u << prop;
+        for (size_t i = 0; i < n; i++) {
+            if (this->flags[cells[i]] & bit) bits[i >> 6] |= (uint64_t)1 << (i & 63);
+        }
+    }
+};
+
+#endif
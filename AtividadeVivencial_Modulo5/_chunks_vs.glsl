@@ -0,0 +1,27 @@
+#version 330 core
+out vec3 TexCoord;
+out float Shade;
+
+// Blocos dos chunks, sem atributos de vertice: gl_VertexID (indice do quad + baseVertex do
+// comando) da o bloco (/ 12) e o canto dele (% 12). Cada bloco sao dois texels do buffer:
+// (x, y, profundidade, camada) e (origem u, origem v, -, -), sem a camera.
+uniform samplerBuffer blocks;
+// Os 12 cantos do bloco (topo + duas faces): posicao, uv dentro do tile e sombra.
+uniform vec2 cornerPos[12];
+uniform vec2 cornerUV[12];
+uniform float cornerShade[12];
+uniform vec2 camera;
+// Tamanho de um tile de cada tileset (camada da textura array) em coordenadas de textura.
+uniform vec2 tileUV[16];
+
+void main()
+{
+    int block = gl_VertexID / 12;
+    int corner = gl_VertexID - block * 12;
+    vec4 a = texelFetch(blocks, block * 2);
+    vec4 b = texelFetch(blocks, block * 2 + 1);
+    int layer = int(a.w);
+    gl_Position = vec4(cornerPos[corner] + a.xy + camera, a.z, 1.0);
+    TexCoord = vec3(b.xy + cornerUV[corner] * tileUV[layer], a.w);
+    Shade = cornerShade[corner];
+}
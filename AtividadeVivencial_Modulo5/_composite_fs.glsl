@@ -0,0 +1,18 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2D cachedColor;
+uniform sampler2D cachedDepth;
+
+void main()
+{
+    ivec2 p = ivec2(gl_FragCoord.xy);
+    float depth = texelFetch(cachedDepth, p, 0).r;
+
+    // Fundo do cache: deixa a cor limpa da tela e nao ocupa o depth buffer.
+    if(depth >= 1.0)
+        discard;
+
+    gl_FragDepth = depth;
+    FragColor = texelFetch(cachedColor, p, 0);
+}
@@ -0,0 +1,50 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2D sceneColor;
+uniform vec2 texelSize;
+
+// FXAA de um passe (variante "console" do Lottes): acha a direcao da borda pela luma dos
+// quatro vizinhos diagonais e tira ate quatro amostras ao longo dela.
+#define FXAA_REDUCE_MIN (1.0 / 128.0)
+#define FXAA_REDUCE_MUL (1.0 / 8.0)
+#define FXAA_SPAN_MAX 8.0
+
+float luma(vec3 c)
+{
+    return dot(c, vec3(0.299, 0.587, 0.114));
+}
+
+void main()
+{
+    vec2 uv = gl_FragCoord.xy * texelSize;
+    vec3 rgbM = texture(sceneColor, uv).rgb;
+    float lumaNW = luma(textureOffset(sceneColor, uv, ivec2(-1, 1)).rgb);
+    float lumaNE = luma(textureOffset(sceneColor, uv, ivec2(1, 1)).rgb);
+    float lumaSW = luma(textureOffset(sceneColor, uv, ivec2(-1, -1)).rgb);
+    float lumaSE = luma(textureOffset(sceneColor, uv, ivec2(1, -1)).rgb);
+    float lumaM = luma(rgbM);
+    float lumaMin = min(lumaM, min(min(lumaNW, lumaNE), min(lumaSW, lumaSE)));
+    float lumaMax = max(lumaM, max(max(lumaNW, lumaNE), max(lumaSW, lumaSE)));
+
+    // Sem contraste local (a maior parte da tela) o pixel sai como esta.
+    if(lumaMax - lumaMin < max(0.0312, lumaMax * 0.125))
+    {
+        FragColor = vec4(rgbM, 1.0);
+        return;
+    }
+
+    // A formula do Lottes supoe y para baixo; aqui NW e (-1, +1), entao o y troca de sinal.
+    // Sem isso a direcao sai espelhada e bordas diagonais sao borradas atravessando.
+    vec2 dir = vec2(-((lumaNW + lumaNE) - (lumaSW + lumaSE)), -((lumaNW + lumaSW) - (lumaNE + lumaSE)));
+    float dirReduce = max((lumaNW + lumaNE + lumaSW + lumaSE) * 0.25 * FXAA_REDUCE_MUL, FXAA_REDUCE_MIN);
+    float rcpDirMin = 1.0 / (min(abs(dir.x), abs(dir.y)) + dirReduce);
+    dir = clamp(dir * rcpDirMin, vec2(-FXAA_SPAN_MAX), vec2(FXAA_SPAN_MAX)) * texelSize;
+
+    vec3 rgbA = 0.5 * (texture(sceneColor, uv + dir * (1.0 / 3.0 - 0.5)).rgb +
+                       texture(sceneColor, uv + dir * (2.0 / 3.0 - 0.5)).rgb);
+    vec3 rgbB = rgbA * 0.5 + 0.25 * (texture(sceneColor, uv - dir * 0.5).rgb +
+                                     texture(sceneColor, uv + dir * 0.5).rgb);
+    float lumaB = luma(rgbB);
+    FragColor = vec4((lumaB < lumaMin || lumaB > lumaMax) ? rgbA : rgbB, 1.0);
+}
@@ -2,6 +2,7 @@
 out vec4 FragColor;
 
 in vec2 TexCoord;
+in float Shade;
 
 uniform sampler2D ourTexture;
 uniform float weight;
@@ -13,5 +14,6 @@ void main()
     if(texColor.a < 0.1)
         discard;
         
+    texColor.rgb *= Shade;
     FragColor = mix(texColor, vec4(0.2, 0.2, 1.0, 1.0), weight);
 }
\ No newline at end of file
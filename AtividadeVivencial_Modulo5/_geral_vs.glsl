@@ -1,16 +1,20 @@
 #version 330 core
 layout (location = 0) in vec2 aPos;
 layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in float aShade;
 
 out vec2 TexCoord;
+out float Shade;
 
 uniform float tx;
 uniform float ty;
+uniform float tz;
 uniform float offsetX;
 uniform float tileW;
 
 void main()
 {
-    gl_Position = vec4(aPos.x + tx, aPos.y + ty, 0.0, 1.0);
+    gl_Position = vec4(aPos.x + tx, aPos.y + ty, tz, 1.0);
     TexCoord = vec2(aTexCoord.x * tileW + offsetX, aTexCoord.y);
+    Shade = aShade;
 }
\ No newline at end of file
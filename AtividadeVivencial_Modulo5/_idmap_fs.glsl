@@ -0,0 +1,46 @@
+#version 330 core
+out vec4 FragColor;
+
+uniform sampler2DArray tileSets;
+uniform usampler2D tileIds;
+uniform sampler2D tileLut;
+uniform vec2 tileUV[16];
+
+uniform vec4 viewport;
+uniform vec2 tileSize;
+uniform vec2 offset;
+uniform ivec2 mapSize;
+uniform vec2 depthParams;
+uniform float weight;
+
+void main()
+{
+    // Inverso do DiamondView: x = (col - row) * tw/2 + offset.x, y = (col + row) * th/2 + offset.y.
+    vec2 ndc = (gl_FragCoord.xy - viewport.xy) / viewport.zw * 2.0 - 1.0 - offset;
+    float a = ndc.x / (tileSize.x * 0.5);
+    float b = ndc.y / (tileSize.y * 0.5);
+    // Em (col, row) continuos cada losango e o quadrado [c-0.5, c+0.5] x [r-0.5, r+0.5];
+    // floor particiona a tela sem buracos nem sobreposicao nas emendas.
+    vec2 cr = vec2(a + b, b - a) * 0.5 + 0.5;
+    ivec2 cell = ivec2(floor(cr));
+    if (cell.x < 0 || cell.y < 0 || cell.x >= mapSize.x || cell.y >= mapSize.y)
+        discard;
+
+    uint id = texelFetch(tileIds, cell, 0).r;
+    vec4 frame = texelFetch(tileLut, ivec2(int(id), 0), 0);
+    if (frame.w == 0.0)
+        discard;
+
+    // Posicao dentro do losango -> uv do tile (mesmo mapeamento dos vertices do topo do bloco).
+    vec2 f = cr - vec2(cell);
+    vec2 uv = vec2(0.5 + 0.5 * (f.x - f.y), 0.5 * (f.x + f.y));
+    int layer = int(frame.x);
+    vec4 texColor = texture(tileSets, vec3(frame.yz + uv * tileUV[layer], frame.x));
+
+    if(texColor.a < 0.1)
+        discard;
+
+    float depth = (float(cell.x + cell.y) + depthParams.x) / depthParams.y * 1.8 - 0.9;
+    gl_FragDepth = depth * 0.5 + 0.5;
+    FragColor = mix(texColor, vec4(0.2, 0.2, 1.0, 1.0), weight);
+}
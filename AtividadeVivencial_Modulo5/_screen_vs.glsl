@@ -0,0 +1,8 @@
+#version 330 core
+
+// Triangulo que cobre a tela inteira, gerado a partir de gl_VertexID.
+void main()
+{
+    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+    gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);
+}
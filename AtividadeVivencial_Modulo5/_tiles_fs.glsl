@@ -0,0 +1,19 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec3 TexCoord;
+in float Shade;
+
+uniform sampler2DArray tileSets;
+uniform float weight;
+
+void main()
+{
+    vec4 texColor = texture(tileSets, TexCoord);
+
+    if(texColor.a < 0.1)
+        discard;
+        
+    texColor.rgb *= Shade;
+    FragColor = mix(texColor, vec4(0.2, 0.2, 1.0, 1.0), weight);
+}
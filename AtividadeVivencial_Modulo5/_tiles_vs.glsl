@@ -0,0 +1,25 @@
+#version 330 core
+layout (location = 0) in vec2 aPos;
+layout (location = 1) in vec2 aTexCoord;
+layout (location = 2) in float aShade;
+layout (location = 3) in vec2 aOffset;
+layout (location = 4) in float aDepth;
+layout (location = 5) in vec2 aFrameUV;
+layout (location = 6) in float aLayer;
+
+out vec3 TexCoord;
+out float Shade;
+
+// Tamanho de um tile de cada tileset (camada da textura array) em coordenadas de textura.
+uniform vec2 tileUV[16];
+// aOffset chega em -1..1 (snorm16); a posicao em NDC e isso vezes offsetRange.
+uniform float offsetRange;
+
+void main()
+{
+    // Por instancia: posicao, profundidade, origem do frame e camada do tileset.
+    int layer = int(aLayer);
+    gl_Position = vec4(aPos + aOffset * offsetRange, aDepth, 1.0);
+    TexCoord = vec3(aFrameUV + aTexCoord * tileUV[layer], aLayer);
+    Shade = aShade;
+}
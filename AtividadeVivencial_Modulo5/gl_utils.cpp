@@ -13,6 +13,7 @@
 | it is really making life easier.                                             |
 \******************************************************************************/
 #include "gl_utils.h"
+#include "Metrics.h"
 
 #include <stdio.h>
 #include <time.h>
@@ -21,6 +22,32 @@
 #define GL_LOG_FILE "gl.log"
 #define MAX_SHADER_LENGTH 262144
 
+/* contadores exportados pelo servidor de metricas (so escrita na thread GL) */
+static int metric_log_lines = Metrics::get ().define (
+	"gl_log_lines_total", METRIC_COUNTER, "linhas gravadas em gl.log"
+);
+static int metric_log_errors = Metrics::get ().define (
+	"gl_log_errors_total", METRIC_COUNTER, "erros gravados em gl.log"
+);
+static int metric_shaders = Metrics::get ().define (
+	"gl_shaders_compiled_total", METRIC_COUNTER, "shaders compilados"
+);
+static int metric_shader_us = Metrics::get ().define (
+	"gl_shader_compile_us_total", METRIC_COUNTER, "tempo compilando shaders (us)"
+);
+static int metric_programmes = Metrics::get ().define (
+	"gl_programmes_linked_total", METRIC_COUNTER, "programas linkados"
+);
+static int metric_resizes = Metrics::get ().define (
+	"window_resizes_total", METRIC_COUNTER, "redimensionamentos da janela"
+);
+static int metric_width = Metrics::get ().define (
+	"window_width", METRIC_GAUGE, "largura da janela"
+);
+static int metric_height = Metrics::get ().define (
+	"window_height", METRIC_GAUGE, "altura da janela"
+);
+
 /*--------------------------------LOG FUNCTIONS-------------------------------*/
 bool restart_gl_log () {
 	FILE* file = fopen (GL_LOG_FILE, "w");
@@ -54,6 +81,7 @@ bool gl_log (const char* message, ...) {
 	vfprintf (file, message, argptr);
 	va_end (argptr);
 	fclose (file);
+	Metrics::get ().add (metric_log_lines, 1);
 	return true;
 }
 
@@ -76,6 +104,8 @@ bool gl_log_err (const char* message, ...) {
 	vfprintf (stderr, message, argptr);
 	va_end (argptr);
 	fclose (file);
+	Metrics::get ().add (metric_log_lines, 1);
+	Metrics::get ().add (metric_log_errors, 1);
 	return true;
 }
 
@@ -92,6 +122,8 @@ bool start_gl () {
 	glfwWindowHint (GLFW_CONTEXT_VERSION_MINOR, 2);
 	glfwWindowHint (GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 	glfwWindowHint (GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	/* amostras do framebuffer padrao: so vale se pedido antes de criar a janela */
+	glfwWindowHint (GLFW_SAMPLES, g_gl_samples);
 
 	/*GLFWmonitor* mon = glfwGetPrimaryMonitor ();
 	const GLFWvidmode* vmode = glfwGetVideoMode (mon);
@@ -110,8 +142,6 @@ bool start_gl () {
 	glfwSetWindowSizeCallback (g_window, glfw_window_size_callback);
 	glfwMakeContextCurrent (g_window);
 	
-	glfwWindowHint (GLFW_SAMPLES, 4);
-	
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
 	{
 		std::cerr << "Falha ao inicializar GLAD" << std::endl;
@@ -123,6 +153,8 @@ bool start_gl () {
 	printf ("Renderer: %s\n", renderer);
 	printf ("OpenGL version supported %s\n", version);
 	gl_log ("renderer: %s\nversion: %s\n", renderer, version);
+	Metrics::get ().set (metric_width, g_gl_width);
+	Metrics::get ().set (metric_height, g_gl_height);
 	
 	return true;
 }
@@ -135,6 +167,9 @@ void glfw_window_size_callback (GLFWwindow* window, int width, int height) {
 	g_gl_width = width;
 	g_gl_height = height;
 	printf ("width %i height %i\n", width, height);
+	Metrics::get ().add (metric_resizes, 1);
+	Metrics::get ().set (metric_width, width);
+	Metrics::get ().set (metric_height, height);
 }
 
 void _update_fps_counter (GLFWwindow* window) {
@@ -199,10 +234,13 @@ bool create_shader (const char* file_name, GLuint* shader, GLenum type) {
 	assert (parse_file_into_str (file_name, shader_string, MAX_SHADER_LENGTH));
 	*shader = glCreateShader (type);
 	const GLchar* p = (const GLchar*)shader_string;
+	double start = glfwGetTime ();
 	glShaderSource (*shader, 1, &p, NULL);
 	glCompileShader (*shader);
 	int params = -1;
 	glGetShaderiv (*shader, GL_COMPILE_STATUS, &params);
+	Metrics::get ().add (metric_shaders, 1);
+	Metrics::get ().add (metric_shader_us, (int64_t)((glfwGetTime () - start) * 1e6));
 	if (GL_TRUE != params) {
 		gl_log_err ("ERROR: GL shader index %i did not compile\n", *shader);
 		print_shader_info_log (*shader);
@@ -255,7 +293,10 @@ bool create_programme (GLuint vert, GLuint frag, GLuint* programme) {
 		print_programme_info_log (*programme);
 		return false;
 	}
-	assert (is_programme_valid (*programme));
+	/* sem validar aqui: com os samplers ainda na unidade 0, programas com samplers de
+	tipos diferentes (_idmap_fs, _chunks_vs + _tiles_fs) nunca validam, e o chamador
+	so liga as unidades depois */
+	Metrics::get ().add (metric_programmes, 1);
 	glDeleteShader (vert);
 	glDeleteShader (frag);
 	return true;
@@ -26,6 +26,7 @@ using namespace std;
 
 extern int g_gl_width;
 extern int g_gl_height;
+extern int g_gl_samples;
 extern GLFWwindow* g_window;
 
 bool restart_gl_log ();
@@ -12,6 +12,9 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "FrameScheduler.h"
+#include "SaveFile.h"
+
 using namespace std;
 using namespace glm;
 
@@ -44,6 +47,18 @@ static int iSelected  = -1;
 
 static GLFWwindow* gWindow = nullptr;
 
+// F5 grava e F9 carrega o tabuleiro, a pontuacao e as tentativas.
+static const char* SAVE_PATH = "jogodascores.sav";
+
+struct SavedQuad
+{
+    float r, g, b;
+    uint32_t eliminated;
+};
+
+// Entre cliques a tela nao muda: o laco so desenha quando algo invalida o frame.
+static FrameScheduler scheduler;
+
 static GLuint shaderID;
 static GLuint VAO;
 
@@ -96,6 +111,10 @@ void updateWindowTitle();
 
 void resetGame();
 
+bool saveGame(const char* path);
+
+bool loadGame(const char* path);
+
 int main()
 {
     srand(static_cast<unsigned int>(time(nullptr)));
@@ -119,6 +138,7 @@ int main()
 
     glfwSetKeyCallback(gWindow, key_callback);
     glfwSetMouseButtonCallback(gWindow, mouse_button_callback);
+    glfwSetWindowRefreshCallback(gWindow, [](GLFWwindow*) { scheduler.invalidate(INVALID_WINDOW); });
 
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
     {
@@ -152,7 +172,8 @@ int main()
 
     while (!glfwWindowShouldClose(gWindow))
     {
-        glfwPollEvents();
+        scheduler.waitForWork();
+        if (!scheduler.beginFrame()) continue;
 
         if (iSelected >= 0 && !gameOver)
         {
@@ -216,6 +237,7 @@ int main()
         glfwSwapBuffers(gWindow);
     }
 
+    scheduler.printStats();
     glDeleteVertexArrays(1, &VAO);
     glDeleteProgram(shaderID);
     glfwDestroyWindow(gWindow);
@@ -225,6 +247,7 @@ int main()
 
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
+    scheduler.invalidate(INVALID_INPUT);
     if (key == GLFW_KEY_ESCAPE && action == GLFW_PRESS)
     {
         glfwSetWindowShouldClose(window, GLFW_TRUE);
@@ -234,10 +257,19 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
         resetGame();
         cout << "Jogo reiniciado!\n";
     }
+    else if (key == GLFW_KEY_F5 && action == GLFW_PRESS)
+    {
+        if (saveGame(SAVE_PATH)) cout << "Jogo salvo em " << SAVE_PATH << endl;
+    }
+    else if (key == GLFW_KEY_F9 && action == GLFW_PRESS)
+    {
+        if (loadGame(SAVE_PATH)) cout << "Jogo carregado de " << SAVE_PATH << endl;
+    }
 }
 
 void mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
 {
+    scheduler.invalidate(INVALID_INPUT);
     if (button == GLFW_MOUSE_BUTTON_LEFT && action == GLFW_PRESS && !gameOver)
     {
         double xpos, ypos;
@@ -432,3 +464,60 @@ void resetGame()
 
     updateWindowTitle();
 }
+
+bool saveGame(const char* path)
+{
+    SavedQuad board[ROWS * COLS];
+    for (int i = 0; i < int(ROWS); i++)
+    {
+        for (int j = 0; j < int(COLS); j++)
+        {
+            SavedQuad& q = board[i * COLS + j];
+            q.r = grid[i][j].color.r;
+            q.g = grid[i][j].color.g;
+            q.b = grid[i][j].color.b;
+            q.eliminated = grid[i][j].eliminated ? 1 : 0;
+        }
+    }
+    SavedCounter counters[] = {
+        makeCounter("attempts", attempts),
+        makeCounter("score", score),
+        makeCounter("game_over", gameOver ? 1 : 0),
+    };
+    SaveWriter w;
+    w.beginSection(SAVE_SECTION_BOARD, 0);
+    w.append(board, sizeof(board));
+    w.beginSection(SAVE_SECTION_COUNTERS, 0);
+    w.append(counters, sizeof(counters));
+    return w.write(path);
+}
+
+// O tabuleiro e pequeno: le direto do arquivo mapeado para o grid.
+bool loadGame(const char* path)
+{
+    SaveFile f;
+    if (!f.open(path)) return false;
+    uint64_t size;
+    const SavedQuad* board = (const SavedQuad*)f.find(SAVE_SECTION_BOARD, 0, size);
+    if (board == NULL || size != sizeof(SavedQuad) * ROWS * COLS)
+    {
+        cerr << "Save sem tabuleiro " << ROWS << "x" << COLS << ": " << path << endl;
+        return false;
+    }
+    resetGame();
+    for (int i = 0; i < int(ROWS); i++)
+    {
+        for (int j = 0; j < int(COLS); j++)
+        {
+            const SavedQuad& q = board[i * COLS + j];
+            grid[i][j].color = vec3(q.r, q.g, q.b);
+            grid[i][j].eliminated = q.eliminated != 0;
+        }
+    }
+    int64_t v;
+    if (loadCounter(f, 0, "attempts", v)) attempts = int(v);
+    if (loadCounter(f, 0, "score", v)) score = int(v);
+    if (loadCounter(f, 0, "game_over", v)) gameOver = v != 0;
+    updateWindowTitle();
+    return true;
+}
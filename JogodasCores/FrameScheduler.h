@@ -0,0 +1,158 @@
+#ifndef FrameScheduler_h
+#define FrameScheduler_h
+
+#include <stdio.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+#include <GLFW/glfw3.h>
+
+#define INVALID_INPUT (1u << 0)
+#define INVALID_ANIMATION (1u << 1)
+#define INVALID_SIMULATION (1u << 2)
+#define INVALID_ASSETS (1u << 3)
+#define INVALID_WINDOW (1u << 4)
+#define INVALID_TIMER (1u << 5)
+#define INVALID_COUNT 6
+
+// Decide quando vale a pena desenhar. Entrada, animacao, simulacao e recarga de assets
+// marcam o frame como invalido; sem nada invalido o loop dorme em glfwWaitEventsTimeout
+// ate chegar um evento, vencer um timer (wakeAt) ou passar maxWait. Com isso a cena
+// parada nao gasta CPU, e a latencia de entrada continua limitada: qualquer evento do
+// sistema acorda o loop na hora.
+class FrameScheduler
+{
+    std::atomic<unsigned int> reasons;
+    std::mutex timerLock;
+    std::vector<double> timers;
+    double maxWait;
+    bool alwaysRender;
+
+    unsigned long long rendered;
+    unsigned long long skipped;
+    unsigned long long waits;
+    unsigned long long byReason[INVALID_COUNT];
+    double idleSeconds;
+
+    void fireTimers()
+    {
+        double now = glfwGetTime();
+        std::lock_guard<std::mutex> guard(timerLock);
+        size_t kept = 0;
+        for (size_t i = 0; i < timers.size(); i++)
+        {
+            if (timers[i] <= now) reasons.fetch_or(INVALID_TIMER);
+            else timers[kept++] = timers[i];
+        }
+        timers.resize(kept);
+    }
+
+public:
+    // maxWait: limite de cada espera, em segundos (rede de seguranca para quem esquecer de invalidar).
+    FrameScheduler(double maxWaitSeconds = 0.5)
+    {
+        reasons = INVALID_WINDOW;
+        maxWait = maxWaitSeconds;
+        alwaysRender = false;
+        rendered = 0;
+        skipped = 0;
+        waits = 0;
+        for (int i = 0; i < INVALID_COUNT; i++) byReason[i] = 0;
+        idleSeconds = 0.0;
+    }
+
+    // Ligado, volta ao comportamento antigo (desenha todo frame).
+    void setAlwaysRender(bool on)
+    {
+        alwaysRender = on;
+    }
+
+    // Da thread principal (callbacks de entrada, laco de simulacao).
+    void invalidate(unsigned int reason)
+    {
+        reasons.fetch_or(reason);
+    }
+
+    // De outras threads: alem de marcar, acorda a thread principal se ela estiver esperando.
+    void invalidateFromThread(unsigned int reason)
+    {
+        reasons.fetch_or(reason);
+        glfwPostEmptyEvent();
+    }
+
+    // Pede um frame no instante t (glfwGetTime), p.ex. a proxima troca de frame de uma animacao.
+    void wakeAt(double t)
+    {
+        std::lock_guard<std::mutex> guard(timerLock);
+        for (size_t i = 0; i < timers.size(); i++)
+        {
+            if (timers[i] > t - 0.001 && timers[i] < t + 0.001) return;
+        }
+        timers.push_back(t);
+    }
+
+    void wakeIn(double seconds)
+    {
+        wakeAt(glfwGetTime() + seconds);
+    }
+
+    // Substitui glfwPollEvents no topo do laco: so bloqueia se nao houver nada a desenhar.
+    void waitForWork()
+    {
+        if (alwaysRender || reasons.load() != 0)
+        {
+            glfwPollEvents();
+            fireTimers();
+            return;
+        }
+        double now = glfwGetTime();
+        double timeout = maxWait;
+        {
+            std::lock_guard<std::mutex> guard(timerLock);
+            for (size_t i = 0; i < timers.size(); i++)
+            {
+                if (timers[i] - now < timeout) timeout = timers[i] - now;
+            }
+        }
+        if (timeout > 0.0)
+        {
+            glfwWaitEventsTimeout(timeout);
+            waits++;
+            idleSeconds += glfwGetTime() - now;
+        }
+        else
+        {
+            glfwPollEvents();
+        }
+        fireTimers();
+    }
+
+    // true se o frame deve ser desenhado; consome os motivos pendentes.
+    bool beginFrame()
+    {
+        unsigned int r = reasons.exchange(0);
+        for (int i = 0; i < INVALID_COUNT; i++)
+        {
+            if (r & (1u << i)) byReason[i]++;
+        }
+        if (r == 0 && !alwaysRender)
+        {
+            skipped++;
+            return false;
+        }
+        rendered++;
+        return true;
+    }
+
+    void printStats(FILE* out = stdout)
+    {
+        const char* names[INVALID_COUNT] = { "entrada", "animacao", "simulacao", "assets", "janela", "timer" };
+        fprintf(out, "agendador: %llu frames desenhados, %llu acordadas sem desenho, %llu esperas (%.1f s ocioso); motivos:",
+            rendered, skipped, waits, idleSeconds);
+        for (int i = 0; i < INVALID_COUNT; i++) fprintf(out, " %s=%llu", names[i], byReason[i]);
+        fprintf(out, "\n");
+    }
+};
+
+#endif
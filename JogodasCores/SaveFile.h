@@ -0,0 +1,359 @@
+#ifndef SaveFile_h
+#define SaveFile_h
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define SAVE_MAGIC 0x45564153u
+#define SAVE_VERSION 1
+#define SAVE_ALIGN 16
+#define SAVE_MAX_IOV 1024
+
+#define SAVE_SECTION_COUNTERS 3
+#define SAVE_SECTION_BOARD 4
+
+// Copia do formato de save do AtividadeVivencial_Modulo5 (sem as camadas de TileMap).
+// Layout no disco (little-endian, tudo alinhado em SAVE_ALIGN):
+//   SaveHeader | SaveSection[sectionCount] | secoes...
+// Nada guarda ponteiro: secoes sao achadas pelo offset na tabela e, dentro de cada uma,
+// as partes sao achadas por offsets relativos ao inicio da secao. Assim o arquivo
+// mapeado ja e o estado, e carregar e so validar a tabela.
+struct SaveHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t sectionCount;
+    uint32_t reserved;
+    uint64_t fileSize;
+    uint64_t reserved2;
+};
+
+struct SaveSection
+{
+    uint32_t type;
+    uint32_t id;
+    uint64_t offset;
+    uint64_t size;
+};
+
+struct SavedCounter
+{
+    char name[24];
+    int64_t value;
+};
+
+// Junta as partes do save como iovecs (sem copiar os arrays grandes) e grava tudo num
+// unico writev, num arquivo temporario renomeado no fim.
+class SaveWriter
+{
+    struct Part
+    {
+        const void* data;
+        size_t size;
+        size_t copy;
+    };
+    std::vector<SaveSection> sections;
+    std::vector<std::vector<Part> > parts;
+    std::vector<char> copies;
+    size_t sectionSize;
+
+    static size_t aligned(size_t n)
+    {
+        return (n + SAVE_ALIGN - 1) & ~(size_t)(SAVE_ALIGN - 1);
+    }
+
+public:
+    SaveWriter()
+    {
+        sectionSize = 0;
+    }
+
+    void beginSection(uint32_t type, uint32_t id)
+    {
+        SaveSection s;
+        s.type = type;
+        s.id = id;
+        s.offset = 0;
+        s.size = 0;
+        sections.push_back(s);
+        parts.push_back(std::vector<Part>());
+        sectionSize = 0;
+    }
+
+    // Referencia data sem copiar (tem que continuar valido ate write); retorna o offset
+    // da parte dentro da secao. Toda parte comeca alinhada.
+    uint64_t append(const void* data, size_t size)
+    {
+        size_t at = aligned(sectionSize);
+        if (at > sectionSize)
+        {
+            Part pad = { NULL, at - sectionSize, 0 };
+            parts.back().push_back(pad);
+        }
+        Part p = { data, size, 0 };
+        parts.back().push_back(p);
+        sectionSize = at + size;
+        sections.back().size = sectionSize;
+        return at;
+    }
+
+    // Para structs pequenas montadas na pilha: guarda uma copia.
+    uint64_t appendCopy(const void* data, size_t size)
+    {
+        size_t start = copies.size();
+        copies.insert(copies.end(), (const char*)data, (const char*)data + size);
+        uint64_t at = append(NULL, size);
+        parts.back().back().copy = start + 1;
+        return at;
+    }
+
+    // Offset (na secao) que a proxima parte vai ter; para preencher cabecalhos antes.
+    uint64_t nextOffset(size_t after)
+    {
+        return aligned(aligned(sectionSize) + after);
+    }
+
+    bool write(const char* filename)
+    {
+        static const char zeros[SAVE_ALIGN] = { 0 };
+        SaveHeader h;
+        memset(&h, 0, sizeof(h));
+        h.magic = SAVE_MAGIC;
+        h.version = SAVE_VERSION;
+        h.sectionCount = (uint32_t)sections.size();
+        size_t pos = aligned(sizeof(SaveHeader) + sizeof(SaveSection) * sections.size());
+        for (size_t i = 0; i < sections.size(); i++)
+        {
+            sections[i].offset = pos;
+            pos = aligned(pos + sections[i].size);
+        }
+        h.fileSize = pos;
+
+        std::vector<struct iovec> iov;
+        size_t headerBytes = sizeof(SaveHeader) + sizeof(SaveSection) * sections.size();
+        struct iovec v;
+        v.iov_base = &h;
+        v.iov_len = sizeof(h);
+        iov.push_back(v);
+        if (!sections.empty())
+        {
+            v.iov_base = sections.data();
+            v.iov_len = sizeof(SaveSection) * sections.size();
+            iov.push_back(v);
+        }
+        size_t written = headerBytes;
+        for (size_t i = 0; i < sections.size(); i++)
+        {
+            if (sections[i].offset > written)
+            {
+                v.iov_base = (void*)zeros;
+                v.iov_len = sections[i].offset - written;
+                iov.push_back(v);
+            }
+            written = sections[i].offset;
+            for (size_t k = 0; k < parts[i].size(); k++)
+            {
+                const Part& p = parts[i][k];
+                if (p.size == 0) continue;
+                if (p.data == NULL && p.copy == 0) v.iov_base = (void*)zeros;
+                else v.iov_base = p.copy ? (void*)&copies[p.copy - 1] : (void*)p.data;
+                v.iov_len = p.size;
+                iov.push_back(v);
+                written += p.size;
+            }
+        }
+        if (pos > written)
+        {
+            v.iov_base = (void*)zeros;
+            v.iov_len = pos - written;
+            iov.push_back(v);
+        }
+
+        std::string tmp = std::string(filename) + ".tmp";
+        int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+        {
+            std::cout << "ERRO: Não foi possível criar o save: " << tmp << " (" << strerror(errno) << ")" << std::endl;
+            return false;
+        }
+        // Um writev por ate SAVE_MAX_IOV partes; escrita parcial continua de onde parou.
+        size_t first = 0;
+        while (first < iov.size())
+        {
+            int n = (int)(iov.size() - first < SAVE_MAX_IOV ? iov.size() - first : SAVE_MAX_IOV);
+            ssize_t got = ::writev(fd, &iov[first], n);
+            if (got < 0)
+            {
+                if (errno == EINTR) continue;
+                std::cout << "ERRO: falha ao gravar o save: " << strerror(errno) << std::endl;
+                ::close(fd);
+                ::unlink(tmp.c_str());
+                return false;
+            }
+            while (got > 0)
+            {
+                if ((size_t)got >= iov[first].iov_len)
+                {
+                    got -= iov[first].iov_len;
+                    first++;
+                }
+                else
+                {
+                    iov[first].iov_base = (char*)iov[first].iov_base + got;
+                    iov[first].iov_len -= got;
+                    got = 0;
+                }
+            }
+            while (first < iov.size() && iov[first].iov_len == 0) first++;
+        }
+        ::close(fd);
+        if (::rename(tmp.c_str(), filename) != 0)
+        {
+            std::cout << "ERRO: Não foi possível substituir o save: " << filename << std::endl;
+            return false;
+        }
+        return true;
+    }
+};
+
+// Save aberto com mmap (privado: editar o estado carregado nao muda o arquivo, e so as
+// paginas escritas sao copiadas). Os ponteiros devolvidos valem ate close.
+class SaveFile
+{
+    unsigned char* base;
+    size_t fileSize;
+    const SaveSection* table;
+    uint32_t count;
+
+public:
+    SaveFile()
+    {
+        base = NULL;
+        fileSize = 0;
+        table = NULL;
+        count = 0;
+    }
+
+    ~SaveFile()
+    {
+        close();
+    }
+
+    bool open(const char* filename)
+    {
+        close();
+        int fd = ::open(filename, O_RDONLY);
+        if (fd < 0)
+        {
+            std::cout << "ERRO: Não foi possível abrir o save: " << filename << std::endl;
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SaveHeader))
+        {
+            std::cout << "ERRO: save vazio ou ilegivel: " << filename << std::endl;
+            ::close(fd);
+            return false;
+        }
+        void* p = mmap(NULL, (size_t)st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED)
+        {
+            std::cout << "ERRO: mmap do save falhou: " << strerror(errno) << std::endl;
+            return false;
+        }
+        base = (unsigned char*)p;
+        fileSize = (size_t)st.st_size;
+        if (!validate())
+        {
+            std::cout << "ERRO: save invalido: " << filename << std::endl;
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    // So estrutura: cabecalho, tabela e limites/alinhamento de cada secao (nao le os dados).
+    bool validate()
+    {
+        const SaveHeader* h = (const SaveHeader*)base;
+        if (h->magic != SAVE_MAGIC || h->version != SAVE_VERSION || h->fileSize != fileSize) return false;
+        if (h->sectionCount > (fileSize - sizeof(SaveHeader)) / sizeof(SaveSection)) return false;
+        table = (const SaveSection*)(base + sizeof(SaveHeader));
+        count = h->sectionCount;
+        uint64_t tableEnd = sizeof(SaveHeader) + (uint64_t)sizeof(SaveSection) * count;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            const SaveSection& s = table[i];
+            if (s.offset % SAVE_ALIGN != 0 || s.offset < tableEnd || s.offset > fileSize) return false;
+            if (s.size > fileSize - s.offset) return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+        if (base) munmap(base, fileSize);
+        base = NULL;
+        fileSize = 0;
+        table = NULL;
+        count = 0;
+    }
+
+    // Ponteiro para a secao (type, id), ou NULL; size recebe o tamanho.
+    void* find(uint32_t type, uint32_t id, uint64_t& size)
+    {
+        for (uint32_t i = 0; i < count; i++)
+        {
+            if (table[i].type == type && table[i].id == id)
+            {
+                size = table[i].size;
+                return base + table[i].offset;
+            }
+        }
+        size = 0;
+        return NULL;
+    }
+
+    size_t getSize()
+    {
+        return fileSize;
+    }
+};
+
+inline SavedCounter makeCounter(const char* name, int64_t value)
+{
+    SavedCounter c;
+    memset(&c, 0, sizeof(c));
+    strncpy(c.name, name, sizeof(c.name) - 1);
+    c.value = value;
+    return c;
+}
+
+// Procura um contador pelo nome na secao de contadores id.
+inline bool loadCounter(SaveFile& f, uint32_t id, const char* name, int64_t& value)
+{
+    uint64_t size;
+    const SavedCounter* c = (const SavedCounter*)f.find(SAVE_SECTION_COUNTERS, id, size);
+    for (uint64_t i = 0; c && i < size / sizeof(SavedCounter); i++)
+    {
+        if (strncmp(c[i].name, name, sizeof(c[i].name)) == 0)
+        {
+            value = c[i].value;
+            return true;
+        }
+    }
+    return false;
+}
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef AlphaMask_h
+#define AlphaMask_h
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// Mascara de 1 bit por texel (ou por bloco de 2^shift x 2^shift texels) indicando onde a
+// textura e opaca. E montada uma vez no carregamento a partir dos pixels RGBA que ja
+// estao na CPU, e permite testar um clique sem ler a textura da GPU.
+class AlphaMask
+{
+public:
+    AlphaMask() : width(0), height(0), shift(0), wordsPerRow(0) {}
+
+    // Um bit fica ligado se qualquer texel do bloco tiver alfa >= threshold, entao a
+    // versao reduzida nunca perde uma regiao opaca (so pode aceitar um pouco a mais na borda).
+    void build(const unsigned char *rgba, int texWidth, int texHeight, unsigned char threshold = 128, int downsampleShift = 0)
+    {
+        shift = downsampleShift < 0 ? 0 : downsampleShift;
+        int block = 1 << shift;
+        width = (texWidth + block - 1) >> shift;
+        height = (texHeight + block - 1) >> shift;
+        wordsPerRow = (width + 63) / 64;
+        bits.assign((size_t)wordsPerRow * height, 0);
+
+        for (int y = 0; y < texHeight; y++)
+        {
+            const unsigned char *row = rgba + (size_t)y * texWidth * 4;
+            uint64_t *maskRow = &bits[(size_t)(y >> shift) * wordsPerRow];
+            for (int x = 0; x < texWidth; x++)
+            {
+                if (row[x * 4 + 3] >= threshold)
+                {
+                    int mx = x >> shift;
+                    maskRow[mx >> 6] |= (uint64_t)1 << (mx & 63);
+                }
+            }
+        }
+    }
+
+    // u, v em [0,1], com v = 0 na primeira linha da imagem.
+    bool test(float u, float v) const
+    {
+        if (bits.empty() || u < 0.0f || v < 0.0f || u > 1.0f || v > 1.0f) return false;
+        int x = (int)(u * (float)width);
+        int y = (int)(v * (float)height);
+        if (x >= width) x = width - 1;
+        if (y >= height) y = height - 1;
+        return (bits[(size_t)y * wordsPerRow + (x >> 6)] >> (x & 63)) & 1;
+    }
+
+    bool empty() const { return bits.empty(); }
+
+    size_t bytes() const { return bits.size() * sizeof(uint64_t); }
+
+private:
+    int width, height;
+    int shift;
+    int wordsPerRow;
+    std::vector<uint64_t> bits;
+};
+
+#endif
@@ -3,6 +3,9 @@
 #include <vector>
 #include <stdio.h>
 #include <stdlib.h>
+#include <chrono>
+#include <cmath>
+#include <functional>
 
 #define STB_IMAGE_IMPLEMENTATION 
 #include <stb_image.h>           
@@ -14,6 +17,13 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "AlphaMask.h"
+#include "LayerFlattener.h"
+#include "ProceduralSky.h"
+#include "TextureCodec.h"
+#include "VertexFormat.h"
+#include "VirtualTexture.h"
+
 const GLint WIDTH = 800, HEIGHT = 600;
 
 class Sprite
@@ -23,11 +33,20 @@ public:
     glm::vec2 position;
     glm::vec2 size; 
     GLfloat rotate; 
-
-    Sprite(const char *texturePath, glm::vec2 pos, glm::vec2 sz, GLfloat rot = 0.0f)
-        : position(pos), size(sz), rotate(rot), textureID(0)
+    std::string name;
+    AlphaMask mask;
+    VirtualTextureSystem *vts;
+    VirtualTexture *vt;
+
+    // maskShift reduz a mascara de picking em blocos de 2^maskShift texels. Com vts, se
+    // existir "<textura>.vtex" o sprite usa a textura virtual em vez de subir a imagem inteira.
+    Sprite(const char *texturePath, glm::vec2 pos, glm::vec2 sz, GLfloat rot = 0.0f, int maskShift = 0,
+           VirtualTextureSystem *vts = nullptr)
+        : position(pos), size(sz), rotate(rot), textureID(0), name(texturePath), vts(vts), vt(nullptr)
     {
-        if (!loadTextureFromFile(texturePath, &this->textureID))
+        if (vts && loadVirtualTexture(texturePath, maskShift))
+            return;
+        if (!loadTextureFromFile(texturePath, &this->textureID, &this->mask, maskShift))
         {
             std::cerr << "Falha ao carregar textura para o sprite: " << texturePath << std::endl;
         }
@@ -43,9 +62,12 @@ public:
 
     Sprite(Sprite&& other) noexcept
         : textureID(other.textureID), position(std::move(other.position)),
-          size(std::move(other.size)), rotate(other.rotate)
+          size(std::move(other.size)), rotate(other.rotate),
+          name(std::move(other.name)), mask(std::move(other.mask)),
+          vts(other.vts), vt(other.vt)
     {
         other.textureID = 0;
+        other.vt = nullptr;
     }
 
     Sprite& operator=(Sprite&& other) noexcept
@@ -60,8 +82,13 @@ public:
         position = std::move(other.position);
         size = std::move(other.size);
         rotate = other.rotate;
+        name = std::move(other.name);
+        mask = std::move(other.mask);
+        vts = other.vts;
+        vt = other.vt;
 
         other.textureID = 0;
+        other.vt = nullptr;
         return *this;
     }
 
@@ -69,31 +96,146 @@ public:
     Sprite& operator=(const Sprite&) = delete;
 
 
+    glm::mat4 model() const
+    {
+        glm::mat4 m = glm::mat4(1.0f);
+        m = glm::translate(m, glm::vec3(position, 0.0f));
+        m = glm::rotate(m, glm::radians(rotate), glm::vec3(0.0f, 0.0f, 1.0f));
+        m = glm::scale(m, glm::vec3(size, 1.0f));
+        return m;
+    }
+
     void draw(GLuint shaderProgramme, GLuint VAO)
     {
+        if (this->vt)
+        {
+            GLuint program = vts->bindForDraw(this->vt);
+            glUniformMatrix4fv(glGetUniformLocation(program, "matrix"), 1, GL_FALSE, glm::value_ptr(model()));
+            glBindVertexArray(VAO);
+            glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+            glBindVertexArray(0);
+            return;
+        }
         if (this->textureID == 0) return;
 
         glUseProgram(shaderProgramme);
 
-        glm::mat4 model = glm::mat4(1.0f);
-        model = glm::translate(model, glm::vec3(position, 0.0f));
-        model = glm::rotate(model, glm::radians(rotate), glm::vec3(0.0f, 0.0f, 1.0f));
-        model = glm::scale(model, glm::vec3(size, 1.0f));
-
-        glUniformMatrix4fv(glGetUniformLocation(shaderProgramme, "matrix"), 1, GL_FALSE, glm::value_ptr(model));
+        glUniformMatrix4fv(glGetUniformLocation(shaderProgramme, "matrix"), 1, GL_FALSE, glm::value_ptr(model()));
 
         glActiveTexture(GL_TEXTURE0);
         glBindTexture(GL_TEXTURE_2D, this->textureID);
 
         glBindVertexArray(VAO);
-        glDrawArrays(GL_TRIANGLES, 0, 6);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
         glBindVertexArray(0);
         glBindTexture(GL_TEXTURE_2D, 0); 
     }
 
+    // Passe de feedback da textura virtual: grava pagina/mip pedidos por esta camada.
+    void drawFeedback(GLuint VAO, int layer, int layerCount)
+    {
+        if (!this->vt) return;
+        GLuint program = vts->bindForFeedback(this->vt, layer, layerCount);
+        glUniformMatrix4fv(glGetUniformLocation(program, "matrix"), 1, GL_FALSE, glm::value_ptr(model()));
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_SHORT, 0);
+        glBindVertexArray(0);
+    }
+
+    // Resumo do que muda o desenho: transform, textura e, na textura virtual, as paginas
+    // residentes. Igual de um quadro para o outro = a camada pode ficar achatada.
+    uint64_t signature() const
+    {
+        uint64_t h = 1469598103934665603ull;
+        auto mix = [&h](const void *data, size_t n)
+        {
+            const unsigned char *b = static_cast<const unsigned char *>(data);
+            for (size_t i = 0; i < n; i++) h = (h ^ b[i]) * 1099511628211ull;
+        };
+        unsigned int version = vt ? vt->version : 0;
+        mix(&position, sizeof(position));
+        mix(&size, sizeof(size));
+        mix(&rotate, sizeof(rotate));
+        mix(&textureID, sizeof(textureID));
+        mix(&vt, sizeof(vt));
+        mix(&version, sizeof(version));
+        return h;
+    }
+
+    // Teste de clique pixel a pixel: leva o ponto (coordenadas de tela) para o espaco
+    // local do quad pela inversa de translate * rotate * scale e consulta a mascara.
+    bool hitTest(glm::vec2 point) const
+    {
+        if ((this->textureID == 0 && !this->vt) || mask.empty()) return false;
+
+        glm::vec2 d = point - position;
+        float a = glm::radians(rotate);
+        float c = std::cos(a), s = std::sin(a);
+        float lx = (c * d.x + s * d.y) / size.x;
+        float ly = (-s * d.x + c * d.y) / size.y;
+        if (lx < -0.5f || lx > 0.5f || ly < -0.5f || ly > 0.5f) return false;
+
+        return mask.test(lx + 0.5f, ly + 0.5f);
+    }
+
 private:
-    static bool loadTextureFromFile(const char *file_name, GLuint *tex)
+    // A mascara sai de um mip reduzido lido das paginas, ja que a imagem inteira nao e carregada.
+    bool loadVirtualTexture(const char *texturePath, int maskShift)
     {
+        std::string vtexPath = std::string(texturePath) + ".vtex";
+        FILE *f = fopen(vtexPath.c_str(), "rb");
+        if (!f) return false;
+        fclose(f);
+
+        this->vt = vts->open(vtexPath.c_str());
+        if (!this->vt) return false;
+
+        int mip = 0;
+        while (mip + 1 < vt->mipCount && vt->levels[mip + 1].width >= 256) mip++;
+        std::vector<unsigned char> rgba;
+        int w, h;
+        if (vt->readLevel(mip, rgba, w, h))
+            mask.build(rgba.data(), w, h, 128, maskShift > mip ? maskShift - mip : 0);
+        return true;
+    }
+
+    // Com um .ctex que a GPU amostre, sobe os blocos comprimidos (ja com os mips) e monta a
+    // mascara de um mip reduzido lido de volta uma vez, como na textura virtual.
+    static bool loadCompressedTexture(const char *file_name, GLuint *tex, AlphaMask *mask, int maskShift)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        CompressedImage image;
+        if (!TextureLoader::find(file_name, image)) return false;
+
+        glGenTextures(1, tex);
+        glBindTexture(GL_TEXTURE_2D, *tex);
+        TextureLoader::upload(image);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                        image.levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        int mip = 0;
+        while (mip + 1 < (int)image.levels.size() && image.levels[mip + 1].width >= 256) mip++;
+        const CompressedLevel &level = image.levels[mip];
+        std::vector<unsigned char> rgba((size_t)level.width * level.height * 4);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glGetTexImage(GL_TEXTURE_2D, mip, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+        mask->build(rgba.data(), level.width, level.height, 128, maskShift > mip ? maskShift - mip : 0);
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+        TextureLoader::account(image.getBytes(), TextureLoader::rgba8Bytes(image),
+                               std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
+        return true;
+    }
+
+    static bool loadTextureFromFile(const char *file_name, GLuint *tex, AlphaMask *mask, int maskShift)
+    {
+        if (loadCompressedTexture(file_name, tex, mask, maskShift))
+            return true;
+
+        auto start = std::chrono::high_resolution_clock::now();
         int x, y, n;
         int force_channels = 4; 
 
@@ -114,15 +256,198 @@ private:
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
+        mask->build(image_data, x, y, 128, maskShift);
+
         stbi_image_free(image_data);
         glBindTexture(GL_TEXTURE_2D, 0); 
+        // RGBA8 com a cadeia de mips (+1/3).
+        size_t bytes = (size_t)x * y * 4 * 4 / 3;
+        TextureLoader::account(bytes, bytes,
+                               std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count());
         return true;
     }
 };
 
 
-int main()
+// Sprite mais acima (desenhado por ultimo) cujo pixel opaco esta sob o cursor.
+static void mouse_button_callback(GLFWwindow *window, int button, int action, int)
+{
+    if (button != GLFW_MOUSE_BUTTON_LEFT || action != GLFW_PRESS) return;
+
+    std::vector<Sprite> *sprites = static_cast<std::vector<Sprite> *>(glfwGetWindowUserPointer(window));
+    if (!sprites) return;
+
+    double mx, my;
+    int winW, winH;
+    glfwGetCursorPos(window, &mx, &my);
+    glfwGetWindowSize(window, &winW, &winH);
+    glm::vec2 point(static_cast<float>(mx * WIDTH / winW), static_cast<float>(my * HEIGHT / winH));
+
+    auto start = std::chrono::high_resolution_clock::now();
+    int hit = -1;
+    for (int i = static_cast<int>(sprites->size()) - 1; i >= 0; --i)
+    {
+        if ((*sprites)[i].hitTest(point))
+        {
+            hit = i;
+            break;
+        }
+    }
+    double us = std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - start).count();
+
+    if (hit >= 0)
+        std::cout << "Clique em " << (*sprites)[hit].name << " (" << us << " us)" << std::endl;
+    else
+        std::cout << "Clique fora dos sprites (" << us << " us)" << std::endl;
+}
+
+// --bench-sky [quadros]: tempo por quadro das camadas de imagem do ceu (sky e clouds_*)
+// contra o ceu procedural com 2 a 8 oitavas, num framebuffer fora da tela em varias
+// resolucoes. As rochas nao entram: sao iguais nos dois casos. O tempo e de relogio entre
+// dois glFinish (timer query nao mede o trabalho em drivers que rasterizam na CPU).
+static void benchSky(GLuint shaderProgramme, GLuint VAO, const glm::mat4 &proj, const char **layers, int frames)
+{
+    // Memoria das imagens como ficaram na GPU (com mips, no formato do .ctex quando houver).
+    size_t loadedBytes = TextureLoader::stats().gpuBytes;
+    std::vector<Sprite> textured;
+    textured.reserve(4);
+    textured.emplace_back(layers[0], glm::vec2(WIDTH / 2.0f, HEIGHT / 2.0f), glm::vec2(WIDTH, HEIGHT));
+    textured.emplace_back(layers[2], glm::vec2(WIDTH / 2.0f, HEIGHT * 0.25f), glm::vec2(WIDTH * 0.7f, HEIGHT * 0.2f));
+    textured.emplace_back(layers[3], glm::vec2(WIDTH / 2.0f, HEIGHT / 2.0f), glm::vec2(WIDTH, HEIGHT));
+    textured.emplace_back(layers[4], glm::vec2(WIDTH / 2.0f, HEIGHT / 2.0f), glm::vec2(WIDTH, HEIGHT));
+    size_t textureBytes = TextureLoader::stats().gpuBytes - loadedBytes;
+
+    ProceduralSky sky;
+    const int sizes[][2] = { { 640, 360 }, { 1280, 720 }, { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 } };
+    const int octaves[] = { 2, 4, 6, 8 };
+    GLuint fbo, color;
+
+    auto gpuMs = [&](const std::function<void()> &drawFrame) {
+        for (int i = 0; i < 3; i++) drawFrame();
+        glFinish();
+        auto start = std::chrono::high_resolution_clock::now();
+        for (int i = 0; i < frames; i++) drawFrame();
+        glFinish();
+        return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count() / frames;
+    };
+
+    std::cout << "ceu: ms por quadro (" << frames << " quadros)" << std::endl;
+    printf("%-11s %9s", "resolucao", "imagens");
+    for (int o : octaves) printf("  %2d oitavas", o);
+    printf("\n");
+    for (const auto &size : sizes)
+    {
+        glGenTextures(1, &color);
+        glBindTexture(GL_TEXTURE_2D, color);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size[0], size[1], 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, color, 0);
+        glViewport(0, 0, size[0], size[1]);
+
+        double imageMs = gpuMs([&]() {
+            glClear(GL_COLOR_BUFFER_BIT);
+            glUseProgram(shaderProgramme);
+            glUniformMatrix4fv(glGetUniformLocation(shaderProgramme, "proj"), 1, GL_FALSE, glm::value_ptr(proj));
+            for (Sprite &sprite : textured) sprite.draw(shaderProgramme, VAO);
+        });
+        printf("%4dx%-6d %9.3f", size[0], size[1], imageMs);
+        for (int o : octaves)
+        {
+            sky.setOctaves(o);
+            printf("  %10.3f", gpuMs([&]() {
+                sky.drawBackground();
+                sky.drawClouds(1.0f);
+            }));
+        }
+        printf("\n");
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteFramebuffers(1, &fbo);
+        glDeleteTextures(1, &color);
+    }
+    glViewport(0, 0, WIDTH, HEIGHT);
+    printf("memoria: imagens %.1f MB de textura (com mips), ceu procedural 0 MB\n", textureBytes / (1024.0 * 1024.0));
+}
+
+// --bake-textures: grava os .ctex de cada camada em cada formato (BC1 so sem alfa, BC3 so
+// com alfa), com a cadeia de mips, e mostra o tempo de codificacao, o tamanho e o PSNR do
+// que a GPU decodifica.
+static void bakeCompressedTextures(const char **layers, int count)
 {
+    for (int i = 0; i < count; i++)
+    {
+        int w, h, n;
+        unsigned char *data = stbi_load(layers[i], &w, &h, &n, 4);
+        if (!data)
+        {
+            std::cerr << "Falha ao carregar imagem para compressao: " << layers[i] << std::endl;
+            continue;
+        }
+        bool alpha = TextureCodec::hasAlpha(data, w, h);
+        for (int f = TEX_BC1; f < TEX_FORMAT_COUNT; f++)
+        {
+            if ((f == TEX_BC1 && alpha) || (f == TEX_BC3 && !alpha)) continue;
+            CompressedImage image;
+            auto start = std::chrono::high_resolution_clock::now();
+            TextureCodec::compress(data, w, h, f, true, image);
+            double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+            std::string path = TextureCodec::pathFor(layers[i], f);
+            if (!TextureCodec::write(path.c_str(), image)) continue;
+            double db = TextureLoader::psnr(image, data);
+            char quality[32] = "- (sem suporte na GPU)";
+            if (db >= 0.0) snprintf(quality, sizeof(quality), "%.1f dB", db);
+            printf("%s: %dx%d, %.1f ms, %.1f MB (RGBA8 %.1f MB), PSNR %s\n", path.c_str(), w, h, ms,
+                   image.getBytes() / (1024.0 * 1024.0), TextureLoader::rgba8Bytes(image) / (1024.0 * 1024.0), quality);
+        }
+        stbi_image_free(data);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    // --bake-vt corta as imagens em paginas (.vtex) antes de abrir a cena;
+    // --no-vt ignora os .vtex e sobe as imagens inteiras como antes.
+    // --procedural-sky troca sky.png e clouds_*.png pelo ceu procedural (--octaves n).
+    // --no-flatten desenha todas as camadas a cada quadro, sem achatar as paradas.
+    // --bake-textures grava as camadas comprimidas (.ctex); sem .vtex, o sprite usa o .ctex
+    // que a GPU suportar (--tex-format fixa um: rgba8, bc1, bc3, bc7 ou etc2).
+    bool bakeVt = false, useVt = true, proceduralSky = false, flatten = true, bakeTextures = false;
+    int skyOctaves = 5, benchSkyFrames = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (std::string(argv[i]) == "--bake-vt") bakeVt = true;
+        else if (std::string(argv[i]) == "--no-vt") useVt = false;
+        else if (std::string(argv[i]) == "--procedural-sky") proceduralSky = true;
+        else if (std::string(argv[i]) == "--no-flatten") flatten = false;
+        else if (std::string(argv[i]) == "--octaves" && i + 1 < argc) skyOctaves = atoi(argv[++i]);
+        else if (std::string(argv[i]) == "--bake-textures") bakeTextures = true;
+        else if (std::string(argv[i]) == "--tex-format" && i + 1 < argc)
+        {
+            int format = TextureCodec::parseFormat(argv[++i]);
+            if (format < 0) std::cerr << "Formato de textura desconhecido: " << argv[i] << std::endl;
+            else TextureLoader::setForced(format);
+        }
+        else if (std::string(argv[i]) == "--bench-sky")
+        {
+            benchSkyFrames = i + 1 < argc && argv[i + 1][0] != '-' ? atoi(argv[++i]) : 100;
+            if (benchSkyFrames <= 0) benchSkyFrames = 100;
+        }
+    }
+
+    const char *layers[] = {
+        "../src/ExerciciosModulo4/sky.png",
+        "../src/ExerciciosModulo4/rocks_2.png",
+        "../src/ExerciciosModulo4/clouds_3.png",
+        "../src/ExerciciosModulo4/clouds_2.png",
+        "../src/ExerciciosModulo4/clouds_1.png"
+    };
+    if (bakeVt)
+    {
+        for (const char *layer : layers)
+            bakeVirtualTexture(layer, (std::string(layer) + ".vtex").c_str());
+    }
+
     glfwInit();
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
@@ -143,6 +468,9 @@ int main()
         return EXIT_FAILURE;
     }
 
+    if (bakeTextures)
+        bakeCompressedTextures(layers, 5);
+
     glEnable(GL_BLEND); 
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
@@ -182,88 +510,182 @@ int main()
     glDeleteShader(vs);
     glDeleteShader(fs);
 
-    GLfloat vertices[] = {
-        -0.5f,  0.5f, 0.0f,  1.0f, 0.0f, 0.0f,    0.0f, 1.0f, 
-         0.5f, -0.5f, 0.0f,  0.0f, 1.0f, 0.0f,    1.0f, 0.0f, 
-        -0.5f, -0.5f, 0.0f,  0.0f, 0.0f, 1.0f,    0.0f, 0.0f, 
-        -0.5f,  0.5f, 0.0f,  1.0f, 0.0f, 0.0f,    0.0f, 1.0f, 
-         0.5f,  0.5f, 0.0f,  0.0f, 1.0f, 0.0f,    1.0f, 1.0f, 
-         0.5f, -0.5f, 0.0f,  0.0f, 0.0f, 1.0f,    1.0f, 0.0f  
+    // Quad de 4 vertices em half float (+-0.5, 0 e 1 sao exatos): 8 bytes por vertice em
+    // vez dos 32 de antes, que ainda levavam uma cor que o shader nao le. Os indices vem do
+    // QuadIndexBuffer compartilhado, sem um EBO so para o sprite.
+    VertexFormat quadFormat;
+    quadFormat.add("vPosition", 0, 2, VF_HALF).add("vTexture", 2, 2, VF_HALF);
+    const float corners[4][4] = {
+        { -0.5f, -0.5f, 0.0f, 0.0f },
+        {  0.5f, -0.5f, 1.0f, 0.0f },
+        {  0.5f,  0.5f, 1.0f, 1.0f },
+        { -0.5f,  0.5f, 0.0f, 1.0f }
     };
+    std::vector<unsigned char> vertices(4 * quadFormat.getStride());
+    for (int i = 0; i < 4; i++)
+    {
+        quadFormat.write(&vertices[i * quadFormat.getStride()], 0, corners[i]);
+        quadFormat.write(&vertices[i * quadFormat.getStride()], 2, corners[i] + 2);
+    }
 
     GLuint VAO, VBO;
     glGenVertexArrays(1, &VAO);
     glGenBuffers(1, &VBO);
     glBindVertexArray(VAO);
     glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)0);
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void *)(6 * sizeof(float)));
-    glEnableVertexAttribArray(2);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size(), vertices.data(), GL_STATIC_DRAW);
+    QuadIndexBuffer::get().bind(1);
+    quadFormat.apply();
     glBindBuffer(GL_ARRAY_BUFFER, 0); 
     glBindVertexArray(0); 
+    VertexFormat::validate(shader_programme, "sprite", { &quadFormat });
 
     glm::mat4 proj = glm::ortho(0.0f, static_cast<float>(WIDTH), static_cast<float>(HEIGHT), 0.0f, -1.0f, 1.0f);
 
     glUseProgram(shader_programme); 
     glUniform1i(glGetUniformLocation(shader_programme, "basic_texture"), 0);
 
-    Sprite skySprite("../src/ExerciciosModulo4/sky.png",
-                     glm::vec2(WIDTH / 2.0f, HEIGHT / 2.0f),
-                     glm::vec2(WIDTH, HEIGHT),
-                     0.0f);
-
-    Sprite rocks_2Sprite("../src/ExerciciosModulo4/rocks_2.png",
-                        glm::vec2(WIDTH / 2.0f, HEIGHT * 0.7f), 
-                        glm::vec2(WIDTH, HEIGHT * 0.6f),       
-                        0.0f);
-
-    Sprite clouds_3Sprite("../src/ExerciciosModulo4/clouds_3.png",
-                        glm::vec2(WIDTH / 2.0f, HEIGHT * 0.25f),
-                        glm::vec2(WIDTH * 0.7f, HEIGHT * 0.2f), 
-                        0.0f);
-
-    Sprite clouds_2Sprite("../src/ExerciciosModulo4/clouds_2.png",
-                        glm::vec2(WIDTH / 2.0f, HEIGHT / 2.0f), 
-                        glm::vec2(WIDTH, HEIGHT),              
-                        0.0f);
-
-    Sprite clouds_1Sprite("../src/ExerciciosModulo4/clouds_1.png",
-                         glm::vec2(WIDTH / 2.0f, HEIGHT / 2.0f), 
-                         glm::vec2(WIDTH, HEIGHT),               
-                         0.0f);
-    
+    if (benchSkyFrames > 0)
+    {
+        benchSky(shader_programme, VAO, proj, layers, benchSkyFrames);
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteProgram(shader_programme);
+        glfwTerminate();
+        return EXIT_SUCCESS;
+    }
+
+    VirtualTextureSystem *vts = nullptr;
+    if (useVt)
+    {
+        vts = new VirtualTextureSystem(WIDTH, HEIGHT);
+        // A projecao nao muda, entao basta passa-la uma vez aos programas da textura virtual.
+        glUseProgram(vts->getDrawProgram());
+        glUniformMatrix4fv(glGetUniformLocation(vts->getDrawProgram(), "proj"), 1, GL_FALSE, glm::value_ptr(proj));
+        glUseProgram(vts->getFeedbackProgram());
+        glUniformMatrix4fv(glGetUniformLocation(vts->getFeedbackProgram(), "proj"), 1, GL_FALSE, glm::value_ptr(proj));
+        // Os sprites com textura virtual usam o mesmo VAO do quad.
+        VertexFormat::validate(vts->getDrawProgram(), "textura virtual", { &quadFormat });
+        VertexFormat::validate(vts->getFeedbackProgram(), "feedback da textura virtual", { &quadFormat });
+    }
+
+    ProceduralSky *sky = nullptr;
+    if (proceduralSky)
+    {
+        sky = new ProceduralSky();
+        sky->setOctaves(skyOctaves);
+    }
+
+    // Com o ceu procedural, sky.png e clouds_*.png nem chegam a ser carregados.
     std::vector<Sprite> sprites;
     sprites.reserve(5); 
-    
-    sprites.push_back(std::move(skySprite));
-    sprites.push_back(std::move(rocks_2Sprite));
-    sprites.push_back(std::move(clouds_3Sprite));
-    sprites.push_back(std::move(clouds_2Sprite));
-    sprites.push_back(std::move(clouds_1Sprite));
+
+    if (!sky)
+        sprites.emplace_back(layers[0],
+                             glm::vec2(WIDTH / 2.0f, HEIGHT / 2.0f),
+                             glm::vec2(WIDTH, HEIGHT),
+                             0.0f, 0, vts);
+
+    sprites.emplace_back(layers[1],
+                         glm::vec2(WIDTH / 2.0f, HEIGHT * 0.7f), 
+                         glm::vec2(WIDTH, HEIGHT * 0.6f),       
+                         0.0f, 0, vts);
+
+    if (!sky)
+    {
+        sprites.emplace_back(layers[2],
+                             glm::vec2(WIDTH / 2.0f, HEIGHT * 0.25f),
+                             glm::vec2(WIDTH * 0.7f, HEIGHT * 0.2f), 
+                             0.0f, 0, vts);
+
+        sprites.emplace_back(layers[3],
+                             glm::vec2(WIDTH / 2.0f, HEIGHT / 2.0f), 
+                             glm::vec2(WIDTH, HEIGHT),              
+                             0.0f, 0, vts);
+
+        sprites.emplace_back(layers[4],
+                             glm::vec2(WIDTH / 2.0f, HEIGHT / 2.0f), 
+                             glm::vec2(WIDTH, HEIGHT),               
+                             0.0f, 0, vts);
+    }
+
+    glfwSetWindowUserPointer(window, &sprites);
+    glfwSetMouseButtonCallback(window, mouse_button_callback);
+
+    // Camadas que nao mudam viram uma textura so; as demais continuam desenhadas uma a uma.
+    int fbWidth, fbHeight;
+    glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+    LayerFlattener *flattener = flatten ? new LayerFlattener(fbWidth, fbHeight) : nullptr;
+    std::vector<uint64_t> signatures;
 
     while (!glfwWindowShouldClose(window))
     {
         glfwPollEvents();
 
-        glClearColor(0.1f, 0.1f, 0.1f, 1.0f); 
-        glClear(GL_COLOR_BUFFER_BIT);
+        if (vts && vts->getTextureCount() > 0)
+        {
+            vts->update();
+            vts->beginFeedback();
+            int layer = 0;
+            for (Sprite& sprite : sprites)
+            {
+                if (sprite.vt) sprite.drawFeedback(VAO, layer++, vts->getTextureCount());
+            }
+            vts->endFeedback();
+        }
+
+        // O gradiente cobre a tela toda, entao dispensa o clear.
+        if (sky)
+        {
+            sky->drawBackground();
+        }
+        else
+        {
+            glClearColor(0.1f, 0.1f, 0.1f, 1.0f); 
+            glClear(GL_COLOR_BUFFER_BIT);
+        }
 
         glUseProgram(shader_programme);
         glUniformMatrix4fv(glGetUniformLocation(shader_programme, "proj"), 1, GL_FALSE, glm::value_ptr(proj));
         
-        for (Sprite& sprite : sprites) 
+        if (flattener)
+        {
+            glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
+            flattener->resize(fbWidth, fbHeight);
+            signatures.resize(sprites.size());
+            for (size_t i = 0; i < sprites.size(); i++) signatures[i] = sprites[i].signature();
+            flattener->draw(signatures, [&](int i) { sprites[i].draw(shader_programme, VAO); });
+        }
+        else
         {
-            sprite.draw(shader_programme, VAO);
+            for (Sprite& sprite : sprites) 
+            {
+                sprite.draw(shader_programme, VAO);
+            }
         }
 
+        if (sky) sky->drawClouds(static_cast<float>(glfwGetTime()));
+
         glfwSwapBuffers(window);
     }
 
     glDeleteVertexArrays(1, &VAO);
     glDeleteBuffers(1, &VBO);
     glDeleteProgram(shader_programme);
+    delete sky;
+    TextureLoader::printStats();
+    if (flattener)
+    {
+        flattener->printStats();
+        delete flattener;
+    }
+
+    if (vts)
+    {
+        vts->printStats();
+        for (Sprite& sprite : sprites) sprite.vt = nullptr;
+        delete vts;
+    }
 
     glfwTerminate();
     return EXIT_SUCCESS;
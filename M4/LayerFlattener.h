@@ -0,0 +1,238 @@
+#ifndef LayerFlattener_h
+#define LayerFlattener_h
+
+#include <stdint.h>
+#include <functional>
+#include <iostream>
+#include <vector>
+
+#include <glad/glad.h>
+
+#define FLATTEN_STABLE_FRAMES 2
+#define FLATTEN_MIN_RUN 2
+
+// Achata sequencias de camadas paradas numa textura do tamanho da tela. A cada quadro o
+// chamador passa um resumo (assinatura) de cada camada; uma camada cuja assinatura nao
+// mudou por FLATTEN_STABLE_FRAMES quadros conta como parada, e cada sequencia de pelo
+// menos FLATTEN_MIN_RUN camadas paradas vira um quad so. A textura da sequencia e refeita
+// apenas quando a assinatura de alguma camada dela muda (ou a sequencia muda de forma).
+// O cache guarda cor pre-multiplicada: as camadas sao compostas sobre transparente com
+// blend separado para o alfa, e o quad final usa (1, 1 - alfa), o que da o mesmo
+// resultado de desenhar as camadas uma a uma sobre o que ja estiver na tela.
+class LayerFlattener
+{
+public:
+    LayerFlattener(int width, int height)
+        : width(width), height(height), frames(0), flattens(0), layersSubmitted(0), quadsDrawn(0)
+    {
+        program = buildProgram();
+        glGenVertexArrays(1, &VAO);
+    }
+
+    ~LayerFlattener()
+    {
+        for (Run &run : runs) release(run);
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteProgram(program);
+    }
+
+    LayerFlattener(const LayerFlattener&) = delete;
+    LayerFlattener& operator=(const LayerFlattener&) = delete;
+
+    // Tamanho do framebuffer de destino; mudar descarta o que estava achatado.
+    void resize(int w, int h)
+    {
+        if (w == width && h == height) return;
+        width = w;
+        height = h;
+        for (Run &run : runs) release(run);
+        runs.clear();
+    }
+
+    // signatures[i] resume tudo que muda o desenho da camada i (transform, textura, ...).
+    // drawLayer(i) desenha a camada i no framebuffer atual com o blend padrao
+    // (SRC_ALPHA, ONE_MINUS_SRC_ALPHA), na ordem de tras para frente.
+    void draw(const std::vector<uint64_t> &signatures, const std::function<void(int)> &drawLayer)
+    {
+        int count = (int)signatures.size();
+        if ((int)lastSignature.size() != count)
+        {
+            lastSignature.assign(signatures.begin(), signatures.end());
+            stableFrames.assign(count, 0);
+        }
+        for (int i = 0; i < count; i++)
+        {
+            stableFrames[i] = signatures[i] == lastSignature[i] ? stableFrames[i] + 1 : 0;
+            lastSignature[i] = signatures[i];
+        }
+        for (Run &run : runs) run.used = false;
+
+        frames++;
+        layersSubmitted += count;
+        int i = 0;
+        while (i < count)
+        {
+            int end = i;
+            while (end < count && stableFrames[end] >= FLATTEN_STABLE_FRAMES) end++;
+            if (end - i < FLATTEN_MIN_RUN)
+            {
+                drawLayer(i++);
+                quadsDrawn++;
+                continue;
+            }
+            uint64_t signature = 1469598103934665603ull;
+            for (int k = i; k < end; k++) signature = (signature ^ signatures[k]) * 1099511628211ull;
+            Run &run = find(i, end - i);
+            if (!run.valid || run.signature != signature)
+            {
+                flatten(run, drawLayer);
+                run.signature = signature;
+                run.valid = true;
+            }
+            run.used = true;
+            drawCached(run);
+            quadsDrawn++;
+            i = end;
+        }
+
+        // Sequencias que deixaram de existir liberam a textura.
+        for (size_t k = 0; k < runs.size();)
+        {
+            if (runs[k].used)
+            {
+                k++;
+                continue;
+            }
+            release(runs[k]);
+            runs.erase(runs.begin() + k);
+        }
+    }
+
+    void printStats()
+    {
+        std::cout << "achatamento: " << flattens << " texturas refeitas em " << frames << " quadros, "
+                  << (frames ? (double)quadsDrawn / frames : 0.0) << " quads por quadro (de "
+                  << (frames ? (double)layersSubmitted / frames : 0.0) << " camadas), "
+                  << runs.size() << " sequencias em cache ("
+                  << runs.size() * (size_t)width * height * 4 / (1024 * 1024) << " MB)" << std::endl;
+    }
+
+private:
+    struct Run
+    {
+        int first, count;
+        uint64_t signature;
+        bool valid, used;
+        GLuint fbo, texture;
+    };
+
+    int width, height;
+    GLuint program, VAO;
+    std::vector<Run> runs;
+    std::vector<uint64_t> lastSignature;
+    std::vector<int> stableFrames;
+    unsigned long long frames, flattens, layersSubmitted, quadsDrawn;
+
+    Run &find(int first, int count)
+    {
+        for (Run &run : runs)
+        {
+            if (run.first == first && run.count == count) return run;
+        }
+        Run run;
+        run.first = first;
+        run.count = count;
+        run.signature = 0;
+        run.valid = run.used = false;
+        glGenTextures(1, &run.texture);
+        glBindTexture(GL_TEXTURE_2D, run.texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenFramebuffers(1, &run.fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, run.fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, run.texture, 0);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cerr << "Framebuffer de achatamento incompleto" << std::endl;
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        runs.push_back(run);
+        return runs.back();
+    }
+
+    static void release(Run &run)
+    {
+        glDeleteFramebuffers(1, &run.fbo);
+        glDeleteTextures(1, &run.texture);
+    }
+
+    void flatten(Run &run, const std::function<void(int)> &drawLayer)
+    {
+        GLint previousFbo, viewport[4];
+        GLfloat clear[4];
+        glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFbo);
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glGetFloatv(GL_COLOR_CLEAR_VALUE, clear);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, run.fbo);
+        glViewport(0, 0, width, height);
+        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glBlendFuncSeparate(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        for (int k = run.first; k < run.first + run.count; k++) drawLayer(k);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, previousFbo);
+        glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+        glClearColor(clear[0], clear[1], clear[2], clear[3]);
+        flattens++;
+    }
+
+    void drawCached(const Run &run)
+    {
+        glUseProgram(program);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, run.texture);
+        glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+        glBindVertexArray(VAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    // Triangulo de tela cheia; o cache tem o tamanho do framebuffer, entao e texel a texel.
+    static GLuint buildProgram()
+    {
+        const char *vs_src =
+            "#version 400\n"
+            "void main() {\n"
+            "    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+            "    gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);\n"
+            "}";
+        const char *fs_src =
+            "#version 400\n"
+            "uniform sampler2D flattened;\n"
+            "out vec4 frag_color;\n"
+            "void main() {\n"
+            "    frag_color = texelFetch(flattened, ivec2(gl_FragCoord.xy), 0);\n"
+            "}";
+        GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vs, 1, &vs_src, NULL);
+        glCompileShader(vs);
+        GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fs, 1, &fs_src, NULL);
+        glCompileShader(fs);
+        GLuint program = glCreateProgram();
+        glAttachShader(program, vs);
+        glAttachShader(program, fs);
+        glLinkProgram(program);
+        glDeleteShader(vs);
+        glDeleteShader(fs);
+        glUseProgram(program);
+        glUniform1i(glGetUniformLocation(program, "flattened"), 0);
+        return program;
+    }
+};
+
+#endif
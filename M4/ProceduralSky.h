@@ -0,0 +1,221 @@
+#ifndef ProceduralSky_h
+#define ProceduralSky_h
+
+#include <iostream>
+#include <string>
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#define SKY_MAX_OCTAVES 8
+
+// Ceu procedural no lugar de sky.png e clouds_*.png: gradiente vertical e nuvens de fBm
+// (value noise com hash inteiro, sem textura) calculados por pixel num triangulo que cobre
+// a tela. Sao dois passes para manter a ordem das camadas de imagem: o fundo antes das
+// rochas e as nuvens, com alfa, depois delas. Duas camadas de nuvem com escala e vento
+// diferentes dao a paralaxe que as tres imagens davam. Nenhuma textura e lida; o custo e
+// so de ALU e cresce com o numero de oitavas.
+class ProceduralSky
+{
+public:
+    ProceduralSky()
+        : program(0), octaves(5), coverage(0.45f), softness(0.25f), wind(0.02f, 0.003f),
+          zenith(0.22f, 0.45f, 0.82f), horizon(0.78f, 0.86f, 0.95f)
+    {
+        glGenVertexArrays(1, &VAO);
+        rebuild();
+    }
+
+    ~ProceduralSky()
+    {
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteProgram(program);
+    }
+
+    ProceduralSky(const ProceduralSky&) = delete;
+    ProceduralSky& operator=(const ProceduralSky&) = delete;
+
+    // Cada oitava soma uma camada de ruido com o dobro da frequencia e metade da amplitude.
+    // O numero de oitavas e fixo no shader (laco de tamanho constante), entao mudar recompila.
+    void setOctaves(int n)
+    {
+        n = n < 1 ? 1 : (n > SKY_MAX_OCTAVES ? SKY_MAX_OCTAVES : n);
+        if (n == octaves) return;
+        octaves = n;
+        rebuild();
+    }
+
+    int getOctaves() const
+    {
+        return octaves;
+    }
+
+    // coverage: limiar do fBm a partir do qual ha nuvem; softness: largura da borda.
+    void setCoverage(float c, float soft)
+    {
+        coverage = c;
+        softness = soft;
+    }
+
+    // Deslocamento do ruido por segundo, em alturas de tela (a camada da frente anda isso,
+    // a do fundo metade).
+    void setWind(glm::vec2 w)
+    {
+        wind = w;
+    }
+
+    void setColors(glm::vec3 top, glm::vec3 bottom)
+    {
+        zenith = top;
+        horizon = bottom;
+    }
+
+    // Gradiente opaco: substitui o clear e a camada sky.png.
+    void drawBackground()
+    {
+        draw(0, 0.0f);
+    }
+
+    // Nuvens com alfa por cima do que ja foi desenhado (blend ligado).
+    void drawClouds(float time)
+    {
+        draw(1, time);
+    }
+
+private:
+    GLuint program, VAO;
+    GLint locPass, locTime, locResolution, locWind, locCoverage, locSoftness, locZenith, locHorizon;
+    int octaves;
+    float coverage, softness;
+    glm::vec2 wind;
+    glm::vec3 zenith, horizon;
+
+    void rebuild()
+    {
+        if (program) glDeleteProgram(program);
+        program = buildProgram(octaves);
+        locPass = glGetUniformLocation(program, "pass");
+        locTime = glGetUniformLocation(program, "time");
+        locResolution = glGetUniformLocation(program, "resolution");
+        locWind = glGetUniformLocation(program, "wind");
+        locCoverage = glGetUniformLocation(program, "coverage");
+        locSoftness = glGetUniformLocation(program, "softness");
+        locZenith = glGetUniformLocation(program, "zenith");
+        locHorizon = glGetUniformLocation(program, "horizon");
+    }
+
+    void draw(int pass, float time)
+    {
+        // A resolucao sai do viewport atual, para o mesmo ceu servir a janela e o benchmark.
+        GLint viewport[4];
+        glGetIntegerv(GL_VIEWPORT, viewport);
+        glUseProgram(program);
+        glUniform1i(locPass, pass);
+        glUniform1f(locTime, time);
+        glUniform2f(locResolution, (float)viewport[2], (float)viewport[3]);
+        glUniform2f(locWind, wind.x, wind.y);
+        glUniform1f(locCoverage, coverage);
+        glUniform1f(locSoftness, softness);
+        glUniform3f(locZenith, zenith.r, zenith.g, zenith.b);
+        glUniform3f(locHorizon, horizon.r, horizon.g, horizon.b);
+        glBindVertexArray(VAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindVertexArray(0);
+    }
+
+    // Triangulo de tela cheia a partir de gl_VertexID, sem buffer de vertices.
+    static const char *vertexSource()
+    {
+        return "#version 400\n"
+               "void main() {\n"
+               "    vec2 p = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);\n"
+               "    gl_Position = vec4(p * 2.0 - 1.0, 0.0, 1.0);\n"
+               "}";
+    }
+
+    static std::string fragmentSource(int octaves)
+    {
+        return "#version 400\n"
+               "#define OCTAVES " + std::to_string(octaves) + "\n"
+               "uniform int pass;\n"
+               "uniform float time;\n"
+               "uniform vec2 resolution;\n"
+               "uniform vec2 wind;\n"
+               "uniform float coverage;\n"
+               "uniform float softness;\n"
+               "uniform vec3 zenith;\n"
+               "uniform vec3 horizon;\n"
+               "out vec4 frag_color;\n"
+               "float hash(ivec2 p) {\n"
+               "    uvec2 q = uvec2(p) * uvec2(1597334673u, 3812015801u);\n"
+               "    uint n = (q.x ^ q.y) * 1597334673u;\n"
+               "    return float(n >> 8) * (1.0 / 16777216.0);\n"
+               "}\n"
+               "float noise(vec2 p) {\n"
+               "    ivec2 i = ivec2(floor(p));\n"
+               "    vec2 f = fract(p);\n"
+               "    vec2 u = f * f * f * (f * (f * 6.0 - 15.0) + 10.0);\n"
+               "    float a = hash(i), b = hash(i + ivec2(1, 0));\n"
+               "    float c = hash(i + ivec2(0, 1)), d = hash(i + ivec2(1, 1));\n"
+               "    return mix(mix(a, b, u.x), mix(c, d, u.x), u.y);\n"
+               "}\n"
+               // Gira cada oitava para as grades do ruido nao se alinharem.
+               "float fbm(vec2 p) {\n"
+               "    const mat2 rot = mat2(0.8, -0.6, 0.6, 0.8);\n"
+               "    float sum = 0.0, amp = 0.5;\n"
+               "    for (int i = 0; i < OCTAVES; i++) {\n"
+               "        sum += amp * noise(p);\n"
+               "        p = rot * p * 2.0 + 17.0;\n"
+               "        amp *= 0.5;\n"
+               "    }\n"
+               "    return sum / (1.0 - amp * 2.0);\n"
+               "}\n"
+               "void main() {\n"
+               "    vec2 uv = gl_FragCoord.xy / resolution;\n"
+               "    if (pass == 0) {\n"
+               "        frag_color = vec4(mix(horizon, zenith, pow(uv.y, 0.8)), 1.0);\n"
+               "        return;\n"
+               "    }\n"
+               // Perto do horizonte (parte de baixo da tela) as nuvens somem: la nao ha ruido a calcular.
+               "    float fade = smoothstep(0.15, 0.55, uv.y);\n"
+               "    if (fade <= 0.0) discard;\n"
+               "    vec2 p = vec2(uv.x * resolution.x / resolution.y, uv.y);\n"
+               "    float far = fbm(p * 3.0 + wind * time * 0.5);\n"
+               "    float near = fbm(p * 1.6 + wind * time + 31.0);\n"
+               "    float density = max(smoothstep(coverage, coverage + softness, near),\n"
+               "                        0.6 * smoothstep(coverage, coverage + softness, far));\n"
+               "    vec3 shade = mix(vec3(0.72, 0.76, 0.84), vec3(1.0), clamp(near * 1.4 - 0.2, 0.0, 1.0));\n"
+               "    frag_color = vec4(shade, density * fade);\n"
+               "}";
+    }
+
+    static GLuint buildProgram(int octaves)
+    {
+        const char *vs_src = vertexSource();
+        std::string fragment = fragmentSource(octaves);
+        const char *fs_src = fragment.c_str();
+        GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vs, 1, &vs_src, NULL);
+        glCompileShader(vs);
+        GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fs, 1, &fs_src, NULL);
+        glCompileShader(fs);
+        GLint ok = 0;
+        glGetShaderiv(fs, GL_COMPILE_STATUS, &ok);
+        if (!ok)
+        {
+            char log[2048];
+            glGetShaderInfoLog(fs, sizeof(log), NULL, log);
+            std::cerr << "Erro no shader do ceu procedural:\n" << log << std::endl;
+        }
+        GLuint program = glCreateProgram();
+        glAttachShader(program, vs);
+        glAttachShader(program, fs);
+        glLinkProgram(program);
+        glDeleteShader(vs);
+        glDeleteShader(fs);
+        return program;
+    }
+};
+
+#endif
@@ -0,0 +1,1071 @@
+#ifndef TextureCodec_h
+#define TextureCodec_h
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <glad/glad.h>
+#include <GLFW/glfw3.h>
+
+
+#define TEX_RGBA8 0
+#define TEX_BC1 1
+#define TEX_BC3 2
+#define TEX_BC7 3
+#define TEX_ETC2 4
+#define TEX_FORMAT_COUNT 5
+
+#define CTEX_MAGIC 0x58455443u
+#define CTEX_VERSION 1
+#define CTEX_MAX_LEVELS 16
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+#ifndef GL_COMPRESSED_RGBA8_ETC2_EAC
+#define GL_COMPRESSED_RGBA8_ETC2_EAC 0x9278
+#endif
+
+struct CompressedLevel
+{
+    int width, height;
+    std::vector<uint8_t> data;
+};
+
+// Uma imagem ja comprimida com a cadeia de mips (ou so o nivel 0), como vai para a GPU.
+struct CompressedImage
+{
+    int format;
+    int width, height;
+    bool alpha;
+    std::vector<CompressedLevel> levels;
+
+    size_t getBytes() const
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < levels.size(); i++) total += levels[i].data.size();
+        return total;
+    }
+};
+
+// Codificadores de blocos 4x4 na CPU e o arquivo .ctex. Cada formato tem um codificador so,
+// sem busca exaustiva: reta principal (PCA) dos texels, quantizacao e um refinamento por
+// minimos quadrados com os indices escolhidos.
+//   BC1: RGB 565, 4 bits por texel (so imagens sem alfa).
+//   BC3: BC1 para a cor + bloco de alfa de 8 valores (BC4), 8 bits por texel.
+//   BC7: modos 6 (RGBA numa reta, indices de 4 bits) e 5 (cor e alfa separados), o que
+//        der menos erro em cada bloco; sem os modos com particoes. 8 bits por texel.
+//   ETC2: GL_COMPRESSED_RGBA8_ETC2_EAC com a cor nos modos do ETC1 (individual e
+//         diferencial, que o ETC2 le igual) e o alfa em EAC, 8 bits por texel.
+class TextureCodec
+{
+    // Grava bits em ordem crescente (BC7).
+    static void putBits(uint8_t *out, int &pos, uint32_t value, int bits)
+    {
+        for (int i = 0; i < bits; i++, pos++)
+        {
+            if (value & (1u << i)) out[pos >> 3] |= (uint8_t)(1u << (pos & 7));
+        }
+    }
+
+    static void putBigEndian(uint8_t *out, uint64_t v)
+    {
+        for (int i = 0; i < 8; i++) out[i] = (uint8_t)(v >> (56 - i * 8));
+    }
+
+    static int clampByte(int v)
+    {
+        return v < 0 ? 0 : (v > 255 ? 255 : v);
+    }
+
+    // Reta que melhor passa pelos n pontos (channels componentes): media + eixo principal,
+    // com as pontas nas projecoes extremas.
+    static void fitLine(const float (*p)[4], int n, int channels, float *e0, float *e1)
+    {
+        float mean[4] = { 0, 0, 0, 0 };
+        for (int i = 0; i < n; i++)
+        {
+            for (int c = 0; c < channels; c++) mean[c] += p[i][c] / n;
+        }
+        float cov[4][4];
+        memset(cov, 0, sizeof(cov));
+        for (int i = 0; i < n; i++)
+        {
+            for (int a = 0; a < channels; a++)
+            {
+                for (int b = 0; b < channels; b++) cov[a][b] += (p[i][a] - mean[a]) * (p[i][b] - mean[b]);
+            }
+        }
+        float axis[4] = { 1, 1, 1, 1 };
+        for (int it = 0; it < 8; it++)
+        {
+            float next[4] = { 0, 0, 0, 0 }, len = 0.0f;
+            for (int a = 0; a < channels; a++)
+            {
+                for (int b = 0; b < channels; b++) next[a] += cov[a][b] * axis[b];
+                len += next[a] * next[a];
+            }
+            if (len < 1e-12f) break;
+            len = sqrtf(len);
+            for (int a = 0; a < channels; a++) axis[a] = next[a] / len;
+        }
+        float lo = 1e30f, hi = -1e30f;
+        for (int i = 0; i < n; i++)
+        {
+            float t = 0.0f;
+            for (int c = 0; c < channels; c++) t += (p[i][c] - mean[c]) * axis[c];
+            if (t < lo) lo = t;
+            if (t > hi) hi = t;
+        }
+        if (lo > hi) lo = hi = 0.0f;
+        for (int c = 0; c < channels; c++)
+        {
+            e0[c] = mean[c] + axis[c] * hi;
+            e1[c] = mean[c] + axis[c] * lo;
+        }
+    }
+
+    // Pontas que minimizam o erro para os pesos w (peso de e0) ja escolhidos.
+    static bool leastSquares(const float (*p)[4], const float *w, int n, int channels, float *e0, float *e1)
+    {
+        float aa = 0, ab = 0, bb = 0, ax[4] = { 0, 0, 0, 0 }, bx[4] = { 0, 0, 0, 0 };
+        for (int i = 0; i < n; i++)
+        {
+            float a = w[i], b = 1.0f - w[i];
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            for (int c = 0; c < channels; c++)
+            {
+                ax[c] += a * p[i][c];
+                bx[c] += b * p[i][c];
+            }
+        }
+        float det = aa * bb - ab * ab;
+        if (fabsf(det) < 1e-6f) return false;
+        for (int c = 0; c < channels; c++)
+        {
+            e0[c] = (ax[c] * bb - bx[c] * ab) / det;
+            e1[c] = (bx[c] * aa - ax[c] * ab) / det;
+        }
+        return true;
+    }
+
+    static uint16_t to565(const float *c)
+    {
+        int r = clampByte((int)(c[0] * 31.0f / 255.0f + 0.5f)), g = clampByte((int)(c[1] * 63.0f / 255.0f + 0.5f));
+        int b = clampByte((int)(c[2] * 31.0f / 255.0f + 0.5f));
+        r = r > 31 ? 31 : r;
+        g = g > 63 ? 63 : g;
+        b = b > 31 ? 31 : b;
+        return (uint16_t)((r << 11) | (g << 5) | b);
+    }
+
+    static void from565(uint16_t v, int *c)
+    {
+        int r = v >> 11, g = (v >> 5) & 63, b = v & 31;
+        c[0] = (r << 3) | (r >> 2);
+        c[1] = (g << 2) | (g >> 4);
+        c[2] = (b << 3) | (b >> 2);
+    }
+
+    // Indices de 2 bits para as pontas c0 > c1 (modo de 4 cores); retorna o erro.
+    static int bc1Indices(const uint8_t *px, uint16_t c0, uint16_t c1, uint32_t &indices)
+    {
+        int pal[4][3];
+        from565(c0, pal[0]);
+        from565(c1, pal[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            pal[2][c] = (2 * pal[0][c] + pal[1][c]) / 3;
+            pal[3][c] = (pal[0][c] + 2 * pal[1][c]) / 3;
+        }
+        int total = 0;
+        indices = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestErr = 1 << 30;
+            for (int k = 0; k < 4; k++)
+            {
+                int dr = px[i * 4] - pal[k][0], dg = px[i * 4 + 1] - pal[k][1], db = px[i * 4 + 2] - pal[k][2];
+                int err = dr * dr + dg * dg + db * db;
+                if (err < bestErr)
+                {
+                    bestErr = err;
+                    best = k;
+                }
+            }
+            indices |= (uint32_t)best << (i * 2);
+            total += bestErr;
+        }
+        return total;
+    }
+
+    // 8 valores (a0 > a1) ou 6 valores + 0 e 255 (a0 <= a1), indices de 3 bits.
+    static int bc4Indices(const uint8_t *px, int a0, int a1, uint64_t &indices)
+    {
+        int pal[8];
+        pal[0] = a0;
+        pal[1] = a1;
+        if (a0 > a1)
+        {
+            for (int i = 2; i < 8; i++) pal[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+        }
+        else
+        {
+            for (int i = 2; i < 6; i++) pal[i] = ((6 - i) * a0 + (i - 1) * a1) / 5;
+            pal[6] = 0;
+            pal[7] = 255;
+        }
+        int total = 0;
+        indices = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestErr = 1 << 30;
+            for (int k = 0; k < 8; k++)
+            {
+                int d = px[i * 4 + 3] - pal[k];
+                if (d * d < bestErr)
+                {
+                    bestErr = d * d;
+                    best = k;
+                }
+            }
+            indices |= (uint64_t)best << (i * 3);
+            total += bestErr;
+        }
+        return total;
+    }
+
+public:
+    static const char *formatName(int format)
+    {
+        static const char *names[] = { "rgba8", "bc1", "bc3", "bc7", "etc2" };
+        return format >= 0 && format < TEX_FORMAT_COUNT ? names[format] : "?";
+    }
+
+    static int parseFormat(const char *name)
+    {
+        for (int f = 0; f < TEX_FORMAT_COUNT; f++)
+        {
+            if (strcmp(name, formatName(f)) == 0) return f;
+        }
+        return -1;
+    }
+
+    // Bytes por bloco 4x4 (RGBA8: por texel).
+    static int blockBytes(int format)
+    {
+        return format == TEX_RGBA8 ? 4 : (format == TEX_BC1 ? 8 : 16);
+    }
+
+    static GLenum glFormat(int format)
+    {
+        switch (format)
+        {
+        case TEX_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case TEX_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case TEX_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+        case TEX_ETC2: return GL_COMPRESSED_RGBA8_ETC2_EAC;
+        default: return GL_RGBA8;
+        }
+    }
+
+    static size_t levelBytes(int format, int width, int height)
+    {
+        if (format == TEX_RGBA8) return (size_t)width * height * 4;
+        return (size_t)((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+    }
+
+    // px: 16 texels RGBA em linhas.
+    static void encodeBC1(const uint8_t *px, uint8_t *out)
+    {
+        float p[16][4];
+        for (int i = 0; i < 16; i++)
+        {
+            for (int c = 0; c < 4; c++) p[i][c] = px[i * 4 + c];
+        }
+        float e0[4], e1[4];
+        fitLine(p, 16, 3, e0, e1);
+        uint16_t best0 = 0, best1 = 0;
+        uint32_t bestIdx = 0;
+        int bestErr = 1 << 30;
+        for (int it = 0; it < 3; it++)
+        {
+            uint16_t c0 = to565(e0), c1 = to565(e1);
+            if (c0 < c1)
+            {
+                uint16_t t = c0;
+                c0 = c1;
+                c1 = t;
+            }
+            uint32_t idx = 0;
+            // Pontas iguais: modo de 3 cores, mas com todos os indices em 0 da na mesma cor.
+            int err = c0 == c1 ? bc1Indices(px, c0, c0, idx) : bc1Indices(px, c0, c1, idx);
+            if (c0 == c1) idx = 0;
+            if (err < bestErr)
+            {
+                bestErr = err;
+                best0 = c0;
+                best1 = c1;
+                bestIdx = idx;
+            }
+            if (c0 == c1) break;
+            static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+            float w[16];
+            for (int i = 0; i < 16; i++) w[i] = weights[(idx >> (i * 2)) & 3];
+            if (!leastSquares(p, w, 16, 3, e0, e1)) break;
+        }
+        out[0] = (uint8_t)best0;
+        out[1] = (uint8_t)(best0 >> 8);
+        out[2] = (uint8_t)best1;
+        out[3] = (uint8_t)(best1 >> 8);
+        for (int i = 0; i < 4; i++) out[4 + i] = (uint8_t)(bestIdx >> (i * 8));
+    }
+
+    static void encodeBC3(const uint8_t *px, uint8_t *out)
+    {
+        int lo = 255, hi = 0, lo6 = 255, hi6 = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            int a = px[i * 4 + 3];
+            if (a < lo) lo = a;
+            if (a > hi) hi = a;
+            if (a != 0 && a != 255)
+            {
+                if (a < lo6) lo6 = a;
+                if (a > hi6) hi6 = a;
+            }
+        }
+        // Modo de 8 valores entre min e max, ou de 6 valores com 0 e 255 exatos a parte.
+        uint64_t idx8, idx6 = 0;
+        int a0 = hi, a1 = lo;
+        int err = bc4Indices(px, a0, a1, idx8);
+        if (lo6 > hi6) lo6 = hi6 = lo == 0 ? 255 : 0;
+        if (bc4Indices(px, lo6, hi6, idx6) < err)
+        {
+            a0 = lo6;
+            a1 = hi6;
+            idx8 = idx6;
+        }
+        out[0] = (uint8_t)a0;
+        out[1] = (uint8_t)a1;
+        for (int i = 0; i < 6; i++) out[2 + i] = (uint8_t)(idx8 >> (i * 8));
+        encodeBC1(px, out + 8);
+    }
+
+    // BC7 modo 6: uma reta so em RGBA (7777 + p-bit por ponta), indices de 4 bits.
+    static int encodeBC7Mode6(const uint8_t *px, uint8_t *out)
+    {
+        static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+        float p[16][4];
+        for (int i = 0; i < 16; i++)
+        {
+            for (int c = 0; c < 4; c++) p[i][c] = px[i * 4 + c];
+        }
+        float e0[4], e1[4];
+        fitLine(p, 16, 4, e0, e1);
+        int best0[4] = { 0, 0, 0, 0 }, best1[4] = { 0, 0, 0, 0 }, bestIdx[16];
+        int bestErr = 1 << 30;
+        memset(bestIdx, 0, sizeof(bestIdx));
+        for (int it = 0; it < 3; it++)
+        {
+            for (int pbits = 0; pbits < 4; pbits++)
+            {
+                int q0[4], q1[4];
+                for (int c = 0; c < 4; c++)
+                {
+                    int p0 = pbits & 1, p1 = pbits >> 1;
+                    int v0 = (int)floorf((e0[c] - p0) / 2.0f + 0.5f), v1 = (int)floorf((e1[c] - p1) / 2.0f + 0.5f);
+                    q0[c] = ((v0 < 0 ? 0 : (v0 > 127 ? 127 : v0)) << 1) | p0;
+                    q1[c] = ((v1 < 0 ? 0 : (v1 > 127 ? 127 : v1)) << 1) | p1;
+                }
+                int pal[16][4];
+                for (int k = 0; k < 16; k++)
+                {
+                    for (int c = 0; c < 4; c++) pal[k][c] = ((64 - weights[k]) * q0[c] + weights[k] * q1[c] + 32) >> 6;
+                }
+                int idx[16], err = 0;
+                for (int i = 0; i < 16 && err < bestErr; i++)
+                {
+                    int best = 0, be = 1 << 30;
+                    for (int k = 0; k < 16; k++)
+                    {
+                        int e = 0;
+                        for (int c = 0; c < 4; c++)
+                        {
+                            int d = px[i * 4 + c] - pal[k][c];
+                            e += d * d;
+                        }
+                        if (e < be)
+                        {
+                            be = e;
+                            best = k;
+                        }
+                    }
+                    idx[i] = best;
+                    err += be;
+                }
+                if (err < bestErr)
+                {
+                    bestErr = err;
+                    memcpy(best0, q0, sizeof(q0));
+                    memcpy(best1, q1, sizeof(q1));
+                    memcpy(bestIdx, idx, sizeof(idx));
+                }
+            }
+            if (bestErr == 0) break;
+            float w[16];
+            for (int i = 0; i < 16; i++) w[i] = 1.0f - weights[bestIdx[i]] / 64.0f;
+            if (!leastSquares(p, w, 16, 4, e0, e1)) break;
+        }
+        // O bit mais alto do indice do texel 0 nao e gravado: tem que ser 0.
+        if (bestIdx[0] >= 8)
+        {
+            for (int c = 0; c < 4; c++)
+            {
+                int t = best0[c];
+                best0[c] = best1[c];
+                best1[c] = t;
+            }
+            for (int i = 0; i < 16; i++) bestIdx[i] = 15 - bestIdx[i];
+        }
+        memset(out, 0, 16);
+        int pos = 0;
+        putBits(out, pos, 1u << 6, 7);
+        for (int c = 0; c < 4; c++)
+        {
+            putBits(out, pos, (uint32_t)(best0[c] >> 1), 7);
+            putBits(out, pos, (uint32_t)(best1[c] >> 1), 7);
+        }
+        putBits(out, pos, (uint32_t)(best0[0] & 1), 1);
+        putBits(out, pos, (uint32_t)(best1[0] & 1), 1);
+        putBits(out, pos, (uint32_t)bestIdx[0], 3);
+        for (int i = 1; i < 16; i++) putBits(out, pos, (uint32_t)bestIdx[i], 4);
+        return bestErr;
+    }
+
+    // BC7 modo 5: cor (777) e alfa (8 bits) em retas separadas, indices de 2 bits cada.
+    // Ganha do modo 6 na borda dos sprites, onde alfa e cor nao andam juntos.
+    static int encodeBC7Mode5(const uint8_t *px, uint8_t *out)
+    {
+        static const int weights[4] = { 0, 21, 43, 64 };
+        float p[16][4];
+        for (int i = 0; i < 16; i++)
+        {
+            for (int c = 0; c < 4; c++) p[i][c] = px[i * 4 + c];
+        }
+        float e0[4], e1[4];
+        fitLine(p, 16, 3, e0, e1);
+        int best0[3] = { 0, 0, 0 }, best1[3] = { 0, 0, 0 }, colorIdx[16];
+        int colorErr = 1 << 30;
+        memset(colorIdx, 0, sizeof(colorIdx));
+        for (int it = 0; it < 3; it++)
+        {
+            int q0[3], q1[3], pal[4][3];
+            for (int c = 0; c < 3; c++)
+            {
+                int v0 = (int)(e0[c] * 127.0f / 255.0f + 0.5f), v1 = (int)(e1[c] * 127.0f / 255.0f + 0.5f);
+                q0[c] = v0 < 0 ? 0 : (v0 > 127 ? 127 : v0);
+                q1[c] = v1 < 0 ? 0 : (v1 > 127 ? 127 : v1);
+                int x0 = (q0[c] << 1) | (q0[c] >> 6), x1 = (q1[c] << 1) | (q1[c] >> 6);
+                for (int k = 0; k < 4; k++) pal[k][c] = ((64 - weights[k]) * x0 + weights[k] * x1 + 32) >> 6;
+            }
+            int idx[16], err = 0;
+            for (int i = 0; i < 16; i++)
+            {
+                int best = 0, be = 1 << 30;
+                for (int k = 0; k < 4; k++)
+                {
+                    int e = 0;
+                    for (int c = 0; c < 3; c++)
+                    {
+                        int d = px[i * 4 + c] - pal[k][c];
+                        e += d * d;
+                    }
+                    if (e < be)
+                    {
+                        be = e;
+                        best = k;
+                    }
+                }
+                idx[i] = best;
+                err += be;
+            }
+            if (err < colorErr)
+            {
+                colorErr = err;
+                memcpy(best0, q0, sizeof(q0));
+                memcpy(best1, q1, sizeof(q1));
+                memcpy(colorIdx, idx, sizeof(idx));
+            }
+            if (colorErr == 0) break;
+            float w[16];
+            for (int i = 0; i < 16; i++) w[i] = 1.0f - weights[colorIdx[i]] / 64.0f;
+            if (!leastSquares(p, w, 16, 3, e0, e1)) break;
+        }
+        int a0 = 255, a1 = 0, alphaIdx[16], alphaErr = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            if (px[i * 4 + 3] < a0) a0 = px[i * 4 + 3];
+            if (px[i * 4 + 3] > a1) a1 = px[i * 4 + 3];
+        }
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, be = 1 << 30;
+            for (int k = 0; k < 4; k++)
+            {
+                int d = px[i * 4 + 3] - (((64 - weights[k]) * a0 + weights[k] * a1 + 32) >> 6);
+                if (d * d < be)
+                {
+                    be = d * d;
+                    best = k;
+                }
+            }
+            alphaIdx[i] = best;
+            alphaErr += be;
+        }
+        if (colorIdx[0] >= 2)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                int t = best0[c];
+                best0[c] = best1[c];
+                best1[c] = t;
+            }
+            for (int i = 0; i < 16; i++) colorIdx[i] = 3 - colorIdx[i];
+        }
+        if (alphaIdx[0] >= 2)
+        {
+            int t = a0;
+            a0 = a1;
+            a1 = t;
+            for (int i = 0; i < 16; i++) alphaIdx[i] = 3 - alphaIdx[i];
+        }
+        memset(out, 0, 16);
+        int pos = 0;
+        putBits(out, pos, 1u << 5, 6);
+        putBits(out, pos, 0, 2);
+        for (int c = 0; c < 3; c++)
+        {
+            putBits(out, pos, (uint32_t)best0[c], 7);
+            putBits(out, pos, (uint32_t)best1[c], 7);
+        }
+        putBits(out, pos, (uint32_t)a0, 8);
+        putBits(out, pos, (uint32_t)a1, 8);
+        putBits(out, pos, (uint32_t)colorIdx[0], 1);
+        for (int i = 1; i < 16; i++) putBits(out, pos, (uint32_t)colorIdx[i], 2);
+        putBits(out, pos, (uint32_t)alphaIdx[0], 1);
+        for (int i = 1; i < 16; i++) putBits(out, pos, (uint32_t)alphaIdx[i], 2);
+        return colorErr + alphaErr;
+    }
+
+    static void encodeBC7(const uint8_t *px, uint8_t *out)
+    {
+        uint8_t mode5[16];
+        int err6 = encodeBC7Mode6(px, out);
+        if (err6 > 0 && encodeBC7Mode5(px, mode5) < err6) memcpy(out, mode5, 16);
+    }
+
+    // Bloco de cor do ETC1: dois meio-blocos (2x4 ou 4x2) com cor base e tabela de
+    // intensidade cada. Tenta as duas divisoes e os modos individual (444 + 444) e
+    // diferencial (555 + delta 333), com a media de cada meio-bloco como base.
+    static void encodeETC1(const uint8_t *px, uint8_t *out)
+    {
+        static const int table[8][2] = { { 2, 8 }, { 5, 17 }, { 9, 29 }, { 13, 42 }, { 18, 60 }, { 24, 80 }, { 33, 106 }, { 47, 183 } };
+        uint64_t bestWord = 0;
+        int bestErr = 1 << 30;
+        for (int flip = 0; flip < 2; flip++)
+        {
+            float avg[2][3] = { { 0, 0, 0 }, { 0, 0, 0 } };
+            for (int i = 0; i < 16; i++)
+            {
+                int x = i & 3, y = i >> 2;
+                int s = flip ? (y >= 2) : (x >= 2);
+                for (int c = 0; c < 3; c++) avg[s][c] += px[i * 4 + c] / 8.0f;
+            }
+            for (int diff = 0; diff < 2; diff++)
+            {
+                int base[2][3], q[2][3];
+                for (int s = 0; s < 2; s++)
+                {
+                    for (int c = 0; c < 3; c++)
+                    {
+                        int max = diff ? 31 : 15;
+                        int v = (int)(avg[s][c] * max / 255.0f + 0.5f);
+                        q[s][c] = v > max ? max : v;
+                    }
+                }
+                if (diff)
+                {
+                    // Delta fora de -4..3 viraria outro modo no ETC2: encurta em direcao a q[0].
+                    for (int c = 0; c < 3; c++)
+                    {
+                        int d = q[1][c] - q[0][c];
+                        q[1][c] = q[0][c] + (d < -4 ? -4 : (d > 3 ? 3 : d));
+                    }
+                }
+                for (int s = 0; s < 2; s++)
+                {
+                    for (int c = 0; c < 3; c++) base[s][c] = diff ? (q[s][c] << 3) | (q[s][c] >> 2) : q[s][c] * 17;
+                }
+                int tables[2] = { 0, 0 }, err = 0;
+                uint32_t msb = 0, lsb = 0;
+                for (int s = 0; s < 2; s++)
+                {
+                    int subErr = 1 << 30;
+                    uint32_t subMsb = 0, subLsb = 0;
+                    for (int t = 0; t < 8; t++)
+                    {
+                        int mods[4] = { table[t][0], table[t][1], -table[t][0], -table[t][1] };
+                        int e = 0;
+                        uint32_t m = 0, l = 0;
+                        for (int i = 0; i < 16 && e < subErr; i++)
+                        {
+                            int x = i & 3, y = i >> 2;
+                            if ((flip ? (y >= 2) : (x >= 2)) != (s == 1)) continue;
+                            int best = 0, be = 1 << 30;
+                            for (int k = 0; k < 4; k++)
+                            {
+                                int pe = 0;
+                                for (int c = 0; c < 3; c++)
+                                {
+                                    int d = px[i * 4 + c] - clampByte(base[s][c] + mods[k]);
+                                    pe += d * d;
+                                }
+                                if (pe < be)
+                                {
+                                    be = pe;
+                                    best = k;
+                                }
+                            }
+                            int bit = x * 4 + y;
+                            m |= (uint32_t)(best >> 1) << bit;
+                            l |= (uint32_t)(best & 1) << bit;
+                            e += be;
+                        }
+                        if (e < subErr)
+                        {
+                            subErr = e;
+                            tables[s] = t;
+                            subMsb = m;
+                            subLsb = l;
+                        }
+                    }
+                    err += subErr;
+                    msb |= subMsb;
+                    lsb |= subLsb;
+                }
+                if (err >= bestErr) continue;
+                bestErr = err;
+                uint64_t w;
+                if (diff)
+                {
+                    w = ((uint64_t)q[0][0] << 59) | ((uint64_t)((q[1][0] - q[0][0]) & 7) << 56)
+                      | ((uint64_t)q[0][1] << 51) | ((uint64_t)((q[1][1] - q[0][1]) & 7) << 48)
+                      | ((uint64_t)q[0][2] << 43) | ((uint64_t)((q[1][2] - q[0][2]) & 7) << 40);
+                }
+                else
+                {
+                    w = ((uint64_t)q[0][0] << 60) | ((uint64_t)q[1][0] << 56) | ((uint64_t)q[0][1] << 52)
+                      | ((uint64_t)q[1][1] << 48) | ((uint64_t)q[0][2] << 44) | ((uint64_t)q[1][2] << 40);
+                }
+                w |= ((uint64_t)tables[0] << 37) | ((uint64_t)tables[1] << 34) | ((uint64_t)diff << 33) | ((uint64_t)flip << 32);
+                w |= ((uint64_t)msb << 16) | lsb;
+                bestWord = w;
+            }
+        }
+        putBigEndian(out, bestWord);
+    }
+
+    // Alfa EAC: base + modificador da tabela vezes o multiplicador, indices de 3 bits.
+    static void encodeEAC(const uint8_t *px, uint8_t *out)
+    {
+        static const int table[16][8] = {
+            { -3, -6, -9, -15, 2, 5, 8, 14 }, { -3, -7, -10, -13, 2, 6, 9, 12 }, { -2, -5, -8, -13, 1, 4, 7, 12 },
+            { -2, -4, -6, -13, 1, 3, 5, 12 }, { -3, -6, -8, -12, 2, 5, 7, 11 }, { -3, -7, -9, -11, 2, 6, 8, 10 },
+            { -4, -7, -8, -11, 3, 6, 7, 10 }, { -3, -5, -8, -11, 2, 4, 7, 10 }, { -2, -6, -8, -10, 1, 5, 7, 9 },
+            { -2, -5, -8, -10, 1, 4, 7, 9 }, { -2, -4, -8, -10, 1, 3, 7, 9 }, { -2, -5, -7, -10, 1, 4, 6, 9 },
+            { -3, -4, -7, -10, 2, 3, 6, 9 }, { -1, -2, -3, -10, 0, 1, 2, 9 }, { -4, -6, -8, -9, 3, 5, 7, 8 },
+            { -3, -5, -7, -9, 2, 4, 6, 8 },
+        };
+        int lo = 255, hi = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            int a = px[i * 4 + 3];
+            if (a < lo) lo = a;
+            if (a > hi) hi = a;
+        }
+        uint64_t bestWord = ((uint64_t)lo << 56) | ((uint64_t)1 << 52);
+        int bestErr = 1 << 30;
+        for (int t = 0; t < 16 && bestErr > 0; t++)
+        {
+            int span = table[t][7] - table[t][3];
+            int m0 = (hi - lo + span - 1) / span;
+            for (int mult = m0 - 1; mult <= m0 + 1; mult++)
+            {
+                if (mult < 1 || mult > 15) continue;
+                int center = lo - table[t][3] * mult;
+                for (int base = center - 2; base <= center + 2; base++)
+                {
+                    if (base < 0 || base > 255) continue;
+                    int err = 0;
+                    uint64_t idx = 0;
+                    for (int i = 0; i < 16 && err < bestErr; i++)
+                    {
+                        int best = 0, be = 1 << 30;
+                        for (int k = 0; k < 8; k++)
+                        {
+                            int d = px[i * 4 + 3] - clampByte(base + table[t][k] * mult);
+                            if (d * d < be)
+                            {
+                                be = d * d;
+                                best = k;
+                            }
+                        }
+                        int x = i & 3, y = i >> 2;
+                        idx |= (uint64_t)best << (45 - 3 * (x * 4 + y));
+                        err += be;
+                    }
+                    if (err < bestErr)
+                    {
+                        bestErr = err;
+                        bestWord = ((uint64_t)base << 56) | ((uint64_t)mult << 52) | ((uint64_t)t << 48) | idx;
+                    }
+                }
+            }
+        }
+        putBigEndian(out, bestWord);
+    }
+
+    static void encodeBlock(int format, const uint8_t *px, uint8_t *out)
+    {
+        switch (format)
+        {
+        case TEX_BC1: encodeBC1(px, out); break;
+        case TEX_BC3: encodeBC3(px, out); break;
+        case TEX_BC7: encodeBC7(px, out); break;
+        case TEX_ETC2:
+            encodeEAC(px, out);
+            encodeETC1(px, out + 8);
+            break;
+        }
+    }
+
+    // Um nivel inteiro. Blocos na borda repetem o ultimo texel. As linhas de blocos sao
+    // divididas entre threads threads (cada bloco e independente).
+    static void compressLevel(const uint8_t *rgba, int width, int height, int format, int threads, std::vector<uint8_t> &out)
+    {
+        int bx = (width + 3) / 4, by = (height + 3) / 4, bytes = blockBytes(format);
+        out.assign((size_t)bx * by * bytes, 0);
+        uint8_t *dst = out.data();
+        auto rows = [rgba, width, height, format, bx, bytes, dst](int r0, int r1) {
+            uint8_t px[64];
+            for (int r = r0; r < r1; r++)
+            {
+                for (int b = 0; b < bx; b++)
+                {
+                    for (int i = 0; i < 16; i++)
+                    {
+                        int x = b * 4 + (i & 3), y = r * 4 + (i >> 2);
+                        x = x < width ? x : width - 1;
+                        y = y < height ? y : height - 1;
+                        memcpy(px + i * 4, rgba + ((size_t)y * width + x) * 4, 4);
+                    }
+                    encodeBlock(format, px, dst + ((size_t)r * bx + b) * bytes);
+                }
+            }
+        };
+        int workers = std::max(1, std::min(threads, by));
+        std::vector<std::thread> pool;
+        for (int t = 1; t < workers; t++)
+            pool.emplace_back(rows, by * t / workers, by * (t + 1) / workers);
+        rows(0, by / workers);
+        for (std::thread &t : pool) t.join();
+    }
+
+    // Metade do tamanho, media de 2x2 texels.
+    static void downsample(const std::vector<uint8_t> &src, int w, int h, std::vector<uint8_t> &dst, int &nw, int &nh)
+    {
+        nw = w > 1 ? w / 2 : 1;
+        nh = h > 1 ? h / 2 : 1;
+        dst.assign((size_t)nw * nh * 4, 0);
+        for (int y = 0; y < nh; y++)
+        {
+            for (int x = 0; x < nw; x++)
+            {
+                int x0 = x * 2 < w ? x * 2 : w - 1, x1 = x * 2 + 1 < w ? x * 2 + 1 : w - 1;
+                int y0 = y * 2 < h ? y * 2 : h - 1, y1 = y * 2 + 1 < h ? y * 2 + 1 : h - 1;
+                for (int c = 0; c < 4; c++)
+                {
+                    int sum = src[((size_t)y0 * w + x0) * 4 + c] + src[((size_t)y0 * w + x1) * 4 + c]
+                            + src[((size_t)y1 * w + x0) * 4 + c] + src[((size_t)y1 * w + x1) * 4 + c];
+                    dst[((size_t)y * nw + x) * 4 + c] = (uint8_t)((sum + 2) / 4);
+                }
+            }
+        }
+    }
+
+    static bool hasAlpha(const uint8_t *rgba, int width, int height)
+    {
+        for (size_t i = 0; i < (size_t)width * height; i++)
+        {
+            if (rgba[i * 4 + 3] != 255) return true;
+        }
+        return false;
+    }
+
+    // Comprime rgba (com a cadeia de mips se mips) no formato pedido; threads 0 usa todos
+    // os nucleos.
+    static void compress(const uint8_t *rgba, int width, int height, int format, bool mips, CompressedImage &img, int threads = 0)
+    {
+        if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+        img.format = format;
+        img.width = width;
+        img.height = height;
+        img.alpha = hasAlpha(rgba, width, height);
+        img.levels.clear();
+        std::vector<uint8_t> level(rgba, rgba + (size_t)width * height * 4), next;
+        int w = width, h = height;
+        while ((int)img.levels.size() < CTEX_MAX_LEVELS)
+        {
+            CompressedLevel l;
+            l.width = w;
+            l.height = h;
+            if (format == TEX_RGBA8) l.data = level;
+            else compressLevel(level.data(), w, h, format, threads, l.data);
+            img.levels.push_back(l);
+            if (!mips || (w == 1 && h == 1)) break;
+            int nw, nh;
+            downsample(level, w, h, next, nw, nh);
+            level.swap(next);
+            w = nw;
+            h = nh;
+        }
+    }
+
+    // "imagem.png" -> "imagem.png.bc7.ctex"
+    static std::string pathFor(const char *image, int format)
+    {
+        return std::string(image) + "." + formatName(format) + ".ctex";
+    }
+
+    // Formato .ctex: cabecalho (8 uint32: magic, versao, formato, largura, altura, niveis,
+    // alfa, reservado) e, por nivel, largura, altura, bytes (uint32) e os blocos.
+    static bool write(const char *path, const CompressedImage &img)
+    {
+        FILE *f = fopen(path, "wb");
+        if (f == NULL)
+        {
+            std::cerr << "Falha ao criar " << path << std::endl;
+            return false;
+        }
+        uint32_t header[8] = { CTEX_MAGIC, CTEX_VERSION, (uint32_t)img.format, (uint32_t)img.width, (uint32_t)img.height,
+            (uint32_t)img.levels.size(), img.alpha ? 1u : 0u, 0 };
+        bool ok = fwrite(header, sizeof(header), 1, f) == 1;
+        for (size_t i = 0; ok && i < img.levels.size(); i++)
+        {
+            const CompressedLevel &l = img.levels[i];
+            uint32_t info[3] = { (uint32_t)l.width, (uint32_t)l.height, (uint32_t)l.data.size() };
+            ok = fwrite(info, sizeof(info), 1, f) == 1 && fwrite(l.data.data(), 1, l.data.size(), f) == l.data.size();
+        }
+        fclose(f);
+        if (!ok) std::cerr << "Falha ao gravar " << path << std::endl;
+        return ok;
+    }
+
+    // Falso sem mensagem se o arquivo nao existe; com mensagem se existe e esta corrompido.
+    static bool read(const char *path, CompressedImage &img)
+    {
+        FILE *f = fopen(path, "rb");
+        if (f == NULL) return false;
+        uint32_t header[8];
+        bool ok = fread(header, sizeof(header), 1, f) == 1 && header[0] == CTEX_MAGIC && header[1] == CTEX_VERSION
+            && header[2] < TEX_FORMAT_COUNT && header[5] >= 1 && header[5] <= CTEX_MAX_LEVELS;
+        if (ok)
+        {
+            img.format = (int)header[2];
+            img.width = (int)header[3];
+            img.height = (int)header[4];
+            img.alpha = header[6] != 0;
+            img.levels.assign(header[5], CompressedLevel());
+        }
+        for (size_t i = 0; ok && i < img.levels.size(); i++)
+        {
+            uint32_t info[3];
+            CompressedLevel &l = img.levels[i];
+            ok = fread(info, sizeof(info), 1, f) == 1 && info[2] == levelBytes(img.format, (int)info[0], (int)info[1]);
+            if (!ok) break;
+            l.width = (int)info[0];
+            l.height = (int)info[1];
+            l.data.resize(info[2]);
+            ok = fread(l.data.data(), 1, l.data.size(), f) == l.data.size();
+        }
+        fclose(f);
+        if (!ok) std::cerr << "Arquivo de textura comprimida invalido: " << path << std::endl;
+        return ok;
+    }
+};
+
+// Memoria e tempo de carga das texturas que passaram pelo TextureLoader.
+struct TextureStats
+{
+    int textures;
+    size_t gpuBytes;
+    size_t rgba8Bytes;
+    double loadMs;
+};
+
+// Escolhe em tempo de execucao o .ctex que a GPU sabe amostrar: BC7, BC1/BC3 (o bake so
+// grava BC1 para imagens sem alfa e BC3 para as com alfa), ETC2. Sem nenhum, quem chamou
+// carrega o PNG em RGBA8 como antes. setForced fixa um formato (rgba8 = sempre o PNG).
+class TextureLoader
+{
+    static int &forced()
+    {
+        static int format = -1;
+        return format;
+    }
+
+public:
+    static TextureStats &stats()
+    {
+        static TextureStats s = { 0, 0, 0, 0.0 };
+        return s;
+    }
+
+    static double now()
+    {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static void setForced(int format)
+    {
+        forced() = format;
+    }
+
+    // Versao do contexto atual; o glad do projeto nao traz as flags da 4.2/4.3.
+    static bool versionAtLeast(int major, int minor)
+    {
+        GLint ma = 0, mi = 0;
+        glGetIntegerv(GL_MAJOR_VERSION, &ma);
+        glGetIntegerv(GL_MINOR_VERSION, &mi);
+        return ma > major || (ma == major && mi >= minor);
+    }
+
+    // Precisa do contexto atual.
+    static bool isSupported(int format)
+    {
+        switch (format)
+        {
+        case TEX_BC1: case TEX_BC3: return glfwExtensionSupported("GL_EXT_texture_compression_s3tc") != 0;
+        case TEX_BC7: return versionAtLeast(4, 2) || glfwExtensionSupported("GL_ARB_texture_compression_bptc");
+        case TEX_ETC2: return versionAtLeast(4, 3) || glfwExtensionSupported("GL_ARB_ES3_compatibility");
+        default: return true;
+        }
+    }
+
+    // Le o primeiro .ctex de image que a GPU suporta. Falso: use o PNG.
+    static bool find(const char *image, CompressedImage &img)
+    {
+        static const int order[] = { TEX_BC7, TEX_BC1, TEX_BC3, TEX_ETC2 };
+        for (size_t i = 0; i < sizeof(order) / sizeof(order[0]); i++)
+        {
+            int f = forced() >= 0 ? forced() : order[i];
+            if (f == TEX_RGBA8) return false;
+            if (isSupported(f) && TextureCodec::read(TextureCodec::pathFor(image, f).c_str(), img)) return true;
+            if (forced() >= 0) return false;
+        }
+        return false;
+    }
+
+    // Sobe os niveis na textura 2D ligada; o filtro fica com quem chamou.
+    static void upload(const CompressedImage &img)
+    {
+        GLenum internal = TextureCodec::glFormat(img.format);
+        for (size_t i = 0; i < img.levels.size(); i++)
+        {
+            const CompressedLevel &l = img.levels[i];
+            if (img.format == TEX_RGBA8)
+            {
+                glTexImage2D(GL_TEXTURE_2D, (GLint)i, GL_RGBA8, l.width, l.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, l.data.data());
+            }
+            else
+            {
+                glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)i, internal, l.width, l.height, 0, (GLsizei)l.data.size(), l.data.data());
+            }
+        }
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)img.levels.size() - 1);
+    }
+
+    // rgba8Bytes: o que a mesma textura ocuparia em RGBA8 (com os mesmos niveis).
+    static void account(size_t gpuBytes, size_t rgba8Bytes, double ms)
+    {
+        TextureStats &s = stats();
+        s.textures++;
+        s.gpuBytes += gpuBytes;
+        s.rgba8Bytes += rgba8Bytes;
+        s.loadMs += ms;
+    }
+
+    static size_t rgba8Bytes(const CompressedImage &img)
+    {
+        size_t total = 0;
+        for (size_t i = 0; i < img.levels.size(); i++) total += (size_t)img.levels[i].width * img.levels[i].height * 4;
+        return total;
+    }
+
+    // PSNR (dB) do nivel 0 como a GPU o decodifica contra a imagem original, RGBA. -1 se a
+    // GPU nao tem o formato.
+    static double psnr(const CompressedImage &img, const uint8_t *rgba)
+    {
+        if (!isSupported(img.format) || img.levels.empty()) return -1.0;
+        const CompressedLevel &l = img.levels[0];
+        GLuint texture;
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        if (img.format == TEX_RGBA8)
+        {
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, l.width, l.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, l.data.data());
+        }
+        else
+        {
+            glCompressedTexImage2D(GL_TEXTURE_2D, 0, TextureCodec::glFormat(img.format), l.width, l.height, 0,
+                                   (GLsizei)l.data.size(), l.data.data());
+        }
+        std::vector<uint8_t> decoded((size_t)l.width * l.height * 4);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, decoded.data());
+        glDeleteTextures(1, &texture);
+        double sum = 0.0;
+        for (size_t i = 0; i < decoded.size(); i++)
+        {
+            double d = (double)decoded[i] - rgba[i];
+            sum += d * d;
+        }
+        double mse = sum / decoded.size();
+        return mse > 0.0 ? 10.0 * log10(255.0 * 255.0 / mse) : 99.0;
+    }
+
+    static void printStats()
+    {
+        TextureStats &s = stats();
+        printf("texturas: %d, %.2f MB na GPU (%.2f MB em RGBA8, %.0f%% a menos), carga %.1f ms\n", s.textures,
+            s.gpuBytes / (1024.0 * 1024.0), s.rgba8Bytes / (1024.0 * 1024.0),
+            s.rgba8Bytes ? 100.0 * (1.0 - (double)s.gpuBytes / s.rgba8Bytes) : 0.0, s.loadMs);
+    }
+};
+
+#endif
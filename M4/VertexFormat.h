@@ -0,0 +1,271 @@
+#ifndef VertexFormat_h
+#define VertexFormat_h
+
+#include <stdint.h>
+#include <string.h>
+#include <initializer_list>
+#include <iostream>
+#include <vector>
+
+#include <glad/glad.h>
+
+// Tipos de atributo. Todos chegam ao shader como float (glVertexAttribPointer).
+#define VF_FLOAT 0   // 32 bits
+#define VF_HALF 1    // float de 16 bits
+#define VF_SNORM16 2 // -1..1 em 16 bits
+#define VF_UNORM16 3 // 0..1 em 16 bits
+#define VF_UNORM8 4  // 0..1 em 8 bits
+#define VF_UINT8 5   // inteiro 0..255 entregue como float (indices pequenos)
+
+#define QUAD_INDEX_MAX_QUADS 16384
+
+struct VertexAttrib
+{
+    const char *name;
+    int location;
+    int components;
+    int type;
+    int offset;
+};
+
+// Layout de um buffer de vertices (ou de instancias, com divisor 1). Cada atributo comeca
+// alinhado a 4 bytes. validate() confere o layout contra os atributos ativos do programa,
+// para um formato compacto nao entregar menos (ou mais) do que o shader le.
+class VertexFormat
+{
+    std::vector<VertexAttrib> attribs;
+    int stride;
+    int divisor;
+
+    const VertexAttrib *find(int location) const
+    {
+        for (size_t i = 0; i < attribs.size(); i++)
+        {
+            if (attribs[i].location == location) return &attribs[i];
+        }
+        return NULL;
+    }
+
+    static int componentsOf(GLenum type)
+    {
+        switch (type)
+        {
+        case GL_FLOAT: return 1;
+        case GL_FLOAT_VEC2: return 2;
+        case GL_FLOAT_VEC3: return 3;
+        case GL_FLOAT_VEC4: return 4;
+        default: return 0;
+        }
+    }
+
+public:
+    VertexFormat(int instanceDivisor = 0) : stride(0), divisor(instanceDivisor) {}
+
+    VertexFormat &add(const char *name, int location, int components, int type)
+    {
+        VertexAttrib a;
+        a.name = name;
+        a.location = location;
+        a.components = components;
+        a.type = type;
+        a.offset = stride;
+        attribs.push_back(a);
+        stride += (components * typeSize(type) + 3) & ~3;
+        return *this;
+    }
+
+    int getStride() const
+    {
+        return stride;
+    }
+
+    static int typeSize(int type)
+    {
+        switch (type)
+        {
+        case VF_FLOAT: return 4;
+        case VF_HALF: case VF_SNORM16: case VF_UNORM16: return 2;
+        default: return 1;
+        }
+    }
+
+    // Liga os atributos no VAO atual, lendo do GL_ARRAY_BUFFER ligado.
+    void apply() const
+    {
+        static const GLenum types[] = { GL_FLOAT, GL_HALF_FLOAT, GL_SHORT, GL_UNSIGNED_SHORT, GL_UNSIGNED_BYTE, GL_UNSIGNED_BYTE };
+        for (size_t i = 0; i < attribs.size(); i++)
+        {
+            const VertexAttrib &a = attribs[i];
+            GLboolean normalized = a.type == VF_SNORM16 || a.type == VF_UNORM16 || a.type == VF_UNORM8;
+            glVertexAttribPointer(a.location, a.components, types[a.type], normalized, stride, (void *)(size_t)a.offset);
+            glEnableVertexAttribArray(a.location);
+            glVertexAttribDivisor(a.location, divisor);
+        }
+    }
+
+    // Grava os components valores de v no atributo location do vertice (stride bytes).
+    void write(unsigned char *vertex, int location, const float *v) const
+    {
+        const VertexAttrib *a = find(location);
+        if (a == NULL) return;
+        unsigned char *p = vertex + a->offset;
+        for (int c = 0; c < a->components; c++)
+        {
+            switch (a->type)
+            {
+            case VF_FLOAT: memcpy(p + c * 4, &v[c], 4); break;
+            case VF_HALF: { uint16_t h = toHalf(v[c]); memcpy(p + c * 2, &h, 2); break; }
+            case VF_SNORM16: { int16_t s = toSnorm16(v[c]); memcpy(p + c * 2, &s, 2); break; }
+            case VF_UNORM16: { uint16_t u = toUnorm16(v[c]); memcpy(p + c * 2, &u, 2); break; }
+            case VF_UNORM8: p[c] = (unsigned char)(v[c] <= 0.0f ? 0 : (v[c] >= 1.0f ? 255 : (int)(v[c] * 255.0f + 0.5f))); break;
+            default: p[c] = (unsigned char)(v[c] <= 0.0f ? 0 : (v[c] >= 255.0f ? 255 : (int)(v[c] + 0.5f))); break;
+            }
+        }
+    }
+
+    // Atributos ativos do programa contra os formatos que alimentam o VAO dele. Erro: o
+    // shader le um atributo que nenhum formato tem, ou le como inteiro. Aviso: o formato
+    // manda componentes ou atributos que o shader nao usa (banda gasta a toa).
+    static bool validate(GLuint program, const char *label, std::initializer_list<const VertexFormat*> formats)
+    {
+        bool ok = true;
+        GLint count = 0;
+        glGetProgramiv(program, GL_ACTIVE_ATTRIBUTES, &count);
+        std::vector<int> used;
+        for (GLint i = 0; i < count; i++)
+        {
+            char name[64];
+            GLint size;
+            GLenum type;
+            glGetActiveAttrib(program, (GLuint)i, sizeof(name), NULL, &size, &type, name);
+            int location = glGetAttribLocation(program, name);
+            if (location < 0) continue;
+            used.push_back(location);
+            const VertexAttrib *a = NULL;
+            for (const VertexFormat *f : formats)
+            {
+                if (a == NULL) a = f->find(location);
+            }
+            int components = componentsOf(type);
+            if (a == NULL)
+            {
+                std::cerr << label << ": o shader le " << name << " (location " << location << ") e nenhum formato de vertice o fornece" << std::endl;
+                ok = false;
+            }
+            else if (components == 0)
+            {
+                std::cerr << label << ": " << name << " (location " << location << ") nao e float/vec; o formato so entrega float" << std::endl;
+                ok = false;
+            }
+            else if (a->components > components)
+            {
+                std::cerr << "Aviso: " << label << ": " << a->name << " manda " << a->components << " componentes e o shader le " << components << std::endl;
+            }
+        }
+        for (const VertexFormat *f : formats)
+        {
+            for (size_t i = 0; i < f->attribs.size(); i++)
+            {
+                bool active = false;
+                for (size_t u = 0; u < used.size(); u++) active = active || used[u] == f->attribs[i].location;
+                if (!active)
+                    std::cerr << "Aviso: " << label << ": atributo " << f->attribs[i].name << " (location " << f->attribs[i].location
+                              << ") sem uso no shader" << std::endl;
+            }
+        }
+        return ok;
+    }
+
+    // Float para half com arredondamento para o par mais proximo.
+    static uint16_t toHalf(float f)
+    {
+        uint32_t x;
+        memcpy(&x, &f, 4);
+        uint32_t sign = (x >> 16) & 0x8000;
+        uint32_t mant = x & 0x7fffff;
+        int rawExp = (int)((x >> 23) & 0xff);
+        if (rawExp == 0xff) return (uint16_t)(sign | 0x7c00 | (mant ? 0x200 : 0));
+        int exp = rawExp - 127 + 15;
+        if (exp >= 31) return (uint16_t)(sign | 0x7c00);
+        if (exp <= 0)
+        {
+            // Subnormal em half.
+            if (exp < -10) return (uint16_t)sign;
+            mant |= 0x800000;
+            int shift = 14 - exp;
+            uint32_t half = mant >> shift;
+            uint32_t rest = mant & ((1u << shift) - 1);
+            uint32_t middle = 1u << (shift - 1);
+            if (rest > middle || (rest == middle && (half & 1))) half++;
+            return (uint16_t)(sign | half);
+        }
+        uint32_t half = sign | ((uint32_t)exp << 10) | (mant >> 13);
+        uint32_t rest = mant & 0x1fff;
+        // O vai-um pode passar para o expoente: continua certo (ate virar infinito).
+        if (rest > 0x1000 || (rest == 0x1000 && (half & 1))) half++;
+        return (uint16_t)half;
+    }
+
+    static int16_t toSnorm16(float f)
+    {
+        f = f < -1.0f ? -1.0f : (f > 1.0f ? 1.0f : f);
+        return (int16_t)(f * 32767.0f + (f < 0.0f ? -0.5f : 0.5f));
+    }
+
+    static uint16_t toUnorm16(float f)
+    {
+        f = f < 0.0f ? 0.0f : (f > 1.0f ? 1.0f : f);
+        return (uint16_t)(f * 65535.0f + 0.5f);
+    }
+};
+
+// Indices de 16 bits para listas de quads (0 1 2 0 2 3, +4 por quad) num buffer so,
+// compartilhado por todos os VAOs que desenham quads. Cresce sob demanda ate
+// QUAD_INDEX_MAX_QUADS quads (65536 vertices, o limite de um indice de 16 bits).
+class QuadIndexBuffer
+{
+    GLuint ebo;
+    int capacity;
+
+    QuadIndexBuffer() : ebo(0), capacity(0) {}
+
+public:
+    // O buffer vive ate o fim do contexto; nao ha destrutor com chamadas GL.
+    static QuadIndexBuffer &get()
+    {
+        static QuadIndexBuffer instance;
+        return instance;
+    }
+
+    // Liga no VAO atual, com pelo menos quads quads. Desenhe com GL_UNSIGNED_SHORT.
+    void bind(int quads)
+    {
+        if (quads > QUAD_INDEX_MAX_QUADS)
+        {
+            std::cerr << quads << " quads nao cabem em indices de 16 bits" << std::endl;
+            quads = QUAD_INDEX_MAX_QUADS;
+        }
+        if (ebo == 0) glGenBuffers(1, &ebo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        if (quads <= capacity) return;
+        // Os VAOs ja ligados veem o conteudo novo: o nome do buffer nao muda.
+        int grown = capacity * 2 > quads ? capacity * 2 : quads;
+        if (grown > QUAD_INDEX_MAX_QUADS) grown = QUAD_INDEX_MAX_QUADS;
+        std::vector<uint16_t> indices(grown * 6);
+        for (int q = 0; q < grown; q++)
+        {
+            uint16_t v = (uint16_t)(q * 4);
+            uint16_t quad[6] = { v, (uint16_t)(v + 1), (uint16_t)(v + 2), v, (uint16_t)(v + 2), (uint16_t)(v + 3) };
+            memcpy(&indices[q * 6], quad, sizeof(quad));
+        }
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint16_t), indices.data(), GL_STATIC_DRAW);
+        capacity = grown;
+    }
+
+    size_t getBytes()
+    {
+        return (size_t)capacity * 6 * sizeof(uint16_t);
+    }
+};
+
+#endif
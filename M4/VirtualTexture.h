@@ -0,0 +1,797 @@
+#ifndef VirtualTexture_h
+#define VirtualTexture_h
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <glad/glad.h>
+#include <stb_image.h>
+
+// Texturas virtuais: a imagem e cortada offline em paginas de tamanho fixo (com borda
+// para o filtro bilinear) para cada nivel de mip e gravada num arquivo .vtex. Em tempo
+// de execucao so as paginas visiveis ficam num cache fisico (uma textura de slots), e
+// uma tabela de indirecao diz em que slot esta cada pagina. Um passe de feedback em
+// baixa resolucao registra quais paginas/mips a tela usa, e uma thread le essas paginas
+// do disco. A memoria de GPU fica limitada pelo tamanho do cache, nao pelo das imagens.
+
+#define VT_MAGIC 0x58455456u
+#define VT_VERSION 1
+#define VT_MAX_MIPS 16
+#define VT_MAX_TEXTURES 15
+#define VT_FEEDBACK_DIVISOR 8
+#define VT_UPLOADS_PER_FRAME 16
+
+struct VTLevel
+{
+    int width, height;
+    int pagesX, pagesY;
+    int firstPage;
+    int atlasX;
+};
+
+static inline int vtPagesFor(int texels, int pageSize)
+{
+    return (texels + pageSize - 1) / pageSize;
+}
+
+// Corta png em paginas e grava em outPath. Formato: cabecalho (7 uint32), offsets das
+// paginas (uint64 por pagina) e os texels RGBA de cada pagina com a borda.
+static inline bool bakeVirtualTexture(const char *pngPath, const char *outPath, int pageSize = 128, int border = 4)
+{
+    int w, h, n;
+    unsigned char *data = stbi_load(pngPath, &w, &h, &n, 4);
+    if (!data)
+    {
+        std::cerr << "Falha ao carregar imagem para textura virtual: " << pngPath << std::endl;
+        return false;
+    }
+
+    std::vector<std::vector<unsigned char> > mips;
+    std::vector<int> mw, mh;
+    mips.push_back(std::vector<unsigned char>(data, data + (size_t)w * h * 4));
+    mw.push_back(w);
+    mh.push_back(h);
+    stbi_image_free(data);
+    while ((mw.back() > pageSize || mh.back() > pageSize) && (int)mips.size() < VT_MAX_MIPS)
+    {
+        int pw = mw.back(), ph = mh.back();
+        int nw = std::max(1, pw / 2), nh = std::max(1, ph / 2);
+        const std::vector<unsigned char> &src = mips.back();
+        std::vector<unsigned char> dst((size_t)nw * nh * 4);
+        for (int y = 0; y < nh; y++)
+        {
+            for (int x = 0; x < nw; x++)
+            {
+                int x0 = std::min(x * 2, pw - 1), x1 = std::min(x * 2 + 1, pw - 1);
+                int y0 = std::min(y * 2, ph - 1), y1 = std::min(y * 2 + 1, ph - 1);
+                for (int c = 0; c < 4; c++)
+                {
+                    int sum = src[((size_t)y0 * pw + x0) * 4 + c] + src[((size_t)y0 * pw + x1) * 4 + c]
+                            + src[((size_t)y1 * pw + x0) * 4 + c] + src[((size_t)y1 * pw + x1) * 4 + c];
+                    dst[((size_t)y * nw + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+                }
+            }
+        }
+        mips.push_back(dst);
+        mw.push_back(nw);
+        mh.push_back(nh);
+    }
+
+    FILE *out = fopen(outPath, "wb");
+    if (!out)
+    {
+        std::cerr << "Falha ao criar " << outPath << std::endl;
+        return false;
+    }
+    uint32_t header[7] = { VT_MAGIC, VT_VERSION, (uint32_t)w, (uint32_t)h, (uint32_t)pageSize, (uint32_t)border, (uint32_t)mips.size() };
+    fwrite(header, sizeof(header), 1, out);
+
+    int totalPages = 0;
+    for (size_t m = 0; m < mips.size(); m++)
+        totalPages += vtPagesFor(mw[m], pageSize) * vtPagesFor(mh[m], pageSize);
+    int stride = pageSize + 2 * border;
+    uint64_t pageBytes = (uint64_t)stride * stride * 4;
+    uint64_t offset = sizeof(header) + sizeof(uint64_t) * totalPages;
+    for (int p = 0; p < totalPages; p++)
+    {
+        uint64_t o = offset + pageBytes * p;
+        fwrite(&o, sizeof(o), 1, out);
+    }
+
+    std::vector<unsigned char> page(pageBytes);
+    for (size_t m = 0; m < mips.size(); m++)
+    {
+        int pw = mw[m], ph = mh[m];
+        const std::vector<unsigned char> &src = mips[m];
+        for (int py = 0; py < vtPagesFor(ph, pageSize); py++)
+        {
+            for (int px = 0; px < vtPagesFor(pw, pageSize); px++)
+            {
+                for (int j = 0; j < stride; j++)
+                {
+                    int sy = std::min(std::max(py * pageSize + j - border, 0), ph - 1);
+                    for (int i = 0; i < stride; i++)
+                    {
+                        int sx = std::min(std::max(px * pageSize + i - border, 0), pw - 1);
+                        memcpy(&page[((size_t)j * stride + i) * 4], &src[((size_t)sy * pw + sx) * 4], 4);
+                    }
+                }
+                fwrite(page.data(), 1, page.size(), out);
+            }
+        }
+    }
+    fclose(out);
+    std::cout << "Textura virtual " << outPath << ": " << w << "x" << h << ", " << mips.size()
+              << " mips, " << totalPages << " paginas de " << pageSize << "px" << std::endl;
+    return true;
+}
+
+class VirtualTextureSystem;
+
+class VirtualTexture
+{
+public:
+    int id;
+    int width, height;
+    int mipCount;
+    std::vector<VTLevel> levels;
+    std::vector<int> pageSlot;
+    std::vector<unsigned char> pagePending;
+    std::string path;
+
+    GLuint indirectionTex;
+    int atlasWidth, atlasHeight;
+    std::vector<unsigned char> indirection;
+    bool indirectionDirty;
+    // Muda a cada reconstrucao da indirecao, isto e, sempre que o que a textura mostra muda.
+    unsigned int version;
+
+    VirtualTexture() : id(-1), width(0), height(0), mipCount(0), indirectionTex(0), atlasWidth(0), atlasHeight(0),
+                       indirectionDirty(true), version(0), file(NULL), pageSize(0), border(0) {}
+
+    ~VirtualTexture()
+    {
+        if (file) fclose(file);
+        if (indirectionTex) glDeleteTextures(1, &indirectionTex);
+    }
+
+    int pageIndex(int mip, int px, int py) const
+    {
+        const VTLevel &l = levels[mip];
+        return l.firstPage + py * l.pagesX + px;
+    }
+
+    // Monta um nivel inteiro em RGBA (usado para a mascara de picking, num mip pequeno).
+    bool readLevel(int mip, std::vector<unsigned char> &rgba, int &w, int &h)
+    {
+        const VTLevel &l = levels[mip];
+        w = l.width;
+        h = l.height;
+        rgba.assign((size_t)w * h * 4, 0);
+        int stride = pageSize + 2 * border;
+        std::vector<unsigned char> page((size_t)stride * stride * 4);
+        for (int py = 0; py < l.pagesY; py++)
+        {
+            for (int px = 0; px < l.pagesX; px++)
+            {
+                if (!readPage(pageIndex(mip, px, py), page.data())) return false;
+                for (int j = 0; j < pageSize && py * pageSize + j < h; j++)
+                {
+                    int cols = std::min(pageSize, w - px * pageSize);
+                    memcpy(&rgba[((size_t)(py * pageSize + j) * w + px * pageSize) * 4],
+                           &page[((size_t)(j + border) * stride + border) * 4], (size_t)cols * 4);
+                }
+            }
+        }
+        return true;
+    }
+
+private:
+    friend class VirtualTextureSystem;
+    FILE *file;
+    std::mutex fileLock;
+    std::vector<uint64_t> offsets;
+    int pageSize, border;
+
+    bool open(const char *vtexPath, int expectedPageSize, int expectedBorder)
+    {
+        file = fopen(vtexPath, "rb");
+        if (!file) return false;
+        uint32_t header[7];
+        if (fread(header, sizeof(header), 1, file) != 1 || header[0] != VT_MAGIC || header[1] != VT_VERSION)
+        {
+            std::cerr << "Arquivo de textura virtual invalido: " << vtexPath << std::endl;
+            return false;
+        }
+        width = (int)header[2];
+        height = (int)header[3];
+        pageSize = (int)header[4];
+        border = (int)header[5];
+        mipCount = (int)header[6];
+        if (pageSize != expectedPageSize || border != expectedBorder || mipCount < 1 || mipCount > VT_MAX_MIPS)
+        {
+            std::cerr << "Textura virtual " << vtexPath << " foi gerada com outro tamanho de pagina" << std::endl;
+            return false;
+        }
+        path = vtexPath;
+
+        int total = 0;
+        atlasWidth = 0;
+        for (int m = 0; m < mipCount; m++)
+        {
+            VTLevel l;
+            l.width = std::max(1, width >> m);
+            l.height = std::max(1, height >> m);
+            l.pagesX = vtPagesFor(l.width, pageSize);
+            l.pagesY = vtPagesFor(l.height, pageSize);
+            l.firstPage = total;
+            l.atlasX = atlasWidth;
+            atlasWidth += l.pagesX;
+            total += l.pagesX * l.pagesY;
+            levels.push_back(l);
+        }
+        atlasHeight = levels[0].pagesY;
+        offsets.resize(total);
+        if (fread(offsets.data(), sizeof(uint64_t), total, file) != (size_t)total) return false;
+        pageSlot.assign(total, -1);
+        pagePending.assign(total, 0);
+        indirection.assign((size_t)atlasWidth * atlasHeight * 4, 0);
+
+        // Todos os niveis lado a lado numa textura inteira; o shader acha o nivel pelo offset.
+        glGenTextures(1, &indirectionTex);
+        glBindTexture(GL_TEXTURE_2D, indirectionTex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8UI, atlasWidth, atlasHeight, 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, indirection.data());
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        return true;
+    }
+
+    bool readPage(int page, unsigned char *dst)
+    {
+        std::lock_guard<std::mutex> guard(fileLock);
+        int stride = pageSize + 2 * border;
+        size_t bytes = (size_t)stride * stride * 4;
+        if (fseek(file, (long)offsets[page], SEEK_SET) != 0) return false;
+        return fread(dst, 1, bytes, file) == bytes;
+    }
+
+    // Cada entrada aponta para o slot da propria pagina ou, se ela nao estiver no cache,
+    // para o ancestral residente mais proximo (o nivel mais grosso esta sempre residente).
+    void rebuildIndirection(int slotsX)
+    {
+        for (int m = mipCount - 1; m >= 0; m--)
+        {
+            const VTLevel &l = levels[m];
+            for (int py = 0; py < l.pagesY; py++)
+            {
+                for (int px = 0; px < l.pagesX; px++)
+                {
+                    unsigned char *e = &indirection[((size_t)py * atlasWidth + l.atlasX + px) * 4];
+                    int slot = pageSlot[pageIndex(m, px, py)];
+                    if (slot >= 0)
+                    {
+                        e[0] = (unsigned char)(slot % slotsX);
+                        e[1] = (unsigned char)(slot / slotsX);
+                        e[2] = (unsigned char)m;
+                        e[3] = 255;
+                    }
+                    else if (m + 1 < mipCount)
+                    {
+                        const VTLevel &p = levels[m + 1];
+                        int ppx = std::min(px / 2, p.pagesX - 1), ppy = std::min(py / 2, p.pagesY - 1);
+                        memcpy(e, &indirection[((size_t)ppy * atlasWidth + p.atlasX + ppx) * 4], 4);
+                    }
+                    else
+                    {
+                        memset(e, 0, 4);
+                    }
+                }
+            }
+        }
+        glBindTexture(GL_TEXTURE_2D, indirectionTex);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, atlasWidth, atlasHeight, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, indirection.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        indirectionDirty = false;
+        version++;
+    }
+};
+
+struct VTSlot
+{
+    int texture;
+    int page;
+    unsigned int lastUsed;
+    bool pinned;
+};
+
+struct VTPageRequest
+{
+    int texture;
+    int page;
+    int mip;
+};
+
+struct VTLoadedPage
+{
+    int texture;
+    int page;
+    std::vector<unsigned char> texels;
+};
+
+class VirtualTextureSystem
+{
+public:
+    // slotsX * slotsY paginas de pageSize (+ borda) formam o cache fisico.
+    VirtualTextureSystem(int screenW, int screenH, int pageSize = 128, int border = 4, int slotsX = 16, int slotsY = 16)
+        : pageSize(pageSize), border(border), slotsX(slotsX), slotsY(slotsY), frame(0), running(true),
+          uploads(0), evictions(0), requested(0), readbackReady(false)
+    {
+        stride = pageSize + 2 * border;
+        slots.resize(slotsX * slotsY);
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            slots[i].texture = -1;
+            slots[i].page = -1;
+            slots[i].lastUsed = 0;
+            slots[i].pinned = false;
+        }
+
+        glGenTextures(1, &physTex);
+        glBindTexture(GL_TEXTURE_2D, physTex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, slotsX * stride, slotsY * stride, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        fbW = std::max(1, screenW / VT_FEEDBACK_DIVISOR);
+        fbH = std::max(1, screenH / VT_FEEDBACK_DIVISOR);
+        glGenTextures(1, &feedbackTex);
+        glBindTexture(GL_TEXTURE_2D, feedbackTex);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, fbW, fbH, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenFramebuffers(1, &feedbackFbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, feedbackFbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, feedbackTex, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+        glGenBuffers(2, readbackPbo);
+        for (int i = 0; i < 2; i++)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackPbo[i]);
+            glBufferData(GL_PIXEL_PACK_BUFFER, fbW * fbH * 4, NULL, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+        drawProgram = buildProgram(fragmentSource());
+        feedbackProgram = buildProgram(feedbackSource());
+
+        loader = std::thread(&VirtualTextureSystem::loaderLoop, this);
+    }
+
+    ~VirtualTextureSystem()
+    {
+        {
+            std::lock_guard<std::mutex> guard(queueLock);
+            running = false;
+        }
+        queueReady.notify_all();
+        loader.join();
+        for (size_t i = 0; i < textures.size(); i++) delete textures[i];
+        glDeleteTextures(1, &physTex);
+        glDeleteTextures(1, &feedbackTex);
+        glDeleteFramebuffers(1, &feedbackFbo);
+        glDeleteBuffers(2, readbackPbo);
+        glDeleteProgram(drawProgram);
+        glDeleteProgram(feedbackProgram);
+    }
+
+    // Abre um .vtex e deixa o nivel mais grosso residente (fixo no cache) como fallback.
+    VirtualTexture *open(const char *vtexPath)
+    {
+        if ((int)textures.size() >= VT_MAX_TEXTURES) return NULL;
+        VirtualTexture *vt = new VirtualTexture();
+        if (!vt->open(vtexPath, pageSize, border))
+        {
+            delete vt;
+            return NULL;
+        }
+        vt->id = (int)textures.size();
+        textures.push_back(vt);
+
+        const VTLevel &top = vt->levels[vt->mipCount - 1];
+        std::vector<unsigned char> texels((size_t)stride * stride * 4);
+        for (int py = 0; py < top.pagesY; py++)
+        {
+            for (int px = 0; px < top.pagesX; px++)
+            {
+                int page = vt->pageIndex(vt->mipCount - 1, px, py);
+                if (!vt->readPage(page, texels.data())) continue;
+                int slot = allocateSlot();
+                if (slot < 0) break;
+                slots[slot].pinned = true;
+                upload(vt, page, slot, texels.data());
+            }
+        }
+        vt->rebuildIndirection(slotsX);
+        return vt;
+    }
+
+    GLuint getDrawProgram() const { return drawProgram; }
+    GLuint getFeedbackProgram() const { return feedbackProgram; }
+    int getTextureCount() const { return (int)textures.size(); }
+
+    // Liga o programa e as texturas de vt; o chamador so precisa passar as matrizes.
+    GLuint bindForDraw(VirtualTexture *vt)
+    {
+        glUseProgram(drawProgram);
+        setCommonUniforms(drawProgram, vt);
+        glActiveTexture(GL_TEXTURE1);
+        glBindTexture(GL_TEXTURE_2D, vt->indirectionTex);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, physTex);
+        return drawProgram;
+    }
+
+    // Programa do passe de feedback: cada pixel de feedback fica com uma das camadas,
+    // alternando a cada frame, para que as camadas de baixo tambem peçam suas paginas.
+    GLuint bindForFeedback(VirtualTexture *vt, int layer, int layerCount)
+    {
+        glUseProgram(feedbackProgram);
+        setCommonUniforms(feedbackProgram, vt);
+        glUniform1i(glGetUniformLocation(feedbackProgram, "vt_id"), vt->id);
+        glUniform1i(glGetUniformLocation(feedbackProgram, "layer_index"), layer);
+        glUniform1i(glGetUniformLocation(feedbackProgram, "layer_count"), std::max(1, layerCount));
+        glUniform1i(glGetUniformLocation(feedbackProgram, "frame"), (int)frame);
+        glUniform1f(glGetUniformLocation(feedbackProgram, "lod_bias"), -log2f((float)VT_FEEDBACK_DIVISOR));
+        return feedbackProgram;
+    }
+
+    void beginFeedback()
+    {
+        glGetIntegerv(GL_VIEWPORT, savedViewport);
+        glBindFramebuffer(GL_FRAMEBUFFER, feedbackFbo);
+        glViewport(0, 0, fbW, fbH);
+        glDisable(GL_BLEND);
+        glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+
+    // Le o feedback de forma assincrona: este frame copia para um PBO e mapeia o do frame anterior.
+    void endFeedback()
+    {
+        int cur = frame & 1;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackPbo[cur]);
+        glReadPixels(0, 0, fbW, fbH, GL_RGBA, GL_UNSIGNED_BYTE, 0);
+        if (readbackReady)
+        {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackPbo[cur ^ 1]);
+            const unsigned char *px = (const unsigned char *)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, fbW * fbH * 4, GL_MAP_READ_BIT);
+            if (px)
+            {
+                processFeedback(px);
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+            }
+        }
+        readbackReady = true;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+        glEnable(GL_BLEND);
+    }
+
+    // Envia para a GPU as paginas que a thread ja leu (com limite por frame) e atualiza
+    // as tabelas de indirecao que mudaram.
+    void update()
+    {
+        frame++;
+        std::deque<VTLoadedPage> ready;
+        {
+            std::lock_guard<std::mutex> guard(queueLock);
+            while (!loaded.empty() && (int)ready.size() < VT_UPLOADS_PER_FRAME)
+            {
+                ready.push_back(std::move(loaded.front()));
+                loaded.pop_front();
+            }
+        }
+        for (size_t i = 0; i < ready.size(); i++)
+        {
+            VirtualTexture *vt = textures[ready[i].texture];
+            vt->pagePending[ready[i].page] = 0;
+            if (vt->pageSlot[ready[i].page] >= 0) continue;
+            int slot = allocateSlot();
+            if (slot < 0) continue;
+            upload(vt, ready[i].page, slot, ready[i].texels.data());
+        }
+        for (size_t i = 0; i < textures.size(); i++)
+        {
+            if (textures[i]->indirectionDirty) textures[i]->rebuildIndirection(slotsX);
+        }
+    }
+
+    void printStats()
+    {
+        int used = 0;
+        for (size_t i = 0; i < slots.size(); i++)
+            if (slots[i].page >= 0) used++;
+        size_t cacheBytes = (size_t)slotsX * stride * slotsY * stride * 4;
+        std::cout << "textura virtual: cache " << used << "/" << slots.size() << " paginas ("
+                  << cacheBytes / (1024 * 1024) << " MB), " << requested << " pedidos, "
+                  << uploads << " uploads, " << evictions << " descartes" << std::endl;
+    }
+
+private:
+    int pageSize, border, stride;
+    int slotsX, slotsY;
+    unsigned int frame;
+    GLuint physTex;
+    std::vector<VTSlot> slots;
+    std::vector<VirtualTexture *> textures;
+
+    GLuint feedbackFbo, feedbackTex;
+    GLuint readbackPbo[2];
+    int fbW, fbH;
+    GLint savedViewport[4];
+    GLuint drawProgram, feedbackProgram;
+
+    std::thread loader;
+    std::mutex queueLock;
+    std::condition_variable queueReady;
+    std::deque<VTPageRequest> requests;
+    std::deque<VTLoadedPage> loaded;
+    bool running;
+
+    unsigned long long uploads, evictions, requested;
+    bool readbackReady;
+
+    void setCommonUniforms(GLuint program, VirtualTexture *vt)
+    {
+        float sizes[VT_MAX_MIPS * 2];
+        int atlas[VT_MAX_MIPS];
+        for (int m = 0; m < vt->mipCount; m++)
+        {
+            sizes[m * 2] = (float)vt->levels[m].width;
+            sizes[m * 2 + 1] = (float)vt->levels[m].height;
+            atlas[m] = vt->levels[m].atlasX;
+        }
+        glUniform2fv(glGetUniformLocation(program, "level_size"), vt->mipCount, sizes);
+        glUniform1iv(glGetUniformLocation(program, "level_atlas_x"), vt->mipCount, atlas);
+        glUniform1i(glGetUniformLocation(program, "mip_count"), vt->mipCount);
+        glUniform1f(glGetUniformLocation(program, "page_size"), (float)pageSize);
+        glUniform1f(glGetUniformLocation(program, "page_border"), (float)border);
+        glUniform2f(glGetUniformLocation(program, "phys_size"), (float)(slotsX * stride), (float)(slotsY * stride));
+        glUniform1i(glGetUniformLocation(program, "phys_cache"), 0);
+        glUniform1i(glGetUniformLocation(program, "indirection"), 1);
+    }
+
+    // LRU: slot livre, senao o menos usado recentemente que nao esteja fixo nem em uso neste frame.
+    int allocateSlot()
+    {
+        int best = -1;
+        for (size_t i = 0; i < slots.size(); i++)
+        {
+            if (slots[i].pinned) continue;
+            if (slots[i].page < 0) return (int)i;
+            if (slots[i].lastUsed + 1 >= frame) continue;
+            if (best < 0 || slots[i].lastUsed < slots[best].lastUsed) best = (int)i;
+        }
+        if (best >= 0)
+        {
+            VirtualTexture *old = textures[slots[best].texture];
+            old->pageSlot[slots[best].page] = -1;
+            old->indirectionDirty = true;
+            slots[best].page = -1;
+            evictions++;
+        }
+        return best;
+    }
+
+    void upload(VirtualTexture *vt, int page, int slot, const unsigned char *texels)
+    {
+        glBindTexture(GL_TEXTURE_2D, physTex);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % slotsX) * stride, (slot / slotsX) * stride, stride, stride,
+                        GL_RGBA, GL_UNSIGNED_BYTE, texels);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        slots[slot].texture = vt->id;
+        slots[slot].page = page;
+        slots[slot].lastUsed = frame;
+        vt->pageSlot[page] = slot;
+        vt->indirectionDirty = true;
+        uploads++;
+    }
+
+    void processFeedback(const unsigned char *px)
+    {
+        std::unordered_set<uint64_t> seen;
+        std::vector<VTPageRequest> wanted;
+        for (int i = 0; i < fbW * fbH; i++)
+        {
+            const unsigned char *p = px + i * 4;
+            int id = p[3] >> 4, mip = p[3] & 15;
+            if (id >= (int)textures.size()) continue;
+            VirtualTexture *vt = textures[id];
+            if (mip >= vt->mipCount) continue;
+            int pageX = p[0] | ((p[2] & 15) << 8);
+            int pageY = p[1] | ((p[2] >> 4) << 8);
+            const VTLevel &l = vt->levels[mip];
+            if (pageX >= l.pagesX || pageY >= l.pagesY) continue;
+            // Pede tambem os ancestrais, para o fallback melhorar enquanto a pagina chega.
+            for (int m = mip; m < vt->mipCount; m++, pageX >>= 1, pageY >>= 1)
+            {
+                const VTLevel &lm = vt->levels[m];
+                int page = vt->pageIndex(m, std::min(pageX, lm.pagesX - 1), std::min(pageY, lm.pagesY - 1));
+                uint64_t key = ((uint64_t)id << 32) | (uint32_t)page;
+                if (!seen.insert(key).second) break;
+                int slot = vt->pageSlot[page];
+                if (slot >= 0)
+                {
+                    slots[slot].lastUsed = frame;
+                    continue;
+                }
+                if (vt->pagePending[page]) continue;
+                VTPageRequest r;
+                r.texture = id;
+                r.page = page;
+                r.mip = m;
+                wanted.push_back(r);
+            }
+        }
+        if (wanted.empty()) return;
+        // Niveis grossos primeiro: cobrem mais tela por pagina.
+        std::sort(wanted.begin(), wanted.end(), [](const VTPageRequest &a, const VTPageRequest &b) { return a.mip > b.mip; });
+        {
+            std::lock_guard<std::mutex> guard(queueLock);
+            for (size_t i = 0; i < wanted.size(); i++)
+            {
+                textures[wanted[i].texture]->pagePending[wanted[i].page] = 1;
+                requests.push_back(wanted[i]);
+            }
+        }
+        requested += wanted.size();
+        queueReady.notify_one();
+    }
+
+    void loaderLoop()
+    {
+        while (true)
+        {
+            VTPageRequest r;
+            {
+                std::unique_lock<std::mutex> guard(queueLock);
+                queueReady.wait(guard, [this]() { return !running || !requests.empty(); });
+                if (!running) return;
+                r = requests.front();
+                requests.pop_front();
+            }
+            VTLoadedPage page;
+            page.texture = r.texture;
+            page.page = r.page;
+            page.texels.resize((size_t)stride * stride * 4);
+            if (!textures[r.texture]->readPage(r.page, page.texels.data())) continue;
+            std::lock_guard<std::mutex> guard(queueLock);
+            loaded.push_back(std::move(page));
+        }
+    }
+
+    static const char *vertexSource()
+    {
+        return "#version 400\n"
+               "layout (location = 0) in vec3 vPosition;\n"
+               "layout (location = 2) in vec2 vTexture;\n"
+               "uniform mat4 proj;\n"
+               "uniform mat4 matrix;\n"
+               "out vec2 text_map;\n"
+               "void main() {\n"
+               "    text_map = vTexture;\n"
+               "    gl_Position = proj * matrix * vec4(vPosition, 1.0);\n"
+               "}";
+    }
+
+    // A textura sobe com a linha 0 em t = 0, igual ao caminho sem textura virtual.
+    static const char *commonSource()
+    {
+        return "#version 400\n"
+               "in vec2 text_map;\n"
+               "uniform vec2 level_size[16];\n"
+               "uniform int level_atlas_x[16];\n"
+               "uniform int mip_count;\n"
+               "uniform float page_size;\n"
+               "uniform float page_border;\n"
+               "uniform float lod_bias;\n"
+               "int vt_mip() {\n"
+               "    vec2 texel = text_map * level_size[0];\n"
+               "    vec2 dx = dFdx(texel), dy = dFdy(texel);\n"
+               "    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) + lod_bias;\n"
+               "    return int(clamp(floor(lod), 0.0, float(mip_count - 1)));\n"
+               "}\n"
+               "ivec2 vt_page(int mip) {\n"
+               "    vec2 uv = clamp(text_map, 0.0, 0.99999);\n"
+               "    return ivec2(floor(uv * level_size[mip] / page_size));\n"
+               "}\n";
+    }
+
+    static std::string fragmentSource()
+    {
+        return std::string(commonSource()) +
+               "uniform sampler2D phys_cache;\n"
+               "uniform usampler2D indirection;\n"
+               "uniform vec2 phys_size;\n"
+               "out vec4 frag_color;\n"
+               "void main() {\n"
+               "    int mip = vt_mip();\n"
+               "    ivec2 page = vt_page(mip);\n"
+               "    uvec4 e = texelFetch(indirection, ivec2(level_atlas_x[mip] + page.x, page.y), 0);\n"
+               "    int rm = int(e.b);\n"
+               "    vec2 uv = clamp(text_map, 0.0, 0.99999);\n"
+               "    vec2 local = fract(uv * level_size[rm] / page_size);\n"
+               "    float stride = page_size + 2.0 * page_border;\n"
+               "    vec2 phys = (vec2(e.rg) * stride + page_border + local * page_size) / phys_size;\n"
+               "    frag_color = textureLod(phys_cache, phys, 0.0);\n"
+               "}";
+    }
+
+    static std::string feedbackSource()
+    {
+        return std::string(commonSource()) +
+               "uniform int vt_id;\n"
+               "uniform int layer_index;\n"
+               "uniform int layer_count;\n"
+               "uniform int frame;\n"
+               "out vec4 request;\n"
+               "void main() {\n"
+               "    int mip = vt_mip();\n"
+               "    ivec2 page = vt_page(mip);\n"
+               "    int k = int(gl_FragCoord.x) + int(gl_FragCoord.y) * 3 + frame;\n"
+               "    if (k % layer_count != layer_index) discard;\n"
+               "    request = vec4(float(page.x & 255), float(page.y & 255),\n"
+               "                   float(((page.x >> 8) & 15) | (((page.y >> 8) & 15) << 4)),\n"
+               "                   float(mip | (vt_id << 4))) / 255.0;\n"
+               "}";
+    }
+
+    static GLuint buildProgram(const std::string &fragment)
+    {
+        const char *vs_src = vertexSource();
+        const char *fs_src = fragment.c_str();
+        GLuint vs = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vs, 1, &vs_src, NULL);
+        glCompileShader(vs);
+        GLuint fs = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fs, 1, &fs_src, NULL);
+        glCompileShader(fs);
+        GLint ok = 0;
+        glGetShaderiv(fs, GL_COMPILE_STATUS, &ok);
+        if (!ok)
+        {
+            char log[2048];
+            glGetShaderInfoLog(fs, sizeof(log), NULL, log);
+            std::cerr << "Erro no shader de textura virtual:\n" << log << std::endl;
+        }
+        GLuint program = glCreateProgram();
+        glAttachShader(program, vs);
+        glAttachShader(program, fs);
+        glLinkProgram(program);
+        glDeleteShader(vs);
+        glDeleteShader(fs);
+        return program;
+    }
+};
+
+#endif